@@ -4,10 +4,14 @@
 #include <fmt/core.h>
 #include <stdexcept>
 #include <algorithm>
+#include <chrono>
+#include <filesystem>
 #include "../timeit.h"
 
 Application::Application(const ApplicationInfo& _info) : info { _info } {
   timeit("init_glfw", [this] { init_glfw(); });
+  timeit("init_job_system", [this] { job_system = std::make_unique<JobSystem>(); });
+  timeit("init_simulation", [this] { simulation = std::make_unique<Simulation>(info.simulation_tick_rate); });
   timeit("init_render_engine", [this] { init_render_engine(); });
 }
 
@@ -30,6 +34,7 @@ void Application::init_glfw() {
     throw std::runtime_error("Failed to create window");
   }
 
+  glfwSetWindowUserPointer(window, this);
   glfwSetKeyCallback(window, key_callback);
 }
 
@@ -46,7 +51,27 @@ void Application::init_render_engine() {
       .required_extensions = {},
       .requested_layers = { "VK_LAYER_KHRONOS_validation" },
     },
-    .max_frames_in_flight = 2
+    .validation = {
+      .enabled = info.validation,
+      .min_severity = LogSeverity::eWarning,
+      .max_messages_per_second = 8
+    },
+    .max_frames_in_flight = 4,
+    .adaptive_frames_in_flight = true,
+    .max_instances = 1024,
+    .max_vertices = 1 << 20,
+    .max_indices = 1 << 22,
+    .max_textures = 16,
+    .texture_budget = 64 * 1024 * 1024,
+    .texture_paths = {},
+    .particle_count = 1'000'000,
+    .light_count = 4096,
+    .vertex_pulling = true,
+    .frame_pacing = true,
+    .async_pipelines = true,
+    .occlusion_culling = true,
+    .scene = {},
+    .capture = info.capture
   };
 
   uint32_t required_extension_count;
@@ -58,22 +83,47 @@ void Application::init_render_engine() {
     render_config.vulkan.required_extensions.begin()
   );
 
-  render_engine = std::make_unique<RenderEngine>(render_config, *this);
+  std::filesystem::path texture_directory { "textures" };
+  if (std::filesystem::is_directory(texture_directory)) {
+    for (const auto& entry : std::filesystem::directory_iterator { texture_directory }) {
+      if (entry.is_regular_file() && entry.path().extension() == ".ktx2") {
+        render_config.texture_paths.push_back(entry.path().string());
+      }
+    }
+    std::ranges::sort(render_config.texture_paths);
+  }
+
+  render_engine = std::make_unique<RenderEngine>(render_config, *this, *job_system);
 }
 
 void Application::key_callback(GLFWwindow* window, int key, int, int action, int) {
+  // GLFW does not expose the OS event time, events are stamped when polled
+  auto application = static_cast<Application*>(glfwGetWindowUserPointer(window));
+  if (application->render_engine) {
+    application->render_engine->record_input(std::chrono::steady_clock::now());
+  }
+
   if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
     glfwSetWindowShouldClose(window, GLFW_TRUE);
   }
+
+  if (key == GLFW_KEY_V && action == GLFW_PRESS && application->render_engine) {
+    auto& render_engine = *application->render_engine;
+    render_engine.set_validation_messages(!render_engine.are_validation_messages_enabled());
+  }
 }
 
 void Application::run() {
+  simulation->start();
+
   while(!glfwWindowShouldClose(window)) {
     glfwPollEvents();
+    job_system->process_main_thread_jobs();
 
-    render_engine->render();
+    render_engine->render(simulation->get_frame_state());
   }
 
+  simulation->stop();
   render_engine->wait_to_finish();
 }
 
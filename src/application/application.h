@@ -1,6 +1,8 @@
 #pragma once
 #include <memory>
 #include "render_engine.h"
+#include "job_system.h"
+#include "simulation.h"
 
 struct GLFWwindow;
 
@@ -9,6 +11,9 @@ struct ApplicationInfo {
     uint32_t width, height;
   } window;
   bool fullscreen;
+  uint32_t simulation_tick_rate;
+  bool validation;
+  RenderConfig::CaptureInfo capture;
 };
 
 class Application {
@@ -33,5 +38,7 @@ private:
 
   const ApplicationInfo& info;
   GLFWwindow* window;
+  std::unique_ptr<JobSystem> job_system;
+  std::unique_ptr<Simulation> simulation;
   std::unique_ptr<RenderEngine> render_engine;
 };
\ No newline at end of file
@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <fmt/core.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include "transform_system.h"
+#include "bvh.h"
+#include "job_system.h"
+
+struct Node {
+  uint32_t parent;
+  glm::vec3 position;
+  glm::quat rotation;
+  glm::vec3 scale;
+};
+
+auto generate_nodes(uint32_t count) -> std::vector<Node> {
+  std::mt19937 rng { 42 };
+  std::uniform_real_distribution<float> distribution { -1.0f, 1.0f };
+
+  std::vector<Node> nodes(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    auto axis = glm::normalize(glm::vec3(distribution(rng), distribution(rng), distribution(rng)) + glm::vec3(0.0f, 0.0f, 2.0f));
+    nodes[i] = {
+      .parent = (i % 16 == 0 ? TransformSystem::no_parent : i - 1 - rng() % (i % 16)),
+      .position = { distribution(rng), distribution(rng), distribution(rng) },
+      .rotation = glm::angleAxis(distribution(rng) * glm::pi<float>(), axis),
+      .scale = glm::vec3(1.0f + 0.5f * distribution(rng))
+    };
+  }
+  return nodes;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+double benchmark_naive(const std::vector<Node>& nodes, std::vector<glm::mat4>& output, uint32_t iterations) {
+  std::vector<glm::mat4> world(nodes.size());
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t iteration = 0; iteration < iterations; ++iteration) {
+    for (size_t i = 0; i < nodes.size(); ++i) {
+      const auto& node = nodes[i];
+      glm::mat4 local = glm::translate(glm::mat4(1.0f), node.position)
+        * glm::mat4_cast(node.rotation)
+        * glm::scale(glm::mat4(1.0f), node.scale);
+      world[i] = (node.parent == TransformSystem::no_parent ? local : world[node.parent] * local);
+      output[i] = world[i];
+    }
+  }
+  return seconds_since(start);
+}
+
+double benchmark_transform_system(const std::vector<Node>& nodes, std::vector<glm::mat4>& output, uint32_t iterations) {
+  TransformSystem transform_system;
+  for (const auto& node : nodes) {
+    auto handle = transform_system.create(node.parent);
+    transform_system.set_position(handle, node.position);
+    transform_system.set_scale(handle, node.scale);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t iteration = 0; iteration < iterations; ++iteration) {
+    // Touching every rotation keeps the whole hierarchy dirty, like the naive loop
+    for (uint32_t i = 0; i < nodes.size(); ++i) {
+      transform_system.set_rotation(i, nodes[i].rotation);
+    }
+    transform_system.update(reinterpret_cast<float*>(output.data()));
+  }
+  return seconds_since(start);
+}
+
+auto generate_boxes(uint32_t count, std::mt19937& rng) -> std::vector<Aabb> {
+  std::uniform_real_distribution<float> position { -100.0f, 100.0f };
+  std::uniform_real_distribution<float> size { 0.1f, 1.0f };
+
+  std::vector<Aabb> boxes(count);
+  for (auto& box : boxes) {
+    glm::vec3 center { position(rng), position(rng), position(rng) };
+    glm::vec3 extent { size(rng), size(rng), size(rng) };
+    box = { center - extent, center + extent };
+  }
+  return boxes;
+}
+
+auto brute_force_cull(const std::vector<Aabb>& boxes, const Frustum& frustum) -> std::vector<uint32_t> {
+  std::vector<uint32_t> visible;
+  for (uint32_t i = 0; i < boxes.size(); ++i) {
+    bool outside = false;
+    for (const auto& plane : frustum.planes) {
+      glm::vec3 normal { plane };
+      auto far = glm::mix(boxes[i].min, boxes[i].max, glm::greaterThanEqual(normal, glm::vec3(0.0f)));
+      outside = outside || glm::dot(normal, far) + plane.w < 0.0f;
+    }
+    if (!outside) {
+      visible.push_back(i);
+    }
+  }
+  return visible;
+}
+
+void benchmark_bvh(uint32_t object_count, uint32_t iterations) {
+  std::mt19937 rng { 42 };
+  auto boxes = generate_boxes(object_count, rng);
+  auto view = glm::lookAt(glm::vec3(-120.0f, -80.0f, 30.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+  auto frustum = Frustum::from_matrix(glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 150.0f) * view);
+
+  Bvh bvh;
+  auto start = std::chrono::steady_clock::now();
+  bvh.build(boxes);
+  double build_time = seconds_since(start);
+
+  std::vector<uint32_t> visible;
+  visible.reserve(object_count);
+  start = std::chrono::steady_clock::now();
+  for (uint32_t iteration = 0; iteration < iterations; ++iteration) {
+    visible.clear();
+    bvh.cull(frustum, visible);
+  }
+  double cull_time = seconds_since(start) / iterations;
+
+  // Tasks write to their own lists, the caller would concatenate them or record a draw list from each
+  JobSystem job_system;
+  std::vector<std::vector<uint32_t>> task_visible(bvh.get_task_count());
+  for (auto& task : task_visible) {
+    task.reserve(object_count);
+  }
+  start = std::chrono::steady_clock::now();
+  for (uint32_t iteration = 0; iteration < iterations; ++iteration) {
+    job_system.parallel_for(bvh.get_task_count(), 1, [&bvh, &frustum, &task_visible] (uint32_t begin, uint32_t end) {
+      for (uint32_t task = begin; task < end; ++task) {
+        task_visible[task].clear();
+        bvh.cull_task(frustum, task, task_visible[task]);
+      }
+    });
+  }
+  double parallel_time = seconds_since(start) / iterations;
+
+  // A tenth of the objects move, refit only visits their ancestors
+  std::uniform_real_distribution<float> offset { -2.0f, 2.0f };
+  for (uint32_t i = 0; i < object_count; i += 10) {
+    glm::vec3 delta { offset(rng), offset(rng), offset(rng) };
+    boxes[i] = { boxes[i].min + delta, boxes[i].max + delta };
+    bvh.set_bounds(i, boxes[i]);
+  }
+  start = std::chrono::steady_clock::now();
+  bvh.refit();
+  double refit_time = seconds_since(start);
+
+  visible.clear();
+  bvh.cull(frustum, visible);
+  std::sort(visible.begin(), visible.end());
+  std::vector<uint32_t> parallel_visible;
+  for (auto& task : task_visible) {
+    task.clear();
+  }
+  for (uint32_t task = 0; task < bvh.get_task_count(); ++task) {
+    bvh.cull_task(frustum, task, task_visible[task]);
+    parallel_visible.insert(parallel_visible.end(), task_visible[task].begin(), task_visible[task].end());
+  }
+  std::sort(parallel_visible.begin(), parallel_visible.end());
+  bool matches = (visible == brute_force_cull(boxes, frustum) && parallel_visible == visible);
+
+  fmt::println("bvh culling: {} objects, {} visible", object_count, visible.size());
+  fmt::println("  build:            {:.1f} ms", build_time * 1e3);
+  fmt::println("  cull, 1 thread:   {:.3f} ms", cull_time * 1e3);
+  fmt::println("  cull, {} threads: {:.3f} ms ({} tasks)", job_system.get_thread_count(), parallel_time * 1e3, bvh.get_task_count());
+  fmt::println("  refit 10%:        {:.2f} ms", refit_time * 1e3);
+  fmt::println("  matches brute force after refit: {}", matches);
+}
+
+int main() {
+  constexpr uint32_t node_count = 100'000;
+  constexpr uint32_t iterations = 100;
+
+  auto nodes = generate_nodes(node_count);
+  std::vector<glm::mat4> naive_output(node_count), batched_output(node_count);
+
+  double naive_time = benchmark_naive(nodes, naive_output, iterations);
+  double batched_time = benchmark_transform_system(nodes, batched_output, iterations);
+
+  float max_error = 0.0f;
+  for (uint32_t i = 0; i < node_count; ++i) {
+    for (int column = 0; column < 4; ++column) {
+      auto difference = glm::abs(naive_output[i][column] - batched_output[i][column]);
+      max_error = glm::max(max_error, glm::max(glm::max(difference.x, difference.y), glm::max(difference.z, difference.w)));
+    }
+  }
+
+  double matrices = static_cast<double>(node_count) * iterations;
+  fmt::println("transforms: {} nodes x {} iterations", node_count, iterations);
+  fmt::println("  naive glm:        {:.1f} M matrices/s", matrices / naive_time / 1e6);
+  fmt::println("  transform system: {:.1f} M matrices/s", matrices / batched_time / 1e6);
+  fmt::println("  max difference:   {}", max_error);
+
+  benchmark_bvh(1'000'000, 100);
+
+  return 0;
+}
\ No newline at end of file
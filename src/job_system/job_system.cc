@@ -0,0 +1,282 @@
+#include "job_system.h"
+#include <limits>
+#include <stdexcept>
+#include <fmt/core.h>
+#include "profiler.h"
+
+namespace {
+
+constexpr uint32_t external_thread_index = std::numeric_limits<uint32_t>::max();
+thread_local uint32_t current_thread_index = external_thread_index;
+
+}
+
+void WorkStealingQueue::push(Job* job) {
+  int64_t b = bottom.load(std::memory_order_relaxed);
+  jobs[b & (capacity - 1)].store(job, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  bottom.store(b + 1, std::memory_order_relaxed);
+}
+
+auto WorkStealingQueue::pop() -> Job* {
+  int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+  bottom.store(b, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t t = top.load(std::memory_order_relaxed);
+
+  if (t > b) {
+    bottom.store(b + 1, std::memory_order_relaxed);
+    return nullptr;
+  }
+
+  Job* job = jobs[b & (capacity - 1)].load(std::memory_order_relaxed);
+  if (t == b) {
+    // Last job, race against thieves for it
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+      job = nullptr;
+    }
+    bottom.store(b + 1, std::memory_order_relaxed);
+  }
+  return job;
+}
+
+auto WorkStealingQueue::steal() -> Job* {
+  int64_t t = top.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t b = bottom.load(std::memory_order_acquire);
+
+  if (t >= b) {
+    return nullptr;
+  }
+
+  Job* job = jobs[t & (capacity - 1)].load(std::memory_order_relaxed);
+  if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+    return nullptr;
+  }
+  return job;
+}
+
+// Thieves only ever shrink the queue, so the owner's answer stays valid until it pushes
+bool WorkStealingQueue::full() const {
+  return bottom.load(std::memory_order_relaxed) - top.load(std::memory_order_acquire) >= capacity;
+}
+
+bool LockedJobQueue::reserve() {
+  std::lock_guard lock { mutex };
+  if (size + reserved == capacity) {
+    return false;
+  }
+  ++reserved;
+  return true;
+}
+
+void LockedJobQueue::cancel_reservation() {
+  std::lock_guard lock { mutex };
+  --reserved;
+}
+
+void LockedJobQueue::push(Job* job) {
+  std::lock_guard lock { mutex };
+  jobs[(head + size) % capacity] = job;
+  ++size;
+  --reserved;
+}
+
+auto LockedJobQueue::pop() -> Job* {
+  std::lock_guard lock { mutex };
+  if (size == 0) {
+    return nullptr;
+  }
+  Job* job = jobs[head];
+  head = (head + 1) % capacity;
+  --size;
+  return job;
+}
+
+JobSystem::JobSystem(uint32_t worker_count) {
+  if (current_thread_index != external_thread_index) {
+    throw std::runtime_error("A thread can only belong to one job system");
+  }
+  current_thread_index = main_thread_index;
+  Profiler::set_thread_name("main");
+
+  thread_data.reserve(worker_count + 1);
+  for (uint32_t i = 0; i <= worker_count; ++i) {
+    thread_data.push_back(std::make_unique<ThreadData>());
+  }
+
+  threads.reserve(worker_count);
+  for (uint32_t i = 1; i <= worker_count; ++i) {
+    threads.emplace_back([this, i] { worker_loop(i); });
+  }
+}
+
+JobSystem::~JobSystem() {
+  running.store(false);
+  queued_jobs.fetch_add(1);
+  queued_jobs.notify_all();
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  current_thread_index = external_thread_index;
+}
+
+auto JobSystem::get_thread_index() -> uint32_t {
+  return current_thread_index;
+}
+
+auto JobSystem::allocate_job(bool main_thread) -> Job* {
+  // Only the main thread itself may run a main thread job inline, everyone else waits for room
+  bool run_inline = !main_thread || current_thread_index == main_thread_index;
+  LockedJobQueue* locked_queue = nullptr;
+  if (main_thread) {
+    locked_queue = &main_thread_queue;
+  } else if (current_thread_index == external_thread_index) {
+    locked_queue = &external_queue;
+  }
+
+  // Waiting threads run other jobs, which also frees up queue space and pool slots
+  auto make_progress = [this] {
+    if (Job* job = find_job(current_thread_index)) {
+      execute(job);
+    } else {
+      std::this_thread::yield();
+    }
+  };
+
+  // Make sure the job can be queued before taking a slot for it
+  while (locked_queue != nullptr ? !locked_queue->reserve() : thread_data[current_thread_index]->queue.full()) {
+    if (run_inline) {
+      return nullptr;
+    }
+    make_progress();
+  }
+
+  while (true) {
+    if (Job* job = take_free_slot()) {
+      return job;
+    }
+    if (run_inline) {
+      if (locked_queue != nullptr) {
+        locked_queue->cancel_reservation();
+      }
+      return nullptr;
+    }
+    make_progress();
+  }
+}
+
+auto JobSystem::take_free_slot() -> Job* {
+  auto take = [] (std::array<Job, job_pool_size>& pool, uint32_t& next_job) -> Job* {
+    for (uint32_t i = 0; i < job_pool_size; ++i) {
+      Job& job = pool[next_job++ % job_pool_size];
+      if (!job.in_use.load(std::memory_order_acquire)) {
+        job.in_use.store(true, std::memory_order_relaxed);
+        return &job;
+      }
+    }
+    return nullptr;
+  };
+
+  if (current_thread_index == external_thread_index) {
+    std::lock_guard lock { external_mutex };
+    return take(external_job_pool, next_external_job);
+  }
+
+  auto& data = *thread_data[current_thread_index];
+  return take(data.job_pool, data.next_job);
+}
+
+void JobSystem::submit(Job* job, bool main_thread) {
+  if (main_thread) {
+    main_thread_queue.push(job);
+    return;
+  }
+
+  if (current_thread_index == external_thread_index) {
+    external_queue.push(job);
+  } else {
+    thread_data[current_thread_index]->queue.push(job);
+  }
+
+  queued_jobs.fetch_add(1, std::memory_order_release);
+  queued_jobs.notify_one();
+}
+
+auto JobSystem::find_job(uint32_t thread_index) -> Job* {
+  Job* job = nullptr;
+  if (thread_index != external_thread_index) {
+    job = thread_data[thread_index]->queue.pop();
+  }
+
+  if (job == nullptr) {
+    job = external_queue.pop();
+  }
+
+  auto thread_count = static_cast<uint32_t>(thread_data.size());
+  uint32_t start = (thread_index == external_thread_index ? 0 : thread_index + 1);
+  for (uint32_t i = 0; job == nullptr && i < thread_count; ++i) {
+    uint32_t victim = (start + i) % thread_count;
+    if (victim != thread_index) {
+      job = thread_data[victim]->queue.steal();
+    }
+  }
+
+  if (job != nullptr) {
+    queued_jobs.fetch_sub(1, std::memory_order_relaxed);
+  }
+  return job;
+}
+
+void JobSystem::execute(Job* job) {
+  PROFILE_ZONE("job");
+  auto counter = job->counter;
+  job->invoke(job->storage);
+  job->destroy(job->storage);
+  job->in_use.store(false, std::memory_order_release);
+  counter->value.fetch_sub(1, std::memory_order_release);
+}
+
+void JobSystem::worker_loop(uint32_t thread_index) {
+  current_thread_index = thread_index;
+  Profiler::set_thread_name(fmt::format("worker {}", thread_index));
+
+  while (running.load(std::memory_order_relaxed)) {
+    if (Job* job = find_job(thread_index)) {
+      execute(job);
+      continue;
+    }
+
+    if (queued_jobs.load(std::memory_order_acquire) == 0) {
+      queued_jobs.wait(0);
+    } else {
+      // Jobs are queued but another thread won the race for them
+      std::this_thread::yield();
+    }
+  }
+}
+
+void JobSystem::wait(JobCounter& counter) {
+  uint32_t thread_index = current_thread_index;
+  while (counter.value.load(std::memory_order_acquire) > 0) {
+    if (thread_index == main_thread_index) {
+      if (Job* job = main_thread_queue.pop()) {
+        execute(job);
+        continue;
+      }
+    }
+
+    if (Job* job = find_job(thread_index)) {
+      execute(job);
+    } else {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void JobSystem::process_main_thread_jobs() {
+  while (Job* job = main_thread_queue.pop()) {
+    execute(job);
+  }
+}
\ No newline at end of file
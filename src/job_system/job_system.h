@@ -0,0 +1,154 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+struct JobCounter {
+  std::atomic<uint32_t> value { 0 };
+};
+
+struct Job {
+  static constexpr size_t storage_size = 64;
+
+  template<typename F>
+  void assign(F&& function) {
+    using Function = std::decay_t<F>;
+    static_assert(sizeof(Function) <= storage_size, "Job captures too much state");
+    static_assert(alignof(Function) <= alignof(std::max_align_t));
+
+    new (storage) Function(std::forward<F>(function));
+    invoke = [] (void* data) { (*static_cast<Function*>(data))(); };
+    destroy = [] (void* data) { static_cast<Function*>(data)->~Function(); };
+  }
+
+  void (*invoke)(void*);
+  void (*destroy)(void*);
+  JobCounter* counter;
+  // Set while the job is queued or running so its pool slot is not handed out again
+  std::atomic<bool> in_use { false };
+  alignas(std::max_align_t) std::byte storage[storage_size];
+};
+
+// Chase-Lev deque: the owning thread pushes and pops at the bottom, other threads steal from the top
+class WorkStealingQueue {
+public:
+  static constexpr int64_t capacity = 4096;
+
+  // Only the owning thread pushes, and only after checking full()
+  void push(Job*);
+  auto pop() -> Job*;
+  auto steal() -> Job*;
+  bool full() const;
+
+private:
+  std::array<std::atomic<Job*>, capacity> jobs;
+  alignas(64) std::atomic<int64_t> top { 0 };
+  alignas(64) std::atomic<int64_t> bottom { 0 };
+};
+
+class LockedJobQueue {
+public:
+  static constexpr size_t capacity = 1024;
+
+  // Producers reserve space before allocating a job so that push cannot fail
+  bool reserve();
+  void cancel_reservation();
+  void push(Job*);
+  auto pop() -> Job*;
+
+private:
+  std::mutex mutex;
+  std::array<Job*, capacity> jobs;
+  size_t head = 0, size = 0, reserved = 0;
+};
+
+class JobSystem {
+public:
+  static constexpr uint32_t main_thread_index = 0;
+
+  explicit JobSystem(uint32_t worker_count = std::max(1u, std::thread::hardware_concurrency()) - 1);
+  ~JobSystem();
+
+  JobSystem(const JobSystem&) = delete;
+  JobSystem& operator=(const JobSystem&) = delete;
+
+  template<typename F>
+  void run(F&& function, JobCounter& counter) {
+    dispatch(std::forward<F>(function), counter, false);
+  }
+
+  // Jobs that must run on the thread that created the job system, e.g. window system or queue calls
+  template<typename F>
+  void run_on_main_thread(F&& function, JobCounter& counter) {
+    dispatch(std::forward<F>(function), counter, true);
+  }
+
+  // Splits [0, count) into ranges of at most batch_size and blocks until all of them have run
+  template<typename F>
+  void parallel_for(uint32_t count, uint32_t batch_size, F&& function) {
+    JobCounter counter;
+    for (uint32_t begin = 0; begin < count; begin += batch_size) {
+      uint32_t end = std::min(count, begin + batch_size);
+      run([&function, begin, end] { function(begin, end); }, counter);
+    }
+    wait(counter);
+  }
+
+  // Runs other jobs while waiting instead of blocking the calling thread
+  void wait(JobCounter&);
+  void process_main_thread_jobs();
+
+  auto get_thread_count() const -> uint32_t { return static_cast<uint32_t>(threads.size()) + 1; }
+  static auto get_thread_index() -> uint32_t;
+
+private:
+  static constexpr uint32_t job_pool_size = 4096;
+
+  struct alignas(64) ThreadData {
+    WorkStealingQueue queue;
+    std::array<Job, job_pool_size> job_pool;
+    uint32_t next_job = 0;
+  };
+
+  template<typename F>
+  void dispatch(F&& function, JobCounter& counter, bool main_thread) {
+    Job* job = allocate_job(main_thread);
+    if (job == nullptr) {
+      // The queue or the job pool is full, so run it on this thread instead
+      function();
+      return;
+    }
+    job->assign(std::forward<F>(function));
+    job->counter = &counter;
+    counter.value.fetch_add(1, std::memory_order_relaxed);
+    submit(job, main_thread);
+  }
+
+  // Returns nullptr when the job should run inline, never for main thread jobs from other threads
+  auto allocate_job(bool main_thread) -> Job*;
+  auto take_free_slot() -> Job*;
+  void submit(Job*, bool main_thread);
+  auto find_job(uint32_t thread_index) -> Job*;
+  void execute(Job*);
+  void worker_loop(uint32_t thread_index);
+
+  std::vector<std::unique_ptr<ThreadData>> thread_data;
+  std::vector<std::thread> threads;
+
+  // Jobs submitted from threads that do not belong to the job system
+  std::mutex external_mutex;
+  std::array<Job, job_pool_size> external_job_pool;
+  uint32_t next_external_job = 0;
+  LockedJobQueue external_queue;
+  LockedJobQueue main_thread_queue;
+
+  std::atomic<uint32_t> queued_jobs { 0 };
+  std::atomic<bool> running { true };
+};
\ No newline at end of file
@@ -1,20 +1,62 @@
 #include <fmt/core.h>
+#include <string>
+#include <string_view>
 #include "application.h"
+#include "profiler.h"
 
-int main() {
+int main(int argc, char** argv) {
 
   try {
+    // --capture <directory> writes every frame as PPM, --capture-raw <directory> as raw texels,
+    // --trace <path> profiles the whole run and writes it as a Chrome trace on exit,
+    // --validation and --no-validation override whether the build type loads validation layers
+    RenderConfig::CaptureInfo capture { .enabled = false, .directory = {}, .format = CaptureFormat::ePpm };
+    std::string trace_path;
+#ifdef NDEBUG
+    bool validation = false;
+#else
+    bool validation = true;
+#endif
+    for (int i = 1; i < argc; ++i) {
+      std::string_view argument { argv[i] };
+      if ((argument == "--capture" || argument == "--capture-raw") && i + 1 < argc) {
+        capture = {
+          .enabled = true,
+          .directory = argv[++i],
+          .format = (argument == "--capture" ? CaptureFormat::ePpm : CaptureFormat::eRaw)
+        };
+      } else if (argument == "--trace" && i + 1 < argc) {
+        trace_path = argv[++i];
+      } else if (argument == "--validation" || argument == "--no-validation") {
+        validation = (argument == "--validation");
+      } else {
+        fmt::println("Unknown argument: {}", argument);
+        return -1;
+      }
+    }
+
     ApplicationInfo info {
       .window = {
         .width = 1280,
         .height = 720
       },
-      .fullscreen = false
+      .fullscreen = false,
+      .simulation_tick_rate = 60,
+      .validation = validation,
+      .capture = capture
     };
-    
-    Application app { info };
-    app.run();
-    
+
+    Profiler::enable(!trace_path.empty());
+    {
+      Application app { info };
+      app.run();
+    }
+
+    if (!trace_path.empty()) {
+      Profiler::enable(false);
+      Profiler::write_chrome_trace(trace_path);
+    }
+
   } catch (const vk::SystemError& e) {
     fmt::println("vk::SystemError -> {}", e.what());
     return -1;
@@ -0,0 +1,159 @@
+#include "profiler.h"
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_set>
+#include <fmt/core.h>
+
+struct Profiler::Track {
+  struct Event {
+    const char* name;
+    int64_t start, end;
+  };
+
+  std::string name;
+  uint32_t id;
+  // Allocated on the first event so that named but idle threads cost nothing
+  std::unique_ptr<Event[]> events;
+  std::atomic<uint64_t> count { 0 };
+};
+
+std::atomic<bool> Profiler::enabled { false };
+
+namespace {
+
+// Tracks and interned names live until the program exits, events point into both
+struct Registry {
+  std::mutex mutex;
+  std::deque<Profiler::Track> tracks;
+  std::unordered_set<std::string> names;
+  std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+};
+
+auto get_registry() -> Registry& {
+  static Registry registry;
+  return registry;
+}
+
+auto add_track(Registry& registry, std::string name) -> Profiler::Track* {
+  auto& track = registry.tracks.emplace_back();
+  track.name = std::move(name);
+  track.id = static_cast<uint32_t>(registry.tracks.size());
+  return &track;
+}
+
+thread_local Profiler::Track* thread_track = nullptr;
+
+auto get_thread_track() -> Profiler::Track* {
+  if (thread_track == nullptr) {
+    auto& registry = get_registry();
+    std::lock_guard lock { registry.mutex };
+    thread_track = add_track(registry, fmt::format("thread {}", registry.tracks.size() + 1));
+  }
+  return thread_track;
+}
+
+auto escape(std::string_view text) -> std::string {
+  std::string escaped;
+  escaped.reserve(text.size());
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+    }
+    escaped += (static_cast<unsigned char>(c) < 0x20 ? ' ' : c);
+  }
+  return escaped;
+}
+
+}
+
+void Profiler::enable(bool _enabled) {
+  enabled.store(_enabled, std::memory_order_relaxed);
+}
+
+auto Profiler::now() -> int64_t {
+  auto elapsed = std::chrono::steady_clock::now() - get_registry().epoch;
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+}
+
+auto Profiler::intern(std::string_view name) -> const char* {
+  auto& registry = get_registry();
+  std::lock_guard lock { registry.mutex };
+  return registry.names.emplace(name).first->c_str();
+}
+
+void Profiler::set_thread_name(std::string_view name) {
+  auto& registry = get_registry();
+  std::lock_guard lock { registry.mutex };
+  if (thread_track == nullptr) {
+    thread_track = add_track(registry, std::string { name });
+  } else {
+    thread_track->name = name;
+  }
+}
+
+auto Profiler::create_track(std::string_view name) -> Track* {
+  auto& registry = get_registry();
+  std::lock_guard lock { registry.mutex };
+  return add_track(registry, std::string { name });
+}
+
+void Profiler::record(const char* name, int64_t start, int64_t end) {
+  record(get_thread_track(), name, start, end);
+}
+
+void Profiler::record(Track* track, const char* name, int64_t start, int64_t end) {
+  if (track->events == nullptr) {
+    auto& registry = get_registry();
+    std::lock_guard lock { registry.mutex };
+    track->events = std::make_unique<Track::Event[]>(track_capacity);
+  }
+
+  // The release publishes the event to a concurrent writer of the trace
+  uint64_t index = track->count.load(std::memory_order_relaxed);
+  track->events[index % track_capacity] = { name, start, end };
+  track->count.store(index + 1, std::memory_order_release);
+}
+
+void Profiler::write_chrome_trace(const std::string& path) {
+  std::ofstream file { path };
+  if (!file.is_open()) {
+    throw std::runtime_error(fmt::format("Failed to open {} for writing", path));
+  }
+
+  auto& registry = get_registry();
+  std::lock_guard lock { registry.mutex };
+
+  uint64_t event_count = 0, dropped_count = 0;
+  file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"learning-vulkan\"}}";
+  for (const auto& track : registry.tracks) {
+    file << fmt::format(
+      ",\n{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{},\"args\":{{\"name\":\"{}\"}}}}",
+      track.id, escape(track.name)
+    );
+    if (track.events == nullptr) {
+      continue;
+    }
+
+    uint64_t count = track.count.load(std::memory_order_acquire);
+    uint64_t first = (count > track_capacity ? count - track_capacity : 0);
+    for (uint64_t i = first; i < count; ++i) {
+      const auto& event = track.events[i % track_capacity];
+      // Timestamps are in microseconds, the fraction keeps nanosecond precision
+      file << fmt::format(
+        ",\n{{\"name\":\"{}\",\"ph\":\"X\",\"pid\":1,\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f}}}",
+        escape(event.name), track.id, static_cast<double>(event.start) / 1000.0,
+        static_cast<double>(event.end - event.start) / 1000.0
+      );
+    }
+    event_count += count - first;
+    dropped_count += first;
+  }
+  file << "\n]}\n";
+
+  fmt::println("Wrote {} profile events to {}, {} older ones were overwritten", event_count, path, dropped_count);
+}
\ No newline at end of file
@@ -0,0 +1,60 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Records named time ranges into per-thread rings and writes them as a Chrome trace, which loads
+// in chrome://tracing and Perfetto. Recording costs a relaxed load while the profiler is disabled.
+class Profiler {
+public:
+  // Events per track, the oldest are overwritten once a track wraps around
+  static constexpr uint64_t track_capacity = 1 << 16;
+
+  struct Track;
+
+  static void enable(bool enabled);
+  static bool is_enabled() { return enabled.load(std::memory_order_relaxed); }
+
+  // Nanoseconds on the trace's timeline
+  static auto now() -> int64_t;
+
+  // Event names are kept by pointer, names that are not string literals have to be interned first
+  static auto intern(std::string_view name) -> const char*;
+
+  static void set_thread_name(std::string_view name);
+  // A track no thread records into implicitly, for timelines like the GPU's
+  static auto create_track(std::string_view name) -> Track*;
+
+  // Only the owning thread records into its track, a created track needs the same discipline
+  static void record(const char* name, int64_t start, int64_t end);
+  static void record(Track*, const char* name, int64_t start, int64_t end);
+
+  // Events recorded while writing may be torn, disable the profiler first
+  static void write_chrome_trace(const std::string& path);
+
+private:
+  static std::atomic<bool> enabled;
+};
+
+class ProfileZone {
+public:
+  explicit ProfileZone(const char* _name) : name { _name }, start { Profiler::is_enabled() ? Profiler::now() : -1 } {}
+  ~ProfileZone() {
+    if (start >= 0) {
+      Profiler::record(name, start, Profiler::now());
+    }
+  }
+
+  ProfileZone(const ProfileZone&) = delete;
+  ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+  const char* name;
+  int64_t start;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profile_zone_, __LINE__) { name }
\ No newline at end of file
@@ -0,0 +1,144 @@
+#include "clustered_lighting.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <tuple>
+#include <utility>
+
+namespace {
+
+auto create_bindings() -> std::vector<vk::DescriptorSetLayoutBinding> {
+  std::vector<vk::DescriptorSetLayoutBinding> bindings;
+  for (uint32_t i = 0; i < 3; ++i) {
+    bindings.push_back({
+      .binding = i,
+      .descriptorType = vk::DescriptorType::eStorageBuffer,
+      .descriptorCount = 1,
+      .stageFlags = vk::ShaderStageFlagBits::eCompute
+    });
+  }
+  return bindings;
+}
+
+}
+
+ClusteredLighting::ClusteredLighting(
+  const vk::raii::Device& _device, MemoryTracker& memory_tracker, uint32_t _max_lights, uint32_t slot_count)
+  : device { _device }, max_lights { _max_lights },
+    cull_pipeline { device, "shaders/light_cull.comp.spv", create_bindings(), 0, local_size } {
+  using enum vk::MemoryPropertyFlagBits;
+  std::tie(cluster_buffer, cluster_memory) =
+    create_buffer(memory_tracker, get_cluster_buffer_size(), eDeviceLocal, MemoryCategory::eStorage);
+  std::tie(light_index_buffer, light_index_memory) =
+    create_buffer(memory_tracker, get_light_index_buffer_size(), eDeviceLocal, MemoryCategory::eStorage);
+
+  vk::DescriptorPoolSize pool_size {
+    .type = vk::DescriptorType::eStorageBuffer,
+    .descriptorCount = 3 * slot_count
+  };
+  vk::DescriptorPoolCreateInfo pool_create_info {
+    .flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
+    .maxSets = slot_count,
+    .poolSizeCount = 1,
+    .pPoolSizes = &pool_size
+  };
+  descriptor_pool = vk::raii::DescriptorPool { device, pool_create_info };
+
+  std::vector<vk::DescriptorSetLayout> layouts(slot_count, cull_pipeline.get_descriptor_set_layout());
+  vk::DescriptorSetAllocateInfo allocate_info {
+    .descriptorPool = *descriptor_pool,
+    .descriptorSetCount = slot_count,
+    .pSetLayouts = layouts.data()
+  };
+  auto descriptor_sets = device.allocateDescriptorSets(allocate_info);
+
+  slots.reserve(slot_count);
+  for (uint32_t i = 0; i < slot_count; ++i) {
+    auto [light_buffer, light_memory] =
+      create_buffer(memory_tracker, get_light_buffer_size(), eHostVisible | eHostCoherent, MemoryCategory::eUniform);
+    auto* data = static_cast<std::byte*>(light_memory.map(0, get_light_buffer_size()));
+    auto* parameters = reinterpret_cast<Parameters*>(data);
+    *parameters = {};
+    auto* lights = reinterpret_cast<Light*>(data + sizeof(Parameters));
+
+    std::array buffer_infos {
+      vk::DescriptorBufferInfo { .buffer = *light_buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+      vk::DescriptorBufferInfo { .buffer = *cluster_buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+      vk::DescriptorBufferInfo { .buffer = *light_index_buffer, .offset = 0, .range = VK_WHOLE_SIZE }
+    };
+    vk::WriteDescriptorSet write {
+      .dstSet = *descriptor_sets[i],
+      .dstBinding = 0,
+      .dstArrayElement = 0,
+      .descriptorCount = static_cast<uint32_t>(buffer_infos.size()),
+      .descriptorType = vk::DescriptorType::eStorageBuffer,
+      .pBufferInfo = buffer_infos.data()
+    };
+    device.updateDescriptorSets(write, nullptr);
+
+    slots.push_back({
+      .light_buffer = std::move(light_buffer),
+      .light_memory = std::move(light_memory),
+      .parameters = parameters,
+      .lights = { lights, max_lights },
+      .descriptor_set = std::move(descriptor_sets[i])
+    });
+  }
+}
+
+auto ClusteredLighting::create_buffer(
+  MemoryTracker& memory_tracker, vk::DeviceSize size, vk::MemoryPropertyFlags properties, MemoryCategory category)
+    -> std::pair<vk::raii::Buffer, DeviceAllocation> {
+  vk::BufferCreateInfo create_info {
+    .size = size,
+    .usage = vk::BufferUsageFlagBits::eStorageBuffer,
+    .sharingMode = vk::SharingMode::eExclusive
+  };
+  vk::raii::Buffer buffer { device, create_info };
+  auto requirements = buffer.getMemoryRequirements();
+  uint32_t memory_type = memory_tracker.find_memory_type(requirements.memoryTypeBits, properties);
+  auto memory = memory_tracker.allocate(requirements.size, memory_type, category);
+  buffer.bindMemory(*memory, 0);
+  return { std::move(buffer), std::move(memory) };
+}
+
+auto ClusteredLighting::get_light_buffer_size() const -> vk::DeviceSize {
+  return sizeof(Parameters) + sizeof(Light) * max_lights;
+}
+
+auto ClusteredLighting::get_cluster_buffer_size() const -> vk::DeviceSize {
+  return sizeof(uint32_t) * cluster_count;
+}
+
+auto ClusteredLighting::get_light_index_buffer_size() const -> vk::DeviceSize {
+  return sizeof(uint32_t) * cluster_count * max_lights_per_cluster;
+}
+
+void ClusteredLighting::set_view(
+  uint32_t slot, const glm::mat4& view, const glm::mat4& projection, vk::Extent2D viewport, uint32_t light_count) {
+  // A right-handed perspective with depth from 0 to 1 keeps both planes in its third and fourth columns
+  float near_plane = projection[3][2] / projection[2][2];
+  float far_plane = projection[3][2] / (projection[2][2] + 1.0f);
+
+  // Slice of a view depth d is log(d) * scale + bias, slice 0 starts at the near plane and the last ends at the far one
+  float slice_scale = static_cast<float>(grid_depth) / std::log(far_plane / near_plane);
+  float slice_bias = -std::log(near_plane) * slice_scale;
+
+  *slots[slot].parameters = {
+    .view = view,
+    .inverse_projection = glm::inverse(projection),
+    .grid = { grid_width, grid_height, grid_depth, std::min(light_count, max_lights) },
+    .tile_size = {
+      static_cast<float>((viewport.width + grid_width - 1) / grid_width),
+      static_cast<float>((viewport.height + grid_height - 1) / grid_height)
+    },
+    .slice_scale_bias = { slice_scale, slice_bias },
+    .viewport_size = { static_cast<float>(viewport.width), static_cast<float>(viewport.height) },
+    .padding = {}
+  };
+}
+
+void ClusteredLighting::cull(vk::raii::CommandBuffer& command_buffer, uint32_t slot) const {
+  cull_pipeline.bind(command_buffer, *slots[slot].descriptor_set);
+  cull_pipeline.dispatch(command_buffer, cluster_count);
+}
\ No newline at end of file
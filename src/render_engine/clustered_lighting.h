@@ -0,0 +1,94 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+#define VULKAN_HPP_NO_CONSTRUCTORS
+#include <vulkan/vulkan.hpp>
+#include <vulkan/vulkan_raii.hpp>
+#include <glm/glm.hpp>
+#include "compute_pipeline.h"
+#include "memory_tracker.h"
+
+// Matches the std430 layout of light_cull.comp and main.frag. A point light is a spot light whose cone
+// covers every direction, its outer angle cosine is -1.
+struct Light {
+  glm::vec3 position;
+  float range;
+  glm::vec3 color;
+  float cos_inner_angle;
+  glm::vec3 direction;
+  float cos_outer_angle;
+};
+static_assert(sizeof(Light) == 48);
+
+// Bins lights into a grid of froxels over the view frustum so that fragments only evaluate the lights
+// that reach their cluster. The grid splits the viewport into tiles and the depth range between the
+// projection's near and far planes into exponential slices, which keeps clusters roughly cubic.
+// A compute shader tests every light against every cluster and writes per cluster light lists, the
+// main pass reads them through its descriptor set.
+class ClusteredLighting {
+public:
+  static constexpr uint32_t grid_width = 16;
+  static constexpr uint32_t grid_height = 9;
+  static constexpr uint32_t grid_depth = 24;
+  static constexpr uint32_t cluster_count = grid_width * grid_height * grid_depth;
+  // Lights past this many in one cluster are dropped from it
+  static constexpr uint32_t max_lights_per_cluster = 128;
+
+  ClusteredLighting(const vk::raii::Device&, MemoryTracker&, uint32_t max_lights, uint32_t slot_count);
+
+  // Host visible, the slot's lights are written here before its commands are submitted
+  auto get_lights(uint32_t slot) const -> std::span<Light> { return slots[slot].lights; }
+  // Camera of the slot and how many of its lights are in use, lights are in world space
+  void set_view(
+    uint32_t slot, const glm::mat4& view, const glm::mat4& projection, vk::Extent2D viewport, uint32_t light_count);
+
+  auto get_light_buffer(uint32_t slot) const -> vk::Buffer { return *slots[slot].light_buffer; }
+  auto get_light_buffer_size() const -> vk::DeviceSize;
+  auto get_cluster_buffer() const -> vk::Buffer { return *cluster_buffer; }
+  auto get_cluster_buffer_size() const -> vk::DeviceSize;
+  auto get_light_index_buffer() const -> vk::Buffer { return *light_index_buffer; }
+  auto get_light_index_buffer_size() const -> vk::DeviceSize;
+
+  // Rewrites the light lists of every cluster from the slot's lights
+  void cull(vk::raii::CommandBuffer&, uint32_t slot) const;
+
+private:
+  // Precedes the lights in their buffer, matches the std430 layout of the shaders
+  struct Parameters {
+    glm::mat4 view;
+    glm::mat4 inverse_projection;
+    glm::uvec4 grid;
+    glm::vec2 tile_size;
+    glm::vec2 slice_scale_bias;
+    glm::vec2 viewport_size;
+    glm::vec2 padding;
+  };
+  static_assert(sizeof(Parameters) % 16 == 0);
+
+  struct Slot {
+    vk::raii::Buffer light_buffer;
+    DeviceAllocation light_memory;
+    Parameters* parameters;
+    std::span<Light> lights;
+    vk::raii::DescriptorSet descriptor_set;
+  };
+
+  static constexpr uint32_t local_size = 64;
+
+  auto create_buffer(MemoryTracker&, vk::DeviceSize, vk::MemoryPropertyFlags, MemoryCategory)
+    -> std::pair<vk::raii::Buffer, DeviceAllocation>;
+
+  const vk::raii::Device& device;
+  uint32_t max_lights;
+  ComputePipeline cull_pipeline;
+  vk::raii::DescriptorPool descriptor_pool { nullptr };
+
+  // Light count of every cluster, its lights start at cluster index * max_lights_per_cluster
+  vk::raii::Buffer cluster_buffer { nullptr };
+  DeviceAllocation cluster_memory;
+  vk::raii::Buffer light_index_buffer { nullptr };
+  DeviceAllocation light_index_memory;
+
+  std::vector<Slot> slots;
+};
\ No newline at end of file
@@ -0,0 +1,57 @@
+#include "compute_pipeline.h"
+#include "file_util.h"
+
+ComputePipeline::ComputePipeline(
+  const vk::raii::Device& device, const std::string& shader_path,
+  const std::vector<vk::DescriptorSetLayoutBinding>& bindings, uint32_t push_constant_size, uint32_t _local_size,
+  const vk::SpecializationInfo* specialization_info, vk::PipelineShaderStageCreateFlags stage_flags)
+  : local_size { _local_size } {
+  vk::DescriptorSetLayoutCreateInfo set_layout_create_info {
+    .bindingCount = static_cast<uint32_t>(bindings.size()),
+    .pBindings = bindings.data()
+  };
+  descriptor_set_layout = vk::raii::DescriptorSetLayout { device, set_layout_create_info };
+
+  vk::PushConstantRange push_constant_range {
+    .stageFlags = vk::ShaderStageFlagBits::eCompute,
+    .offset = 0,
+    .size = push_constant_size
+  };
+
+  vk::DescriptorSetLayout set_layouts[] = { *descriptor_set_layout };
+  vk::PipelineLayoutCreateInfo pipeline_layout_create_info {
+    .setLayoutCount = 1,
+    .pSetLayouts = set_layouts,
+    .pushConstantRangeCount = (push_constant_size > 0 ? 1u : 0u),
+    .pPushConstantRanges = &push_constant_range
+  };
+  pipeline_layout = vk::raii::PipelineLayout { device, pipeline_layout_create_info };
+
+  auto code = read_file(shader_path);
+  vk::ShaderModuleCreateInfo shader_module_create_info {
+    .codeSize = code.size(),
+    .pCode = reinterpret_cast<const uint32_t*>(code.data())
+  };
+  vk::raii::ShaderModule shader_module { device, shader_module_create_info };
+
+  vk::ComputePipelineCreateInfo create_info {
+    .stage = {
+      .flags = stage_flags,
+      .stage = vk::ShaderStageFlagBits::eCompute,
+      .module = *shader_module,
+      .pName = "main",
+      .pSpecializationInfo = specialization_info
+    },
+    .layout = *pipeline_layout
+  };
+  pipeline = vk::raii::Pipeline { device, nullptr, create_info };
+}
+
+void ComputePipeline::bind(vk::raii::CommandBuffer& command_buffer, vk::DescriptorSet descriptor_set) const {
+  command_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, *pipeline);
+  command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *pipeline_layout, 0, { descriptor_set }, nullptr);
+}
+
+void ComputePipeline::dispatch(vk::raii::CommandBuffer& command_buffer, uint32_t invocation_count) const {
+  command_buffer.dispatch((invocation_count + local_size - 1) / local_size, 1, 1);
+}
\ No newline at end of file
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#define VULKAN_HPP_NO_CONSTRUCTORS
+#include <vulkan/vulkan.hpp>
+#include <vulkan/vulkan_raii.hpp>
+
+// A compute shader together with its layouts. Resources are bound in set 0 with the given
+// bindings, per dispatch parameters go in a single push constant block.
+class ComputePipeline {
+public:
+  ComputePipeline(
+    const vk::raii::Device&, const std::string& shader_path, const std::vector<vk::DescriptorSetLayoutBinding>&,
+    uint32_t push_constant_size, uint32_t local_size, const vk::SpecializationInfo* = nullptr,
+    vk::PipelineShaderStageCreateFlags = {});
+
+  auto get_descriptor_set_layout() const -> vk::DescriptorSetLayout { return *descriptor_set_layout; }
+  auto get_pipeline_layout() const -> vk::PipelineLayout { return *pipeline_layout; }
+
+  void bind(vk::raii::CommandBuffer&, vk::DescriptorSet) const;
+  template<typename T>
+  void push_constants(vk::raii::CommandBuffer& command_buffer, const T& constants) const {
+    command_buffer.pushConstants<T>(*pipeline_layout, vk::ShaderStageFlagBits::eCompute, 0, constants);
+  }
+  // Enough workgroups of the shader's local size to cover invocation_count invocations
+  void dispatch(vk::raii::CommandBuffer&, uint32_t invocation_count) const;
+
+private:
+  uint32_t local_size;
+  vk::raii::DescriptorSetLayout descriptor_set_layout { nullptr };
+  vk::raii::PipelineLayout pipeline_layout { nullptr };
+  vk::raii::Pipeline pipeline { nullptr };
+};
\ No newline at end of file
@@ -0,0 +1,142 @@
+#include "debug_log.h"
+#include <algorithm>
+#include <fmt/core.h>
+#include <fmt/color.h>
+
+namespace {
+
+auto hash(std::string_view text, uint64_t value = 0xcbf29ce484222325) -> uint64_t {
+  for (char c : text) {
+    value = (value ^ static_cast<uint8_t>(c)) * 0x100000001b3;
+  }
+  return value;
+}
+
+auto get_color(LogSeverity severity) -> fmt::color {
+  switch (severity) {
+    case LogSeverity::eVerbose: return fmt::color::white;
+    case LogSeverity::eInfo: return fmt::color::green;
+    case LogSeverity::eWarning: return fmt::color::yellow;
+    case LogSeverity::eError: return fmt::color::red;
+  }
+  return fmt::color::dark_red;
+}
+
+}
+
+DebugLog::DebugLog(const RenderConfig::ValidationInfo& info)
+  : min_severity { info.min_severity }, max_messages_per_second { info.max_messages_per_second },
+    slots { std::make_unique<Slot[]>(queue_capacity) }, tail { 0 }, dropped { 0 },
+    head { 0 }, window_start { Clock::now() }, reported_dropped { 0 } {
+  for (uint64_t i = 0; i < queue_capacity; ++i) {
+    slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  drain_thread = std::jthread([this] (std::stop_token stop_token) { drain(stop_token); });
+}
+
+DebugLog::~DebugLog() {
+  // The drain thread prints what is still queued before it stops
+  drain_thread.request_stop();
+  drain_thread.join();
+}
+
+void DebugLog::push(LogSeverity severity, std::string_view id, std::string_view text) {
+  if (severity < min_severity) {
+    return;
+  }
+
+  uint64_t position = tail.load(std::memory_order_relaxed);
+  Slot* slot;
+  while (true) {
+    slot = &slots[position % queue_capacity];
+    auto sequence = slot->sequence.load(std::memory_order_acquire);
+    auto difference = static_cast<int64_t>(sequence - position);
+    if (difference == 0) {
+      if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (difference < 0) {
+      // The drain thread has not freed this slot since the last lap, the queue is full
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    } else {
+      position = tail.load(std::memory_order_relaxed);
+    }
+  }
+
+  slot->severity = severity;
+  slot->id_length = static_cast<uint32_t>(std::min(id.size(), max_id_length));
+  slot->text_length = static_cast<uint32_t>(std::min(text.size(), max_text_length));
+  std::copy_n(id.data(), slot->id_length, slot->id.data());
+  std::copy_n(text.data(), slot->text_length, slot->text.data());
+  slot->sequence.store(position + 1, std::memory_order_release);
+}
+
+void DebugLog::drain(std::stop_token stop_token) {
+  while (true) {
+    // Checked before draining so that everything pushed before the stop is still printed
+    bool stopping = stop_token.stop_requested();
+    for (auto* slot = &slots[head % queue_capacity];
+         slot->sequence.load(std::memory_order_acquire) == head + 1;
+         slot = &slots[head % queue_capacity]) {
+      process(*slot);
+      slot->sequence.store(head + queue_capacity, std::memory_order_release);
+      ++head;
+    }
+
+    if (stopping || Clock::now() - window_start >= report_interval) {
+      report_counts();
+    }
+    if (stopping) {
+      return;
+    }
+    std::this_thread::sleep_for(poll_interval);
+  }
+}
+
+void DebugLog::process(const Slot& slot) {
+  std::string_view id { slot.id.data(), slot.id_length };
+  std::string_view text { slot.text.data(), slot.text_length };
+
+  // Repeats are counted for as long as the message is remembered
+  if (repeats.size() >= max_distinct_messages) {
+    repeats.clear();
+  }
+  auto [repeat, first] = repeats.try_emplace(
+    hash(text, hash(id)), Repeats { std::string { id }, std::string { text.substr(0, repeat_excerpt_length) }, 0 }
+  );
+  if (!first) {
+    ++repeat->second.count;
+    return;
+  }
+
+  auto& window = id_windows[std::string { id }];
+  if (max_messages_per_second > 0 && window.printed >= max_messages_per_second) {
+    ++window.suppressed;
+    return;
+  }
+  ++window.printed;
+  fmt::print(fmt::fg(get_color(slot.severity)), "[[{}]] {}\n", id, text);
+}
+
+void DebugLog::report_counts() {
+  for (auto& [key, repeat] : repeats) {
+    if (repeat.count > 0) {
+      fmt::println("[[{}]] repeated {} times: {}...", repeat.id, repeat.count, repeat.excerpt);
+      repeat.count = 0;
+    }
+  }
+  for (auto& [id, window] : id_windows) {
+    if (window.suppressed > 0) {
+      fmt::println("[[{}]] {} more messages suppressed", id, window.suppressed);
+    }
+  }
+  id_windows.clear();
+
+  auto total_dropped = dropped.load(std::memory_order_relaxed);
+  if (total_dropped > reported_dropped) {
+    fmt::println("{} debug messages dropped, the log queue was full", total_dropped - reported_dropped);
+    reported_dropped = total_dropped;
+  }
+  window_start = Clock::now();
+}
\ No newline at end of file
@@ -0,0 +1,80 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include "render_config.h"
+
+// Takes messages from any thread without locking or allocating and prints them on a background
+// thread, so a flood of validation messages costs the threads raising them one copy each. Repeats
+// of a message are printed once and counted, an id may print max_messages_per_second distinct
+// messages a second and the rest are counted too. Counts are printed once a second.
+class DebugLog {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit DebugLog(const RenderConfig::ValidationInfo&);
+  ~DebugLog();
+
+  DebugLog(const DebugLog&) = delete;
+  DebugLog& operator=(const DebugLog&) = delete;
+
+  // Messages below the minimum severity are ignored, the message is dropped when the queue is full.
+  // Longer messages are truncated.
+  void push(LogSeverity, std::string_view id, std::string_view text);
+
+private:
+  static constexpr uint64_t queue_capacity = 256;
+  static constexpr size_t max_id_length = 128;
+  static constexpr size_t max_text_length = 2048;
+  static constexpr size_t max_distinct_messages = 4096;
+  static constexpr auto poll_interval = std::chrono::milliseconds(10);
+  static constexpr auto report_interval = std::chrono::seconds(1);
+
+  // A slot is free for the producer claiming position p when its sequence is p, and holds a
+  // message for the consumer at position p when it is p + 1
+  struct Slot {
+    std::atomic<uint64_t> sequence;
+    LogSeverity severity;
+    uint32_t id_length, text_length;
+    std::array<char, max_id_length> id;
+    std::array<char, max_text_length> text;
+  };
+
+  // Enough of the message to tell which one repeats
+  static constexpr size_t repeat_excerpt_length = 80;
+
+  struct Repeats {
+    std::string id, excerpt;
+    uint64_t count;
+  };
+
+  struct IdWindow {
+    uint32_t printed;
+    uint64_t suppressed;
+  };
+
+  void drain(std::stop_token);
+  void process(const Slot&);
+  void report_counts();
+
+  LogSeverity min_severity;
+  uint32_t max_messages_per_second;
+
+  std::unique_ptr<Slot[]> slots;
+  alignas(64) std::atomic<uint64_t> tail;
+  alignas(64) std::atomic<uint64_t> dropped;
+
+  // Only touched by the drain thread
+  uint64_t head;
+  Clock::time_point window_start;
+  std::unordered_map<uint64_t, Repeats> repeats;
+  std::unordered_map<std::string, IdWindow> id_windows;
+  uint64_t reported_dropped;
+  std::jthread drain_thread;
+};
\ No newline at end of file
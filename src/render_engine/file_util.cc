@@ -0,0 +1,16 @@
+#include "file_util.h"
+#include <fstream>
+#include <stdexcept>
+
+auto read_file(const std::string& path) -> std::vector<std::byte> {
+  std::ifstream file { path, std::ios::ate | std::ios::binary };
+  if (!file.is_open()) {
+    throw std::runtime_error("Failed to open file: " + path);
+  }
+
+  auto size = static_cast<size_t>(file.tellg());
+  std::vector<std::byte> buffer(size);
+  file.seekg(0);
+  file.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(size));
+  return buffer;
+}
\ No newline at end of file
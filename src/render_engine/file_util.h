@@ -0,0 +1,7 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Whole file contents, throws when the file cannot be opened
+auto read_file(const std::string& path) -> std::vector<std::byte>;
\ No newline at end of file
@@ -0,0 +1,26 @@
+#include "frame_arena.h"
+
+FrameArena::FrameArena(size_t initial_size) : block(initial_size) {
+  resource.emplace(block.data(), block.size(), &spill);
+}
+
+void FrameArena::rewind() {
+  resource->release();
+  if (spill.bytes == 0) {
+    return;
+  }
+
+  // Grown with headroom, so a frame that varies a little does not spill every time
+  block.resize(2 * (block.size() + spill.bytes));
+  spill.bytes = 0;
+  resource.emplace(block.data(), block.size(), &spill);
+}
+
+auto FrameArena::SpillResource::do_allocate(size_t size, size_t alignment) -> void* {
+  bytes += size;
+  return std::pmr::new_delete_resource()->allocate(size, alignment);
+}
+
+void FrameArena::SpillResource::do_deallocate(void* pointer, size_t size, size_t alignment) {
+  std::pmr::new_delete_resource()->deallocate(pointer, size, alignment);
+}
\ No newline at end of file
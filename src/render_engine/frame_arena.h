@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include <memory_resource>
+#include <optional>
+#include <vector>
+
+// Bump allocator for CPU data that only lives while one frame is recorded and in flight. Rewinding
+// frees everything at once. A frame that outgrows the block spills to the heap and the block grows
+// to fit the next time it is rewound, so frames of steady size never reach the heap.
+class FrameArena {
+public:
+  explicit FrameArena(size_t initial_size);
+
+  FrameArena(const FrameArena&) = delete;
+  FrameArena& operator=(const FrameArena&) = delete;
+
+  // Everything allocated since the last rewind must be dead
+  void rewind();
+
+  auto get() -> std::pmr::memory_resource& { return *resource; }
+  auto get_capacity() const -> size_t { return block.size(); }
+  auto get_spilled_bytes() const -> size_t { return spill.bytes; }
+
+private:
+  // Passes spilled allocations on to the heap and remembers how much the block was short
+  class SpillResource : public std::pmr::memory_resource {
+  public:
+    size_t bytes = 0;
+
+  private:
+    auto do_allocate(size_t size, size_t alignment) -> void* override;
+    void do_deallocate(void* pointer, size_t size, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+  };
+
+  std::vector<std::byte> block;
+  SpillResource spill;
+  std::optional<std::pmr::monotonic_buffer_resource> resource;
+};
\ No newline at end of file
@@ -0,0 +1,74 @@
+#include "frame_balancer.h"
+#include <algorithm>
+#include <utility>
+
+FrameBalancer::FrameBalancer(uint32_t _max_frames_in_flight, bool _adaptive)
+  : max_frames_in_flight { _max_frames_in_flight }, adaptive { _adaptive },
+    frames_in_flight { adaptive ? std::min(2u, max_frames_in_flight) : max_frames_in_flight },
+    last_bound { FrameBound::eCpu }, classified_frames { 0 }, window_sum {}, average {}, window_count { 0 },
+    window_gpu_bound { 0 }, gpu_bound_share { 0.0f } {}
+
+bool FrameBalancer::record(const Sample& sample) {
+  last_bound = (sample.gpu_milliseconds > sample.cpu_milliseconds ? FrameBound::eGpu : FrameBound::eCpu);
+  ++classified_frames;
+
+  window_sum.cpu_milliseconds += sample.cpu_milliseconds;
+  window_sum.gpu_milliseconds += sample.gpu_milliseconds;
+  window_sum.fence_wait_milliseconds += sample.fence_wait_milliseconds;
+  window_gpu_bound += (last_bound == FrameBound::eGpu ? 1 : 0);
+  if (++window_count < window_size) {
+    return false;
+  }
+
+  average = {
+    .cpu_milliseconds = window_sum.cpu_milliseconds / window_size,
+    .gpu_milliseconds = window_sum.gpu_milliseconds / window_size,
+    .fence_wait_milliseconds = window_sum.fence_wait_milliseconds / window_size
+  };
+  gpu_bound_share = static_cast<float>(window_gpu_bound) / window_size;
+  window_sum = {};
+  window_count = 0;
+  window_gpu_bound = 0;
+
+  if (!adaptive) {
+    return false;
+  }
+  auto previous = std::exchange(frames_in_flight, select_frames_in_flight());
+  return frames_in_flight != previous;
+}
+
+auto FrameBalancer::select_frames_in_flight() const -> uint32_t {
+  bool gpu_bound = (gpu_bound_share >= 0.75f);
+  bool cpu_bound = (gpu_bound_share <= 0.25f);
+
+  if (gpu_bound) {
+    if (frames_in_flight > 2) {
+      return frames_in_flight - 1;
+    }
+    // Leaving one takes more CPU time than entering it, so a CPU time near the threshold cannot flip it
+    if (frames_in_flight == 2 && average.cpu_milliseconds < average.gpu_milliseconds / 8.0) {
+      return 1;
+    }
+    if (frames_in_flight == 1 && average.cpu_milliseconds > average.gpu_milliseconds / 4.0) {
+      return std::min(2u, max_frames_in_flight);
+    }
+    return frames_in_flight;
+  }
+  if (cpu_bound) {
+    return (frames_in_flight == 1 ? std::min(2u, max_frames_in_flight) : frames_in_flight);
+  }
+  return std::min(frames_in_flight + 1, max_frames_in_flight);
+}
+
+auto FrameBalancer::get_stats() const -> FrameStats {
+  return {
+    .frames_in_flight = frames_in_flight,
+    .swap_chain_images = 0,
+    .last_bound = last_bound,
+    .cpu_milliseconds = average.cpu_milliseconds,
+    .gpu_milliseconds = average.gpu_milliseconds,
+    .fence_wait_milliseconds = average.fence_wait_milliseconds,
+    .gpu_bound_share = gpu_bound_share,
+    .classified_frames = classified_frames
+  };
+}
\ No newline at end of file
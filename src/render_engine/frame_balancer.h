@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+
+enum class FrameBound {
+  eCpu, eGpu
+};
+
+struct FrameStats {
+  uint32_t frames_in_flight;
+  // 0 when rendering offscreen
+  uint32_t swap_chain_images;
+  FrameBound last_bound;
+  // Averages over the last complete window, not set before the first one
+  double cpu_milliseconds;
+  double gpu_milliseconds;
+  double fence_wait_milliseconds;
+  float gpu_bound_share;
+  uint64_t classified_frames;
+};
+
+// Picks how many frames the CPU may record ahead of the GPU. A frame is GPU bound when the GPU was
+// busy with it for longer than the CPU worked on it, the CPU time leaves out blocking on fences and
+// image acquisition since that is the CPU waiting for the GPU. Once per window of frames:
+// - mostly GPU bound, every queued frame waits for the GPU, so frames beyond two only add latency.
+//   At two, when the CPU's work is small next to the GPU's, one frame trades little throughput for
+//   a frame less latency.
+// - mostly CPU bound, a single frame leaves the GPU idle while the CPU records, so it goes back to two
+// - mixed, the bottleneck swings between them and a deeper queue absorbs the swings
+class FrameBalancer {
+public:
+  struct Sample {
+    double cpu_milliseconds;
+    double gpu_milliseconds;
+    double fence_wait_milliseconds;
+  };
+
+  // Without adaptive the frames are classified but their count stays at max_frames_in_flight
+  FrameBalancer(uint32_t max_frames_in_flight, bool adaptive);
+
+  // Returns whether the frames in flight changed
+  bool record(const Sample&);
+
+  auto get_frames_in_flight() const -> uint32_t { return frames_in_flight; }
+  auto get_stats() const -> FrameStats;
+
+private:
+  static constexpr uint32_t window_size = 32;
+
+  auto select_frames_in_flight() const -> uint32_t;
+
+  uint32_t max_frames_in_flight;
+  bool adaptive;
+  uint32_t frames_in_flight;
+  FrameBound last_bound;
+  uint64_t classified_frames;
+
+  // The window being filled and the last complete one
+  Sample window_sum, average;
+  uint32_t window_count, window_gpu_bound;
+  float gpu_bound_share;
+};
\ No newline at end of file
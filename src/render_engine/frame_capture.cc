@@ -0,0 +1,173 @@
+#include "frame_capture.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <fmt/core.h>
+#include "texture_source.h"
+
+FrameCapture::FrameCapture(
+  const vk::raii::Device& device, MemoryTracker& memory_tracker, vk::Format _format, vk::Extent2D _extent,
+  uint32_t slot_count, const RenderConfig::CaptureInfo& info)
+  : format { _format }, extent { _extent }, directory { info.directory }, file_format { info.format },
+    dropped_frames { 0 } {
+  using enum vk::Format;
+  auto format_info = get_format_info(format);
+  if (!format_info || format_info->compressed) {
+    throw std::runtime_error(fmt::format("Cannot capture frames in format {}", vk::to_string(format)));
+  }
+  bool rgba8 = (format == eR8G8B8A8Unorm || format == eR8G8B8A8Srgb || format == eB8G8R8A8Unorm || format == eB8G8R8A8Srgb);
+  if (file_format == CaptureFormat::ePpm && !rgba8) {
+    throw std::runtime_error(fmt::format("Cannot write frames in format {} as PPM", vk::to_string(format)));
+  }
+  frame_size = get_level_size(*format_info, extent);
+
+  std::filesystem::create_directories(directory);
+
+  slots.reserve(slot_count);
+  for (uint32_t i = 0; i < slot_count; ++i) {
+    vk::BufferCreateInfo create_info {
+      .size = frame_size,
+      .usage = vk::BufferUsageFlagBits::eTransferDst,
+      .sharingMode = vk::SharingMode::eExclusive
+    };
+    vk::raii::Buffer buffer { device, create_info };
+
+    // Cached memory makes reading back much faster, coherent saves invalidating it
+    auto requirements = buffer.getMemoryRequirements();
+    using enum vk::MemoryPropertyFlagBits;
+    uint32_t memory_type;
+    try {
+      memory_type = memory_tracker.find_memory_type(requirements.memoryTypeBits, eHostVisible | eHostCoherent | eHostCached);
+    } catch (const std::runtime_error&) {
+      memory_type = memory_tracker.find_memory_type(requirements.memoryTypeBits, eHostVisible | eHostCoherent);
+    }
+    auto memory = memory_tracker.allocate(requirements.size, memory_type, MemoryCategory::eReadback);
+    buffer.bindMemory(*memory, 0);
+    auto data = static_cast<const std::byte*>(memory.map(0, frame_size));
+
+    slots.push_back({ std::move(buffer), std::move(memory), data, 0 });
+  }
+
+  free_buffers.resize(max_pending_frames);
+  pending_frames.reserve(max_pending_frames);
+  for (auto& buffer : free_buffers) {
+    buffer.resize(frame_size);
+  }
+
+  fmt::println(
+    "Capturing {}x{} {} frames to {}", extent.width, extent.height,
+    (file_format == CaptureFormat::ePpm ? "PPM" : vk::to_string(format) + " raw"), directory
+  );
+  writer_thread = std::jthread([this] (std::stop_token stop_token) { write_frames(stop_token); });
+}
+
+FrameCapture::~FrameCapture() {
+  // The writer drains every pending frame before it stops
+  writer_thread.request_stop();
+  writer_thread.join();
+
+  if (dropped_frames > 0) {
+    fmt::println("Frame capture dropped {} frames, the writer could not keep up", dropped_frames);
+  }
+}
+
+void FrameCapture::submitted(uint32_t slot, uint64_t frame_number) {
+  slots[slot].frame_number = frame_number;
+}
+
+void FrameCapture::collect(uint32_t slot, bool wait) {
+  auto& source = slots[slot];
+  if (source.frame_number == 0) {
+    return;
+  }
+
+  Frame frame { .number = source.frame_number, .data = {} };
+  source.frame_number = 0;
+  {
+    std::unique_lock lock { mutex };
+    if (wait) {
+      condition.wait(lock, [this] { return !free_buffers.empty(); });
+    }
+    if (free_buffers.empty()) {
+      ++dropped_frames;
+      return;
+    }
+    frame.data = std::move(free_buffers.back());
+    free_buffers.pop_back();
+  }
+
+  std::memcpy(frame.data.data(), source.data, frame_size);
+  {
+    std::lock_guard lock { mutex };
+    pending_frames.push_back(std::move(frame));
+  }
+  condition.notify_all();
+}
+
+void FrameCapture::flush() {
+  std::vector<uint32_t> order(slots.size());
+  for (uint32_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::ranges::sort(order, {}, [this] (uint32_t slot) { return slots[slot].frame_number; });
+
+  for (uint32_t slot : order) {
+    collect(slot, true);
+  }
+}
+
+void FrameCapture::write_frames(std::stop_token stop_token) {
+  while (true) {
+    Frame frame;
+    {
+      std::unique_lock lock { mutex };
+      condition.wait(lock, stop_token, [this] { return !pending_frames.empty(); });
+      if (pending_frames.empty()) {
+        return;
+      }
+      frame = std::move(pending_frames.front());
+      pending_frames.erase(pending_frames.begin());
+    }
+
+    write_frame(frame);
+
+    {
+      std::lock_guard lock { mutex };
+      free_buffers.push_back(std::move(frame.data));
+    }
+    condition.notify_all();
+  }
+}
+
+void FrameCapture::write_frame(const Frame& frame) {
+  bool ppm = (file_format == CaptureFormat::ePpm);
+  auto path = fmt::format("{}/frame_{:06}.{}", directory, frame.number, ppm ? "ppm" : "raw");
+  std::ofstream file { path, std::ios::binary };
+  if (!file.is_open()) {
+    fmt::println("Failed to open capture file: {}", path);
+    return;
+  }
+
+  if (!ppm) {
+    file.write(reinterpret_cast<const char*>(frame.data.data()), static_cast<std::streamsize>(frame.data.size()));
+    return;
+  }
+
+  // PPM holds RGB rows top to bottom, the alpha channel is dropped
+  bool bgra = (format == vk::Format::eB8G8R8A8Unorm || format == vk::Format::eB8G8R8A8Srgb);
+  file << fmt::format("P6\n{} {}\n255\n", extent.width, extent.height);
+
+  std::vector<char> row(extent.width * 3);
+  for (uint32_t y = 0; y < extent.height; ++y) {
+    const std::byte* pixels = frame.data.data() + static_cast<size_t>(y) * extent.width * 4;
+    for (uint32_t x = 0; x < extent.width; ++x) {
+      const std::byte* pixel = pixels + x * 4;
+      row[x * 3 + 0] = static_cast<char>(pixel[bgra ? 2 : 0]);
+      row[x * 3 + 1] = static_cast<char>(pixel[1]);
+      row[x * 3 + 2] = static_cast<char>(pixel[bgra ? 0 : 2]);
+    }
+    file.write(row.data(), static_cast<std::streamsize>(row.size()));
+  }
+}
\ No newline at end of file
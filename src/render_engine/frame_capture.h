@@ -0,0 +1,74 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#define VULKAN_HPP_NO_CONSTRUCTORS
+#include <vulkan/vulkan.hpp>
+#include <vulkan/vulkan_raii.hpp>
+#include "render_config.h"
+#include "memory_tracker.h"
+
+// Copies rendered frames into a ring of host visible buffers, one per frame in flight, and writes
+// them to disk on a background thread. A slot is only read after the fence of the frame that
+// filled it has signalled, which the renderer waits for anyway before reusing the slot, so
+// capturing never stalls on the frame just submitted.
+class FrameCapture {
+public:
+  FrameCapture(
+    const vk::raii::Device&, MemoryTracker&, vk::Format, vk::Extent2D, uint32_t slot_count,
+    const RenderConfig::CaptureInfo&);
+  ~FrameCapture();
+
+  FrameCapture(const FrameCapture&) = delete;
+  FrameCapture& operator=(const FrameCapture&) = delete;
+
+  auto get_buffer(uint32_t slot) const -> vk::Buffer { return *slots[slot].buffer; }
+  auto get_buffer_size() const -> vk::DeviceSize { return frame_size; }
+  auto get_extent() const -> vk::Extent2D { return extent; }
+
+  // The slot's commands that copy the frame were submitted
+  void submitted(uint32_t slot, uint64_t frame_number);
+  // Hands the slot's frame to the writer, only once the fence of its submission has signalled.
+  // The frame is dropped when the writer is too far behind, unless wait is set.
+  void collect(uint32_t slot, bool wait = false);
+  // Collects every slot in frame order without dropping any, the device has to be idle
+  void flush();
+
+private:
+  // Frames the writer may fall behind by before new ones are dropped
+  static constexpr size_t max_pending_frames = 8;
+
+  struct Slot {
+    vk::raii::Buffer buffer;
+    DeviceAllocation memory;
+    const std::byte* data;
+    uint64_t frame_number;
+  };
+
+  struct Frame {
+    uint64_t number;
+    std::vector<std::byte> data;
+  };
+
+  void write_frames(std::stop_token);
+  void write_frame(const Frame&);
+
+  vk::Format format;
+  vk::Extent2D extent;
+  vk::DeviceSize frame_size;
+  std::string directory;
+  CaptureFormat file_format;
+  std::vector<Slot> slots;
+  uint64_t dropped_frames;
+
+  std::mutex mutex;
+  std::condition_variable_any condition;
+  // Oldest first, reserved up front so queueing a frame never allocates
+  std::vector<Frame> pending_frames;
+  std::vector<std::vector<std::byte>> free_buffers;
+  std::jthread writer_thread;
+};
\ No newline at end of file
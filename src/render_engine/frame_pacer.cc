@@ -0,0 +1,38 @@
+#include "frame_pacer.h"
+#include <algorithm>
+#include <thread>
+
+void FramePacer::wait_for_frame_start() const {
+  if (delay > Clock::duration::zero()) {
+    std::this_thread::sleep_for(delay);
+  }
+}
+
+void FramePacer::record_blocked(Clock::duration blocked) {
+  // Close a quarter of the gap each frame so a single noisy frame cannot push the delay too far
+  auto slack = blocked - margin;
+  auto limit = (refresh_interval > Clock::duration::zero() ? std::min(refresh_interval, max_delay) : max_delay);
+  delay = std::clamp(delay + slack / 4, Clock::duration::zero(), limit);
+}
+
+void FramePacer::record_displayed(Clock::time_point time) {
+  if (last_displayed == Clock::time_point {}) {
+    last_displayed = time;
+    return;
+  }
+
+  auto interval = time - last_displayed;
+  last_displayed = time;
+
+  if (refresh_interval == Clock::duration::zero()) {
+    refresh_interval = interval;
+    return;
+  }
+
+  // A frame that took noticeably longer than a refresh was dropped, back off quickly
+  if (interval > refresh_interval * 3 / 2) {
+    delay /= 2;
+    return;
+  }
+  refresh_interval += (interval - refresh_interval) / 16;
+}
\ No newline at end of file
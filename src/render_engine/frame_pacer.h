@@ -0,0 +1,26 @@
+#pragma once
+#include <chrono>
+
+// Delays the start of CPU frames so they finish just before the GPU and display can take them.
+// Time spent blocked on fences or image acquisition is latency that input waited for nothing,
+// so the delay grows until only a small safety margin of blocking is left and is halved as soon
+// as a frame misses its refresh.
+class FramePacer {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  void wait_for_frame_start() const;
+  void record_blocked(Clock::duration);
+  void record_displayed(Clock::time_point);
+
+  auto get_delay() const -> Clock::duration { return delay; }
+  auto get_refresh_interval() const -> Clock::duration { return refresh_interval; }
+
+private:
+  static constexpr Clock::duration margin = std::chrono::microseconds(1000);
+  static constexpr Clock::duration max_delay = std::chrono::milliseconds(50);
+
+  Clock::duration delay {};
+  Clock::duration refresh_interval {};
+  Clock::time_point last_displayed {};
+};
\ No newline at end of file
@@ -0,0 +1,290 @@
+#include "geometry_pool.h"
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <fmt/core.h>
+
+RangeAllocator::RangeAllocator(uint32_t _capacity) : capacity { _capacity } {
+  reset();
+}
+
+auto RangeAllocator::allocate(uint32_t count) -> std::optional<uint32_t> {
+  if (count == 0) {
+    return 0;
+  }
+
+  for (auto range = free_ranges.begin(); range != free_ranges.end(); ++range) {
+    auto [offset, size] = *range;
+    if (size < count) {
+      continue;
+    }
+
+    free_ranges.erase(range);
+    if (size > count) {
+      free_ranges.emplace(offset + count, size - count);
+    }
+    free_count -= count;
+    return offset;
+  }
+  return std::nullopt;
+}
+
+void RangeAllocator::free(uint32_t offset, uint32_t count) {
+  if (count == 0) {
+    return;
+  }
+  free_count += count;
+
+  auto next = free_ranges.lower_bound(offset);
+  if (next != free_ranges.end() && offset + count == next->first) {
+    count += next->second;
+    next = free_ranges.erase(next);
+  }
+
+  if (next != free_ranges.begin()) {
+    auto previous = std::prev(next);
+    if (previous->first + previous->second == offset) {
+      previous->second += count;
+      return;
+    }
+  }
+  free_ranges.emplace_hint(next, offset, count);
+}
+
+void RangeAllocator::reset() {
+  free_ranges.clear();
+  if (capacity > 0) {
+    free_ranges.emplace(0, capacity);
+  }
+  free_count = capacity;
+}
+
+GeometryPool::GeometryPool(
+  const vk::raii::Device& _device, MemoryTracker& _memory_tracker, const vk::raii::Queue& _queue, uint32_t queue_family,
+  const Config& _config)
+  : device { _device }, memory_tracker { _memory_tracker }, queue { _queue }, config { _config },
+    vertex_address { 0 }, vertex_allocator { config.max_vertices }, index_allocator { config.max_indices } {
+  vk::CommandPoolCreateInfo command_pool_create_info {
+    .flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+    .queueFamilyIndex = queue_family
+  };
+  command_pool = vk::raii::CommandPool { device, command_pool_create_info };
+
+  vk::CommandBufferAllocateInfo allocate_info {
+    .commandPool = *command_pool,
+    .level = vk::CommandBufferLevel::ePrimary,
+    .commandBufferCount = 1
+  };
+  command_buffer = std::move(vk::raii::CommandBuffers { device, allocate_info }.front());
+  fence = vk::raii::Fence { device, vk::FenceCreateInfo {} };
+
+  vertex_buffer = create_vertex_buffer();
+  index_buffer = create_index_buffer();
+}
+
+auto GeometryPool::add(std::span<const std::byte> vertices, std::span<const uint32_t> indices) -> MeshHandle {
+  auto vertex_count = static_cast<uint32_t>(vertices.size() / config.vertex_size);
+  auto index_count = static_cast<uint32_t>(indices.size());
+
+  auto vertex_offset = vertex_allocator.allocate(vertex_count);
+  auto first_index = index_allocator.allocate(index_count);
+  if (!vertex_offset || !first_index) {
+    if (vertex_offset) {
+      vertex_allocator.free(*vertex_offset, vertex_count);
+    }
+    if (first_index) {
+      index_allocator.free(*first_index, index_count);
+    }
+    if (vertex_allocator.get_free_count() < vertex_count || index_allocator.get_free_count() < index_count) {
+      throw std::runtime_error(fmt::format(
+        "Geometry pool has no room for {} vertices and {} indices, {} and {} are free",
+        vertex_count, index_count, vertex_allocator.get_free_count(), index_allocator.get_free_count()
+      ));
+    }
+
+    // Compaction leaves all the free space in one range at the end
+    compact();
+    vertex_offset = vertex_allocator.allocate(vertex_count);
+    first_index = index_allocator.allocate(index_count);
+  }
+
+  MeshRange range {
+    .vertex_offset = static_cast<int32_t>(*vertex_offset),
+    .vertex_count = vertex_count,
+    .first_index = *first_index,
+    .index_count = index_count
+  };
+
+  vk::DeviceSize vertex_bytes = vertices.size();
+  vk::DeviceSize index_bytes = indices.size_bytes();
+  auto staging = create_buffer(
+    vertex_bytes + index_bytes, vk::BufferUsageFlagBits::eTransferSrc,
+    vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, MemoryCategory::eStaging
+  );
+  auto* data = static_cast<std::byte*>(staging.memory.map(0, vertex_bytes + index_bytes));
+  std::memcpy(data, vertices.data(), vertex_bytes);
+  std::memcpy(data + vertex_bytes, indices.data(), index_bytes);
+  staging.memory.unmap();
+
+  submit([&] (vk::raii::CommandBuffer& command_buffer) {
+    if (vertex_bytes > 0) {
+      vk::BufferCopy vertex_region {
+        .srcOffset = 0,
+        .dstOffset = vk::DeviceSize { *vertex_offset } * config.vertex_size,
+        .size = vertex_bytes
+      };
+      command_buffer.copyBuffer(*staging.buffer, *vertex_buffer.buffer, vertex_region);
+    }
+    if (index_bytes > 0) {
+      vk::BufferCopy index_region {
+        .srcOffset = vertex_bytes,
+        .dstOffset = vk::DeviceSize { range.first_index } * sizeof(uint32_t),
+        .size = index_bytes
+      };
+      command_buffer.copyBuffer(*staging.buffer, *index_buffer.buffer, index_region);
+    }
+  });
+
+  MeshHandle handle;
+  if (free_handles.empty()) {
+    handle = static_cast<MeshHandle>(meshes.size());
+    meshes.emplace_back(range);
+  } else {
+    handle = free_handles.back();
+    free_handles.pop_back();
+    meshes[handle] = range;
+  }
+  return handle;
+}
+
+void GeometryPool::remove(MeshHandle handle) {
+  const auto& range = *meshes[handle];
+  vertex_allocator.free(static_cast<uint32_t>(range.vertex_offset), range.vertex_count);
+  index_allocator.free(range.first_index, range.index_count);
+  meshes[handle].reset();
+  free_handles.push_back(handle);
+}
+
+void GeometryPool::compact() {
+  auto new_vertex_buffer = create_vertex_buffer();
+  auto new_index_buffer = create_index_buffer();
+
+  // Packs the meshes in handle order
+  std::vector<vk::BufferCopy> vertex_regions, index_regions;
+  uint32_t vertex_end = 0, index_end = 0;
+  for (auto& mesh : meshes) {
+    if (!mesh) {
+      continue;
+    }
+
+    if (mesh->vertex_count > 0) {
+      vertex_regions.push_back({
+        .srcOffset = vk::DeviceSize { static_cast<uint32_t>(mesh->vertex_offset) } * config.vertex_size,
+        .dstOffset = vk::DeviceSize { vertex_end } * config.vertex_size,
+        .size = vk::DeviceSize { mesh->vertex_count } * config.vertex_size
+      });
+    }
+    if (mesh->index_count > 0) {
+      index_regions.push_back({
+        .srcOffset = vk::DeviceSize { mesh->first_index } * sizeof(uint32_t),
+        .dstOffset = vk::DeviceSize { index_end } * sizeof(uint32_t),
+        .size = vk::DeviceSize { mesh->index_count } * sizeof(uint32_t)
+      });
+    }
+
+    mesh->vertex_offset = static_cast<int32_t>(vertex_end);
+    mesh->first_index = index_end;
+    vertex_end += mesh->vertex_count;
+    index_end += mesh->index_count;
+  }
+
+  device.waitIdle();
+  submit([&] (vk::raii::CommandBuffer& command_buffer) {
+    if (!vertex_regions.empty()) {
+      command_buffer.copyBuffer(*vertex_buffer.buffer, *new_vertex_buffer.buffer, vertex_regions);
+    }
+    if (!index_regions.empty()) {
+      command_buffer.copyBuffer(*index_buffer.buffer, *new_index_buffer.buffer, index_regions);
+    }
+  });
+
+  vertex_buffer = std::move(new_vertex_buffer);
+  index_buffer = std::move(new_index_buffer);
+  if (config.vertex_usage & vk::BufferUsageFlagBits::eShaderDeviceAddress) {
+    vertex_address = device.getBufferAddress({ .buffer = *vertex_buffer.buffer });
+  }
+
+  vertex_allocator.reset();
+  index_allocator.reset();
+  (void)vertex_allocator.allocate(vertex_end);
+  (void)index_allocator.allocate(index_end);
+}
+
+auto GeometryPool::create_buffer(
+  vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags properties, MemoryCategory category)
+    -> GpuBuffer {
+  vk::BufferCreateInfo create_info {
+    .size = size,
+    .usage = usage,
+    .sharingMode = vk::SharingMode::eExclusive
+  };
+  vk::raii::Buffer buffer { device, create_info };
+
+  vk::MemoryAllocateFlags allocate_flags;
+  if (usage & vk::BufferUsageFlagBits::eShaderDeviceAddress) {
+    allocate_flags = vk::MemoryAllocateFlagBits::eDeviceAddress;
+  }
+
+  auto requirements = buffer.getMemoryRequirements();
+  uint32_t memory_type = memory_tracker.find_memory_type(requirements.memoryTypeBits, properties);
+  auto memory = memory_tracker.allocate(requirements.size, memory_type, category, allocate_flags);
+  buffer.bindMemory(*memory, 0);
+  return { std::move(buffer), std::move(memory) };
+}
+
+auto GeometryPool::create_vertex_buffer() -> GpuBuffer {
+  using enum vk::BufferUsageFlagBits;
+  auto buffer = create_buffer(
+    vk::DeviceSize { config.max_vertices } * config.vertex_size,
+    eTransferSrc | eTransferDst | eVertexBuffer | config.vertex_usage,
+    vk::MemoryPropertyFlagBits::eDeviceLocal, MemoryCategory::eVertex
+  );
+  if (config.vertex_usage & eShaderDeviceAddress) {
+    vertex_address = device.getBufferAddress({ .buffer = *buffer.buffer });
+  }
+  return buffer;
+}
+
+auto GeometryPool::create_index_buffer() -> GpuBuffer {
+  using enum vk::BufferUsageFlagBits;
+  return create_buffer(
+    vk::DeviceSize { config.max_indices } * sizeof(uint32_t), eTransferSrc | eTransferDst | eIndexBuffer,
+    vk::MemoryPropertyFlagBits::eDeviceLocal, MemoryCategory::eIndex
+  );
+}
+
+void GeometryPool::submit(const std::function<void(vk::raii::CommandBuffer&)>& record) {
+  command_buffer.reset();
+  command_buffer.begin({ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+  record(command_buffer);
+
+  // Later frames read the copied geometry as vertex input, index data and through vertex pulling
+  vk::MemoryBarrier2 barrier {
+    .srcStageMask = vk::PipelineStageFlagBits2::eCopy,
+    .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eVertexInput | vk::PipelineStageFlagBits2::eVertexShader,
+    .dstAccessMask = vk::AccessFlagBits2::eVertexAttributeRead | vk::AccessFlagBits2::eIndexRead
+      | vk::AccessFlagBits2::eShaderStorageRead
+  };
+  command_buffer.pipelineBarrier2({ .memoryBarrierCount = 1, .pMemoryBarriers = &barrier });
+  command_buffer.end();
+
+  vk::CommandBuffer command_buffers[] = { *command_buffer };
+  vk::SubmitInfo submit_info {
+    .commandBufferCount = 1,
+    .pCommandBuffers = command_buffers
+  };
+  queue.submit(submit_info, *fence);
+  (void)device.waitForFences(*fence, true, UINT64_MAX);
+  device.resetFences(*fence);
+}
\ No newline at end of file
@@ -0,0 +1,101 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <optional>
+#include <span>
+#include <vector>
+#define VULKAN_HPP_NO_CONSTRUCTORS
+#include <vulkan/vulkan.hpp>
+#include <vulkan/vulkan_raii.hpp>
+#include "memory_tracker.h"
+
+// First fit allocator over a range of elements, freed ranges merge with their free neighbours
+class RangeAllocator {
+public:
+  explicit RangeAllocator(uint32_t capacity);
+
+  auto allocate(uint32_t count) -> std::optional<uint32_t>;
+  void free(uint32_t offset, uint32_t count);
+  // Forgets every allocation
+  void reset();
+
+  auto get_capacity() const -> uint32_t { return capacity; }
+  auto get_free_count() const -> uint32_t { return free_count; }
+
+private:
+  uint32_t capacity, free_count;
+  // Offset to count of every free range
+  std::map<uint32_t, uint32_t> free_ranges;
+};
+
+// Vertices and indices of every mesh live in one vertex and one index buffer, so a frame binds them
+// once and draws select their mesh with vertexOffset and firstIndex. Uploads and compaction wait for
+// the GPU and are meant for load time.
+class GeometryPool {
+public:
+  using MeshHandle = uint32_t;
+  static constexpr vk::IndexType index_type = vk::IndexType::eUint32;
+
+  struct Config {
+    uint32_t vertex_size;
+    uint32_t max_vertices;
+    uint32_t max_indices;
+    // Added to the transfer and vertex buffer usage of the vertex buffer
+    vk::BufferUsageFlags vertex_usage;
+  };
+
+  struct MeshRange {
+    int32_t vertex_offset;
+    uint32_t vertex_count;
+    uint32_t first_index;
+    uint32_t index_count;
+  };
+
+  GeometryPool(const vk::raii::Device&, MemoryTracker&, const vk::raii::Queue&, uint32_t queue_family, const Config&);
+
+  // Indices count from the mesh's first vertex. Compacts when the free space is too fragmented for
+  // the mesh and throws when there is not enough of it.
+  auto add(std::span<const std::byte> vertices, std::span<const uint32_t> indices) -> MeshHandle;
+  // The ranges can be reused right away, draws in flight must not read the mesh anymore
+  void remove(MeshHandle);
+  // Moves every mesh to the front of fresh buffers, ranges change while handles stay valid.
+  // Waits for the device to be idle before the old buffers go away.
+  void compact();
+
+  auto get(MeshHandle handle) const -> const MeshRange& { return *meshes[handle]; }
+  auto get_vertex_buffer() const -> vk::Buffer { return *vertex_buffer.buffer; }
+  auto get_index_buffer() const -> vk::Buffer { return *index_buffer.buffer; }
+  // Only set when the vertex usage includes shader device address, changes with compaction
+  auto get_vertex_address() const -> vk::DeviceAddress { return vertex_address; }
+  auto get_free_vertices() const -> uint32_t { return vertex_allocator.get_free_count(); }
+  auto get_free_indices() const -> uint32_t { return index_allocator.get_free_count(); }
+
+private:
+  struct GpuBuffer {
+    vk::raii::Buffer buffer { nullptr };
+    DeviceAllocation memory;
+  };
+
+  auto create_buffer(vk::DeviceSize, vk::BufferUsageFlags, vk::MemoryPropertyFlags, MemoryCategory) -> GpuBuffer;
+  auto create_vertex_buffer() -> GpuBuffer;
+  auto create_index_buffer() -> GpuBuffer;
+  void submit(const std::function<void(vk::raii::CommandBuffer&)>&);
+
+  const vk::raii::Device& device;
+  MemoryTracker& memory_tracker;
+  const vk::raii::Queue& queue;
+  Config config;
+
+  vk::raii::CommandPool command_pool { nullptr };
+  vk::raii::CommandBuffer command_buffer { nullptr };
+  vk::raii::Fence fence { nullptr };
+
+  GpuBuffer vertex_buffer, index_buffer;
+  vk::DeviceAddress vertex_address;
+  RangeAllocator vertex_allocator, index_allocator;
+
+  std::vector<std::optional<MeshRange>> meshes;
+  std::vector<MeshHandle> free_handles;
+};
\ No newline at end of file
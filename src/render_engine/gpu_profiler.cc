@@ -0,0 +1,118 @@
+#include "gpu_profiler.h"
+#include <utility>
+
+GpuProfiler::GpuProfiler(
+  const vk::raii::PhysicalDevice& physical_device, const vk::raii::Device& device, uint32_t queue_family,
+  uint32_t slot_count)
+  : clock_offset { 0 }, calibration_query { slot_count * max_zones * 2 }, frame_query { calibration_query + 1 },
+    slots(slot_count), current_slot { 0 }, recording { false }, zone_open { false }, track { nullptr } {
+  auto valid_bits = physical_device.getQueueFamilyProperties()[queue_family].timestampValidBits;
+  supported = (valid_bits > 0);
+  timestamp_period = static_cast<double>(physical_device.getProperties().limits.timestampPeriod);
+  timestamp_mask = (valid_bits >= 64 ? ~uint64_t { 0 } : (uint64_t { 1 } << valid_bits) - 1);
+  if (!supported) {
+    return;
+  }
+
+  vk::QueryPoolCreateInfo create_info {
+    .queryType = vk::QueryType::eTimestamp,
+    .queryCount = frame_query + slot_count * 2
+  };
+  query_pool = vk::raii::QueryPool { device, create_info };
+  track = Profiler::create_track("GPU");
+}
+
+void GpuProfiler::write_calibration(vk::raii::CommandBuffer& command_buffer) {
+  if (!supported) {
+    return;
+  }
+  command_buffer.resetQueryPool(*query_pool, calibration_query, 1);
+  command_buffer.writeTimestamp2(vk::PipelineStageFlagBits2::eAllCommands, *query_pool, calibration_query);
+}
+
+void GpuProfiler::calibrate(int64_t cpu_before, int64_t cpu_after) {
+  if (!supported) {
+    return;
+  }
+  auto timestamp = query_pool.getResult<uint64_t>(
+    calibration_query, 1, sizeof(uint64_t), vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait
+  ).second;
+  auto gpu_time = static_cast<double>(timestamp & timestamp_mask) * timestamp_period;
+  clock_offset = (cpu_before + cpu_after) / 2 - static_cast<int64_t>(gpu_time);
+}
+
+void GpuProfiler::begin_frame(vk::raii::CommandBuffer& command_buffer, uint32_t slot) {
+  current_slot = slot;
+  slots[slot].zone_count = 0;
+  slots[slot].frame_pending = supported;
+  recording = supported && Profiler::is_enabled();
+  if (recording) {
+    command_buffer.resetQueryPool(*query_pool, slot * max_zones * 2, max_zones * 2);
+  }
+  if (supported) {
+    command_buffer.resetQueryPool(*query_pool, frame_query + slot * 2, 2);
+    command_buffer.writeTimestamp2(vk::PipelineStageFlagBits2::eAllCommands, *query_pool, frame_query + slot * 2);
+  }
+}
+
+void GpuProfiler::end_frame(vk::raii::CommandBuffer& command_buffer) {
+  if (supported) {
+    command_buffer.writeTimestamp2(
+      vk::PipelineStageFlagBits2::eAllCommands, *query_pool, frame_query + current_slot * 2 + 1
+    );
+  }
+}
+
+void GpuProfiler::begin_zone(vk::raii::CommandBuffer& command_buffer, const char* name) {
+  auto& slot = slots[current_slot];
+  zone_open = recording && slot.zone_count < max_zones;
+  if (!zone_open) {
+    return;
+  }
+  slot.names[slot.zone_count] = name;
+  uint32_t query = (current_slot * max_zones + slot.zone_count) * 2;
+  command_buffer.writeTimestamp2(vk::PipelineStageFlagBits2::eAllCommands, *query_pool, query);
+}
+
+void GpuProfiler::end_zone(vk::raii::CommandBuffer& command_buffer) {
+  if (!zone_open) {
+    return;
+  }
+  auto& slot = slots[current_slot];
+  uint32_t query = (current_slot * max_zones + slot.zone_count) * 2 + 1;
+  command_buffer.writeTimestamp2(vk::PipelineStageFlagBits2::eAllCommands, *query_pool, query);
+  ++slot.zone_count;
+  zone_open = false;
+}
+
+void GpuProfiler::collect(uint32_t slot) {
+  slots[slot].frame_milliseconds.reset();
+  if (std::exchange(slots[slot].frame_pending, false)) {
+    // Read one at a time, unlike a range that would allocate every frame
+    auto flags = vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait;
+    auto begin = query_pool.getResult<uint64_t>(frame_query + slot * 2, 1, sizeof(uint64_t), flags).second;
+    auto end = query_pool.getResult<uint64_t>(frame_query + slot * 2 + 1, 1, sizeof(uint64_t), flags).second;
+    auto ticks = (end - begin) & timestamp_mask;
+    slots[slot].frame_milliseconds = static_cast<double>(ticks) * timestamp_period / 1e6;
+  }
+
+  uint32_t zone_count = std::exchange(slots[slot].zone_count, 0);
+  if (zone_count == 0) {
+    return;
+  }
+
+  uint32_t query_count = zone_count * 2;
+  auto timestamps = query_pool.getResults<uint64_t>(
+    slot * max_zones * 2, query_count, query_count * sizeof(uint64_t), sizeof(uint64_t),
+    vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait
+  ).second;
+  for (uint32_t i = 0; i < zone_count; ++i) {
+    Profiler::record(
+      track, slots[slot].names[i], to_profiler_time(timestamps[2 * i]), to_profiler_time(timestamps[2 * i + 1])
+    );
+  }
+}
+
+auto GpuProfiler::to_profiler_time(uint64_t timestamp) const -> int64_t {
+  return static_cast<int64_t>(static_cast<double>(timestamp & timestamp_mask) * timestamp_period) + clock_offset;
+}
\ No newline at end of file
@@ -0,0 +1,62 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <vector>
+#define VULKAN_HPP_NO_CONSTRUCTORS
+#include <vulkan/vulkan.hpp>
+#include <vulkan/vulkan_raii.hpp>
+#include "profiler.h"
+
+// Times ranges of a command buffer with timestamp queries and adds them to the profiler's GPU track.
+// Like frame capture it keeps one slot per frame in flight and reads a slot back only after the
+// fence of its frame has signalled, so reading results never stalls. The whole frame is timed even
+// while the profiler is disabled, the engine balances its frames in flight with it.
+class GpuProfiler {
+public:
+  static constexpr uint32_t max_zones = 32;
+
+  GpuProfiler(const vk::raii::PhysicalDevice&, const vk::raii::Device&, uint32_t queue_family, uint32_t slot_count);
+
+  // Queues without timestamp support leave every call a no-op
+  bool is_supported() const { return supported; }
+
+  // The GPU clock is mapped onto the profiler's by writing a timestamp in a submission of its own,
+  // which lands between the CPU times read before submitting and after it finished
+  void write_calibration(vk::raii::CommandBuffer&);
+  void calibrate(int64_t cpu_before, int64_t cpu_after);
+
+  // Zones are only written into frames begun while the profiler is enabled
+  void begin_frame(vk::raii::CommandBuffer&, uint32_t slot);
+  void end_frame(vk::raii::CommandBuffer&);
+  void begin_zone(vk::raii::CommandBuffer&, const char* name);
+  void end_zone(vk::raii::CommandBuffer&);
+  void collect(uint32_t slot);
+  // GPU time between the slot's begin_frame and end_frame, set by collect and empty until then
+  auto get_frame_milliseconds(uint32_t slot) const -> std::optional<double> { return slots[slot].frame_milliseconds; }
+
+private:
+  struct Slot {
+    std::array<const char*, max_zones> names;
+    uint32_t zone_count;
+    bool frame_pending;
+    std::optional<double> frame_milliseconds;
+  };
+
+  auto to_profiler_time(uint64_t timestamp) const -> int64_t;
+
+  bool supported;
+  double timestamp_period;
+  uint64_t timestamp_mask;
+  int64_t clock_offset;
+  uint32_t calibration_query;
+  // Two queries per slot after the calibration query
+  uint32_t frame_query;
+
+  vk::raii::QueryPool query_pool { nullptr };
+  std::vector<Slot> slots;
+  uint32_t current_slot;
+  bool recording;
+  bool zone_open;
+  Profiler::Track* track;
+};
\ No newline at end of file
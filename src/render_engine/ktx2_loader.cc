@@ -0,0 +1,105 @@
+#include "ktx2_loader.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#include <fmt/core.h>
+#include "texture_decoder.h"
+#include "file_util.h"
+
+namespace {
+
+constexpr std::array<uint8_t, 12> ktx2_identifier {
+  0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+};
+
+struct Header {
+  std::array<uint8_t, 12> identifier;
+  uint32_t vk_format, type_size;
+  uint32_t pixel_width, pixel_height, pixel_depth;
+  uint32_t layer_count, face_count, level_count;
+  uint32_t supercompression_scheme;
+  uint32_t dfd_byte_offset, dfd_byte_length;
+  uint32_t kvd_byte_offset, kvd_byte_length;
+  uint64_t sgd_byte_offset, sgd_byte_length;
+};
+static_assert(sizeof(Header) == 80);
+
+struct LevelIndex {
+  uint64_t byte_offset, byte_length, uncompressed_byte_length;
+};
+static_assert(sizeof(LevelIndex) == 24);
+
+bool is_sampleable(const vk::raii::PhysicalDevice& physical_device, vk::Format format) {
+  using enum vk::FormatFeatureFlagBits;
+  auto features = physical_device.getFormatProperties(format).optimalTilingFeatures;
+  return (features & eSampledImage) && (features & eSampledImageFilterLinear);
+}
+
+}
+
+auto load_ktx2(const std::string& path, const vk::raii::PhysicalDevice& physical_device) -> TextureSource {
+  auto file = read_file(path);
+
+  Header header;
+  if (file.size() < sizeof(Header)) {
+    throw std::runtime_error(fmt::format("{} is not a KTX2 file", path));
+  }
+  std::memcpy(&header, file.data(), sizeof(Header));
+  if (header.identifier != ktx2_identifier) {
+    throw std::runtime_error(fmt::format("{} is not a KTX2 file", path));
+  }
+
+  if (header.vk_format == VK_FORMAT_UNDEFINED || header.supercompression_scheme != 0) {
+    throw std::runtime_error(fmt::format("{}: Basis Universal and supercompressed textures are not supported", path));
+  }
+  if (header.pixel_height == 0 || header.pixel_depth > 1 || header.layer_count > 1 || header.face_count != 1) {
+    throw std::runtime_error(fmt::format("{}: only single 2D textures are supported", path));
+  }
+
+  auto format = static_cast<vk::Format>(header.vk_format);
+  auto info = get_format_info(format);
+  if (!info) {
+    throw std::runtime_error(fmt::format("{}: unsupported format {}", path, vk::to_string(format)));
+  }
+
+  // A level count of zero asks for the mip chain to be generated
+  uint32_t level_count = std::max(header.level_count, 1u);
+  if (sizeof(Header) + size_t { level_count } * sizeof(LevelIndex) > file.size()) {
+    throw std::runtime_error(fmt::format("{}: level index is truncated", path));
+  }
+
+  TextureSource source {
+    .format = format,
+    .levels = {},
+    .data = {}
+  };
+
+  for (uint32_t level = 0; level < level_count; ++level) {
+    LevelIndex index;
+    std::memcpy(&index, file.data() + sizeof(Header) + level * sizeof(LevelIndex), sizeof(LevelIndex));
+
+    vk::Extent2D extent {
+      .width = std::max(header.pixel_width >> level, 1u),
+      .height = std::max(header.pixel_height >> level, 1u)
+    };
+    size_t size = get_level_size(*info, extent);
+    if (index.byte_length < size || index.byte_offset + size > file.size()) {
+      throw std::runtime_error(fmt::format("{}: level {} is truncated", path, level));
+    }
+
+    source.levels.push_back({ .extent = extent, .offset = source.data.size(), .size = size });
+    auto begin = file.begin() + static_cast<ptrdiff_t>(index.byte_offset);
+    source.data.insert(source.data.end(), begin, begin + static_cast<ptrdiff_t>(size));
+  }
+
+  if (!is_sampleable(physical_device, format)) {
+    if (!info->compressed || !can_decode(format)) {
+      throw std::runtime_error(fmt::format("{}: format {} is not supported by the device", path, vk::to_string(format)));
+    }
+    fmt::println("{}: format {} is not supported by the device, decoding to RGBA8", path, vk::to_string(format));
+    source = decode_to_rgba8(source);
+  }
+
+  return source;
+}
\ No newline at end of file
@@ -0,0 +1,10 @@
+#pragma once
+#include <string>
+#define VULKAN_HPP_NO_CONSTRUCTORS
+#include <vulkan/vulkan.hpp>
+#include <vulkan/vulkan_raii.hpp>
+#include "texture_source.h"
+
+// Loads a 2D texture from a KTX2 file without supercompression. Formats the device cannot sample
+// are decoded to RGBA8 on the CPU when a decoder exists, otherwise loading fails.
+auto load_ktx2(const std::string& path, const vk::raii::PhysicalDevice&) -> TextureSource;
\ No newline at end of file
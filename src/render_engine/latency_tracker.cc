@@ -0,0 +1,95 @@
+#include "latency_tracker.h"
+#include <algorithm>
+#include <fmt/core.h>
+
+LatencyTracker::LatencyTracker(Clock::duration _report_interval)
+  : report_interval { _report_interval }, last_report { Clock::now() }, has_pending_input { false }, frames {} {}
+
+void LatencyTracker::record_input(Clock::time_point time) {
+  // The oldest event since the last frame is the one that waited the longest
+  if (!has_pending_input) {
+    pending_input = time;
+    has_pending_input = true;
+  }
+}
+
+void LatencyTracker::begin_frame(uint64_t frame_id, Clock::time_point time) {
+  auto& frame = frames[frame_id % frame_history];
+  frame = {
+    .id = frame_id,
+    .has_input = has_pending_input,
+    .displayed = false,
+    .input = pending_input,
+    .stages = {}
+  };
+  frame.stages.fill(time);
+  has_pending_input = false;
+}
+
+void LatencyTracker::record_stage(uint64_t frame_id, Stage stage, Clock::time_point time) {
+  auto& frame = frames[frame_id % frame_history];
+  if (frame.id == frame_id) {
+    frame.stages[static_cast<size_t>(stage)] = time;
+  }
+}
+
+void LatencyTracker::record_displayed(uint64_t frame_id, Clock::time_point time) {
+  auto& frame = frames[frame_id % frame_history];
+  if (frame.id != frame_id || frame.displayed) {
+    return;
+  }
+  frame.displayed = true;
+
+  auto stage = [&frame] (Stage s) { return frame.stages[static_cast<size_t>(s)]; };
+  if (frame.has_input) {
+    input_to_display.add(time - frame.input);
+  }
+  frame_to_display.add(time - stage(Stage::eStart));
+  record_to_submit.add(stage(Stage::eSubmit) - stage(Stage::eRecord));
+  present_to_display.add(time - stage(Stage::ePresent));
+}
+
+bool LatencyTracker::is_displayed(uint64_t frame_id) const {
+  const auto& frame = frames[frame_id % frame_history];
+  return frame.id != frame_id || frame.displayed;
+}
+
+void LatencyTracker::Samples::add(Clock::duration duration) {
+  if (count < sample_capacity) {
+    values[count++] = std::chrono::duration<float, std::milli>(duration).count();
+  }
+}
+
+void LatencyTracker::Samples::report(std::string_view name) {
+  if (count == 0) {
+    fmt::println("  {:<18} no samples", name);
+    return;
+  }
+
+  auto end = values.begin() + static_cast<ptrdiff_t>(count);
+  auto percentile = [this, end] (float p) {
+    auto nth = values.begin() + static_cast<ptrdiff_t>(p * static_cast<float>(count - 1));
+    std::nth_element(values.begin(), nth, end);
+    return *nth;
+  };
+
+  fmt::println(
+    "  {:<18} p50 {:6.2f} ms  p90 {:6.2f} ms  p99 {:6.2f} ms  max {:6.2f} ms  ({} samples)",
+    name, percentile(0.5f), percentile(0.9f), percentile(0.99f), percentile(1.0f), count
+  );
+  count = 0;
+}
+
+void LatencyTracker::report_if_due(std::string_view display_source) {
+  auto now = Clock::now();
+  if (now - last_report < report_interval) {
+    return;
+  }
+  last_report = now;
+
+  fmt::println("latency, display time from {}:", display_source);
+  input_to_display.report("input to display");
+  frame_to_display.report("frame to display");
+  record_to_submit.report("record to submit");
+  present_to_display.report("present to display");
+}
\ No newline at end of file
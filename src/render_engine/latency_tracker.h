@@ -0,0 +1,55 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+
+// Follows every frame, and the input it answers, through recording, submission and presentation.
+// Input events arriving between two frames are answered by the next frame to start.
+class LatencyTracker {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  enum class Stage {
+    eStart, eRecord, eSubmit, ePresent
+  };
+
+  explicit LatencyTracker(Clock::duration report_interval);
+
+  void record_input(Clock::time_point);
+  void begin_frame(uint64_t frame_id, Clock::time_point);
+  void record_stage(uint64_t frame_id, Stage, Clock::time_point);
+  // The time the frame reached the display, or the closest approximation available
+  void record_displayed(uint64_t frame_id, Clock::time_point);
+  bool is_displayed(uint64_t frame_id) const;
+
+  void report_if_due(std::string_view display_source);
+
+private:
+  static constexpr size_t frame_history = 16;
+  static constexpr size_t sample_capacity = 1024;
+
+  struct FrameRecord {
+    uint64_t id;
+    bool has_input, displayed;
+    Clock::time_point input;
+    std::array<Clock::time_point, 4> stages;
+  };
+
+  struct Samples {
+    std::array<float, sample_capacity> values;
+    size_t count = 0;
+
+    void add(Clock::duration);
+    void report(std::string_view name);
+  };
+
+  Clock::duration report_interval;
+  Clock::time_point last_report;
+
+  bool has_pending_input;
+  Clock::time_point pending_input;
+  std::array<FrameRecord, frame_history> frames;
+
+  Samples input_to_display, frame_to_display, record_to_submit, present_to_display;
+};
\ No newline at end of file
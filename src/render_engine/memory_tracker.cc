@@ -0,0 +1,211 @@
+#include "memory_tracker.h"
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <fmt/core.h>
+
+namespace {
+
+constexpr std::array<std::string_view, memory_category_count> category_names {
+  "vertex", "index", "uniform", "instance", "staging", "texture", "render target", "readback", "storage"
+};
+
+float to_mib(vk::DeviceSize size) {
+  return static_cast<float>(size) / (1024.0f * 1024.0f);
+}
+
+}
+
+DeviceAllocation::DeviceAllocation(
+  MemoryTracker& _tracker, vk::raii::DeviceMemory _memory, uint32_t _heap, MemoryCategory _category, vk::DeviceSize _size)
+  : tracker { &_tracker }, memory { std::move(_memory) }, heap { _heap }, category { _category }, size { _size } {}
+
+DeviceAllocation::~DeviceAllocation() {
+  release();
+}
+
+DeviceAllocation::DeviceAllocation(DeviceAllocation&& other) noexcept
+  : tracker { std::exchange(other.tracker, nullptr) }, memory { std::move(other.memory) },
+    heap { other.heap }, category { other.category }, size { std::exchange(other.size, 0) } {}
+
+DeviceAllocation& DeviceAllocation::operator=(DeviceAllocation&& other) noexcept {
+  if (this != &other) {
+    release();
+    tracker = std::exchange(other.tracker, nullptr);
+    memory = std::move(other.memory);
+    heap = other.heap;
+    category = other.category;
+    size = std::exchange(other.size, 0);
+  }
+  return *this;
+}
+
+void DeviceAllocation::release() {
+  memory.clear();
+  if (tracker != nullptr) {
+    tracker->release(heap, category, size);
+    tracker = nullptr;
+  }
+}
+
+MemoryTracker::MemoryTracker(
+  const vk::raii::PhysicalDevice& _physical_device, const vk::raii::Device& _device, bool _budget_supported)
+  : physical_device { _physical_device }, device { _device }, budget_supported { _budget_supported },
+    memory_properties { _physical_device.getMemoryProperties() },
+    report_interval { std::chrono::seconds(10) }, last_report { Clock::now() } {
+  heaps.resize(memory_properties.memoryHeapCount);
+  for (uint32_t i = 0; i < memory_properties.memoryHeapCount; ++i) {
+    const auto& heap = memory_properties.memoryHeaps[i];
+    heaps[i] = {
+      .size = heap.size,
+      .budget = static_cast<vk::DeviceSize>(static_cast<float>(heap.size) * fallback_budget_share),
+      .driver_usage = 0,
+      .tracked = 0,
+      .tracked_at_query = 0,
+      .peak = 0,
+      .categories = {},
+      .device_local = static_cast<bool>(heap.flags & vk::MemoryHeapFlagBits::eDeviceLocal)
+    };
+  }
+
+  std::lock_guard lock { mutex };
+  update_budget();
+}
+
+auto MemoryTracker::find_memory_type(uint32_t type_filter, vk::MemoryPropertyFlags flags) const -> uint32_t {
+  for (uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i) {
+    if (type_filter & (1 << i) && (memory_properties.memoryTypes[i].propertyFlags & flags) == flags) {
+      return i;
+    }
+  }
+  throw std::runtime_error("Failed to find suitable memory type.");
+}
+
+auto MemoryTracker::get_heap_index(uint32_t memory_type) const -> uint32_t {
+  return memory_properties.memoryTypes[memory_type].heapIndex;
+}
+
+void MemoryTracker::update_budget() {
+  if (!budget_supported) {
+    return;
+  }
+
+  auto properties = physical_device.getMemoryProperties2<
+    vk::PhysicalDeviceMemoryProperties2, vk::PhysicalDeviceMemoryBudgetPropertiesEXT
+  >();
+  const auto& budget = properties.get<vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+  for (size_t i = 0; i < heaps.size(); ++i) {
+    heaps[i].budget = budget.heapBudget[i];
+    heaps[i].driver_usage = budget.heapUsage[i];
+    heaps[i].tracked_at_query = heaps[i].tracked;
+  }
+}
+
+auto MemoryTracker::get_usage(const Heap& heap) const -> vk::DeviceSize {
+  if (!budget_supported) {
+    return heap.tracked;
+  }
+  // The driver numbers lag behind, so add what changed since they were queried
+  auto usage = heap.driver_usage + heap.tracked - heap.tracked_at_query;
+  return std::max(usage, heap.tracked);
+}
+
+bool MemoryTracker::fits_budget(uint32_t heap_index, vk::DeviceSize size) {
+  std::lock_guard lock { mutex };
+  update_budget();
+  const auto& heap = heaps[heap_index];
+  auto limit = static_cast<vk::DeviceSize>(static_cast<float>(heap.budget) * budget_usage_limit);
+  return get_usage(heap) + size <= limit;
+}
+
+auto MemoryTracker::allocate(
+  vk::DeviceSize size, uint32_t memory_type, MemoryCategory category, vk::MemoryAllocateFlags flags) -> DeviceAllocation {
+  uint32_t heap_index = get_heap_index(memory_type);
+
+  // Evictors free allocations themselves, so they run without holding the lock
+  for (size_t i = 0; !fits_budget(heap_index, size); ++i) {
+    if (i == evictors.size()) {
+      throw std::runtime_error(fmt::format(
+        "Allocating {:.2f} MiB of {} memory would exceed the budget of heap {}",
+        to_mib(size), category_names[static_cast<size_t>(category)], heap_index
+      ));
+    }
+    evictors[i](heap_index, size);
+  }
+
+  vk::MemoryAllocateFlagsInfo allocate_flags_info {
+    .flags = flags
+  };
+
+  vk::MemoryAllocateInfo allocate_info {
+    .pNext = (flags ? &allocate_flags_info : nullptr),
+    .allocationSize = size,
+    .memoryTypeIndex = memory_type
+  };
+  vk::raii::DeviceMemory memory { device, allocate_info };
+
+  {
+    std::lock_guard lock { mutex };
+    auto& heap = heaps[heap_index];
+    heap.tracked += size;
+    heap.categories[static_cast<size_t>(category)] += size;
+    heap.peak = std::max(heap.peak, heap.tracked);
+  }
+  return DeviceAllocation { *this, std::move(memory), heap_index, category, size };
+}
+
+void MemoryTracker::release(uint32_t heap_index, MemoryCategory category, vk::DeviceSize size) {
+  std::lock_guard lock { mutex };
+  auto& heap = heaps[heap_index];
+  heap.tracked -= size;
+  heap.categories[static_cast<size_t>(category)] -= size;
+}
+
+void MemoryTracker::add_evictor(Evictor evictor) {
+  evictors.push_back(std::move(evictor));
+}
+
+void MemoryTracker::report_if_due() {
+  auto now = Clock::now();
+  if (now - last_report < report_interval) {
+    return;
+  }
+  last_report = now;
+  report();
+}
+
+auto MemoryTracker::get_category_sizes() -> std::array<vk::DeviceSize, memory_category_count> {
+  std::lock_guard lock { mutex };
+  std::array<vk::DeviceSize, memory_category_count> sizes {};
+  for (const auto& heap : heaps) {
+    for (size_t category = 0; category < memory_category_count; ++category) {
+      sizes[category] += heap.categories[category];
+    }
+  }
+  return sizes;
+}
+
+auto MemoryTracker::get_category_name(MemoryCategory category) -> std::string_view {
+  return category_names[static_cast<size_t>(category)];
+}
+
+void MemoryTracker::report() {
+  std::lock_guard lock { mutex };
+  update_budget();
+
+  fmt::println("memory, budget from {}:", budget_supported ? "VK_EXT_memory_budget" : "heap size");
+  for (size_t i = 0; i < heaps.size(); ++i) {
+    const auto& heap = heaps[i];
+    fmt::println(
+      "  heap {} ({}): {:.2f} / {:.2f} MiB budget, {:.2f} MiB tracked, {:.2f} MiB peak, {:.2f} MiB heap",
+      i, heap.device_local ? "device local" : "host", to_mib(get_usage(heap)), to_mib(heap.budget),
+      to_mib(heap.tracked), to_mib(heap.peak), to_mib(heap.size)
+    );
+
+    for (size_t category = 0; category < memory_category_count; ++category) {
+      if (heap.categories[category] > 0) {
+        fmt::println("    {:<14} {:.2f} MiB", category_names[category], to_mib(heap.categories[category]));
+      }
+    }
+  }
+}
\ No newline at end of file
@@ -0,0 +1,101 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string_view>
+#include <vector>
+#define VULKAN_HPP_NO_CONSTRUCTORS
+#include <vulkan/vulkan.hpp>
+#include <vulkan/vulkan_raii.hpp>
+
+enum class MemoryCategory : uint32_t {
+  eVertex, eIndex, eUniform, eInstance, eStaging, eTexture, eRenderTarget, eReadback, eStorage
+};
+constexpr size_t memory_category_count = 9;
+
+class MemoryTracker;
+
+// Device memory that gives its bytes back to the tracker when it is freed
+class DeviceAllocation {
+public:
+  DeviceAllocation() = default;
+  DeviceAllocation(MemoryTracker&, vk::raii::DeviceMemory, uint32_t heap, MemoryCategory, vk::DeviceSize);
+  ~DeviceAllocation();
+
+  DeviceAllocation(DeviceAllocation&&) noexcept;
+  DeviceAllocation& operator=(DeviceAllocation&&) noexcept;
+  DeviceAllocation(const DeviceAllocation&) = delete;
+  DeviceAllocation& operator=(const DeviceAllocation&) = delete;
+
+  auto operator*() const -> vk::DeviceMemory { return *memory; }
+  auto map(vk::DeviceSize offset, vk::DeviceSize size) -> void* { return memory.mapMemory(offset, size); }
+  void unmap() { memory.unmapMemory(); }
+  auto get_size() const -> vk::DeviceSize { return size; }
+
+private:
+  void release();
+
+  MemoryTracker* tracker = nullptr;
+  vk::raii::DeviceMemory memory { nullptr };
+  uint32_t heap = 0;
+  MemoryCategory category = MemoryCategory::eVertex;
+  vk::DeviceSize size = 0;
+};
+
+// Accounts every device allocation per heap and category and keeps heaps under their budget.
+// The budget comes from VK_EXT_memory_budget when the device supports it, which also covers
+// memory used by other processes, and is otherwise a fixed share of the heap size.
+class MemoryTracker {
+public:
+  using Clock = std::chrono::steady_clock;
+  // Frees memory from the heap, called when an allocation of the given size would exceed the budget
+  using Evictor = std::function<void(uint32_t heap, vk::DeviceSize size)>;
+
+  MemoryTracker(const vk::raii::PhysicalDevice&, const vk::raii::Device&, bool budget_supported);
+
+  auto find_memory_type(uint32_t type_filter, vk::MemoryPropertyFlags) const -> uint32_t;
+  auto get_heap_index(uint32_t memory_type) const -> uint32_t;
+  bool fits_budget(uint32_t heap, vk::DeviceSize);
+
+  // Evicts when the allocation would exceed the budget and throws if that does not make room
+  auto allocate(vk::DeviceSize, uint32_t memory_type, MemoryCategory, vk::MemoryAllocateFlags = {}) -> DeviceAllocation;
+
+  // Evictors are registered during setup and called in registration order
+  void add_evictor(Evictor);
+
+  void report_if_due();
+  void report();
+  // Bytes currently allocated in each category, summed over all heaps
+  auto get_category_sizes() -> std::array<vk::DeviceSize, memory_category_count>;
+  static auto get_category_name(MemoryCategory) -> std::string_view;
+
+private:
+  friend class DeviceAllocation;
+
+  static constexpr float budget_usage_limit = 0.95f;
+  static constexpr float fallback_budget_share = 0.8f;
+
+  struct Heap {
+    vk::DeviceSize size, budget, driver_usage;
+    vk::DeviceSize tracked, tracked_at_query, peak;
+    std::array<vk::DeviceSize, memory_category_count> categories;
+    bool device_local;
+  };
+
+  void update_budget();
+  auto get_usage(const Heap&) const -> vk::DeviceSize;
+  void release(uint32_t heap, MemoryCategory, vk::DeviceSize);
+
+  const vk::raii::PhysicalDevice& physical_device;
+  const vk::raii::Device& device;
+  bool budget_supported;
+  vk::PhysicalDeviceMemoryProperties memory_properties;
+
+  std::mutex mutex;
+  std::vector<Heap> heaps;
+  std::vector<Evictor> evictors;
+
+  Clock::duration report_interval;
+  Clock::time_point last_report;
+};
\ No newline at end of file
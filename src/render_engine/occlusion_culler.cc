@@ -0,0 +1,371 @@
+#include "occlusion_culler.h"
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+
+namespace {
+
+auto create_bindings(std::span<const vk::DescriptorType> types) -> std::vector<vk::DescriptorSetLayoutBinding> {
+  std::vector<vk::DescriptorSetLayoutBinding> bindings;
+  for (uint32_t i = 0; i < types.size(); ++i) {
+    bindings.push_back({
+      .binding = i,
+      .descriptorType = types[i],
+      .descriptorCount = 1,
+      .stageFlags = vk::ShaderStageFlagBits::eCompute
+    });
+  }
+  return bindings;
+}
+
+constexpr std::array cull_bindings {
+  vk::DescriptorType::eCombinedImageSampler,
+  vk::DescriptorType::eStorageBuffer,
+  vk::DescriptorType::eStorageBuffer,
+  vk::DescriptorType::eStorageBuffer
+};
+
+constexpr std::array reduce_bindings {
+  vk::DescriptorType::eCombinedImageSampler,
+  vk::DescriptorType::eStorageImage
+};
+
+}
+
+OcclusionCuller::OcclusionCuller(
+  const vk::raii::Device& _device, MemoryTracker& memory_tracker, vk::Extent2D depth_extent, uint32_t _max_candidates,
+  uint32_t _max_meshes, uint32_t slot_count)
+  : device { _device }, max_candidates { _max_candidates }, max_meshes { _max_meshes },
+    cull_pipeline {
+      device, "shaders/occlusion_cull.comp.spv", create_bindings(cull_bindings), sizeof(CullConstants), local_size
+    },
+    reduce_pipeline {
+      device, "shaders/hiz_reduce.comp.spv", create_bindings(reduce_bindings), sizeof(ReduceConstants), local_size
+    } {
+  // Only texel fetches read through the sampler, filtering never applies
+  vk::SamplerCreateInfo sampler_create_info {
+    .magFilter = vk::Filter::eNearest,
+    .minFilter = vk::Filter::eNearest,
+    .mipmapMode = vk::SamplerMipmapMode::eNearest,
+    .addressModeU = vk::SamplerAddressMode::eClampToEdge,
+    .addressModeV = vk::SamplerAddressMode::eClampToEdge,
+    .addressModeW = vk::SamplerAddressMode::eClampToEdge,
+    .maxLod = VK_LOD_CLAMP_NONE
+  };
+  sampler = vk::raii::Sampler { device, sampler_create_info };
+
+  create_pyramid(memory_tracker, depth_extent);
+
+  auto level_count = get_pyramid_levels();
+  std::array pool_sizes {
+    vk::DescriptorPoolSize {
+      .type = vk::DescriptorType::eCombinedImageSampler,
+      .descriptorCount = slot_count + level_count
+    },
+    vk::DescriptorPoolSize {
+      .type = vk::DescriptorType::eStorageBuffer,
+      .descriptorCount = 3 * slot_count
+    },
+    vk::DescriptorPoolSize {
+      .type = vk::DescriptorType::eStorageImage,
+      .descriptorCount = level_count
+    }
+  };
+  vk::DescriptorPoolCreateInfo pool_create_info {
+    .flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
+    .maxSets = slot_count + level_count,
+    .poolSizeCount = static_cast<uint32_t>(pool_sizes.size()),
+    .pPoolSizes = pool_sizes.data()
+  };
+  descriptor_pool = vk::raii::DescriptorPool { device, pool_create_info };
+
+  std::vector<vk::DescriptorSetLayout> reduce_layouts(level_count, reduce_pipeline.get_descriptor_set_layout());
+  vk::DescriptorSetAllocateInfo allocate_info {
+    .descriptorPool = *descriptor_pool,
+    .descriptorSetCount = level_count,
+    .pSetLayouts = reduce_layouts.data()
+  };
+  reduce_descriptor_sets = device.allocateDescriptorSets(allocate_info);
+
+  create_slots(memory_tracker, slot_count);
+}
+
+void OcclusionCuller::create_pyramid(MemoryTracker& memory_tracker, vk::Extent2D extent) {
+  level_extents.push_back(extent);
+  while (extent.width > 1 || extent.height > 1) {
+    extent = { std::max(1u, extent.width / 2), std::max(1u, extent.height / 2) };
+    level_extents.push_back(extent);
+  }
+
+  using enum vk::ImageUsageFlagBits;
+  vk::ImageCreateInfo create_info {
+    .imageType = vk::ImageType::e2D,
+    .format = pyramid_format,
+    .extent = { level_extents.front().width, level_extents.front().height, 1 },
+    .mipLevels = get_pyramid_levels(),
+    .arrayLayers = 1,
+    .samples = vk::SampleCountFlagBits::e1,
+    .tiling = vk::ImageTiling::eOptimal,
+    .usage = eStorage | eSampled | eTransferDst,
+    .sharingMode = vk::SharingMode::eExclusive,
+    .initialLayout = vk::ImageLayout::eUndefined
+  };
+  pyramid = vk::raii::Image { device, create_info };
+
+  auto requirements = pyramid.getMemoryRequirements();
+  uint32_t memory_type = memory_tracker.find_memory_type(
+    requirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal
+  );
+  pyramid_memory = memory_tracker.allocate(requirements.size, memory_type, MemoryCategory::eRenderTarget);
+  pyramid.bindMemory(*pyramid_memory, 0);
+
+  auto create_view = [&] (uint32_t base_level, uint32_t level_count) {
+    vk::ImageViewCreateInfo view_create_info {
+      .image = *pyramid,
+      .viewType = vk::ImageViewType::e2D,
+      .format = pyramid_format,
+      .subresourceRange = {
+        .aspectMask = vk::ImageAspectFlagBits::eColor,
+        .baseMipLevel = base_level,
+        .levelCount = level_count,
+        .baseArrayLayer = 0,
+        .layerCount = 1
+      }
+    };
+    return vk::raii::ImageView { device, view_create_info };
+  };
+
+  pyramid_view = create_view(0, get_pyramid_levels());
+  for (uint32_t level = 0; level < get_pyramid_levels(); ++level) {
+    level_views.push_back(create_view(level, 1));
+  }
+}
+
+void OcclusionCuller::create_slots(MemoryTracker& memory_tracker, uint32_t slot_count) {
+  using enum vk::BufferUsageFlagBits;
+  using enum vk::MemoryPropertyFlagBits;
+
+  auto create_buffer = [&] (
+    vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags properties, MemoryCategory category) {
+    vk::BufferCreateInfo create_info {
+      .size = size,
+      .usage = usage,
+      .sharingMode = vk::SharingMode::eExclusive
+    };
+    vk::raii::Buffer buffer { device, create_info };
+    auto requirements = buffer.getMemoryRequirements();
+    uint32_t memory_type = memory_tracker.find_memory_type(requirements.memoryTypeBits, properties);
+    auto memory = memory_tracker.allocate(requirements.size, memory_type, category);
+    buffer.bindMemory(*memory, 0);
+    return std::make_pair(std::move(buffer), std::move(memory));
+  };
+
+  vk::DeviceSize meshes_size = sizeof(MeshInfo) * std::max(max_meshes, 1u);
+  std::tie(mesh_buffer, mesh_memory) =
+    create_buffer(meshes_size, eStorageBuffer, eHostVisible | eHostCoherent, MemoryCategory::eStorage);
+  meshes = { static_cast<MeshInfo*>(mesh_memory.map(0, meshes_size)), max_meshes };
+
+  std::vector<vk::DescriptorSetLayout> layouts(slot_count, cull_pipeline.get_descriptor_set_layout());
+  vk::DescriptorSetAllocateInfo allocate_info {
+    .descriptorPool = *descriptor_pool,
+    .descriptorSetCount = slot_count,
+    .pSetLayouts = layouts.data()
+  };
+  auto descriptor_sets = device.allocateDescriptorSets(allocate_info);
+
+  vk::DeviceSize candidates_size = sizeof(OcclusionCandidate) * max_candidates;
+  slots.reserve(slot_count);
+  for (uint32_t i = 0; i < slot_count; ++i) {
+    auto [candidate_buffer, candidate_memory] =
+      create_buffer(candidates_size, eStorageBuffer, eHostVisible | eHostCoherent, MemoryCategory::eInstance);
+    auto [indirect_buffer, indirect_memory] =
+      create_buffer(get_indirect_buffer_size(), eStorageBuffer | eIndirectBuffer, eDeviceLocal, MemoryCategory::eStorage);
+    auto* candidates = static_cast<OcclusionCandidate*>(candidate_memory.map(0, candidates_size));
+
+    vk::DescriptorImageInfo pyramid_info {
+      .sampler = *sampler,
+      .imageView = *pyramid_view,
+      .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
+    };
+    vk::DescriptorBufferInfo candidate_info { .buffer = *candidate_buffer, .offset = 0, .range = VK_WHOLE_SIZE };
+    vk::DescriptorBufferInfo indirect_info { .buffer = *indirect_buffer, .offset = 0, .range = VK_WHOLE_SIZE };
+    vk::DescriptorBufferInfo mesh_info { .buffer = *mesh_buffer, .offset = 0, .range = VK_WHOLE_SIZE };
+    std::array writes {
+      vk::WriteDescriptorSet {
+        .dstSet = *descriptor_sets[i],
+        .dstBinding = 0,
+        .descriptorCount = 1,
+        .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+        .pImageInfo = &pyramid_info
+      },
+      vk::WriteDescriptorSet {
+        .dstSet = *descriptor_sets[i],
+        .dstBinding = 1,
+        .descriptorCount = 1,
+        .descriptorType = vk::DescriptorType::eStorageBuffer,
+        .pBufferInfo = &candidate_info
+      },
+      vk::WriteDescriptorSet {
+        .dstSet = *descriptor_sets[i],
+        .dstBinding = 2,
+        .descriptorCount = 1,
+        .descriptorType = vk::DescriptorType::eStorageBuffer,
+        .pBufferInfo = &indirect_info
+      },
+      vk::WriteDescriptorSet {
+        .dstSet = *descriptor_sets[i],
+        .dstBinding = 3,
+        .descriptorCount = 1,
+        .descriptorType = vk::DescriptorType::eStorageBuffer,
+        .pBufferInfo = &mesh_info
+      }
+    };
+    device.updateDescriptorSets(writes, nullptr);
+
+    slots.push_back({
+      .candidate_buffer = std::move(candidate_buffer),
+      .candidate_memory = std::move(candidate_memory),
+      .candidates = { candidates, max_candidates },
+      .indirect_buffer = std::move(indirect_buffer),
+      .indirect_memory = std::move(indirect_memory),
+      .descriptor_set = std::move(descriptor_sets[i])
+    });
+  }
+}
+
+auto OcclusionCuller::get_indirect_buffer_size() const -> vk::DeviceSize {
+  return sizeof(vk::DrawIndexedIndirectCommand) * max_candidates;
+}
+
+void OcclusionCuller::initialize(vk::raii::CommandBuffer& command_buffer) const {
+  using Stage = vk::PipelineStageFlagBits2;
+  using Access = vk::AccessFlagBits2;
+  vk::ImageSubresourceRange range {
+    .aspectMask = vk::ImageAspectFlagBits::eColor,
+    .baseMipLevel = 0,
+    .levelCount = vk::RemainingMipLevels,
+    .baseArrayLayer = 0,
+    .layerCount = 1
+  };
+
+  vk::ImageMemoryBarrier2 clear_barrier {
+    .srcStageMask = Stage::eNone,
+    .srcAccessMask = Access::eNone,
+    .dstStageMask = Stage::eClear,
+    .dstAccessMask = Access::eTransferWrite,
+    .oldLayout = vk::ImageLayout::eUndefined,
+    .newLayout = vk::ImageLayout::eTransferDstOptimal,
+    .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+    .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+    .image = *pyramid,
+    .subresourceRange = range
+  };
+  command_buffer.pipelineBarrier2({ .imageMemoryBarrierCount = 1, .pImageMemoryBarriers = &clear_barrier });
+
+  vk::ClearColorValue far_plane { std::array { 1.0f, 0.0f, 0.0f, 0.0f } };
+  command_buffer.clearColorImage(*pyramid, vk::ImageLayout::eTransferDstOptimal, far_plane, range);
+
+  // The layout the render graph expects after a reduction
+  vk::ImageMemoryBarrier2 reduced_barrier {
+    .srcStageMask = Stage::eClear,
+    .srcAccessMask = Access::eTransferWrite,
+    .dstStageMask = Stage::eComputeShader,
+    .dstAccessMask = Access::eShaderStorageRead | Access::eShaderStorageWrite,
+    .oldLayout = vk::ImageLayout::eTransferDstOptimal,
+    .newLayout = vk::ImageLayout::eGeneral,
+    .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+    .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+    .image = *pyramid,
+    .subresourceRange = range
+  };
+  command_buffer.pipelineBarrier2({ .imageMemoryBarrierCount = 1, .pImageMemoryBarriers = &reduced_barrier });
+}
+
+void OcclusionCuller::set_depth(vk::ImageView depth_view) {
+  std::vector<vk::DescriptorImageInfo> source_infos(get_pyramid_levels());
+  std::vector<vk::DescriptorImageInfo> destination_infos(get_pyramid_levels());
+  std::vector<vk::WriteDescriptorSet> writes;
+  for (uint32_t level = 0; level < get_pyramid_levels(); ++level) {
+    source_infos[level] = {
+      .sampler = *sampler,
+      .imageView = (level == 0 ? depth_view : *level_views[level - 1]),
+      .imageLayout = (level == 0 ? vk::ImageLayout::eShaderReadOnlyOptimal : vk::ImageLayout::eGeneral)
+    };
+    destination_infos[level] = {
+      .imageView = *level_views[level],
+      .imageLayout = vk::ImageLayout::eGeneral
+    };
+
+    writes.push_back({
+      .dstSet = *reduce_descriptor_sets[level],
+      .dstBinding = 0,
+      .descriptorCount = 1,
+      .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+      .pImageInfo = &source_infos[level]
+    });
+    writes.push_back({
+      .dstSet = *reduce_descriptor_sets[level],
+      .dstBinding = 1,
+      .descriptorCount = 1,
+      .descriptorType = vk::DescriptorType::eStorageImage,
+      .pImageInfo = &destination_infos[level]
+    });
+  }
+  device.updateDescriptorSets(writes, nullptr);
+}
+
+void OcclusionCuller::set_meshes(std::span<const DrawInfo> draws) {
+  if (draws.size() > max_meshes) {
+    throw std::runtime_error(
+      "Occlusion culler got " + std::to_string(draws.size()) + " meshes, its capacity is " + std::to_string(max_meshes)
+    );
+  }
+  for (size_t i = 0; i < draws.size(); ++i) {
+    meshes[i] = {
+      .index_count = draws[i].index_count,
+      .first_index = draws[i].first_index,
+      .vertex_offset = draws[i].vertex_offset,
+      .padding = 0
+    };
+  }
+}
+
+void OcclusionCuller::cull(
+  vk::raii::CommandBuffer& command_buffer, uint32_t slot, uint32_t candidate_count,
+  const glm::mat4& view_projection) const {
+  CullConstants constants {
+    .view_projection = view_projection,
+    .candidate_count = candidate_count
+  };
+  cull_pipeline.bind(command_buffer, *slots[slot].descriptor_set);
+  cull_pipeline.push_constants(command_buffer, constants);
+  cull_pipeline.dispatch(command_buffer, candidate_count);
+}
+
+void OcclusionCuller::build_pyramid(vk::raii::CommandBuffer& command_buffer) const {
+  // Each level reads the one before it, which the previous dispatch has to have finished writing
+  vk::MemoryBarrier2 level_barrier {
+    .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+    .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+    .dstAccessMask = vk::AccessFlagBits2::eShaderSampledRead
+  };
+
+  for (uint32_t level = 0; level < get_pyramid_levels(); ++level) {
+    if (level > 0) {
+      command_buffer.pipelineBarrier2({ .memoryBarrierCount = 1, .pMemoryBarriers = &level_barrier });
+    }
+
+    const auto& source = level_extents[level == 0 ? 0 : level - 1];
+    const auto& destination = level_extents[level];
+    ReduceConstants constants {
+      .source_extent = { source.width, source.height },
+      .destination_extent = { destination.width, destination.height }
+    };
+    reduce_pipeline.bind(command_buffer, *reduce_descriptor_sets[level]);
+    reduce_pipeline.push_constants(command_buffer, constants);
+    reduce_pipeline.dispatch(command_buffer, destination.width * destination.height);
+  }
+}
\ No newline at end of file
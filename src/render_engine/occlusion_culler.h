@@ -0,0 +1,116 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+#define VULKAN_HPP_NO_CONSTRUCTORS
+#include <vulkan/vulkan.hpp>
+#include <vulkan/vulkan_raii.hpp>
+#include <glm/glm.hpp>
+#include "compute_pipeline.h"
+#include "memory_tracker.h"
+
+// Matches the std430 layout of occlusion_cull.comp
+struct OcclusionCandidate {
+  glm::vec3 min;
+  uint32_t instance;
+  glm::vec3 max;
+  // Index into the meshes of OcclusionCuller::set_meshes
+  uint32_t mesh;
+};
+static_assert(sizeof(OcclusionCandidate) == 32);
+
+// Rejects instances hidden behind what the previous frame drew. After the main pass the depth buffer
+// is reduced into a hierarchical-Z pyramid whose texels hold the farthest depth below them, and before
+// the next main pass a compute shader tests the bounds of every candidate against the level at which
+// they cover at most 2x2 texels. Each candidate gets an indexed indirect draw of its mesh with one or
+// no instance, so draws keep their first instance and the vertex shaders are unchanged.
+class OcclusionCuller {
+public:
+  struct DrawInfo {
+    uint32_t index_count, first_index;
+    int32_t vertex_offset;
+  };
+
+  OcclusionCuller(
+    const vk::raii::Device&, MemoryTracker&, vk::Extent2D depth_extent, uint32_t max_candidates, uint32_t max_meshes,
+    uint32_t slot_count);
+
+  // Clears the pyramid to the far plane, nothing is occluded until the first reduction
+  void initialize(vk::raii::CommandBuffer&) const;
+  // The depth buffer belongs to the render graph, its view only exists once the graph is compiled
+  void set_depth(vk::ImageView);
+  // Where each mesh is in the geometry pool, only called while no cull is in flight
+  void set_meshes(std::span<const DrawInfo>);
+
+  // Host visible, the slot's candidates are written here before its commands are submitted
+  auto get_candidates(uint32_t slot) const -> std::span<OcclusionCandidate> { return slots[slot].candidates; }
+  auto get_indirect_buffer(uint32_t slot) const -> vk::Buffer { return *slots[slot].indirect_buffer; }
+  auto get_indirect_buffer_size() const -> vk::DeviceSize;
+  auto get_pyramid() const -> vk::Image { return *pyramid; }
+  auto get_pyramid_view() const -> vk::ImageView { return *pyramid_view; }
+  auto get_pyramid_extent() const -> vk::Extent2D { return level_extents.front(); }
+  auto get_pyramid_levels() const -> uint32_t { return static_cast<uint32_t>(level_extents.size()); }
+  static constexpr auto pyramid_format = vk::Format::eR32Sfloat;
+
+  // Writes the slot's indirect draws, view_projection is the one the pyramid was rendered with
+  void cull(
+    vk::raii::CommandBuffer&, uint32_t slot, uint32_t candidate_count, const glm::mat4& view_projection) const;
+  // Reduces the depth buffer level by level, the pass has to wait for depth writes and pyramid reads
+  void build_pyramid(vk::raii::CommandBuffer&) const;
+
+private:
+  struct CullConstants {
+    glm::mat4 view_projection;
+    uint32_t candidate_count;
+  };
+
+  // Matches the std430 layout of occlusion_cull.comp
+  struct MeshInfo {
+    uint32_t index_count, first_index;
+    int32_t vertex_offset;
+    uint32_t padding;
+  };
+
+  struct ReduceConstants {
+    glm::uvec2 source_extent;
+    glm::uvec2 destination_extent;
+  };
+
+  struct Slot {
+    vk::raii::Buffer candidate_buffer;
+    DeviceAllocation candidate_memory;
+    std::span<OcclusionCandidate> candidates;
+    vk::raii::Buffer indirect_buffer;
+    DeviceAllocation indirect_memory;
+    vk::raii::DescriptorSet descriptor_set;
+  };
+
+  static constexpr uint32_t local_size = 64;
+
+  void create_pyramid(MemoryTracker&, vk::Extent2D);
+  void create_slots(MemoryTracker&, uint32_t slot_count);
+
+  const vk::raii::Device& device;
+  uint32_t max_candidates;
+  uint32_t max_meshes;
+  ComputePipeline cull_pipeline;
+  ComputePipeline reduce_pipeline;
+  vk::raii::Sampler sampler { nullptr };
+  vk::raii::DescriptorPool descriptor_pool { nullptr };
+
+  // Host visible, shared by every slot
+  vk::raii::Buffer mesh_buffer { nullptr };
+  DeviceAllocation mesh_memory;
+  std::span<MeshInfo> meshes;
+
+  // Level 0 has the size of the depth buffer, every further level halves it rounding down
+  std::vector<vk::Extent2D> level_extents;
+  vk::raii::Image pyramid { nullptr };
+  DeviceAllocation pyramid_memory;
+  vk::raii::ImageView pyramid_view { nullptr };
+  // Level i is reduced from the depth buffer or level i - 1 through set i
+  std::vector<vk::raii::ImageView> level_views;
+  std::vector<vk::raii::DescriptorSet> reduce_descriptor_sets;
+
+  std::vector<Slot> slots;
+};
\ No newline at end of file
@@ -0,0 +1,274 @@
+#include "particle_system.h"
+#include <array>
+#include <cmath>
+#include <string>
+#include "file_util.h"
+
+namespace {
+
+// The shader mirrors these constants and functions
+constexpr float gravity = 4.0f;
+constexpr float restitution = 0.5f;
+
+auto hash(uint32_t x) -> uint32_t {
+  x ^= x >> 16;
+  x *= 0x7feb352du;
+  x ^= x >> 15;
+  x *= 0x846ca68bu;
+  x ^= x >> 16;
+  return x;
+}
+
+// Uniform in [0, 1), exact in single precision on both sides
+auto random(uint32_t& state) -> float {
+  state = hash(state);
+  return static_cast<float>(state >> 8) * (1.0f / 16777216.0f);
+}
+
+void respawn(Particle& particle, uint32_t index) {
+  particle.spawn_count += 1;
+  uint32_t state = (index * 0x9e3779b9u) ^ particle.spawn_count;
+  float angle = random(state) * 6.2831853f;
+  float radius = random(state) * 0.05f;
+  float speed = random(state) * 0.5f;
+  particle.position = { radius * std::cos(angle), radius * std::sin(angle), 0.0f };
+  float rise = random(state);
+  particle.velocity = { speed * std::cos(angle), speed * std::sin(angle), 2.0f + rise };
+  particle.life = 1.0f + 2.0f * random(state);
+}
+
+void step(Particle& particle, uint32_t index, float delta_time) {
+  particle.life -= delta_time;
+  if (particle.life <= 0.0f) {
+    respawn(particle, index);
+    return;
+  }
+
+  particle.velocity.z -= gravity * delta_time;
+  particle.position += particle.velocity * delta_time;
+  if (particle.position.z < 0.0f) {
+    particle.position.z = -particle.position.z;
+    particle.velocity.z *= -restitution;
+  }
+}
+
+auto create_shader_module(const vk::raii::Device& device, const std::string& path) -> vk::raii::ShaderModule {
+  auto code = read_file(path);
+  vk::ShaderModuleCreateInfo create_info {
+    .codeSize = code.size(),
+    .pCode = reinterpret_cast<const uint32_t*>(code.data())
+  };
+  return vk::raii::ShaderModule { device, create_info };
+}
+
+}
+
+ParticleSystem::ParticleSystem(
+  const vk::raii::Device& device, vk::Buffer particle_buffer, uint32_t _particle_count, vk::Format color_format,
+  vk::Format depth_format)
+  : particle_count { _particle_count },
+    simulate_pipeline {
+      device, "shaders/particles.comp.spv",
+      {
+        {
+          .binding = 0,
+          .descriptorType = vk::DescriptorType::eStorageBuffer,
+          .descriptorCount = 1,
+          .stageFlags = vk::ShaderStageFlagBits::eCompute | vk::ShaderStageFlagBits::eVertex
+        }
+      },
+      sizeof(SimulateConstants), local_size
+    } {
+  create_descriptor_set(device, particle_buffer);
+  create_draw_pipeline(device, color_format, depth_format);
+}
+
+auto ParticleSystem::create_particles(uint32_t count) -> std::vector<Particle> {
+  std::vector<Particle> particles(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    particles[i] = {};
+    respawn(particles[i], i);
+    // Staggered lifetimes keep the fountain from pulsing
+    particles[i].life *= static_cast<float>(i % 1024 + 1) / 1024.0f;
+  }
+  return particles;
+}
+
+void ParticleSystem::simulate_reference(std::span<Particle> particles, float delta_time) {
+  for (uint32_t i = 0; i < particles.size(); ++i) {
+    step(particles[i], i, delta_time);
+  }
+}
+
+void ParticleSystem::create_descriptor_set(const vk::raii::Device& device, vk::Buffer particle_buffer) {
+  vk::DescriptorPoolSize pool_size {
+    .type = vk::DescriptorType::eStorageBuffer,
+    .descriptorCount = 1
+  };
+
+  vk::DescriptorPoolCreateInfo pool_create_info {
+    .flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
+    .maxSets = 1,
+    .poolSizeCount = 1,
+    .pPoolSizes = &pool_size
+  };
+  descriptor_pool = vk::raii::DescriptorPool { device, pool_create_info };
+
+  vk::DescriptorSetLayout set_layouts[] = { simulate_pipeline.get_descriptor_set_layout() };
+  vk::DescriptorSetAllocateInfo allocate_info {
+    .descriptorPool = *descriptor_pool,
+    .descriptorSetCount = 1,
+    .pSetLayouts = set_layouts
+  };
+  descriptor_set = std::move(vk::raii::DescriptorSets { device, allocate_info }.front());
+
+  vk::DescriptorBufferInfo buffer_info {
+    .buffer = particle_buffer,
+    .offset = 0,
+    .range = VK_WHOLE_SIZE
+  };
+
+  vk::WriteDescriptorSet descriptor_write {
+    .dstSet = *descriptor_set,
+    .dstBinding = 0,
+    .dstArrayElement = 0,
+    .descriptorCount = 1,
+    .descriptorType = vk::DescriptorType::eStorageBuffer,
+    .pBufferInfo = &buffer_info
+  };
+  device.updateDescriptorSets(descriptor_write, nullptr);
+}
+
+void ParticleSystem::create_draw_pipeline(
+  const vk::raii::Device& device, vk::Format color_format, vk::Format depth_format) {
+  auto vertex_shader_module = create_shader_module(device, "shaders/particles.vert.spv");
+  auto fragment_shader_module = create_shader_module(device, "shaders/particles.frag.spv");
+
+  std::array shader_stages {
+    vk::PipelineShaderStageCreateInfo {
+      .stage = vk::ShaderStageFlagBits::eVertex,
+      .module = *vertex_shader_module,
+      .pName = "main"
+    },
+    vk::PipelineShaderStageCreateInfo {
+      .stage = vk::ShaderStageFlagBits::eFragment,
+      .module = *fragment_shader_module,
+      .pName = "main"
+    }
+  };
+
+  // Particles are pulled from the storage buffer by vertex index
+  vk::PipelineVertexInputStateCreateInfo vertex_input_state_create_info {};
+
+  vk::PipelineInputAssemblyStateCreateInfo input_assembly_state_create_info {
+    .topology = vk::PrimitiveTopology::ePointList,
+    .primitiveRestartEnable = false
+  };
+
+  std::array dynamic_states {
+    vk::DynamicState::eViewport,
+    vk::DynamicState::eScissor
+  };
+
+  vk::PipelineDynamicStateCreateInfo dynamic_state_create_info {
+    .dynamicStateCount = static_cast<uint32_t>(dynamic_states.size()),
+    .pDynamicStates = dynamic_states.data()
+  };
+
+  vk::PipelineViewportStateCreateInfo viewport_state_create_info {
+    .viewportCount = 1,
+    .scissorCount = 1
+  };
+
+  vk::PipelineRasterizationStateCreateInfo rasterization_state_create_info {
+    .depthClampEnable = false,
+    .rasterizerDiscardEnable = false,
+    .polygonMode = vk::PolygonMode::eFill,
+    .cullMode = vk::CullModeFlagBits::eNone,
+    .frontFace = vk::FrontFace::eCounterClockwise,
+    .depthBiasEnable = false,
+    .lineWidth = 1.0f
+  };
+
+  vk::PipelineMultisampleStateCreateInfo multisample_state_create_info {
+    .rasterizationSamples = vk::SampleCountFlagBits::e1,
+    .sampleShadingEnable = false,
+  };
+
+  vk::PipelineDepthStencilStateCreateInfo depth_stencil_state_create_info {
+    .depthTestEnable = true,
+    .depthWriteEnable = false,
+    .depthCompareOp = vk::CompareOp::eLess,
+    .depthBoundsTestEnable = false,
+    .stencilTestEnable = false
+  };
+
+  using enum vk::ColorComponentFlagBits;
+  vk::PipelineColorBlendAttachmentState color_blend_attachment_state {
+    .blendEnable = false,
+    .colorWriteMask = eR | eG | eB | eA
+  };
+
+  vk::PipelineColorBlendStateCreateInfo color_blend_state_create_info {
+    .attachmentCount = 1,
+    .pAttachments = &color_blend_attachment_state
+  };
+
+  vk::PushConstantRange push_constant_range {
+    .stageFlags = vk::ShaderStageFlagBits::eVertex,
+    .offset = 0,
+    .size = sizeof(glm::mat4)
+  };
+
+  vk::DescriptorSetLayout set_layouts[] = { simulate_pipeline.get_descriptor_set_layout() };
+  vk::PipelineLayoutCreateInfo pipeline_layout_create_info {
+    .setLayoutCount = 1,
+    .pSetLayouts = set_layouts,
+    .pushConstantRangeCount = 1,
+    .pPushConstantRanges = &push_constant_range
+  };
+  draw_pipeline_layout = vk::raii::PipelineLayout { device, pipeline_layout_create_info };
+
+  vk::PipelineRenderingCreateInfo rendering_create_info {
+    .colorAttachmentCount = 1,
+    .pColorAttachmentFormats = &color_format,
+    .depthAttachmentFormat = depth_format
+  };
+
+  vk::GraphicsPipelineCreateInfo create_info {
+    .pNext = &rendering_create_info,
+    .stageCount = static_cast<uint32_t>(shader_stages.size()),
+    .pStages = shader_stages.data(),
+    .pVertexInputState = &vertex_input_state_create_info,
+    .pInputAssemblyState = &input_assembly_state_create_info,
+    .pViewportState = &viewport_state_create_info,
+    .pRasterizationState = &rasterization_state_create_info,
+    .pMultisampleState = &multisample_state_create_info,
+    .pDepthStencilState = &depth_stencil_state_create_info,
+    .pColorBlendState = &color_blend_state_create_info,
+    .pDynamicState = &dynamic_state_create_info,
+    .layout = *draw_pipeline_layout,
+    .renderPass = nullptr,
+    .subpass = 0,
+  };
+  draw_pipeline = vk::raii::Pipeline { device, nullptr, create_info };
+}
+
+void ParticleSystem::simulate(vk::raii::CommandBuffer& command_buffer, float delta_time) const {
+  SimulateConstants constants {
+    .delta_time = delta_time,
+    .particle_count = particle_count
+  };
+  simulate_pipeline.bind(command_buffer, *descriptor_set);
+  simulate_pipeline.push_constants(command_buffer, constants);
+  simulate_pipeline.dispatch(command_buffer, particle_count);
+}
+
+void ParticleSystem::draw(vk::raii::CommandBuffer& command_buffer, const glm::mat4& view_projection) const {
+  command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *draw_pipeline);
+  command_buffer.bindDescriptorSets(
+    vk::PipelineBindPoint::eGraphics, *draw_pipeline_layout, 0, { *descriptor_set }, nullptr
+  );
+  command_buffer.pushConstants<glm::mat4>(*draw_pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, view_projection);
+  command_buffer.draw(particle_count, 1, 0, 0);
+}
\ No newline at end of file
@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+#define VULKAN_HPP_NO_CONSTRUCTORS
+#include <vulkan/vulkan.hpp>
+#include <vulkan/vulkan_raii.hpp>
+#include <glm/glm.hpp>
+#include "compute_pipeline.h"
+
+// Matches the std430 layout of the shaders
+struct Particle {
+  glm::vec3 position;
+  float life;
+  glm::vec3 velocity;
+  uint32_t spawn_count;
+};
+static_assert(sizeof(Particle) == 32);
+
+// Particles live in a device local storage buffer that a compute shader steps every frame and the
+// draw reads back as point sprites, so the CPU never touches them after the initial upload.
+// The CPU reference runs the exact same step and exists to validate the shader.
+class ParticleSystem {
+public:
+  ParticleSystem(
+    const vk::raii::Device&, vk::Buffer particle_buffer, uint32_t particle_count, vk::Format color_format,
+    vk::Format depth_format);
+
+  static auto create_particles(uint32_t count) -> std::vector<Particle>;
+  static void simulate_reference(std::span<Particle>, float delta_time);
+
+  void simulate(vk::raii::CommandBuffer&, float delta_time) const;
+  // Expects viewport and scissor to be set, particles are depth tested but do not write depth
+  void draw(vk::raii::CommandBuffer&, const glm::mat4& view_projection) const;
+
+  auto get_particle_count() const -> uint32_t { return particle_count; }
+
+private:
+  struct SimulateConstants {
+    float delta_time;
+    uint32_t particle_count;
+  };
+
+  static constexpr uint32_t local_size = 256;
+
+  void create_descriptor_set(const vk::raii::Device&, vk::Buffer);
+  void create_draw_pipeline(const vk::raii::Device&, vk::Format color_format, vk::Format depth_format);
+
+  uint32_t particle_count;
+  ComputePipeline simulate_pipeline;
+  vk::raii::DescriptorPool descriptor_pool { nullptr };
+  vk::raii::DescriptorSet descriptor_set { nullptr };
+  vk::raii::PipelineLayout draw_pipeline_layout { nullptr };
+  vk::raii::Pipeline draw_pipeline { nullptr };
+};
\ No newline at end of file
@@ -0,0 +1,299 @@
+#include "pipeline_cache.h"
+#include <algorithm>
+#include <fmt/core.h>
+#include "profiler.h"
+#include "file_util.h"
+
+namespace {
+
+auto get_blend_attachment_state(BlendMode mode) -> vk::PipelineColorBlendAttachmentState {
+  using enum vk::ColorComponentFlagBits;
+  vk::PipelineColorBlendAttachmentState state {
+    .blendEnable = (mode != BlendMode::eOpaque),
+    .srcColorBlendFactor = vk::BlendFactor::eOne,
+    .dstColorBlendFactor = vk::BlendFactor::eZero,
+    .colorBlendOp = vk::BlendOp::eAdd,
+    .srcAlphaBlendFactor = vk::BlendFactor::eOne,
+    .dstAlphaBlendFactor = vk::BlendFactor::eZero,
+    .alphaBlendOp = vk::BlendOp::eAdd,
+    .colorWriteMask = eR | eG | eB | eA
+  };
+
+  if (mode == BlendMode::eAlpha) {
+    state.srcColorBlendFactor = vk::BlendFactor::eSrcAlpha;
+    state.dstColorBlendFactor = vk::BlendFactor::eOneMinusSrcAlpha;
+    state.dstAlphaBlendFactor = vk::BlendFactor::eOneMinusSrcAlpha;
+  } else if (mode == BlendMode::eAdditive) {
+    state.dstColorBlendFactor = vk::BlendFactor::eOne;
+    state.dstAlphaBlendFactor = vk::BlendFactor::eOne;
+  }
+  return state;
+}
+
+}
+
+auto PipelineStateHash::operator()(const PipelineState& state) const -> size_t {
+  // FNV-1a over the fields, padding never takes part
+  uint64_t hash = 14695981039346656037ull;
+  auto mix = [&hash] (uint64_t value) {
+    hash ^= value;
+    hash *= 1099511628211ull;
+  };
+
+  mix(state.vertex_shader);
+  mix(state.fragment_shader);
+  mix(state.vertex_layout);
+  mix(static_cast<uint64_t>(state.blend));
+  mix(static_cast<uint64_t>(state.samples));
+  mix(static_cast<uint64_t>(state.topology));
+  mix(static_cast<uint64_t>(state.polygon_mode));
+  mix(static_cast<VkCullModeFlags>(state.cull_mode));
+  for (auto constant : state.specialization) {
+    mix(constant);
+  }
+  return static_cast<size_t>(hash);
+}
+
+PipelineCache::PipelineCache(
+  const vk::raii::Device& _device, JobSystem& _job_system, vk::PipelineLayout _layout, vk::Format _color_format,
+  vk::Format _depth_format)
+  : device { _device }, job_system { _job_system }, layout { _layout }, color_format { _color_format },
+    depth_format { _depth_format },
+    stats { .hits = 0, .misses = 0, .pipelines = 0, .compile_time = {} },
+    report_interval { std::chrono::seconds(10) }, last_report { Clock::now() } {
+  // Pipeline caches synchronize internally, so the compile jobs share this one
+  driver_cache = vk::raii::PipelineCache { device, vk::PipelineCacheCreateInfo {} };
+}
+
+PipelineCache::~PipelineCache() {
+  for (auto* entry : compiling) {
+    job_system.wait(entry->counter);
+  }
+}
+
+auto PipelineCache::add_shader(const std::string& path) -> uint16_t {
+  for (size_t i = 0; i < shader_paths.size(); ++i) {
+    if (shader_paths[i] == path) {
+      return static_cast<uint16_t>(i);
+    }
+  }
+
+  auto code = read_file(path);
+  vk::ShaderModuleCreateInfo create_info {
+    .codeSize = code.size(),
+    .pCode = reinterpret_cast<const uint32_t*>(code.data())
+  };
+  shader_modules.emplace_back(device, create_info);
+  shader_paths.push_back(path);
+  return static_cast<uint16_t>(shader_paths.size() - 1);
+}
+
+auto PipelineCache::add_vertex_layout(VertexLayout vertex_layout) -> uint16_t {
+  vertex_layouts.push_back(std::move(vertex_layout));
+  return static_cast<uint16_t>(vertex_layouts.size() - 1);
+}
+
+auto PipelineCache::request(const PipelineState& state) -> PipelineHandle {
+  if (auto pipeline = pipelines.find(state); pipeline != pipelines.end()) {
+    stats.hits += 1;
+    return PipelineHandle { pipeline->second.get() };
+  }
+  stats.misses += 1;
+
+  auto entry = std::make_unique<Entry>();
+  entry->state = state;
+  entry->vertex_shader = *shader_modules[state.vertex_shader];
+  entry->fragment_shader = *shader_modules[state.fragment_shader];
+  entry->vertex_layout = &vertex_layouts[state.vertex_layout];
+
+  auto* compiled = entry.get();
+  compiling.push_back(compiled);
+  pipelines.emplace(state, std::move(entry));
+  stats.pipelines = pipelines.size();
+
+  job_system.run([this, compiled] {
+    auto start = Clock::now();
+    try {
+      compiled->pipeline = create_pipeline(*compiled);
+    } catch (...) {
+      compiled->error = std::current_exception();
+    }
+    compiled->compile_time = Clock::now() - start;
+    compiled->ready.store(true, std::memory_order_release);
+  }, compiled->counter);
+  return PipelineHandle { compiled };
+}
+
+void PipelineCache::wait(PipelineHandle handle) {
+  job_system.wait(handle.entry->counter);
+  if (auto entry = std::ranges::find(compiling, handle.entry); entry != compiling.end()) {
+    compiling.erase(entry);
+    finish(*handle.entry);
+  }
+}
+
+auto PipelineCache::get(const PipelineState& state) -> vk::Pipeline {
+  auto handle = request(state);
+  wait(handle);
+  return handle.get();
+}
+
+void PipelineCache::update() {
+  // Erased before finishing, so the list stays consistent when a compile error is rethrown
+  for (size_t i = 0; i < compiling.size();) {
+    auto* entry = compiling[i];
+    if (!entry->ready.load(std::memory_order_acquire)) {
+      ++i;
+      continue;
+    }
+    compiling.erase(compiling.begin() + static_cast<std::ptrdiff_t>(i));
+    finish(*entry);
+  }
+}
+
+void PipelineCache::finish(Entry& entry) {
+  if (entry.error) {
+    std::rethrow_exception(entry.error);
+  }
+
+  // A long compile here is where a hitch would have been without the stand-in
+  std::chrono::duration<double, std::milli> compile_time { entry.compile_time };
+  stats.compile_time += compile_time;
+  fmt::println("pipeline {:016x} compiled in {:.2f} ms", PipelineStateHash {}(entry.state), compile_time.count());
+}
+
+auto PipelineCache::create_pipeline(const Entry& entry) const -> vk::raii::Pipeline {
+  PROFILE_ZONE("create_pipeline");
+  const auto& state = entry.state;
+
+  std::array<vk::SpecializationMapEntry, PipelineState::max_specialization_constants> specialization_entries;
+  for (uint32_t i = 0; i < specialization_entries.size(); ++i) {
+    specialization_entries[i] = {
+      .constantID = i,
+      .offset = static_cast<uint32_t>(sizeof(uint32_t) * i),
+      .size = sizeof(uint32_t)
+    };
+  }
+
+  // Entries for constants a shader does not declare are ignored
+  vk::SpecializationInfo specialization_info {
+    .mapEntryCount = static_cast<uint32_t>(specialization_entries.size()),
+    .pMapEntries = specialization_entries.data(),
+    .dataSize = sizeof(state.specialization),
+    .pData = state.specialization.data()
+  };
+
+  std::array shader_stages {
+    vk::PipelineShaderStageCreateInfo {
+      .stage = vk::ShaderStageFlagBits::eVertex,
+      .module = entry.vertex_shader,
+      .pName = "main",
+      .pSpecializationInfo = &specialization_info
+    },
+    vk::PipelineShaderStageCreateInfo {
+      .stage = vk::ShaderStageFlagBits::eFragment,
+      .module = entry.fragment_shader,
+      .pName = "main",
+      .pSpecializationInfo = &specialization_info
+    }
+  };
+
+  const auto& vertex_layout = *entry.vertex_layout;
+  vk::PipelineVertexInputStateCreateInfo vertex_input_state_create_info {
+    .vertexBindingDescriptionCount = static_cast<uint32_t>(vertex_layout.bindings.size()),
+    .pVertexBindingDescriptions = vertex_layout.bindings.data(),
+    .vertexAttributeDescriptionCount = static_cast<uint32_t>(vertex_layout.attributes.size()),
+    .pVertexAttributeDescriptions = vertex_layout.attributes.data()
+  };
+
+  vk::PipelineInputAssemblyStateCreateInfo input_assembly_state_create_info {
+    .topology = state.topology,
+    .primitiveRestartEnable = false
+  };
+
+  std::array dynamic_states {
+    vk::DynamicState::eViewport,
+    vk::DynamicState::eScissor
+  };
+
+  vk::PipelineDynamicStateCreateInfo dynamic_state_create_info {
+    .dynamicStateCount = static_cast<uint32_t>(dynamic_states.size()),
+    .pDynamicStates = dynamic_states.data()
+  };
+
+  vk::PipelineViewportStateCreateInfo viewport_state_create_info {
+    .viewportCount = 1,
+    .scissorCount = 1
+  };
+
+  vk::PipelineRasterizationStateCreateInfo rasterization_state_create_info {
+    .depthClampEnable = false,
+    .rasterizerDiscardEnable = false,
+    .polygonMode = state.polygon_mode,
+    .cullMode = state.cull_mode,
+    .frontFace = vk::FrontFace::eCounterClockwise,
+    .depthBiasEnable = false,
+    .lineWidth = 1.0f
+  };
+
+  vk::PipelineMultisampleStateCreateInfo multisample_state_create_info {
+    .rasterizationSamples = state.samples,
+    .sampleShadingEnable = false,
+  };
+
+  auto color_blend_attachment_state = get_blend_attachment_state(state.blend);
+  vk::PipelineColorBlendStateCreateInfo color_blend_state_create_info {
+    .attachmentCount = 1,
+    .pAttachments = &color_blend_attachment_state
+  };
+
+  vk::PipelineDepthStencilStateCreateInfo depth_stencil_state_create_info {
+    .depthTestEnable = true,
+    .depthWriteEnable = (state.blend == BlendMode::eOpaque),
+    .depthCompareOp = vk::CompareOp::eLess,
+    .depthBoundsTestEnable = false,
+    .stencilTestEnable = false
+  };
+
+  vk::PipelineRenderingCreateInfo rendering_create_info {
+    .colorAttachmentCount = 1,
+    .pColorAttachmentFormats = &color_format,
+    .depthAttachmentFormat = depth_format
+  };
+
+  vk::GraphicsPipelineCreateInfo create_info {
+    .pNext = &rendering_create_info,
+    .stageCount = static_cast<uint32_t>(shader_stages.size()),
+    .pStages = shader_stages.data(),
+    .pVertexInputState = &vertex_input_state_create_info,
+    .pInputAssemblyState = &input_assembly_state_create_info,
+    .pViewportState = &viewport_state_create_info,
+    .pRasterizationState = &rasterization_state_create_info,
+    .pMultisampleState = &multisample_state_create_info,
+    .pDepthStencilState = &depth_stencil_state_create_info,
+    .pColorBlendState = &color_blend_state_create_info,
+    .pDynamicState = &dynamic_state_create_info,
+    .layout = layout,
+    .renderPass = nullptr,
+    .subpass = 0,
+  };
+  return vk::raii::Pipeline { device, driver_cache, create_info };
+}
+
+void PipelineCache::report_if_due() {
+  auto now = Clock::now();
+  if (now - last_report < report_interval) {
+    return;
+  }
+  last_report = now;
+  report();
+}
+
+void PipelineCache::report() const {
+  auto lookups = stats.hits + stats.misses;
+  fmt::println(
+    "pipelines: {} created, {} hits and {} misses ({:.1f}% hit rate), {:.2f} ms compiling",
+    stats.pipelines, stats.hits, stats.misses, (lookups > 0 ? 100.0 * stats.hits / lookups : 0.0),
+    stats.compile_time.count()
+  );
+}
\ No newline at end of file
@@ -0,0 +1,139 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#define VULKAN_HPP_NO_CONSTRUCTORS
+#include <vulkan/vulkan.hpp>
+#include <vulkan/vulkan_raii.hpp>
+#include "job_system.h"
+
+enum class BlendMode : uint8_t {
+  eOpaque, eAlpha, eAdditive
+};
+
+// Everything that differs between the graphics pipelines of one layout. Shaders and vertex layouts are
+// the ids the cache handed out for them, specialization constant i of both stages takes specialization[i].
+struct PipelineState {
+  static constexpr uint32_t max_specialization_constants = 4;
+
+  uint16_t vertex_shader;
+  uint16_t fragment_shader;
+  uint16_t vertex_layout;
+  BlendMode blend;
+  vk::SampleCountFlagBits samples;
+  vk::PrimitiveTopology topology;
+  vk::PolygonMode polygon_mode;
+  vk::CullModeFlags cull_mode;
+  std::array<uint32_t, max_specialization_constants> specialization;
+
+  bool operator==(const PipelineState&) const = default;
+};
+
+struct PipelineStateHash {
+  auto operator()(const PipelineState&) const -> size_t;
+};
+
+// Creates graphics pipelines on first use and hands out the same pipeline for equal states. All
+// pipelines share one layout and render to one color and one depth format with dynamic viewport and
+// scissor. Opaque pipelines write depth, blended ones only test against it.
+// Pipelines are compiled by jobs, requests return at once and draws use a stand-in until they are ready.
+class PipelineCache {
+  struct Entry;
+
+public:
+  // Future-like view of a pipeline that may still be compiling
+  class PipelineHandle {
+  public:
+    PipelineHandle() = default;
+
+    bool is_ready() const { return entry != nullptr && entry->ready.load(std::memory_order_acquire); }
+    // Null until the pipeline is ready
+    auto get() const -> vk::Pipeline { return (is_ready() ? *entry->pipeline : vk::Pipeline {}); }
+
+  private:
+    friend class PipelineCache;
+    explicit PipelineHandle(Entry* _entry) : entry { _entry } {}
+    Entry* entry = nullptr;
+  };
+
+  struct VertexLayout {
+    std::vector<vk::VertexInputBindingDescription> bindings;
+    std::vector<vk::VertexInputAttributeDescription> attributes;
+  };
+
+  struct Stats {
+    uint64_t hits, misses;
+    size_t pipelines;
+    std::chrono::duration<double, std::milli> compile_time;
+  };
+
+  PipelineCache(
+    const vk::raii::Device&, JobSystem&, vk::PipelineLayout, vk::Format color_format, vk::Format depth_format);
+  // Waits for the compile jobs still running
+  ~PipelineCache();
+
+  PipelineCache(const PipelineCache&) = delete;
+  PipelineCache& operator=(const PipelineCache&) = delete;
+
+  // Loading the same path twice returns the same id
+  auto add_shader(const std::string& path) -> uint16_t;
+  auto add_vertex_layout(VertexLayout) -> uint16_t;
+
+  // Starts compiling on a worker unless the state was requested before
+  auto request(const PipelineState&) -> PipelineHandle;
+  void wait(PipelineHandle);
+  // Requests and waits, for pipelines that are needed right away
+  auto get(const PipelineState&) -> vk::Pipeline;
+
+  // Call once per frame, logs finished compiles and rethrows their errors
+  void update();
+  auto get_layout() const -> vk::PipelineLayout { return layout; }
+  auto get_stats() const -> const Stats& { return stats; }
+
+  void report_if_due();
+  void report() const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  // Shaders and vertex layouts are resolved on the requesting thread, so jobs never index containers
+  // that are still growing
+  struct Entry {
+    PipelineState state;
+    vk::ShaderModule vertex_shader, fragment_shader;
+    const VertexLayout* vertex_layout;
+    vk::raii::Pipeline pipeline { nullptr };
+    JobCounter counter;
+    std::atomic<bool> ready { false };
+    std::exception_ptr error;
+    Clock::duration compile_time;
+  };
+
+  auto create_pipeline(const Entry&) const -> vk::raii::Pipeline;
+  void finish(Entry&);
+
+  const vk::raii::Device& device;
+  JobSystem& job_system;
+  vk::PipelineLayout layout;
+  vk::Format color_format, depth_format;
+  // Lets the driver reuse compiled shader code between pipelines that share stages
+  vk::raii::PipelineCache driver_cache { nullptr };
+
+  std::vector<std::string> shader_paths;
+  std::deque<vk::raii::ShaderModule> shader_modules;
+  std::deque<VertexLayout> vertex_layouts;
+  std::unordered_map<PipelineState, std::unique_ptr<Entry>, PipelineStateHash> pipelines;
+  // Compiles that were started and not yet finished on the requesting thread
+  std::vector<Entry*> compiling;
+
+  Stats stats;
+  Clock::duration report_interval;
+  Clock::time_point last_report;
+};
\ No newline at end of file
@@ -0,0 +1,201 @@
+#include "radix_sort.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace {
+
+// Every shader sees the same five buffers, so one descriptor set serves all three pipelines
+auto create_bindings() -> std::vector<vk::DescriptorSetLayoutBinding> {
+  std::vector<vk::DescriptorSetLayoutBinding> bindings;
+  for (uint32_t i = 0; i < 5; ++i) {
+    bindings.push_back({
+      .binding = i,
+      .descriptorType = vk::DescriptorType::eStorageBuffer,
+      .descriptorCount = 1,
+      .stageFlags = vk::ShaderStageFlagBits::eCompute
+    });
+  }
+  return bindings;
+}
+
+}
+
+// Ranks are computed per subgroup, which only covers every invocation once when no subgroup is partial
+auto RadixSort::create_pipeline(const vk::raii::Device& device, const std::string& shader_path) -> ComputePipeline {
+  return {
+    device, shader_path, create_bindings(), sizeof(Constants), local_size, nullptr,
+    vk::PipelineShaderStageCreateFlagBits::eRequireFullSubgroups
+  };
+}
+
+RadixSort::RadixSort(
+  const vk::raii::Device& _device, MemoryTracker& memory_tracker, uint32_t _max_count, uint32_t max_bindings)
+  : device { _device }, max_count { _max_count },
+    count_pipeline { create_pipeline(device, "shaders/radix_count.comp.spv") },
+    scan_pipeline { create_pipeline(device, "shaders/radix_scan.comp.spv") },
+    scatter_pipeline { create_pipeline(device, "shaders/radix_scatter.comp.spv") } {
+  vk::DeviceSize pairs_size = sizeof(uint32_t) * std::max(max_count, 1u);
+  std::tie(internal_keys, internal_keys_memory) = create_buffer(memory_tracker, pairs_size);
+  std::tie(internal_values, internal_values_memory) = create_buffer(memory_tracker, pairs_size);
+  uint32_t max_blocks = std::max((max_count + block_size - 1) / block_size, 1u);
+  std::tie(histograms, histograms_memory) = create_buffer(memory_tracker, sizeof(uint32_t) * radix * max_blocks);
+
+  vk::DescriptorPoolSize pool_size {
+    .type = vk::DescriptorType::eStorageBuffer,
+    .descriptorCount = 2 * 5 * max_bindings
+  };
+  vk::DescriptorPoolCreateInfo pool_create_info {
+    .flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
+    .maxSets = 2 * max_bindings,
+    .poolSizeCount = 1,
+    .pPoolSizes = &pool_size
+  };
+  descriptor_pool = vk::raii::DescriptorPool { device, pool_create_info };
+}
+
+bool RadixSort::is_supported(const vk::raii::PhysicalDevice& physical_device) {
+  auto properties = physical_device.getProperties2<
+    vk::PhysicalDeviceProperties2, vk::PhysicalDeviceSubgroupProperties, vk::PhysicalDeviceVulkan13Properties
+  >();
+  auto features = physical_device.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan13Features>();
+  const auto& subgroup = properties.get<vk::PhysicalDeviceSubgroupProperties>();
+  // SPIR-V 1.6 shaders may run with any subgroup size between the minimum and the maximum
+  const auto& subgroup_size = properties.get<vk::PhysicalDeviceVulkan13Properties>();
+  return (subgroup.supportedStages & vk::ShaderStageFlagBits::eCompute)
+    && (subgroup.supportedOperations & vk::SubgroupFeatureFlagBits::eBallot)
+    && features.get<vk::PhysicalDeviceVulkan13Features>().computeFullSubgroups
+    && local_size % subgroup_size.maxSubgroupSize == 0
+    && subgroup_size.minSubgroupSize >= local_size / 64;
+}
+
+auto RadixSort::create_buffer(MemoryTracker& memory_tracker, vk::DeviceSize size)
+    -> std::pair<vk::raii::Buffer, DeviceAllocation> {
+  vk::BufferCreateInfo create_info {
+    .size = size,
+    .usage = vk::BufferUsageFlagBits::eStorageBuffer,
+    .sharingMode = vk::SharingMode::eExclusive
+  };
+  vk::raii::Buffer buffer { device, create_info };
+  auto requirements = buffer.getMemoryRequirements();
+  uint32_t memory_type = memory_tracker.find_memory_type(
+    requirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal
+  );
+  auto memory = memory_tracker.allocate(requirements.size, memory_type, MemoryCategory::eStorage);
+  buffer.bindMemory(*memory, 0);
+  return { std::move(buffer), std::move(memory) };
+}
+
+auto RadixSort::create_descriptor_set(
+  vk::Buffer keys_in, vk::Buffer values_in, vk::Buffer keys_out, vk::Buffer values_out) -> vk::raii::DescriptorSet {
+  vk::DescriptorSetLayout layouts[] = { count_pipeline.get_descriptor_set_layout() };
+  vk::DescriptorSetAllocateInfo allocate_info {
+    .descriptorPool = *descriptor_pool,
+    .descriptorSetCount = 1,
+    .pSetLayouts = layouts
+  };
+  auto descriptor_set = std::move(vk::raii::DescriptorSets { device, allocate_info }.front());
+
+  std::array buffer_infos {
+    vk::DescriptorBufferInfo { .buffer = keys_in, .offset = 0, .range = VK_WHOLE_SIZE },
+    vk::DescriptorBufferInfo { .buffer = values_in, .offset = 0, .range = VK_WHOLE_SIZE },
+    vk::DescriptorBufferInfo { .buffer = keys_out, .offset = 0, .range = VK_WHOLE_SIZE },
+    vk::DescriptorBufferInfo { .buffer = values_out, .offset = 0, .range = VK_WHOLE_SIZE },
+    vk::DescriptorBufferInfo { .buffer = *histograms, .offset = 0, .range = VK_WHOLE_SIZE }
+  };
+  vk::WriteDescriptorSet write {
+    .dstSet = *descriptor_set,
+    .dstBinding = 0,
+    .dstArrayElement = 0,
+    .descriptorCount = static_cast<uint32_t>(buffer_infos.size()),
+    .descriptorType = vk::DescriptorType::eStorageBuffer,
+    .pBufferInfo = buffer_infos.data()
+  };
+  device.updateDescriptorSets(write, nullptr);
+  return descriptor_set;
+}
+
+auto RadixSort::bind(vk::Buffer keys, vk::Buffer values) -> Binding {
+  return {
+    create_descriptor_set(keys, values, *internal_keys, *internal_values),
+    create_descriptor_set(*internal_keys, *internal_values, keys, values)
+  };
+}
+
+void RadixSort::sort(vk::raii::CommandBuffer& command_buffer, const Binding& binding, uint32_t count) const {
+  if (count > max_count) {
+    throw std::runtime_error(
+      "Radix sort of " + std::to_string(count) + " pairs exceeds its capacity of " + std::to_string(max_count)
+    );
+  }
+  if (count == 0) {
+    return;
+  }
+
+  // Every dispatch reads what the one before it wrote and overwrites what it read
+  vk::MemoryBarrier2 dispatch_barrier {
+    .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+    .srcAccessMask = vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+    .dstAccessMask = vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite
+  };
+  auto wait_for_previous = [&] {
+    command_buffer.pipelineBarrier2({ .memoryBarrierCount = 1, .pMemoryBarriers = &dispatch_barrier });
+  };
+
+  uint32_t block_count = (count + block_size - 1) / block_size;
+  for (uint32_t shift = 0; shift < 32; shift += radix_bits) {
+    auto descriptor_set = *binding.descriptor_sets[(shift / radix_bits) % 2];
+    Constants constants {
+      .count = count,
+      .shift = shift,
+      .block_count = block_count
+    };
+    if (shift > 0) {
+      wait_for_previous();
+    }
+
+    count_pipeline.bind(command_buffer, descriptor_set);
+    count_pipeline.push_constants(command_buffer, constants);
+    count_pipeline.dispatch(command_buffer, block_count * local_size);
+    wait_for_previous();
+
+    // A single workgroup scans the counts of every block
+    scan_pipeline.bind(command_buffer, descriptor_set);
+    scan_pipeline.push_constants(command_buffer, constants);
+    scan_pipeline.dispatch(command_buffer, local_size);
+    wait_for_previous();
+
+    scatter_pipeline.bind(command_buffer, descriptor_set);
+    scatter_pipeline.push_constants(command_buffer, constants);
+    scatter_pipeline.dispatch(command_buffer, block_count * local_size);
+  }
+}
+
+void RadixSort::sort_reference(std::span<uint32_t> keys, std::span<uint32_t> values) {
+  std::vector<uint32_t> scratch_keys(keys.size()), scratch_values(values.size());
+  std::span<uint32_t> keys_in = keys, values_in = values, keys_out = scratch_keys, values_out = scratch_values;
+  for (uint32_t shift = 0; shift < 32; shift += radix_bits) {
+    std::array<uint32_t, radix> offsets {};
+    for (auto key : keys_in) {
+      ++offsets[(key >> shift) & (radix - 1)];
+    }
+
+    uint32_t sum = 0;
+    for (auto& offset : offsets) {
+      uint32_t digit_count = offset;
+      offset = sum;
+      sum += digit_count;
+    }
+
+    for (size_t i = 0; i < keys_in.size(); ++i) {
+      uint32_t destination = offsets[(keys_in[i] >> shift) & (radix - 1)]++;
+      keys_out[destination] = keys_in[i];
+      values_out[destination] = values_in[i];
+    }
+    std::swap(keys_in, keys_out);
+    std::swap(values_in, values_out);
+  }
+}
\ No newline at end of file
@@ -0,0 +1,75 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <span>
+#include <utility>
+#define VULKAN_HPP_NO_CONSTRUCTORS
+#include <vulkan/vulkan.hpp>
+#include <vulkan/vulkan_raii.hpp>
+#include "compute_pipeline.h"
+#include "memory_tracker.h"
+
+// Sorts pairs of 32 bit keys and values by key on the GPU, pairs with equal keys keep their order.
+// Every pass sorts by four bits of the key: blocks of the input count their digits, a single workgroup
+// turns the counts into the offset of every digit in every block, and the blocks scatter their pairs
+// ranked within each subgroup by ballots. The passes alternate between the caller's buffers and
+// internal ones, after all eight the sorted pairs are back in the caller's buffers.
+class RadixSort {
+public:
+  // The descriptor sets for one pair of key and value buffers
+  class Binding {
+  private:
+    friend class RadixSort;
+    Binding(vk::raii::DescriptorSet to_internal, vk::raii::DescriptorSet to_caller)
+      : descriptor_sets { std::move(to_internal), std::move(to_caller) } {}
+    std::array<vk::raii::DescriptorSet, 2> descriptor_sets;
+  };
+
+  static constexpr uint32_t radix_bits = 4;
+  static constexpr uint32_t radix = 1u << radix_bits;
+  static constexpr uint32_t local_size = 256;
+  static constexpr uint32_t items_per_invocation = 16;
+  static constexpr uint32_t block_size = local_size * items_per_invocation;
+
+  RadixSort(const vk::raii::Device&, MemoryTracker&, uint32_t max_count, uint32_t max_bindings);
+
+  // Ranking needs ballots in compute shaders and full subgroups, and the scatter keeps counts for at
+  // most 64 subgroups. The device has to enable computeFullSubgroups.
+  static bool is_supported(const vk::raii::PhysicalDevice&);
+
+  // The buffers need storage buffer usage and room for max_count elements
+  auto bind(vk::Buffer keys, vk::Buffer values) -> Binding;
+  // Writes to the pairs have to be visible to compute shaders, the sorted pairs are compute shader writes
+  void sort(vk::raii::CommandBuffer&, const Binding&, uint32_t count) const;
+
+  // The same passes on the CPU, for validation and as the baseline the GPU sort is measured against
+  static void sort_reference(std::span<uint32_t> keys, std::span<uint32_t> values);
+
+private:
+  struct Constants {
+    uint32_t count;
+    uint32_t shift;
+    uint32_t block_count;
+  };
+
+  static auto create_pipeline(const vk::raii::Device&, const std::string& shader_path) -> ComputePipeline;
+  auto create_buffer(MemoryTracker&, vk::DeviceSize) -> std::pair<vk::raii::Buffer, DeviceAllocation>;
+  auto create_descriptor_set(vk::Buffer keys_in, vk::Buffer values_in, vk::Buffer keys_out, vk::Buffer values_out)
+    -> vk::raii::DescriptorSet;
+
+  const vk::raii::Device& device;
+  uint32_t max_count;
+  ComputePipeline count_pipeline;
+  ComputePipeline scan_pipeline;
+  ComputePipeline scatter_pipeline;
+  vk::raii::DescriptorPool descriptor_pool { nullptr };
+
+  // The first pass scatters from the caller's buffers into these, the next one back and so on
+  vk::raii::Buffer internal_keys { nullptr };
+  DeviceAllocation internal_keys_memory;
+  vk::raii::Buffer internal_values { nullptr };
+  DeviceAllocation internal_values_memory;
+  // Digit counts and then offsets of every block, all blocks of a digit are consecutive
+  vk::raii::Buffer histograms { nullptr };
+  DeviceAllocation histograms_memory;
+};
\ No newline at end of file
@@ -1,5 +1,15 @@
 #pragma once
+#include <string>
 #include <vector>
+#include "scene_generator.h"
+
+enum class CaptureFormat {
+  eRaw, ePpm
+};
+
+enum class LogSeverity {
+  eVerbose, eInfo, eWarning, eError
+};
 
 struct RenderConfig {
   struct Resolution {
@@ -11,5 +21,43 @@ struct RenderConfig {
     std::vector<const char*> requested_layers;
   } vulkan;
 
+  // Validation layers can only be loaded at startup, their messages can be muted at any time
+  struct ValidationInfo {
+    bool enabled;
+    LogSeverity min_severity;
+    // Distinct messages one id may print each second, 0 prints all of them
+    uint32_t max_messages_per_second;
+  } validation;
+
+  // Slots of per frame resources, the most frames the CPU may record ahead of the GPU
   uint32_t max_frames_in_flight;
+  // Moves the frames in flight, and swap chain images with them, between 1 and the maximum by whether
+  // frames are CPU or GPU bound. Off keeps every slot in use.
+  bool adaptive_frames_in_flight;
+  uint32_t max_instances;
+  // Capacity of the geometry pool shared by every mesh
+  uint32_t max_vertices;
+  uint32_t max_indices;
+  uint32_t max_textures;
+  uint64_t texture_budget;
+  std::vector<std::string> texture_paths;
+  uint32_t particle_count;
+  // Point and spot lights over the scene, fragments only shade the ones binned into their cluster
+  uint32_t light_count;
+  // Fetch vertices through buffer device addresses instead of fixed vertex input
+  bool vertex_pulling;
+  bool frame_pacing;
+  // Compile pipelines on workers and draw with a stand-in meanwhile, off keeps frames deterministic
+  bool async_pipelines;
+  // Test instances against the previous frame's depth on the GPU and skip the hidden ones
+  bool occlusion_culling;
+  // Replaces the default grid of quads with a generated scene when its object count is not 0
+  StressSceneConfig scene;
+
+  // Writes every presented frame to directory
+  struct CaptureInfo {
+    bool enabled;
+    std::string directory;
+    CaptureFormat format;
+  } capture;
 };
\ No newline at end of file
@@ -1,73 +1,155 @@
 #include "render_engine.h"
+#include "ktx2_loader.h"
+#include "radix_sort.h"
 #include <algorithm>
 #include <fmt/core.h>
-#include <fmt/color.h>
-#include <fstream>
 #include <chrono>
 #include <limits>
 #include <array>
+#include <span>
 #include <set>
+#include <tuple>
+#include <cmath>
+#include <random>
 #include "../application/application.h"
+#include "job_system.h"
+#include "profiler.h"
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
-
-#ifdef NDEBUG
-  constexpr bool enable_validation_layers = false;
-#else
-  constexpr bool enable_validation_layers = true;
-#endif
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
 
 struct Vertex {
   glm::vec2 position;
   glm::vec3 color;
+  glm::vec2 uv;
+};
+
+// Where the pulling vertex shader finds each attribute, offsets count floats and negative ones
+// mark an attribute the format does not have
+struct VertexFormat {
+  vk::DeviceAddress vertices;
+  uint32_t stride;
+  int32_t position_offset;
+  int32_t color_offset;
+  int32_t uv_offset;
+};
+
+constexpr VertexFormat vertex_format {
+  .vertices = 0,
+  .stride = sizeof(Vertex) / sizeof(float),
+  .position_offset = offsetof(Vertex, position) / sizeof(float),
+  .color_offset = offsetof(Vertex, color) / sizeof(float),
+  .uv_offset = offsetof(Vertex, uv) / sizeof(float)
+};
+
+// Changes between draws without touching memory, the vertex format only matters when pulling
+struct DrawConstants {
+  VertexFormat format;
+  uint32_t first_texture;
+};
+
+// The view projection is pushed once per pass and the draw constants for every draw, both shaders
+// declare the same offsets
+struct PushConstants {
+  glm::mat4 view_projection;
+  DrawConstants draw;
 };
+static_assert(sizeof(PushConstants) <= 128, "Push constants must fit the guaranteed minimum size");
 
 struct Mesh {
   std::vector<Vertex> vertices;
-  std::vector<uint16_t> indices;
+  std::vector<uint32_t> indices;
 };
 
-const Mesh mesh {
+const Mesh quad {
   .vertices = {
-    { {-0.5f, -0.5f}, { 1.0f, 0.0f, 0.0f } },
-    { { 0.5f, -0.5f}, { 0.0f, 1.0f, 0.0f } },
-    { { 0.5f,  0.5f}, { 0.0f, 0.0f, 1.0f } },
-    { {-0.5f,  0.5f}, { 1.0f, 1.0f, 1.0f } }
+    { {-0.5f, -0.5f}, { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f } },
+    { { 0.5f, -0.5f}, { 0.0f, 1.0f, 0.0f }, { 1.0f, 0.0f } },
+    { { 0.5f,  0.5f}, { 0.0f, 0.0f, 1.0f }, { 1.0f, 1.0f } },
+    { {-0.5f,  0.5f}, { 1.0f, 1.0f, 1.0f }, { 0.0f, 1.0f } }
   },
   .indices = {
     0, 1, 2, 2, 3, 0
   }
 };
 
+// Meshes lie in the xy plane of their node
+auto get_mesh_bounds(std::span<const Vertex> vertices) -> Aabb {
+  Aabb bounds {
+    .min = glm::vec3(std::numeric_limits<float>::max()),
+    .max = glm::vec3(-std::numeric_limits<float>::max())
+  };
+  for (const auto& vertex : vertices) {
+    bounds.min = glm::min(bounds.min, glm::vec3(vertex.position, 0.0f));
+    bounds.max = glm::max(bounds.max, glm::vec3(vertex.position, 0.0f));
+  }
+  return bounds;
+}
+
 struct TransformMatrices {
-  glm::mat4 model;
   glm::mat4 view;
   glm::mat4 projection;
 };
 
-RenderEngine::RenderEngine(const RenderConfig& _config, const Application& application)
-    : config { _config }, current_frame { 0 } {
+auto get_camera_matrices(float aspect_ratio) -> TransformMatrices {
+  TransformMatrices matrices {
+    .view = glm::lookAt(glm::vec3(2.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
+    .projection = glm::perspective(glm::radians(45.0f), aspect_ratio, 0.1f, 10.0f)
+  };
+  matrices.projection[1][1] *= -1.0f;
+  return matrices;
+}
+
+RenderEngine::RenderEngine(const RenderConfig& _config, const Application& application, JobSystem& _job_system)
+    : RenderEngine { _config, &application, _job_system } {}
+
+RenderEngine::RenderEngine(const RenderConfig& _config, JobSystem& _job_system)
+    : RenderEngine { _config, nullptr, _job_system } {}
+
+RenderEngine::RenderEngine(const RenderConfig& _config, const Application* application, JobSystem& _job_system)
+    : config { _config }, headless { application == nullptr }, job_system { _job_system },
+      current_frame { 0 }, frame_id { 0 } {
+  create_debug_log();
   create_instance();
-  create_debug_messenger();
-  create_window_surface(application);
+  if (config.validation.enabled) {
+    create_debug_messenger();
+  }
+  if (!headless) {
+    create_window_surface(*application);
+  }
   select_physical_device();
   create_logical_device();
+  create_memory_tracker();
   query_queues();
-  create_swap_chain();
+  create_frame_balancer();
+  if (headless) {
+    create_offscreen_images();
+  } else {
+    create_swap_chain();
+  }
   create_swap_chain_image_views();
-  create_render_pass();
+  select_depth_format();
   create_descriptor_set_layout();
   create_graphics_pipeline();
-  create_framebuffers();
+  create_frame_capture();
   create_command_pool();
-  create_uniform_buffers();
+  create_gpu_profiler();
+  create_frame_arenas();
+  create_particles();
+  create_occlusion_culler();
+  create_lights();
+  create_render_graph();
+  create_textures();
   create_descriptor_pool();
   create_descriptor_sets();
-  create_vertex_buffer();
-  create_index_buffer();
+  create_geometry_pool();
+  create_instance_buffers();
+  create_scene();
   create_command_buffer();
   create_sync_objects();
+  create_frame_timing();
 }
 
 void RenderEngine::create_instance() {
@@ -83,9 +165,10 @@ void RenderEngine::create_instance() {
     .pApplicationInfo = &application_info,
   };
 
-  if constexpr (enable_validation_layers) {
+  // Also reports messages raised while the instance itself is created or destroyed
+  auto debug_messenger_create_info = get_debug_messenger_create_info();
+  if (config.validation.enabled) {
     check_validation_layers_support();
-    auto debug_messenger_create_info = get_debug_messenger_create_info();
     create_info.enabledLayerCount = static_cast<uint32_t>(config.vulkan.requested_layers.size());
     create_info.ppEnabledLayerNames = config.vulkan.requested_layers.data();
     create_info.pNext = static_cast<const void*>(&debug_messenger_create_info);
@@ -95,7 +178,7 @@ void RenderEngine::create_instance() {
   }
 
   auto required_extensions = config.vulkan.required_extensions;
-  if constexpr (enable_validation_layers) {
+  if (config.validation.enabled) {
     required_extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
   }
   check_required_extensions_support();
@@ -129,6 +212,10 @@ void RenderEngine::check_validation_layers_support() {
   }
 }
 
+void RenderEngine::create_debug_log() {
+  debug_log = std::make_unique<DebugLog>(config.validation);
+}
+
 void RenderEngine::create_debug_messenger() {
   auto create_info = get_debug_messenger_create_info();
   debug_messenger = std::make_unique<vk::raii::DebugUtilsMessengerEXT>(*instance, create_info);
@@ -137,50 +224,81 @@ void RenderEngine::create_debug_messenger() {
 auto RenderEngine::get_debug_messenger_create_info() -> vk::DebugUtilsMessengerCreateInfoEXT {
   using enum vk::DebugUtilsMessageSeverityFlagBitsEXT;
   using enum vk::DebugUtilsMessageTypeFlagBitsEXT;
+
+  // Severities below the minimum are not even raised by the layers
+  auto min_severity = config.validation.min_severity;
+  vk::DebugUtilsMessageSeverityFlagsEXT severities = eError;
+  if (min_severity <= LogSeverity::eWarning) {
+    severities |= eWarning;
+  }
+  if (min_severity <= LogSeverity::eInfo) {
+    severities |= eInfo;
+  }
+  if (min_severity <= LogSeverity::eVerbose) {
+    severities |= eVerbose;
+  }
+
   vk::DebugUtilsMessengerCreateInfoEXT create_info = {
-    .messageSeverity = eWarning | eError,
+    .messageSeverity = severities,
     .messageType = eGeneral | eValidation | ePerformance,
     .pfnUserCallback = debug_callback,
-    .pUserData = nullptr
+    .pUserData = debug_log.get()
   };
   return create_info;
 }
 
+// Runs on whichever thread raised the message, it only queues it for the log's own thread
 VKAPI_ATTR VkBool32 VKAPI_CALL RenderEngine::debug_callback(
   VkDebugUtilsMessageSeverityFlagBitsEXT severity,
   VkDebugUtilsMessageTypeFlagsEXT,
   const VkDebugUtilsMessengerCallbackDataEXT* data,
-  void*) {
+  void* user_data) {
 
-  fmt::color color { fmt::color::white };
+  LogSeverity log_severity = LogSeverity::eError;
   switch (severity) {
     case VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT:
-      color = fmt::color::white;
+      log_severity = LogSeverity::eVerbose;
       break;
 
     case VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT:
-      color = fmt::color::green;
+      log_severity = LogSeverity::eInfo;
       break;
 
     case VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT:
-      color = fmt::color::yellow;
+      log_severity = LogSeverity::eWarning;
       break;
 
     case VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT:
-      color = fmt::color::red;
-      break;
-
     case VK_DEBUG_UTILS_MESSAGE_SEVERITY_FLAG_BITS_MAX_ENUM_EXT:
-      color = fmt::color::dark_red;
+      log_severity = LogSeverity::eError;
       break;
   }
 
-  std::string error = fmt::format("[[{}]] {}\n", data->pMessageIdName, data->pMessage);
-  fmt::print(fmt::fg(color), "{}", error);
-
+  static_cast<DebugLog*>(user_data)->push(
+    log_severity, (data->pMessageIdName ? data->pMessageIdName : "unnamed"), data->pMessage
+  );
   return VK_FALSE;
 }
 
+void RenderEngine::set_validation_messages(bool enabled) {
+  if (!config.validation.enabled) {
+    if (enabled) {
+      fmt::println("Validation layers were not loaded at startup, there are no messages to show");
+    }
+    return;
+  }
+
+  if (enabled && !debug_messenger) {
+    create_debug_messenger();
+  } else if (!enabled) {
+    debug_messenger.reset();
+  }
+}
+
+bool RenderEngine::are_validation_messages_enabled() const {
+  return debug_messenger != nullptr;
+}
+
 void RenderEngine::create_window_surface(const Application& application) {
   VkSurfaceKHR _surface;
   application.create_window_surface(**instance, _surface);
@@ -188,9 +306,10 @@ void RenderEngine::create_window_surface(const Application& application) {
 }
 
 void RenderEngine::select_physical_device() {
-  required_device_extensions = {
-    VK_KHR_SWAPCHAIN_EXTENSION_NAME
-  };
+  required_device_extensions.clear();
+  if (!headless) {
+    required_device_extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+  }
 
   vk::raii::PhysicalDevices physical_devices { *instance };
   physical_device = std::make_unique<vk::raii::PhysicalDevice>(
@@ -206,6 +325,57 @@ void RenderEngine::select_physical_device() {
   if (!is_device_suitable(*physical_device)) {
     throw std::runtime_error("No suitable device found");
   }
+
+  select_optional_device_extensions();
+}
+
+void RenderEngine::select_optional_device_extensions() {
+  enabled_device_extensions = required_device_extensions;
+
+  auto available_extensions = physical_device->enumerateDeviceExtensionProperties();
+  auto is_available = [&available_extensions] (const char* name) {
+    return std::ranges::any_of(available_extensions, [name] (const vk::ExtensionProperties property) {
+      return std::strcmp(name, property.extensionName.data()) == 0;
+    });
+  };
+
+  // Present wait gives the time a frame reached the display, otherwise latency ends at the fence
+  present_wait_enabled = false;
+  if (!headless && is_available(VK_KHR_PRESENT_ID_EXTENSION_NAME) && is_available(VK_KHR_PRESENT_WAIT_EXTENSION_NAME)) {
+    auto features = physical_device->getFeatures2<
+      vk::PhysicalDeviceFeatures2,
+      vk::PhysicalDevicePresentIdFeaturesKHR,
+      vk::PhysicalDevicePresentWaitFeaturesKHR
+    >();
+    present_wait_enabled = features.get<vk::PhysicalDevicePresentIdFeaturesKHR>().presentId
+      && features.get<vk::PhysicalDevicePresentWaitFeaturesKHR>().presentWait;
+  }
+
+  if (present_wait_enabled) {
+    enabled_device_extensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+    enabled_device_extensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+  }
+
+  memory_budget_enabled = is_available(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+  if (memory_budget_enabled) {
+    enabled_device_extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+  }
+
+  // Buffer device address is core in 1.2 but optional, without it the fixed vertex input is used
+  vertex_pulling_enabled = false;
+  if (config.vertex_pulling) {
+    auto features = physical_device->getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+    vertex_pulling_enabled = features.get<vk::PhysicalDeviceVulkan12Features>().bufferDeviceAddress;
+  }
+
+  // One indirect draw per candidate needs multi draw indirect, and each picks its instance through
+  // firstInstance. Without them only the frustum culls.
+  auto features = physical_device->getFeatures();
+  occlusion_culling_enabled = config.occlusion_culling && features.multiDrawIndirect
+    && features.drawIndirectFirstInstance;
+  max_draw_indirect_count = physical_device->getProperties().limits.maxDrawIndirectCount;
+
+  radix_sort_supported = RadixSort::is_supported(*physical_device);
 }
 
 bool RenderEngine::is_device_suitable(const vk::raii::PhysicalDevice& _device) {
@@ -225,6 +395,27 @@ bool RenderEngine::is_device_suitable(const vk::raii::PhysicalDevice& _device) {
     }
   }
 
+  // Rendering is built on Vulkan 1.3's dynamic rendering and synchronization2
+  if (_device.getProperties().apiVersion < VK_API_VERSION_1_3) {
+    return false;
+  }
+  auto features = _device.getFeatures2<
+    vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features, vk::PhysicalDeviceVulkan13Features
+  >();
+  const auto& vulkan_13_features = features.get<vk::PhysicalDeviceVulkan13Features>();
+  if (!vulkan_13_features.dynamicRendering || !vulkan_13_features.synchronization2) {
+    return false;
+  }
+
+  // The fragment shader picks each material's texture with a non-uniform index
+  if (!features.get<vk::PhysicalDeviceVulkan12Features>().shaderSampledImageArrayNonUniformIndexing) {
+    return false;
+  }
+
+  if (headless) {
+    return true;
+  }
+
   // Swap Chain is adequate
   auto _swap_chain_info = get_swap_chain_info(_device);
   if (_swap_chain_info.formats.empty() || _swap_chain_info.present_modes.empty()) {
@@ -244,7 +435,8 @@ auto RenderEngine::get_queue_family_indices(const vk::raii::PhysicalDevice& _dev
       indices.graphics_family = i;
     }
 
-    if (_device.getSurfaceSupportKHR(i, *surface)) {
+    // Headless frames are never presented, the graphics queue stands in for the present queue
+    if (headless ? indices.graphics_family == i : _device.getSurfaceSupportKHR(i, *surface)) {
       indices.present_family = i;
     }
 
@@ -253,16 +445,30 @@ auto RenderEngine::get_queue_family_indices(const vk::raii::PhysicalDevice& _dev
     }
   }
 
+  // Prefer a dedicated transfer family for texture streaming, graphics queues can always transfer
+  indices.transfer_family = indices.graphics_family;
+  for (uint32_t i = 0; i < static_cast<uint32_t>(properties.size()); ++i) {
+    auto flags = properties[i].queueFlags;
+    if ((flags & vk::QueueFlagBits::eTransfer) && !(flags & vk::QueueFlagBits::eGraphics)
+        && !(flags & vk::QueueFlagBits::eCompute)) {
+      indices.transfer_family = i;
+      break;
+    }
+  }
+
   return indices;
 }
 
 void RenderEngine::create_logical_device() {
   queue_family_indices = get_queue_family_indices(*physical_device);
-  swap_chain_info = get_swap_chain_info(*physical_device);
+  if (!headless) {
+    swap_chain_info = get_swap_chain_info(*physical_device);
+  }
 
   std::set<uint32_t> unique_queue_families {
     queue_family_indices.graphics_family.value(),
-    queue_family_indices.present_family.value()
+    queue_family_indices.present_family.value(),
+    queue_family_indices.transfer_family.value()
   };
 
   std::vector<vk::DeviceQueueCreateInfo> queue_create_infos;
@@ -278,17 +484,43 @@ void RenderEngine::create_logical_device() {
     queue_create_infos.emplace_back(queue_create_info);
   }
 
-  vk::PhysicalDeviceFeatures device_features {};
+  vk::PhysicalDeviceFeatures device_features {
+    .multiDrawIndirect = occlusion_culling_enabled,
+    .drawIndirectFirstInstance = occlusion_culling_enabled
+  };
+
+  vk::PhysicalDevicePresentWaitFeaturesKHR present_wait_features {
+    .presentWait = true
+  };
+
+  vk::PhysicalDevicePresentIdFeaturesKHR present_id_features {
+    .pNext = &present_wait_features,
+    .presentId = true
+  };
+
+  vk::PhysicalDeviceVulkan13Features vulkan_13_features {
+    .pNext = (present_wait_enabled ? &present_id_features : nullptr),
+    .computeFullSubgroups = radix_sort_supported,
+    .synchronization2 = true,
+    .dynamicRendering = true
+  };
+
+  vk::PhysicalDeviceVulkan12Features vulkan_12_features {
+    .pNext = &vulkan_13_features,
+    .shaderSampledImageArrayNonUniformIndexing = true,
+    .bufferDeviceAddress = vertex_pulling_enabled
+  };
 
   vk::DeviceCreateInfo create_info {
+    .pNext = &vulkan_12_features,
     .queueCreateInfoCount = static_cast<uint32_t>(queue_create_infos.size()),
     .pQueueCreateInfos = queue_create_infos.data(),
-    .enabledExtensionCount = static_cast<uint32_t>(required_device_extensions.size()),
-    .ppEnabledExtensionNames = required_device_extensions.data(),
+    .enabledExtensionCount = static_cast<uint32_t>(enabled_device_extensions.size()),
+    .ppEnabledExtensionNames = enabled_device_extensions.data(),
     .pEnabledFeatures = &device_features,
   };
 
-  if constexpr (enable_validation_layers) {
+  if (config.validation.enabled) {
     create_info.enabledLayerCount = static_cast<uint32_t>(config.vulkan.requested_layers.size());
     create_info.ppEnabledLayerNames = config.vulkan.requested_layers.data();
   } else {
@@ -299,6 +531,10 @@ void RenderEngine::create_logical_device() {
   device = std::make_unique<vk::raii::Device>(*physical_device, create_info);
 }
 
+void RenderEngine::create_memory_tracker() {
+  memory_tracker = std::make_unique<MemoryTracker>(*physical_device, *device, memory_budget_enabled);
+}
+
 void RenderEngine::query_queues() {
   graphics_queue = std::make_unique<vk::raii::Queue>(
     device->getQueue(queue_family_indices.graphics_family.value(), 0)
@@ -307,6 +543,10 @@ void RenderEngine::query_queues() {
   present_queue = std::make_unique<vk::raii::Queue>(
     device->getQueue(queue_family_indices.present_family.value(), 0)
   );
+
+  transfer_queue = std::make_unique<vk::raii::Queue>(
+    device->getQueue(queue_family_indices.transfer_family.value(), 0)
+  );
 }
 
 auto RenderEngine::get_swap_chain_info(const vk::raii::PhysicalDevice& _device) 
@@ -359,15 +599,34 @@ auto RenderEngine::select_present_mode(const std::vector<vk::PresentModeKHR>& pr
   return vk::PresentModeKHR::eFifo;
 }
 
+auto RenderEngine::select_swap_chain_image_count(const vk::SurfaceCapabilitiesKHR& capabilities) -> uint32_t {
+  // The display holds one image while every frame in flight renders into another, fixed frames in
+  // flight keep one image over the driver's minimum
+  uint32_t image_count = capabilities.minImageCount + 1;
+  if (config.adaptive_frames_in_flight) {
+    image_count = std::max(frames_in_flight + 1, capabilities.minImageCount);
+  }
+  if (capabilities.maxImageCount > 0 && image_count > capabilities.maxImageCount) {
+    image_count = capabilities.maxImageCount;
+  }
+  return image_count;
+}
+
 void RenderEngine::create_swap_chain() {
   auto extent = select_swap_chain_extent(swap_chain_info.capabilities);
   auto surface_format = select_surface_format(swap_chain_info.formats);
   auto present_mode = select_present_mode(swap_chain_info.present_modes);
 
   auto capabilities = swap_chain_info.capabilities;
-  uint32_t image_count = capabilities.minImageCount + 1;
-  if (capabilities.maxImageCount > 0 && image_count > capabilities.maxImageCount) {
-    image_count = capabilities.maxImageCount;
+  uint32_t image_count = select_swap_chain_image_count(capabilities);
+
+  // Captured frames are copied straight out of the swap chain images
+  vk::ImageUsageFlags image_usage = vk::ImageUsageFlagBits::eColorAttachment;
+  if (config.capture.enabled) {
+    if (!(capabilities.supportedUsageFlags & vk::ImageUsageFlagBits::eTransferSrc)) {
+      throw std::runtime_error("Swap chain images cannot be copied from, frame capture is not supported");
+    }
+    image_usage |= vk::ImageUsageFlagBits::eTransferSrc;
   }
 
   vk::SwapchainCreateInfoKHR create_info = {
@@ -377,12 +636,12 @@ void RenderEngine::create_swap_chain() {
     .imageColorSpace = surface_format.colorSpace,
     .imageExtent = extent,
     .imageArrayLayers = 1,
-    .imageUsage = vk::ImageUsageFlagBits::eColorAttachment,
+    .imageUsage = image_usage,
     .preTransform = capabilities.currentTransform,
     .compositeAlpha = vk::CompositeAlphaFlagBitsKHR::eOpaque,
     .presentMode = present_mode,
     .clipped = vk::True,
-    .oldSwapchain = nullptr
+    .oldSwapchain = (swap_chain ? **swap_chain : vk::SwapchainKHR {})
   };
 
   uint32_t indices[] = { 
@@ -406,6 +665,63 @@ void RenderEngine::create_swap_chain() {
   swap_chain_image_format = surface_format.format;
 }
 
+// Only called with the device idle
+void RenderEngine::recreate_swap_chain() {
+  // Waits for presents target the old swap chain, the thread starts over on the new one
+  bool waiting_for_presents = present_wait_thread.joinable();
+  if (waiting_for_presents) {
+    present_wait_thread.request_stop();
+    present_wait_thread.join();
+    pending_presents.clear();
+  }
+
+  swap_chain_image_views.clear();
+  create_swap_chain();
+  create_swap_chain_image_views();
+
+  if (waiting_for_presents) {
+    present_wait_thread = std::jthread([this] (std::stop_token stop_token) { wait_for_presents(stop_token); });
+  }
+}
+
+void RenderEngine::create_offscreen_images() {
+  swap_chain_extent = { config.resolution.width, config.resolution.height };
+  swap_chain_image_format = vk::Format::eR8G8B8A8Unorm;
+
+  vk::ImageUsageFlags image_usage = vk::ImageUsageFlagBits::eColorAttachment;
+  if (config.capture.enabled) {
+    image_usage |= vk::ImageUsageFlagBits::eTransferSrc;
+  }
+
+  // One image per frame in flight, so the image index is the frame index
+  for (uint32_t i = 0; i < config.max_frames_in_flight; ++i) {
+    vk::ImageCreateInfo create_info {
+      .imageType = vk::ImageType::e2D,
+      .format = swap_chain_image_format,
+      .extent = { swap_chain_extent.width, swap_chain_extent.height, 1 },
+      .mipLevels = 1,
+      .arrayLayers = 1,
+      .samples = vk::SampleCountFlagBits::e1,
+      .tiling = vk::ImageTiling::eOptimal,
+      .usage = image_usage,
+      .sharingMode = vk::SharingMode::eExclusive,
+      .initialLayout = vk::ImageLayout::eUndefined
+    };
+    vk::raii::Image image { *device, create_info };
+
+    auto requirements = image.getMemoryRequirements();
+    uint32_t memory_type = memory_tracker->find_memory_type(
+      requirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal
+    );
+    auto memory = memory_tracker->allocate(requirements.size, memory_type, MemoryCategory::eRenderTarget);
+    image.bindMemory(*memory, 0);
+
+    swap_chain_images.push_back(*image);
+    offscreen_images.push_back(std::move(image));
+    offscreen_image_memories.push_back(std::move(memory));
+  }
+}
+
 void RenderEngine::create_swap_chain_image_views() {
   auto size = swap_chain_images.size();
   swap_chain_image_views.reserve(size);
@@ -433,229 +749,146 @@ void RenderEngine::create_swap_chain_image_views() {
   }
 }
 
-void RenderEngine::create_render_pass() {
-  vk::AttachmentDescription color_attachment {
-    .format = swap_chain_image_format,
-    .samples = vk::SampleCountFlagBits::e1,
-    .loadOp = vk::AttachmentLoadOp::eClear,
-    .storeOp = vk::AttachmentStoreOp::eStore,
-    .stencilLoadOp = vk::AttachmentLoadOp::eDontCare,
-    .stencilStoreOp = vk::AttachmentStoreOp::eDontCare,
-    .initialLayout = vk::ImageLayout::eUndefined,
-    .finalLayout = vk::ImageLayout::ePresentSrcKHR
-  };
-
-  vk::AttachmentReference color_attachment_reference {
-    .attachment = 0,
-    .layout = vk::ImageLayout::eColorAttachmentOptimal
-  };
-
-  vk::SubpassDescription subpass_description {
-    .pipelineBindPoint = vk::PipelineBindPoint::eGraphics,
-    .colorAttachmentCount = 1,
-    .pColorAttachments = &color_attachment_reference,
-  };
-
-  vk::SubpassDependency subpass_dependency {
-    .srcSubpass = vk::SubpassExternal,
-    .dstSubpass = 0,
-    .srcStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput,
-    .dstStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput,
-    .srcAccessMask = vk::AccessFlagBits::eNone,
-    .dstAccessMask = vk::AccessFlagBits::eColorAttachmentWrite
-  };
-
-  vk::RenderPassCreateInfo create_info {
-    .attachmentCount = 1,
-    .pAttachments = &color_attachment,
-    .subpassCount = 1,
-    .pSubpasses = &subpass_description,
-    .dependencyCount = 1,
-    .pDependencies = &subpass_dependency
-  };
-
-  render_pass = std::make_unique<vk::raii::RenderPass>(*device, create_info);
+void RenderEngine::select_depth_format() {
+  // The occlusion culler samples the depth buffer, so every candidate has to support both
+  using enum vk::FormatFeatureFlagBits;
+  for (auto format : { vk::Format::eD32Sfloat, vk::Format::eX8D24UnormPack32, vk::Format::eD16Unorm }) {
+    auto features = physical_device->getFormatProperties(format).optimalTilingFeatures;
+    if ((features & eDepthStencilAttachment) && (features & eSampledImage)) {
+      depth_format = format;
+      return;
+    }
+  }
+  throw std::runtime_error("Failed to find a sampled depth format");
 }
 
 void RenderEngine::create_descriptor_set_layout() {
-  vk::DescriptorSetLayoutBinding ubo_layout_bounding {
-    .binding = 0,
-    .descriptorType = vk::DescriptorType::eUniformBuffer,
-    .descriptorCount = 1,
-    .stageFlags = vk::ShaderStageFlagBits::eVertex
+  // Camera and per draw data come from push constants, binding 0 used to hold the camera. Bindings 2 to 4
+  // hold the frame's lights and the cluster light lists.
+  std::array<vk::DescriptorSetLayoutBinding, 4> bindings;
+  bindings[0] = {
+    .binding = 1,
+    .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+    .descriptorCount = config.max_textures,
+    .stageFlags = vk::ShaderStageFlagBits::eFragment
   };
+  for (uint32_t i = 1; i < bindings.size(); ++i) {
+    bindings[i] = {
+      .binding = i + 1,
+      .descriptorType = vk::DescriptorType::eStorageBuffer,
+      .descriptorCount = 1,
+      .stageFlags = vk::ShaderStageFlagBits::eFragment
+    };
+  }
 
   vk::DescriptorSetLayoutCreateInfo create_info {
-    .bindingCount = 1,
-    .pBindings = &ubo_layout_bounding
+    .bindingCount = static_cast<uint32_t>(bindings.size()),
+    .pBindings = bindings.data()
   };
 
   descriptor_set_layout = std::make_unique<vk::raii::DescriptorSetLayout>(*device, create_info);
 }
 
 void RenderEngine::create_graphics_pipeline() {
-  auto vertex_shader_code = read_file("shaders/main.vert.spv");
-  auto fragment_shader_code = read_file("shaders/main.frag.spv");
-  auto vertex_shader_module = create_shader_module(vertex_shader_code);
-  auto fragment_shader_module = create_shader_module(fragment_shader_code);
-
-  vk::PipelineShaderStageCreateInfo vertex_shader_stage_create_info {
-    .stage = vk::ShaderStageFlagBits::eVertex,
-    .module = *vertex_shader_module,
-    .pName = "main"
-  };
-
-  vk::PipelineShaderStageCreateInfo fragment_shader_stage_create_info {
-    .stage = vk::ShaderStageFlagBits::eFragment,
-    .module = *fragment_shader_module,
-    .pName = "main"
-  };
-
-  std::array shader_stages = {
-    vertex_shader_stage_create_info, fragment_shader_stage_create_info
-  };
-
-  vk::VertexInputBindingDescription binding_description {
-    .binding = 0,
-    .stride = sizeof(Vertex),
-    .inputRate = vk::VertexInputRate::eVertex
-  };
-
-  std::array<vk::VertexInputAttributeDescription, 2> attribute_descriptions;
-  attribute_descriptions[0] = {
-    .location = 0,
-    .binding = 0,
-    .format = vk::Format::eR32G32Sfloat,
-    .offset = offsetof(Vertex, position)
-  };
-  
-  attribute_descriptions[1] = {
-    .location = 1,
-    .binding = 0,
-    .format = vk::Format::eR32G32B32Sfloat,
-    .offset = offsetof(Vertex, color)
-  };
-
-  vk::PipelineVertexInputStateCreateInfo vertex_input_state_create_info {
-    .vertexBindingDescriptionCount = 1,
-    .pVertexBindingDescriptions = &binding_description,
-    .vertexAttributeDescriptionCount = static_cast<uint32_t>(attribute_descriptions.size()),
-    .pVertexAttributeDescriptions = attribute_descriptions.data()
-  };
-
-  vk::PipelineInputAssemblyStateCreateInfo input_assembly_state_create_info {
-    .topology = vk::PrimitiveTopology::eTriangleList,
-    .primitiveRestartEnable = false
-  };
-
-  std::array dynamic_states {
-    vk::DynamicState::eViewport,
-    vk::DynamicState::eScissor
-  };
-
-  vk::PipelineDynamicStateCreateInfo dynamic_state_create_info {
-    .dynamicStateCount = static_cast<uint32_t>(dynamic_states.size()),
-    .pDynamicStates = dynamic_states.data()
-  };
-
-  vk::PipelineViewportStateCreateInfo viewport_state_create_info {
-    .viewportCount = 1,
-    .scissorCount = 1
-  };
-
-  vk::PipelineRasterizationStateCreateInfo rasterization_state_create_info {
-    .depthClampEnable = false,
-    .rasterizerDiscardEnable = false,
-    .polygonMode = vk::PolygonMode::eFill,
-    .cullMode = vk::CullModeFlagBits::eBack,
-    .frontFace = vk::FrontFace::eCounterClockwise,
-    .depthBiasEnable = false,
-    .lineWidth = 1.0f
-  };
-
-  vk::PipelineMultisampleStateCreateInfo multisample_state_create_info {
-    .rasterizationSamples = vk::SampleCountFlagBits::e1,
-    .sampleShadingEnable = false,
-  };
-
-  using enum vk::ColorComponentFlagBits;
-  vk::PipelineColorBlendAttachmentState color_blend_attachment_state {
-    .blendEnable = false,
-    .colorWriteMask = eR | eG | eB | eA
-  };
-
-  vk::PipelineColorBlendStateCreateInfo color_blend_state_create_info {
-    .attachmentCount = 1,
-    .pAttachments = &color_blend_attachment_state
+  vk::PushConstantRange push_constant_range {
+    .stageFlags = vk::ShaderStageFlagBits::eVertex,
+    .offset = 0,
+    .size = sizeof(PushConstants)
   };
 
   vk::DescriptorSetLayout set_layouts[] = { **descriptor_set_layout };
   vk::PipelineLayoutCreateInfo pipeline_layout_create_info {
     .setLayoutCount = 1,
-    .pSetLayouts = set_layouts
+    .pSetLayouts = set_layouts,
+    .pushConstantRangeCount = 1,
+    .pPushConstantRanges = &push_constant_range
   };
   pipeline_layout = std::make_unique<vk::raii::PipelineLayout>(*device, pipeline_layout_create_info);
+  pipeline_cache = std::make_unique<PipelineCache>(
+    *device, job_system, **pipeline_layout, swap_chain_image_format, depth_format
+  );
 
-  vk::GraphicsPipelineCreateInfo graphics_pipeline_create_info {
-    .stageCount = static_cast<uint32_t>(shader_stages.size()),
-    .pStages = shader_stages.data(),
-    .pVertexInputState = &vertex_input_state_create_info,
-    .pInputAssemblyState = &input_assembly_state_create_info,
-    .pViewportState = &viewport_state_create_info,
-    .pRasterizationState = &rasterization_state_create_info,
-    .pMultisampleState = &multisample_state_create_info,
-    .pDepthStencilState = nullptr,
-    .pColorBlendState = &color_blend_state_create_info,
-    .pDynamicState = &dynamic_state_create_info,
-    .layout = *pipeline_layout,
-    .renderPass = *render_pass,
-    .subpass = 0,
-  };
-
-  graphics_pipeline = std::make_unique<vk::raii::Pipeline>(*device, nullptr, graphics_pipeline_create_info);
-}
-
-std::vector<std::byte> RenderEngine::read_file(const std::string& path) {
-  std::ifstream file { path, std::ios::ate | std::ios::binary };
-  if (!file.is_open()) {
-    throw std::runtime_error("Failed to open file: " + path);
+  PipelineCache::VertexLayout vertex_layout;
+  vertex_layout.bindings.push_back({
+    .binding = 1,
+    .stride = sizeof(glm::mat4),
+    .inputRate = vk::VertexInputRate::eInstance
+  });
+
+  // The instance model matrix occupies one location per column
+  for (uint32_t column = 0; column < 4; ++column) {
+    vertex_layout.attributes.push_back({
+      .location = 3 + column,
+      .binding = 1,
+      .format = vk::Format::eR32G32B32A32Sfloat,
+      .offset = static_cast<uint32_t>(sizeof(glm::vec4) * column)
+    });
   }
 
-  auto size = static_cast<size_t>(file.tellg());
-  std::vector<std::byte> buffer(size);
-  file.seekg(0);
-  file.read(reinterpret_cast<char*>(buffer.data()), size);
-  
-  return buffer;
-}
+  // Materials are per instance too, in a buffer of their own that only changes with the scene
+  vertex_layout.bindings.push_back({
+    .binding = 2,
+    .stride = sizeof(uint32_t),
+    .inputRate = vk::VertexInputRate::eInstance
+  });
+  vertex_layout.attributes.push_back({
+    .location = 7,
+    .binding = 2,
+    .format = vk::Format::eR32Uint,
+    .offset = 0
+  });
+
+  // Pulled vertices come from the vertex format push constants, only the instance bindings remain
+  if (!vertex_pulling_enabled) {
+    vertex_layout.bindings.push_back({
+      .binding = 0,
+      .stride = sizeof(Vertex),
+      .inputRate = vk::VertexInputRate::eVertex
+    });
+    vertex_layout.attributes.push_back({
+      .location = 0,
+      .binding = 0,
+      .format = vk::Format::eR32G32Sfloat,
+      .offset = offsetof(Vertex, position)
+    });
+    vertex_layout.attributes.push_back({
+      .location = 1,
+      .binding = 0,
+      .format = vk::Format::eR32G32B32Sfloat,
+      .offset = offsetof(Vertex, color)
+    });
+    vertex_layout.attributes.push_back({
+      .location = 2,
+      .binding = 0,
+      .format = vk::Format::eR32G32Sfloat,
+      .offset = offsetof(Vertex, uv)
+    });
+  }
 
-auto RenderEngine::create_shader_module(const std::vector<std::byte>& code) 
-  -> std::unique_ptr<vk::raii::ShaderModule> {
-  vk::ShaderModuleCreateInfo create_info {
-    .codeSize = code.size(),
-    .pCode = reinterpret_cast<const uint32_t*>(code.data())
+  // Both stages size their texture indexing by the texture count in constant 0
+  main_pipeline_state = {
+    .vertex_shader = pipeline_cache->add_shader(
+      vertex_pulling_enabled ? "shaders/main_pulled.vert.spv" : "shaders/main.vert.spv"
+    ),
+    .fragment_shader = pipeline_cache->add_shader("shaders/main.frag.spv"),
+    .vertex_layout = pipeline_cache->add_vertex_layout(std::move(vertex_layout)),
+    .blend = BlendMode::eOpaque,
+    .samples = vk::SampleCountFlagBits::e1,
+    .topology = vk::PrimitiveTopology::eTriangleList,
+    .polygon_mode = vk::PolygonMode::eFill,
+    .cull_mode = vk::CullModeFlagBits::eBack,
+    .specialization = { config.max_textures, 0, 0, 0 }
   };
 
-  return std::make_unique<vk::raii::ShaderModule>(*device, create_info);
-}
-
-void RenderEngine::create_framebuffers() {
-  swap_chain_framebuffers.reserve(swap_chain_image_views.size());
-  for (size_t i = 0; i < swap_chain_image_views.size(); ++i) {
-    std::array attachments = {
-      *swap_chain_image_views[i]
-    };
-    
-    vk::FramebufferCreateInfo create_info {
-      .renderPass = *render_pass,
-      .attachmentCount = static_cast<uint32_t>(attachments.size()),
-      .pAttachments = attachments.data(),
-      .width = swap_chain_extent.width,
-      .height = swap_chain_extent.height,
-      .layers = 1
-    };
-
-    swap_chain_framebuffers.emplace_back(*device, create_info);
+  // The untextured stand-in is quick to compile and drawn until the main pipeline is ready
+  if (config.async_pipelines) {
+    auto fallback_pipeline_state = main_pipeline_state;
+    fallback_pipeline_state.fragment_shader = pipeline_cache->add_shader("shaders/main_fallback.frag.spv");
+    fallback_pipeline = pipeline_cache->get(fallback_pipeline_state);
+    main_pipeline = pipeline_cache->request(main_pipeline_state);
+  } else {
+    main_pipeline = pipeline_cache->request(main_pipeline_state);
+    pipeline_cache->wait(main_pipeline);
   }
 }
 
@@ -668,62 +901,64 @@ void RenderEngine::create_command_pool() {
   command_pool = std::make_unique<vk::raii::CommandPool>(*device, create_info);
 }
 
-uint32_t RenderEngine::find_memory_type(uint32_t type_filter, vk::MemoryPropertyFlags flags) {
-  auto properties = physical_device->getMemoryProperties();
-  for (uint32_t i = 0; i < properties.memoryTypeCount; ++i) {
-    if (type_filter & (1 << i) && (properties.memoryTypes[i].propertyFlags & flags) == flags) {
-      return i;
-    }
-  }
-  throw std::runtime_error("Failed to find suitable memory type.");
-}
-
-void RenderEngine::create_uniform_buffers() {
-  using enum vk::MemoryPropertyFlagBits;
-  using enum vk::BufferUsageFlagBits;
-
-  vk::DeviceSize buffer_size = sizeof(TransformMatrices);
+void RenderEngine::create_gpu_profiler() {
+  gpu_profiler = std::make_unique<GpuProfiler>(
+    *physical_device, *device, queue_family_indices.graphics_family.value(), config.max_frames_in_flight
+  );
 
-  uniform_buffers.reserve(config.max_frames_in_flight);
-  uniform_buffer_memories.reserve(config.max_frames_in_flight);
-  uniform_buffer_ptrs.resize(config.max_frames_in_flight);
+  int64_t before = Profiler::now();
+  submit_one_time([this] (vk::raii::CommandBuffer& command_buffer) { gpu_profiler->write_calibration(command_buffer); });
+  gpu_profiler->calibrate(before, Profiler::now());
+}
 
+void RenderEngine::create_frame_arenas() {
   for (uint32_t i = 0; i < config.max_frames_in_flight; ++i) {
-    auto [buffer, memory] = 
-      create_buffer(buffer_size, eUniformBuffer, eHostVisible | eHostCoherent);
-    uniform_buffer_ptrs[i] = memory.mapMemory(0, buffer_size);
-    uniform_buffer_memories.emplace_back(std::move(memory));
-    uniform_buffers.emplace_back(std::move(buffer));
+    frame_arenas.push_back(std::make_unique<FrameArena>(frame_arena_size));
   }
 }
 
-void RenderEngine::update_uniform_buffer(uint32_t index) {
-  static auto prev_time = std::chrono::high_resolution_clock::now();
-  auto curr_time = std::chrono::high_resolution_clock::now();
-  float time = std::chrono::duration<float, std::chrono::seconds::period>(curr_time - prev_time).count();
+void RenderEngine::submit_one_time(const std::function<void(vk::raii::CommandBuffer&)>& record) {
+  vk::CommandBufferAllocateInfo command_buffer_allocate_info {
+    .commandPool = *command_pool,
+    .level = vk::CommandBufferLevel::ePrimary,
+    .commandBufferCount = 1
+  };
+
+  vk::raii::CommandBuffers one_time_command_buffers { *device, command_buffer_allocate_info };
+  auto& command_buffer = one_time_command_buffers[0];
 
-  float aspect_ratio = static_cast<float>(config.resolution.width) / config.resolution.height;
-  TransformMatrices transformation {
-    .model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
-    .view = glm::lookAt(glm::vec3(2.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
-    .projection = glm::perspective(glm::radians(45.0f), aspect_ratio, 0.1f, 10.0f)
+  vk::CommandBufferBeginInfo begin_info {
+    .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit
   };
-  transformation.projection[1][1] *= -1.0f;
+  command_buffer.begin(begin_info);
+  record(command_buffer);
+  command_buffer.end();
 
-  std::memcpy(uniform_buffer_ptrs[index], static_cast<const void*>(&transformation), sizeof(TransformMatrices));
+  vk::CommandBuffer command_buffers[] = { *command_buffer };
+  vk::SubmitInfo submit_info {
+    .commandBufferCount = 1,
+    .pCommandBuffers = command_buffers
+  };
+  graphics_queue->submit(submit_info);
+  graphics_queue->waitIdle();
 }
 
 void RenderEngine::create_descriptor_pool() {
-  vk::DescriptorPoolSize pool_size {
-    .type = vk::DescriptorType::eUniformBuffer,
-    .descriptorCount = config.max_frames_in_flight
+  std::array<vk::DescriptorPoolSize, 2> pool_sizes;
+  pool_sizes[0] = {
+    .type = vk::DescriptorType::eCombinedImageSampler,
+    .descriptorCount = config.max_frames_in_flight * config.max_textures
+  };
+  pool_sizes[1] = {
+    .type = vk::DescriptorType::eStorageBuffer,
+    .descriptorCount = config.max_frames_in_flight * 3
   };
 
   vk::DescriptorPoolCreateInfo create_info {
     .flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
     .maxSets = config.max_frames_in_flight,
-    .poolSizeCount = 1,
-    .pPoolSizes = &pool_size
+    .poolSizeCount = static_cast<uint32_t>(pool_sizes.size()),
+    .pPoolSizes = pool_sizes.data()
   };
 
   descriptor_pool = std::make_unique<vk::raii::DescriptorPool>(*device, create_info);
@@ -739,28 +974,41 @@ void RenderEngine::create_descriptor_sets() {
 
   descriptor_sets = device->allocateDescriptorSets(allocate_info);
   for (uint32_t i = 0; i < config.max_frames_in_flight; ++i) {
-    vk::DescriptorBufferInfo buffer_info {
-      .buffer = uniform_buffers[i],
-      .offset = 0,
-      .range = sizeof(TransformMatrices)
+    write_texture_descriptors(i);
+
+    // Each frame has its own lights, the light lists are rewritten in place every frame
+    std::array buffer_infos {
+      vk::DescriptorBufferInfo {
+        .buffer = clustered_lighting->get_light_buffer(i),
+        .offset = 0,
+        .range = clustered_lighting->get_light_buffer_size()
+      },
+      vk::DescriptorBufferInfo {
+        .buffer = clustered_lighting->get_cluster_buffer(),
+        .offset = 0,
+        .range = clustered_lighting->get_cluster_buffer_size()
+      },
+      vk::DescriptorBufferInfo {
+        .buffer = clustered_lighting->get_light_index_buffer(),
+        .offset = 0,
+        .range = clustered_lighting->get_light_index_buffer_size()
+      }
     };
-
     vk::WriteDescriptorSet descriptor_write {
       .dstSet = descriptor_sets[i],
-      .dstBinding = 0,
+      .dstBinding = 2,
       .dstArrayElement = 0,
-      .descriptorCount = 1,
-      .descriptorType = vk::DescriptorType::eUniformBuffer,
-      .pBufferInfo = &buffer_info
+      .descriptorCount = static_cast<uint32_t>(buffer_infos.size()),
+      .descriptorType = vk::DescriptorType::eStorageBuffer,
+      .pBufferInfo = buffer_infos.data()
     };
-
     device->updateDescriptorSets(descriptor_write, nullptr);
   }
 }
 
 auto RenderEngine::create_buffer(
-  vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags properties)
-    -> std::pair<vk::raii::Buffer, vk::raii::DeviceMemory> {
+  vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags properties, MemoryCategory category)
+    -> std::pair<vk::raii::Buffer, DeviceAllocation> {
   vk::BufferCreateInfo create_info {
     .size = size,
     .usage = usage,
@@ -769,82 +1017,612 @@ auto RenderEngine::create_buffer(
   vk::raii::Buffer buffer { *device, create_info };
   auto memory_requirements = buffer.getMemoryRequirements();
 
-  vk::MemoryAllocateInfo allocate_info {
-    .allocationSize = memory_requirements.size,
-    .memoryTypeIndex = find_memory_type(memory_requirements.memoryTypeBits, properties)
-  };
-  vk::raii::DeviceMemory memory { *device, allocate_info };
+  // Buffers read through their device address need memory that has one
+  vk::MemoryAllocateFlags allocate_flags;
+  if (usage & vk::BufferUsageFlagBits::eShaderDeviceAddress) {
+    allocate_flags = vk::MemoryAllocateFlagBits::eDeviceAddress;
+  }
+
+  uint32_t memory_type = memory_tracker->find_memory_type(memory_requirements.memoryTypeBits, properties);
+  auto memory = memory_tracker->allocate(memory_requirements.size, memory_type, category, allocate_flags);
   buffer.bindMemory(*memory, 0);
   return std::make_pair(std::move(buffer), std::move(memory));
 }
 
 void RenderEngine::copy_buffer(vk::Buffer src_buffer, vk::Buffer dst_buffer, vk::DeviceSize size) {
-  vk::CommandBufferAllocateInfo command_buffer_allocate_info {
-    .commandPool = *command_pool,
-    .level = vk::CommandBufferLevel::ePrimary,
-    .commandBufferCount = 1
+  submit_one_time([=] (vk::raii::CommandBuffer& command_buffer) {
+    vk::BufferCopy copy_region {
+      .size = size
+    };
+    command_buffer.copyBuffer(src_buffer, dst_buffer, copy_region);
+  });
+}
+
+void RenderEngine::create_geometry_pool() {
+  GeometryPool::Config pool_config {
+    .vertex_size = sizeof(Vertex),
+    .max_vertices = config.max_vertices,
+    .max_indices = config.max_indices,
+    .vertex_usage = {}
   };
+  if (vertex_pulling_enabled) {
+    pool_config.vertex_usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress;
+  }
 
-  vk::raii::CommandBuffers transfer_command_buffers { *device, command_buffer_allocate_info };
-  auto command_buffer = *transfer_command_buffers[0];
+  geometry_pool = std::make_unique<GeometryPool>(
+    *device, *memory_tracker, *graphics_queue, queue_family_indices.graphics_family.value(), pool_config
+  );
+  meshes.push_back(geometry_pool->add(std::as_bytes(std::span { quad.vertices }), quad.indices));
+  mesh_bounds.push_back(get_mesh_bounds(quad.vertices));
+}
 
-  vk::CommandBufferBeginInfo begin_info {
-    .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit
-  };
-  command_buffer.begin(begin_info);
+void RenderEngine::create_instance_buffers() {
+  using enum vk::MemoryPropertyFlagBits;
+  using enum vk::BufferUsageFlagBits;
 
-  vk::BufferCopy copy_region {
-    .size = size
-  };
-  command_buffer.copyBuffer(src_buffer, dst_buffer, copy_region);
-  command_buffer.end();
+  vk::DeviceSize buffer_size = sizeof(glm::mat4) * config.max_instances;
 
-  vk::SubmitInfo submit_info {
-    .commandBufferCount = 1,
-    .pCommandBuffers = &command_buffer
-  };
-  graphics_queue->submit(submit_info);
-  graphics_queue->waitIdle();
+  instance_buffers.reserve(config.max_frames_in_flight);
+  instance_buffer_memories.reserve(config.max_frames_in_flight);
+  instance_buffer_ptrs.resize(config.max_frames_in_flight);
+
+  for (uint32_t i = 0; i < config.max_frames_in_flight; ++i) {
+    auto [buffer, memory] =
+      create_buffer(buffer_size, eVertexBuffer, eHostVisible | eHostCoherent, MemoryCategory::eInstance);
+    instance_buffer_ptrs[i] = memory.map(0, buffer_size);
+    instance_buffer_memories.emplace_back(std::move(memory));
+    instance_buffers.emplace_back(std::move(buffer));
+  }
+
+  vk::DeviceSize material_size = sizeof(uint32_t) * config.max_instances;
+  auto [buffer, memory] =
+    create_buffer(material_size, eVertexBuffer, eHostVisible | eHostCoherent, MemoryCategory::eInstance);
+  material_buffer_data = { static_cast<uint32_t*>(memory.map(0, material_size)), config.max_instances };
+  material_buffer = std::make_unique<vk::raii::Buffer>(std::move(buffer));
+  material_buffer_memory = std::make_unique<DeviceAllocation>(std::move(memory));
 }
 
-void RenderEngine::create_vertex_buffer() {
+void RenderEngine::create_particles() {
+  if (config.particle_count == 0) {
+    return;
+  }
+
   using enum vk::MemoryPropertyFlagBits;
   using enum vk::BufferUsageFlagBits;
 
-  vk::DeviceSize buffer_size = sizeof(Vertex) * mesh.vertices.size();
-  auto [staging_buffer, staging_buffer_memory] = 
-    create_buffer(buffer_size, eTransferSrc, eHostVisible | eHostCoherent);
+  auto particles = ParticleSystem::create_particles(config.particle_count);
+  vk::DeviceSize buffer_size = sizeof(Particle) * particles.size();
+  auto [staging_buffer, staging_buffer_memory] =
+    create_buffer(buffer_size, eTransferSrc, eHostVisible | eHostCoherent, MemoryCategory::eStaging);
 
-  void* data = staging_buffer_memory.mapMemory(0, buffer_size);
-  std::memcpy(data, static_cast<const void*>(mesh.vertices.data()), buffer_size);
-  staging_buffer_memory.unmapMemory();
+  void* data = staging_buffer_memory.map(0, buffer_size);
+  std::memcpy(data, static_cast<const void*>(particles.data()), buffer_size);
+  staging_buffer_memory.unmap();
 
-  auto [buffer, memory] = 
-    create_buffer(buffer_size, eTransferDst | eVertexBuffer, eDeviceLocal);
+  auto [buffer, memory] =
+    create_buffer(buffer_size, eTransferSrc | eTransferDst | eStorageBuffer, eDeviceLocal, MemoryCategory::eStorage);
   copy_buffer(*staging_buffer, *buffer, buffer_size);
 
-  vertex_buffer = std::make_unique<vk::raii::Buffer>(std::move(buffer));
-  vertex_buffer_memory = std::make_unique<vk::raii::DeviceMemory>(std::move(memory));
+  particle_buffer = std::make_unique<vk::raii::Buffer>(std::move(buffer));
+  particle_buffer_memory = std::make_unique<DeviceAllocation>(std::move(memory));
+  particle_system = std::make_unique<ParticleSystem>(
+    *device, **particle_buffer, config.particle_count, swap_chain_image_format, depth_format
+  );
+  particle_time = 0.0;
+  particle_delta_time = 0.0f;
 }
 
-void RenderEngine::create_index_buffer() {
+void RenderEngine::update_particles(const FrameState& frame_state) {
+  // Long stalls would launch every particle at once, so steps are capped
+  particle_delta_time = static_cast<float>(std::clamp(frame_state.time - particle_time, 0.0, 0.1));
+  particle_time = frame_state.time;
+}
+
+auto RenderEngine::validate_particles(uint32_t steps, float delta_time) -> double {
+  if (!particle_system) {
+    return 0.0;
+  }
+  device->waitIdle();
+
   using enum vk::MemoryPropertyFlagBits;
   using enum vk::BufferUsageFlagBits;
-  
-  vk::DeviceSize buffer_size = sizeof(uint16_t) * mesh.indices.size();
-  auto [staging_buffer, staging_buffer_memory] =
-    create_buffer(buffer_size, eTransferSrc, eHostVisible | eHostCoherent);
-  
-  void* data = staging_buffer_memory.mapMemory(0, buffer_size);
-  std::memcpy(data, static_cast<const void*>(mesh.indices.data()), buffer_size);
-  staging_buffer_memory.unmapMemory();
-
-  auto [buffer, memory] = 
-    create_buffer(buffer_size, eTransferDst | eIndexBuffer, eDeviceLocal);
-  copy_buffer(*staging_buffer, *buffer, buffer_size);
 
-  index_buffer = std::make_unique<vk::raii::Buffer>(std::move(buffer));
-  index_buffer_memory = std::make_unique<vk::raii::DeviceMemory>(std::move(memory));
+  auto count = particle_system->get_particle_count();
+  vk::DeviceSize buffer_size = sizeof(Particle) * count;
+  auto [readback_buffer, readback_memory] =
+    create_buffer(buffer_size, eTransferDst, eHostVisible | eHostCoherent, MemoryCategory::eReadback);
+
+  auto read_particles = [&] {
+    copy_buffer(**particle_buffer, *readback_buffer, buffer_size);
+    std::vector<Particle> particles(count);
+    std::memcpy(static_cast<void*>(particles.data()), readback_memory.map(0, buffer_size), buffer_size);
+    readback_memory.unmap();
+    return particles;
+  };
+
+  auto expected = read_particles();
+  submit_one_time([this, steps, delta_time] (vk::raii::CommandBuffer& command_buffer) {
+    using Stage = vk::PipelineStageFlagBits2;
+    using Access = vk::AccessFlagBits2;
+    vk::MemoryBarrier2 step_barrier {
+      .srcStageMask = Stage::eAllCommands,
+      .srcAccessMask = Access::eMemoryWrite,
+      .dstStageMask = Stage::eComputeShader,
+      .dstAccessMask = Access::eShaderStorageRead | Access::eShaderStorageWrite
+    };
+    vk::MemoryBarrier2 readback_barrier {
+      .srcStageMask = Stage::eComputeShader,
+      .srcAccessMask = Access::eShaderStorageWrite,
+      .dstStageMask = Stage::eCopy,
+      .dstAccessMask = Access::eTransferRead
+    };
+
+    for (uint32_t i = 0; i < steps; ++i) {
+      command_buffer.pipelineBarrier2({ .memoryBarrierCount = 1, .pMemoryBarriers = &step_barrier });
+      particle_system->simulate(command_buffer, delta_time);
+    }
+    command_buffer.pipelineBarrier2({ .memoryBarrierCount = 1, .pMemoryBarriers = &readback_barrier });
+  });
+  auto simulated = read_particles();
+
+  for (uint32_t i = 0; i < steps; ++i) {
+    ParticleSystem::simulate_reference(expected, delta_time);
+  }
+
+  // Transcendentals and fused multiplies round differently, a respawn mismatch is a real error
+  uint32_t mismatches = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    bool same_spawn = (expected[i].spawn_count == simulated[i].spawn_count);
+    if (!same_spawn || glm::length(expected[i].position - simulated[i].position) > 1e-3f) {
+      ++mismatches;
+    }
+  }
+  return static_cast<double>(mismatches) / count;
+}
+
+auto RenderEngine::benchmark_radix_sort(uint32_t count, uint32_t iterations) -> SortBenchmark {
+  if (!radix_sort_supported) {
+    throw std::runtime_error("Radix sort needs subgroup ballots and full subgroups in compute shaders");
+  }
+  device->waitIdle();
+
+  using enum vk::MemoryPropertyFlagBits;
+  using enum vk::BufferUsageFlagBits;
+
+  std::mt19937 rng { 1 };
+  std::vector<uint32_t> keys(count), values(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    keys[i] = static_cast<uint32_t>(rng());
+    values[i] = i;
+  }
+
+  // Keys and then values, the input on the way in and the sorted pairs on the way out
+  vk::DeviceSize buffer_size = sizeof(uint32_t) * count;
+  auto [staging_buffer, staging_memory] =
+    create_buffer(2 * buffer_size, eTransferSrc | eTransferDst, eHostVisible | eHostCoherent, MemoryCategory::eStaging);
+  auto* staging = static_cast<uint32_t*>(staging_memory.map(0, 2 * buffer_size));
+  std::memcpy(staging, keys.data(), buffer_size);
+  std::memcpy(staging + count, values.data(), buffer_size);
+
+  auto [key_buffer, key_memory] =
+    create_buffer(buffer_size, eStorageBuffer | eTransferSrc | eTransferDst, eDeviceLocal, MemoryCategory::eStorage);
+  auto [value_buffer, value_memory] =
+    create_buffer(buffer_size, eStorageBuffer | eTransferSrc | eTransferDst, eDeviceLocal, MemoryCategory::eStorage);
+
+  RadixSort radix_sort { *device, *memory_tracker, count, 1 };
+  auto binding = radix_sort.bind(*key_buffer, *value_buffer);
+
+  iterations = std::max(iterations, 1u);
+  vk::QueryPoolCreateInfo query_pool_create_info {
+    .queryType = vk::QueryType::eTimestamp,
+    .queryCount = 2 * iterations
+  };
+  vk::raii::QueryPool query_pool { *device, query_pool_create_info };
+
+  // Every sort starts over from the unsorted input, only the sorts themselves are timed
+  submit_one_time([&] (vk::raii::CommandBuffer& command_buffer) {
+    using Stage = vk::PipelineStageFlagBits2;
+    using Access = vk::AccessFlagBits2;
+    vk::MemoryBarrier2 upload_barrier {
+      .srcStageMask = Stage::eCopy,
+      .srcAccessMask = Access::eTransferWrite,
+      .dstStageMask = Stage::eComputeShader,
+      .dstAccessMask = Access::eShaderStorageRead | Access::eShaderStorageWrite
+    };
+    vk::MemoryBarrier2 sorted_barrier {
+      .srcStageMask = Stage::eComputeShader,
+      .srcAccessMask = Access::eShaderStorageRead | Access::eShaderStorageWrite,
+      .dstStageMask = Stage::eCopy,
+      .dstAccessMask = Access::eTransferRead | Access::eTransferWrite
+    };
+
+    command_buffer.resetQueryPool(*query_pool, 0, 2 * iterations);
+    for (uint32_t i = 0; i < iterations; ++i) {
+      command_buffer.copyBuffer(
+        *staging_buffer, *key_buffer, vk::BufferCopy { .srcOffset = 0, .dstOffset = 0, .size = buffer_size }
+      );
+      command_buffer.copyBuffer(
+        *staging_buffer, *value_buffer, vk::BufferCopy { .srcOffset = buffer_size, .dstOffset = 0, .size = buffer_size }
+      );
+      command_buffer.pipelineBarrier2({ .memoryBarrierCount = 1, .pMemoryBarriers = &upload_barrier });
+      command_buffer.writeTimestamp2(Stage::eAllCommands, *query_pool, 2 * i);
+      radix_sort.sort(command_buffer, binding, count);
+      command_buffer.writeTimestamp2(Stage::eAllCommands, *query_pool, 2 * i + 1);
+      command_buffer.pipelineBarrier2({ .memoryBarrierCount = 1, .pMemoryBarriers = &sorted_barrier });
+    }
+    command_buffer.copyBuffer(
+      *key_buffer, *staging_buffer, vk::BufferCopy { .srcOffset = 0, .dstOffset = 0, .size = buffer_size }
+    );
+    command_buffer.copyBuffer(
+      *value_buffer, *staging_buffer, vk::BufferCopy { .srcOffset = 0, .dstOffset = buffer_size, .size = buffer_size }
+    );
+  });
+
+  auto timestamps = query_pool.getResults<uint64_t>(
+    0, 2 * iterations, 2 * iterations * sizeof(uint64_t), sizeof(uint64_t),
+    vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait
+  ).second;
+  auto graphics_family = queue_family_indices.graphics_family.value();
+  auto valid_bits = physical_device->getQueueFamilyProperties()[graphics_family].timestampValidBits;
+  uint64_t timestamp_mask = (valid_bits >= 64 ? ~uint64_t { 0 } : (uint64_t { 1 } << valid_bits) - 1);
+  double ticks = 0.0;
+  for (uint32_t i = 0; i < iterations; ++i) {
+    ticks += static_cast<double>((timestamps[2 * i + 1] - timestamps[2 * i]) & timestamp_mask);
+  }
+  double period = static_cast<double>(physical_device->getProperties().limits.timestampPeriod);
+
+  RadixSort::sort_reference(keys, values);
+  uint32_t mismatches = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    mismatches += (staging[i] != keys[i] || staging[count + i] != values[i] ? 1 : 0);
+  }
+  staging_memory.unmap();
+
+  return {
+    .mismatch = (count > 0 ? static_cast<double>(mismatches) / count : 0.0),
+    .milliseconds = ticks * period / 1e6 / iterations
+  };
+}
+
+void RenderEngine::create_occlusion_culler() {
+  if (!occlusion_culling_enabled) {
+    return;
+  }
+
+  occlusion_culler = std::make_unique<OcclusionCuller>(
+    *device, *memory_tracker, swap_chain_extent, config.max_instances, config.scene.mesh_count + 1,
+    config.max_frames_in_flight
+  );
+  submit_one_time([this] (vk::raii::CommandBuffer& command_buffer) { occlusion_culler->initialize(command_buffer); });
+  occlusion_candidate_count = 0;
+  previous_view_projection = glm::mat4(1.0f);
+  culling_view_projection = glm::mat4(1.0f);
+}
+
+void RenderEngine::create_lights() {
+  clustered_lighting = std::make_unique<ClusteredLighting>(
+    *device, *memory_tracker, config.light_count, config.max_frames_in_flight
+  );
+
+  // Spread evenly over the grid just above it, ranges shrink as lights get denser so that about the
+  // same number of them reach each point whatever the count
+  scene_lights.reserve(config.light_count);
+  float range = 0.35f * std::sqrt(64.0f / static_cast<float>(std::max(config.light_count, 1u)));
+  for (uint32_t i = 0; i < config.light_count; ++i) {
+    float x = std::fmod(0.5f + 0.7548777f * static_cast<float>(i), 1.0f);
+    float y = std::fmod(0.5f + 0.5698403f * static_cast<float>(i), 1.0f);
+    float hue = 6.0f * std::fmod(0.6180340f * static_cast<float>(i), 1.0f);
+    auto channel = [hue] (float offset) {
+      return 0.15f * std::clamp(std::abs(std::fmod(hue + offset, 6.0f) - 3.0f) - 1.0f, 0.0f, 1.0f);
+    };
+
+    Light light {
+      .position = { 1.1f * x - 0.55f, 1.1f * y - 0.55f, 0.03f + 0.1f * static_cast<float>(i % 3) },
+      .range = range,
+      .color = { channel(0.0f), channel(4.0f), channel(2.0f) },
+      .cos_inner_angle = -1.0f,
+      .direction = { 0.0f, 0.0f, -1.0f },
+      .cos_outer_angle = -1.0f
+    };
+    // Every fourth light is a spot pointing down, which reaches further in a narrower cone
+    if (i % 4 == 0) {
+      light.range *= 1.5f;
+      light.cos_inner_angle = std::cos(glm::radians(30.0f));
+      light.cos_outer_angle = std::cos(glm::radians(40.0f));
+    }
+    scene_lights.push_back(light);
+  }
+}
+
+void RenderEngine::update_lights(uint32_t index, const FrameState& frame_state) {
+  PROFILE_ZONE("update_lights");
+  // Every light circles its place at its own pace
+  auto lights = clustered_lighting->get_lights(index);
+  auto time = static_cast<float>(frame_state.time);
+  for (uint32_t i = 0; i < scene_lights.size(); ++i) {
+    float angle = time * (0.5f + 0.15f * static_cast<float>(i % 7)) + 2.3999632f * static_cast<float>(i);
+    lights[i] = scene_lights[i];
+    lights[i].position += 0.05f * glm::vec3(std::cos(angle), std::sin(angle), 0.0f);
+  }
+
+  float aspect_ratio = static_cast<float>(swap_chain_extent.width) / swap_chain_extent.height;
+  auto camera = get_camera_matrices(aspect_ratio);
+  clustered_lighting->set_view(
+    index, camera.view, camera.projection, swap_chain_extent, static_cast<uint32_t>(scene_lights.size())
+  );
+}
+
+void RenderEngine::create_scene() {
+  transform_system = std::make_unique<TransformSystem>(frames_in_flight);
+  root_node = transform_system->create();
+  root_rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+  instance_meshes.push_back(0);
+  instance_materials.push_back(0);
+
+  if (config.scene.object_count > 0) {
+    create_generated_scene();
+  } else {
+    create_grid_scene();
+  }
+
+  if (occlusion_culler) {
+    std::vector<OcclusionCuller::DrawInfo> draws;
+    for (auto handle : meshes) {
+      const auto& range = geometry_pool->get(handle);
+      draws.push_back({
+        .index_count = range.index_count,
+        .first_index = range.first_index,
+        .vertex_offset = range.vertex_offset
+      });
+    }
+    occlusion_culler->set_meshes(draws);
+  }
+
+  // Texture streaming reads the materials every frame, so the mapped buffer is only ever written
+  std::ranges::copy(instance_materials, material_buffer_data.begin());
+
+  // Culling refills these every frame and never grows them past the instance capacity
+  scene_bounds.reserve(config.max_instances);
+  visible_instances.reserve(config.max_instances);
+  draw_list.reserve(config.max_instances);
+}
+
+void RenderEngine::create_grid_scene() {
+  // A grid of small quads on top of the root, each instance samples texture index % texture count
+  constexpr int grid_size = 8;
+  if (static_cast<uint32_t>(grid_size * grid_size) >= config.max_instances) {
+    throw std::runtime_error("Scene has more transforms than instance buffer capacity");
+  }
+  constexpr float spacing = 1.0f / grid_size;
+  for (int y = 0; y < grid_size; ++y) {
+    for (int x = 0; x < grid_size; ++x) {
+      auto node = transform_system->create(root_node);
+      float offset = (grid_size - 1) * 0.5f;
+      // Lifted off the root's quad so the depth test does not fight over their shared plane
+      transform_system->set_position(node, glm::vec3((x - offset) * spacing, (y - offset) * spacing, 0.01f));
+      transform_system->set_scale(node, glm::vec3(spacing * 0.8f));
+      instance_meshes.push_back(0);
+      instance_materials.push_back(node);
+    }
+  }
+}
+
+void RenderEngine::create_generated_scene() {
+  // The root takes an instance too
+  if (config.scene.object_count >= config.max_instances) {
+    throw std::runtime_error("Generated scene has more objects than instance buffer capacity");
+  }
+
+  auto scene = generate_scene(config.scene);
+  std::vector<Vertex> vertices;
+  for (const auto& generated : scene.meshes) {
+    vertices.clear();
+    for (const auto& vertex : generated.vertices) {
+      vertices.push_back({ .position = vertex.position, .color = vertex.color, .uv = vertex.uv });
+    }
+    meshes.push_back(geometry_pool->add(std::as_bytes(std::span { vertices }), generated.indices));
+    mesh_bounds.push_back(get_mesh_bounds(vertices));
+  }
+
+  // Objects stand on the root's quad, materials pick the texture like instance indices do in the grid
+  instance_meshes.reserve(scene.objects.size() + 1);
+  instance_materials.reserve(scene.objects.size() + 1);
+  for (const auto& object : scene.objects) {
+    auto node = transform_system->create(root_node);
+    transform_system->set_position(node, object.position);
+    transform_system->set_rotation(node, object.rotation);
+    transform_system->set_scale(node, glm::vec3(object.scale));
+    instance_meshes.push_back(object.mesh + 1);
+    instance_materials.push_back(object.material);
+    if (object.spin != 0.0f) {
+      spinning_nodes.push_back({ .node = node, .rotation = object.rotation, .speed = object.spin });
+    }
+  }
+}
+
+void RenderEngine::update_scene(uint32_t index, const FrameState& frame_state) {
+  PROFILE_ZONE("update_scene");
+  // Setting the same rotation again would mark the whole scene as moved
+  if (frame_state.rotation != root_rotation) {
+    root_rotation = frame_state.rotation;
+    transform_system->set_rotation(root_node, root_rotation);
+  }
+  // Only the dynamic objects of a generated scene change their local matrices
+  auto time = static_cast<float>(frame_state.time);
+  for (const auto& spinning : spinning_nodes) {
+    transform_system->set_rotation(
+      spinning.node, spinning.rotation * glm::angleAxis(time * spinning.speed, glm::vec3(0.0f, 0.0f, 1.0f))
+    );
+  }
+
+  if (transform_system->size() > config.max_instances) {
+    throw std::runtime_error("Scene has more transforms than instance buffer capacity");
+  }
+
+  // Local matrices are independent, only the hierarchy sweep has to run in order
+  uint32_t first_batch = transform_system->first_dirty_batch();
+  uint32_t batch_count = transform_system->batch_count() - std::min(first_batch, transform_system->batch_count());
+  job_system.parallel_for(batch_count, 256, [this, first_batch] (uint32_t begin, uint32_t end) {
+    transform_system->update_local_matrices(first_batch + begin, first_batch + end);
+  });
+  transform_system->update_world_matrices(static_cast<float*>(instance_buffer_ptrs[index]));
+  cull_scene(index);
+}
+
+void RenderEngine::cull_scene(uint32_t index) {
+  PROFILE_ZONE("cull_scene");
+  uint32_t instance_count = transform_system->size();
+  auto update_bounds = [this] (uint32_t instance) {
+    scene_bounds[instance] = transform_bounds(
+      mesh_bounds[instance_meshes[instance]], glm::make_mat4(transform_system->get_world_matrix(instance))
+    );
+  };
+
+  if (scene_bvh.size() != instance_count) {
+    scene_bounds.resize(instance_count);
+    for (uint32_t i = 0; i < instance_count; ++i) {
+      update_bounds(i);
+    }
+    scene_bvh.build(scene_bounds);
+  } else if (auto changed = transform_system->get_changed_nodes(); !changed.empty()) {
+    // Only moved objects loosen the tree, a static scene skips the refit
+    for (auto instance : changed) {
+      update_bounds(instance);
+      scene_bvh.set_bounds(instance, scene_bounds[instance]);
+    }
+    scene_bvh.refit();
+  }
+
+  float aspect_ratio = static_cast<float>(swap_chain_extent.width) / swap_chain_extent.height;
+  auto camera = get_camera_matrices(aspect_ratio);
+  auto view_projection = camera.projection * camera.view;
+  visible_instances.clear();
+  scene_bvh.cull(Frustum::from_matrix(view_projection), visible_instances);
+  std::sort(visible_instances.begin(), visible_instances.end());
+
+  // The pyramid holds the previous frame's depth, so candidates are projected with that frame's camera
+  if (occlusion_culler) {
+    auto candidates = occlusion_culler->get_candidates(index);
+    for (size_t i = 0; i < visible_instances.size(); ++i) {
+      const auto& bounds = scene_bounds[visible_instances[i]];
+      candidates[i] = {
+        .min = bounds.min,
+        .instance = visible_instances[i],
+        .max = bounds.max,
+        .mesh = instance_meshes[visible_instances[i]]
+      };
+    }
+    occlusion_candidate_count = static_cast<uint32_t>(visible_instances.size());
+    culling_view_projection = previous_view_projection;
+    previous_view_projection = view_projection;
+    return;
+  }
+
+  // Neighbouring instances of the same mesh merge into a single draw
+  draw_list.clear();
+  for (uint32_t instance : visible_instances) {
+    uint32_t mesh = instance_meshes[instance];
+    if (!draw_list.empty() && draw_list.back().mesh == mesh
+        && draw_list.back().first_instance + draw_list.back().instance_count == instance) {
+      ++draw_list.back().instance_count;
+    } else {
+      draw_list.push_back({ mesh, instance, 1 });
+    }
+  }
+}
+
+void RenderEngine::create_textures() {
+  TextureStreamer::Config streamer_config {
+    .budget = config.texture_budget,
+    .upload_limit = 16 * 1024 * 1024,
+    .tail_size = 64,
+    .max_uploads = 4,
+    .frames_in_flight = config.max_frames_in_flight
+  };
+
+  texture_streamer = std::make_unique<TextureStreamer>(
+    *physical_device, *device, *memory_tracker,
+    *graphics_queue, queue_family_indices.graphics_family.value(),
+    *transfer_queue, queue_family_indices.transfer_family.value(),
+    streamer_config
+  );
+
+  // Files fill the first slots and are loaded here so load errors reach the caller, the rest are procedural
+  auto file_count = static_cast<uint32_t>(std::min<size_t>(config.texture_paths.size(), config.max_textures));
+  std::vector<TextureSource> sources(config.max_textures);
+  for (uint32_t i = 0; i < file_count; ++i) {
+    sources[i] = load_ktx2(config.texture_paths[i], *physical_device);
+  }
+
+  job_system.parallel_for(config.max_textures - file_count, 1, [&sources, file_count] (uint32_t begin, uint32_t end) {
+    for (uint32_t i = file_count + begin; i < file_count + end; ++i) {
+      // A different hue for every texture
+      float hue = 6.0f * static_cast<float>(i) / static_cast<float>(sources.size());
+      auto channel = [hue] (float offset) {
+        return static_cast<uint8_t>(255.0f * std::clamp(std::abs(std::fmod(hue + offset, 6.0f) - 3.0f) - 1.0f, 0.0f, 1.0f));
+      };
+      sources[i] = generate_checker_texture(1024, 64, { channel(0.0f), channel(4.0f), channel(2.0f), 255 });
+    }
+  });
+
+  for (auto& source : sources) {
+    texture_streamer->add(std::move(source));
+  }
+
+  texture_descriptor_versions.resize(config.max_frames_in_flight, 0);
+}
+
+void RenderEngine::update_textures(uint32_t index) {
+  PROFILE_ZONE("update_textures");
+  // Request the mip level at which a texel covers about one pixel of each instance's quad, for the
+  // texture its material samples
+  float aspect_ratio = static_cast<float>(config.resolution.width) / config.resolution.height;
+  auto camera = get_camera_matrices(aspect_ratio);
+  auto view_projection = camera.projection * camera.view;
+  float pixels_per_unit = std::abs(camera.projection[1][1]) * 0.5f * static_cast<float>(swap_chain_extent.height);
+
+  for (uint32_t i = 0; i < transform_system->size(); ++i) {
+    auto model = glm::make_mat4(transform_system->get_world_matrix(i));
+    auto clip = view_projection * model[3];
+    if (clip.w <= 0.0f) {
+      continue;
+    }
+
+    auto texture = instance_materials[i] % texture_streamer->size();
+    float pixels = glm::length(glm::vec3(model[0])) * pixels_per_unit / clip.w;
+    float texels = static_cast<float>(texture_streamer->get_width(texture));
+    auto level = static_cast<uint32_t>(std::max(0.0f, std::floor(std::log2(texels / std::max(pixels, 1.0f)))));
+    texture_streamer->request(texture, level);
+  }
+
+  texture_streamer->update();
+  if (texture_descriptor_versions[index] != texture_streamer->get_version()) {
+    write_texture_descriptors(index);
+  }
+}
+
+void RenderEngine::write_texture_descriptors(uint32_t index) {
+  std::pmr::vector<vk::DescriptorImageInfo> image_infos { &frame_arenas[index]->get() };
+  image_infos.reserve(config.max_textures);
+  for (uint32_t i = 0; i < config.max_textures; ++i) {
+    image_infos.push_back({
+      .sampler = texture_streamer->get_sampler(),
+      .imageView = texture_streamer->get_image_view(i % texture_streamer->size()),
+      .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
+    });
+  }
+
+  vk::WriteDescriptorSet descriptor_write {
+    .dstSet = descriptor_sets[index],
+    .dstBinding = 1,
+    .dstArrayElement = 0,
+    .descriptorCount = config.max_textures,
+    .descriptorType = vk::DescriptorType::eCombinedImageSampler,
+    .pImageInfo = image_infos.data()
+  };
+
+  device->updateDescriptorSets(descriptor_write, nullptr);
+  texture_descriptor_versions[index] = texture_streamer->get_version();
 }
 
 void RenderEngine::create_command_buffer() {
@@ -860,24 +1638,201 @@ void RenderEngine::create_command_buffer() {
   }
 }
 
+void RenderEngine::create_frame_capture() {
+  if (!config.capture.enabled) {
+    return;
+  }
+
+  frame_capture = std::make_unique<FrameCapture>(
+    *device, *memory_tracker, swap_chain_image_format, swap_chain_extent, config.max_frames_in_flight, config.capture
+  );
+}
+
+void RenderEngine::create_render_graph() {
+  render_graph = std::make_unique<RenderGraph>(*device, *memory_tracker);
+
+  RenderGraph::ImageInfo backbuffer_info {
+    .format = swap_chain_image_format,
+    .extent = swap_chain_extent,
+    .usage = vk::ImageUsageFlagBits::eColorAttachment,
+    .aspect = vk::ImageAspectFlagBits::eColor
+  };
+  if (frame_capture) {
+    backbuffer_info.usage |= vk::ImageUsageFlagBits::eTransferSrc;
+  }
+
+  // The acquire semaphore is waited on at the color attachment output stage
+  RenderGraph::ResourceState acquired {
+    .stage = vk::PipelineStageFlagBits2::eColorAttachmentOutput,
+    .access = vk::AccessFlagBits2::eNone,
+    .layout = vk::ImageLayout::eUndefined
+  };
+  RenderGraph::ResourceState presented {
+    .stage = vk::PipelineStageFlagBits2::eNone,
+    .access = vk::AccessFlagBits2::eNone,
+    .layout = vk::ImageLayout::ePresentSrcKHR
+  };
+  auto final_state = (headless ? std::nullopt : std::optional { presented });
+  backbuffer = render_graph->import_image("backbuffer", backbuffer_info, acquired, final_state);
+
+  RenderGraph::ImageInfo depth_info {
+    .format = depth_format,
+    .extent = swap_chain_extent,
+    .usage = vk::ImageUsageFlagBits::eDepthStencilAttachment,
+    .aspect = vk::ImageAspectFlagBits::eDepth
+  };
+  if (occlusion_culler) {
+    depth_info.usage |= vk::ImageUsageFlagBits::eSampled;
+  }
+  depth_buffer = render_graph->create_image("depth", depth_info);
+
+  if (particle_system) {
+    // The previous frame's draw is the last reader
+    RenderGraph::ResourceState drawn {
+      .stage = vk::PipelineStageFlagBits2::eVertexShader,
+      .access = vk::AccessFlagBits2::eShaderStorageRead,
+      .layout = vk::ImageLayout::eUndefined
+    };
+    particle_resource = render_graph->import_buffer(
+      "particles", **particle_buffer, sizeof(Particle) * particle_system->get_particle_count(), drawn
+    );
+
+    render_graph->add_pass("particles", [this] (vk::raii::CommandBuffer& command_buffer) {
+      particle_system->simulate(command_buffer, particle_delta_time);
+    }).write(particle_resource, RenderGraph::Usage::eStorageReadWrite);
+  }
+
+  if (occlusion_culler) {
+    // The previous frame's reduction wrote the pyramid last and its draws read the indirect buffer last
+    RenderGraph::ResourceState reduced {
+      .stage = vk::PipelineStageFlagBits2::eComputeShader,
+      .access = vk::AccessFlagBits2::eShaderStorageWrite,
+      .layout = vk::ImageLayout::eGeneral
+    };
+    RenderGraph::ResourceState drawn {
+      .stage = vk::PipelineStageFlagBits2::eDrawIndirect,
+      .access = vk::AccessFlagBits2::eIndirectCommandRead,
+      .layout = vk::ImageLayout::eUndefined
+    };
+
+    using enum vk::ImageUsageFlagBits;
+    RenderGraph::ImageInfo pyramid_info {
+      .format = OcclusionCuller::pyramid_format,
+      .extent = occlusion_culler->get_pyramid_extent(),
+      .usage = eStorage | eSampled | eTransferDst,
+      .aspect = vk::ImageAspectFlagBits::eColor,
+      .mip_levels = occlusion_culler->get_pyramid_levels()
+    };
+    hiz_pyramid = render_graph->import_image("hiz pyramid", pyramid_info, reduced, reduced);
+    render_graph->set_image(hiz_pyramid, occlusion_culler->get_pyramid(), occlusion_culler->get_pyramid_view());
+    indirect_draws = render_graph->import_buffer(
+      "indirect draws", occlusion_culler->get_indirect_buffer(0), occlusion_culler->get_indirect_buffer_size(), drawn
+    );
+
+    render_graph->add_pass("occlusion cull", [this] (vk::raii::CommandBuffer& command_buffer) {
+      occlusion_culler->cull(command_buffer, current_frame, occlusion_candidate_count, culling_view_projection);
+    }).read(hiz_pyramid, RenderGraph::Usage::eSampledCompute)
+      .write(indirect_draws, RenderGraph::Usage::eStorageWrite);
+  }
+
+  // The previous frame's main pass read the light lists last
+  RenderGraph::ResourceState shaded {
+    .stage = vk::PipelineStageFlagBits2::eFragmentShader,
+    .access = vk::AccessFlagBits2::eShaderStorageRead,
+    .layout = vk::ImageLayout::eUndefined
+  };
+  light_clusters = render_graph->import_buffer(
+    "light clusters", clustered_lighting->get_cluster_buffer(), clustered_lighting->get_cluster_buffer_size(), shaded
+  );
+  light_indices = render_graph->import_buffer(
+    "light indices", clustered_lighting->get_light_index_buffer(), clustered_lighting->get_light_index_buffer_size(),
+    shaded
+  );
+
+  render_graph->add_pass("light culling", [this] (vk::raii::CommandBuffer& command_buffer) {
+    clustered_lighting->cull(command_buffer, current_frame);
+  }).write(light_clusters, RenderGraph::Usage::eStorageWrite)
+    .write(light_indices, RenderGraph::Usage::eStorageWrite);
+
+  vk::ClearColorValue clear_color { std::array { 0.0f, 0.0f, 0.0f, 1.0f } };
+  vk::ClearDepthStencilValue clear_depth { .depth = 1.0f, .stencil = 0 };
+  auto main_pass = render_graph->add_pass("main", [this] (vk::raii::CommandBuffer& command_buffer) {
+    draw_scene(command_buffer);
+  }).write_color(backbuffer, clear_color)
+    .write_depth(depth_buffer, clear_depth)
+    .read(light_clusters, RenderGraph::Usage::eStorageReadFragment)
+    .read(light_indices, RenderGraph::Usage::eStorageReadFragment);
+  if (particle_system) {
+    main_pass.read(particle_resource, RenderGraph::Usage::eStorageReadVertex);
+  }
+  if (occlusion_culler) {
+    main_pass.read(indirect_draws, RenderGraph::Usage::eIndirectBuffer);
+
+    // Reduced after this frame's draws, the next frame culls against it
+    render_graph->add_pass("hiz pyramid", [this] (vk::raii::CommandBuffer& command_buffer) {
+      occlusion_culler->build_pyramid(command_buffer);
+    }).read(depth_buffer, RenderGraph::Usage::eSampledCompute)
+      .write(hiz_pyramid, RenderGraph::Usage::eStorageReadWrite);
+  }
+
+  if (frame_capture) {
+    // The host reads the buffer once the frame's fence has signalled
+    RenderGraph::ResourceState host_read {
+      .stage = vk::PipelineStageFlagBits2::eHost,
+      .access = vk::AccessFlagBits2::eHostRead,
+      .layout = vk::ImageLayout::eUndefined
+    };
+    capture_buffer = render_graph->import_buffer(
+      "capture", frame_capture->get_buffer(0), frame_capture->get_buffer_size(), host_read
+    );
+
+    render_graph->add_pass("capture", [this] (vk::raii::CommandBuffer& command_buffer) {
+      auto extent = frame_capture->get_extent();
+      vk::BufferImageCopy region {
+        .bufferOffset = 0,
+        .bufferRowLength = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource = { .aspectMask = vk::ImageAspectFlagBits::eColor, .mipLevel = 0, .baseArrayLayer = 0, .layerCount = 1 },
+        .imageOffset = { 0, 0, 0 },
+        .imageExtent = { extent.width, extent.height, 1 }
+      };
+      command_buffer.copyImageToBuffer(
+        render_graph->get_image(backbuffer), vk::ImageLayout::eTransferSrcOptimal,
+        frame_capture->get_buffer(current_frame), region
+      );
+    }).read(backbuffer, RenderGraph::Usage::eTransferSrc)
+      .write(capture_buffer, RenderGraph::Usage::eTransferDst)
+      .side_effects();
+  }
+
+  render_graph->compile();
+  if (occlusion_culler) {
+    occlusion_culler->set_depth(render_graph->get_image_view(depth_buffer));
+  }
+}
+
 void RenderEngine::record_command_buffer(vk::raii::CommandBuffer& command_buffer, uint32_t image_index) {
+  PROFILE_ZONE("record_command_buffer");
   vk::CommandBufferBeginInfo command_buffer_begin_info {};
   command_buffer.begin(command_buffer_begin_info);
+  gpu_profiler->begin_frame(command_buffer, current_frame);
 
-  vk::ClearValue clear_color {{ std::array { 0.0f, 0.0f, 0.0f, 1.0f }}};
-  vk::RenderPassBeginInfo render_pass_begin_info {
-    .renderPass = *render_pass,
-    .framebuffer = swap_chain_framebuffers[image_index],
-    .renderArea = {
-      .offset = { 0, 0 },
-      .extent = swap_chain_extent
-    },
-    .clearValueCount = 1,
-    .pClearValues = &clear_color
-  };
-  command_buffer.beginRenderPass(render_pass_begin_info, vk::SubpassContents::eInline);
+  render_graph->set_image(backbuffer, swap_chain_images[image_index], *swap_chain_image_views[image_index]);
+  if (frame_capture) {
+    render_graph->set_buffer(capture_buffer, frame_capture->get_buffer(current_frame));
+  }
+  if (occlusion_culler) {
+    render_graph->set_buffer(indirect_draws, occlusion_culler->get_indirect_buffer(current_frame));
+  }
+  render_graph->execute(command_buffer, frame_arenas[current_frame]->get(), gpu_profiler.get());
+
+  gpu_profiler->end_frame(command_buffer);
+  command_buffer.end();
+}
 
-  command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *graphics_pipeline);
+void RenderEngine::draw_scene(vk::raii::CommandBuffer& command_buffer) {
+  auto pipeline = (main_pipeline.is_ready() ? main_pipeline.get() : fallback_pipeline);
+  command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
 
   vk::Viewport viewport {
     .x = 0.0f,
@@ -895,15 +1850,56 @@ void RenderEngine::record_command_buffer(vk::raii::CommandBuffer& command_buffer
   };
   command_buffer.setScissor(0, scissor);
 
-  command_buffer.bindVertexBuffers(0, { **vertex_buffer }, { 0 });
-  command_buffer.bindIndexBuffer(*index_buffer, 0, vk::IndexType::eUint16);
+  float aspect_ratio = static_cast<float>(swap_chain_extent.width) / swap_chain_extent.height;
+  auto camera = get_camera_matrices(aspect_ratio);
+  auto view_projection = camera.projection * camera.view;
+  command_buffer.pushConstants<glm::mat4>(
+    *pipeline_layout, vk::ShaderStageFlagBits::eVertex, offsetof(PushConstants, view_projection), view_projection
+  );
+
+  // Every mesh shares the pool's buffers, draws only pick their ranges
+  if (vertex_pulling_enabled) {
+    command_buffer.bindVertexBuffers(1, { *instance_buffers[current_frame], **material_buffer }, { 0, 0 });
+  } else {
+    command_buffer.bindVertexBuffers(
+      0, { geometry_pool->get_vertex_buffer(), *instance_buffers[current_frame], **material_buffer }, { 0, 0, 0 }
+    );
+  }
+  command_buffer.bindIndexBuffer(geometry_pool->get_index_buffer(), 0, GeometryPool::index_type);
   command_buffer.bindDescriptorSets(
     vk::PipelineBindPoint::eGraphics, *pipeline_layout, 0, { *descriptor_sets[current_frame] }, nullptr
   );
-  command_buffer.drawIndexed(static_cast<uint32_t>(mesh.indices.size()), 1, 0, 0, 0);
 
-  command_buffer.endRenderPass();
-  command_buffer.end();
+  // Per draw data only goes through push constants, changing it writes no memory and binds nothing
+  DrawConstants draw_constants {
+    .format = vertex_format,
+    .first_texture = 0
+  };
+  draw_constants.format.vertices = geometry_pool->get_vertex_address();
+  command_buffer.pushConstants<DrawConstants>(
+    *pipeline_layout, vk::ShaderStageFlagBits::eVertex, offsetof(PushConstants, draw), draw_constants
+  );
+
+  if (occlusion_culler) {
+    // A single call takes at most maxDrawIndirectCount commands
+    for (uint32_t first = 0; first < occlusion_candidate_count; first += max_draw_indirect_count) {
+      command_buffer.drawIndexedIndirect(
+        occlusion_culler->get_indirect_buffer(current_frame), first * sizeof(vk::DrawIndexedIndirectCommand),
+        std::min(max_draw_indirect_count, occlusion_candidate_count - first), sizeof(vk::DrawIndexedIndirectCommand)
+      );
+    }
+  } else {
+    for (const auto& range : draw_list) {
+      const auto& geometry = geometry_pool->get(meshes[range.mesh]);
+      command_buffer.drawIndexed(
+        geometry.index_count, range.instance_count, geometry.first_index, geometry.vertex_offset, range.first_instance
+      );
+    }
+  }
+
+  if (particle_system) {
+    particle_system->draw(command_buffer, view_projection);
+  }
 }
 
 void RenderEngine::create_sync_objects() {
@@ -923,46 +1919,252 @@ void RenderEngine::create_sync_objects() {
   }
 }
 
-void RenderEngine::render() {
-  (void)device->waitForFences(*in_flight_fences[current_frame], true, UINT64_MAX);
+void RenderEngine::render(const FrameState& frame_state) {
+  PROFILE_ZONE("frame");
+  auto render_start = Clock::now();
+  if (config.frame_pacing) {
+    frame_pacer->wait_for_frame_start();
+  }
+
+  auto frame_start = Clock::now();
+  latency_tracker->begin_frame(++frame_id, frame_start);
+  collect_display_times();
+
+  {
+    PROFILE_ZONE("wait for frame fence");
+    (void)device->waitForFences(*in_flight_fences[current_frame], true, UINT64_MAX);
+  }
+  if (!present_wait_enabled && frame_ids[current_frame] != 0) {
+    latency_tracker->record_displayed(frame_ids[current_frame], Clock::now());
+  }
   device->resetFences(*in_flight_fences[current_frame]);
+  frame_arenas[current_frame]->rewind();
+  gpu_profiler->collect(current_frame);
+  if (frame_capture) {
+    frame_capture->collect(current_frame);
+  }
+  bool rebalance = false;
+  if (auto gpu_milliseconds = gpu_profiler->get_frame_milliseconds(current_frame)) {
+    frame_samples[current_frame].gpu_milliseconds = *gpu_milliseconds;
+    rebalance = frame_balancer->record(frame_samples[current_frame]);
+  }
+
+  uint32_t image_index = current_frame;
+  if (!headless) {
+    vk::Result result;
+    std::tie(result, image_index) = swap_chain->acquireNextImage(UINT32_MAX, *image_available_semaphores[current_frame]);
+  }
+  auto blocked = Clock::now() - frame_start;
+  frame_ids[current_frame] = frame_id;
 
-  auto [result, image_index] 
-    = swap_chain->acquireNextImage(UINT32_MAX, *image_available_semaphores[current_frame]);
+  update_textures(current_frame);
+  update_particles(frame_state);
 
+  latency_tracker->record_stage(frame_id, LatencyTracker::Stage::eRecord, Clock::now());
+  // The draw list comes out of the scene update, so it runs before recording
+  update_scene(current_frame, frame_state);
+  update_lights(current_frame, frame_state);
   command_buffers[current_frame].reset();
   record_command_buffer(command_buffers[current_frame], image_index);
 
-  update_uniform_buffer(current_frame);
-
   vk::Semaphore wait_semaphores[] = { *image_available_semaphores[current_frame] };
   vk::PipelineStageFlags wait_stages[] = { vk::PipelineStageFlagBits::eColorAttachmentOutput };
   vk::Semaphore signal_semaphores[] = { *render_finished_semaphores[current_frame] };
   vk::CommandBuffer _command_buffers[] = { command_buffers[current_frame] };
   vk::SubmitInfo submit_info {
-    .waitSemaphoreCount = 1,
+    .waitSemaphoreCount = (headless ? 0u : 1u),
     .pWaitSemaphores = wait_semaphores,
     .pWaitDstStageMask = wait_stages,
     .commandBufferCount = 1,
     .pCommandBuffers = _command_buffers,
-    .signalSemaphoreCount = 1,
+    .signalSemaphoreCount = (headless ? 0u : 1u),
     .pSignalSemaphores = signal_semaphores
   };
-  graphics_queue->submit(submit_info, *in_flight_fences[current_frame]);
+  latency_tracker->record_stage(frame_id, LatencyTracker::Stage::eSubmit, Clock::now());
+  {
+    PROFILE_ZONE("submit");
+    graphics_queue->submit(submit_info, *in_flight_fences[current_frame]);
+  }
+  if (frame_capture) {
+    frame_capture->submitted(current_frame, frame_id);
+  }
+
+  latency_tracker->record_stage(frame_id, LatencyTracker::Stage::ePresent, Clock::now());
+  if (!headless) {
+    present(image_index);
+  }
+
+  if (config.frame_pacing) {
+    frame_pacer->record_blocked(blocked);
+  }
+  latency_tracker->report_if_due(present_wait_enabled ? "present wait" : "fence signal");
+  memory_tracker->report_if_due();
+  pipeline_cache->update();
+  pipeline_cache->report_if_due();
+
+  // Everything since the previous frame ended is CPU work for this one, except the pacer's delay and
+  // blocking on the GPU
+  auto frame_end = Clock::now();
+  auto idle = (frame_start - render_start) + blocked;
+  auto since = (last_frame_end == Clock::time_point {} ? render_start : last_frame_end);
+  using Milliseconds = std::chrono::duration<double, std::milli>;
+  frame_samples[current_frame] = {
+    .cpu_milliseconds = Milliseconds(frame_end - since - idle).count(),
+    .gpu_milliseconds = 0.0,
+    .fence_wait_milliseconds = Milliseconds(blocked).count()
+  };
+  if (rebalance) {
+    set_frames_in_flight(frame_balancer->get_frames_in_flight());
+  }
+  last_frame_end = Clock::now();
+
+  current_frame = (current_frame + 1) % frames_in_flight;
+}
+
+void RenderEngine::present(uint32_t image_index) {
+  PROFILE_ZONE("present");
+  vk::Semaphore wait_semaphores[] = { *render_finished_semaphores[current_frame] };
+
+  vk::PresentIdKHR present_id {
+    .swapchainCount = 1,
+    .pPresentIds = &frame_id
+  };
 
   vk::SwapchainKHR swap_chains[] = { **swap_chain };
   vk::PresentInfoKHR present_info {
+    .pNext = (present_wait_enabled ? &present_id : nullptr),
     .waitSemaphoreCount = 1,
-    .pWaitSemaphores = signal_semaphores,
+    .pWaitSemaphores = wait_semaphores,
     .swapchainCount = 1,
     .pSwapchains = swap_chains,
     .pImageIndices = &image_index
   };
   (void)present_queue->presentKHR(present_info);
 
-  current_frame = (current_frame + 1) % config.max_frames_in_flight;
+  if (present_wait_enabled) {
+    {
+      std::lock_guard lock { present_mutex };
+      pending_presents.push_back(frame_id);
+    }
+    present_condition.notify_one();
+  }
+}
+
+void RenderEngine::create_frame_balancer() {
+  frame_balancer = std::make_unique<FrameBalancer>(config.max_frames_in_flight, config.adaptive_frames_in_flight);
+  frame_samples.resize(config.max_frames_in_flight);
+  frames_in_flight = frame_balancer->get_frames_in_flight();
+  last_frame_end = {};
+}
+
+void RenderEngine::set_frames_in_flight(uint32_t count) {
+  PROFILE_ZONE("set_frames_in_flight");
+  // Changes are rare enough to drain the queue for, slots going out of use are read back now instead
+  // of whenever they are used again
+  device->waitIdle();
+  for (uint32_t i = count; i < frames_in_flight; ++i) {
+    gpu_profiler->collect(i);
+    if (frame_capture) {
+      frame_capture->collect(i);
+    }
+  }
+
+  auto stats = frame_balancer->get_stats();
+  fmt::println(
+    "frames in flight {} -> {}: {:.0f}% GPU bound, CPU {:.2f} ms, GPU {:.2f} ms, fence wait {:.2f} ms",
+    frames_in_flight, count, 100.0f * stats.gpu_bound_share, stats.cpu_milliseconds, stats.gpu_milliseconds,
+    stats.fence_wait_milliseconds
+  );
+  frames_in_flight = count;
+  transform_system->set_output_count(count);
+  if (!headless) {
+    recreate_swap_chain();
+  }
+}
+
+void RenderEngine::record_input(Clock::time_point time) {
+  latency_tracker->record_input(time);
+}
+
+void RenderEngine::create_frame_timing() {
+  latency_tracker = std::make_unique<LatencyTracker>(std::chrono::seconds(5));
+  frame_pacer = std::make_unique<FramePacer>();
+  frame_ids.resize(config.max_frames_in_flight, 0);
+
+  if (present_wait_enabled) {
+    pending_presents.reserve(16);
+    displayed_frames.reserve(16);
+    present_wait_thread = std::jthread([this] (std::stop_token stop_token) { wait_for_presents(stop_token); });
+  }
+}
+
+void RenderEngine::collect_display_times() {
+  if (present_wait_enabled) {
+    std::lock_guard lock { present_mutex };
+    for (auto [id, time] : displayed_frames) {
+      latency_tracker->record_displayed(id, time);
+      frame_pacer->record_displayed(time);
+    }
+    displayed_frames.clear();
+    return;
+  }
+
+  // Without present wait the fence is the last observable point, polled once per frame
+  auto now = Clock::now();
+  for (uint32_t i = 0; i < config.max_frames_in_flight; ++i) {
+    if (frame_ids[i] != 0 && !latency_tracker->is_displayed(frame_ids[i])
+        && in_flight_fences[i].getStatus() == vk::Result::eSuccess) {
+      latency_tracker->record_displayed(frame_ids[i], now);
+    }
+  }
+}
+
+void RenderEngine::wait_for_presents(std::stop_token stop_token) {
+  while (!stop_token.stop_requested()) {
+    uint64_t id;
+    {
+      std::unique_lock lock { present_mutex };
+      if (!present_condition.wait(lock, stop_token, [this] { return !pending_presents.empty(); })) {
+        return;
+      }
+      id = pending_presents.front();
+      pending_presents.erase(pending_presents.begin());
+    }
+
+    // Short timeouts keep the thread responsive to shutdown while a frame is not being shown
+    auto result = vk::Result::eTimeout;
+    while (result == vk::Result::eTimeout && !stop_token.stop_requested()) {
+      try {
+        result = swap_chain->waitForPresent(id, 100'000'000);
+      } catch (const vk::SystemError&) {
+        result = vk::Result::eErrorOutOfDateKHR;
+      }
+    }
+
+    if (result == vk::Result::eSuccess || result == vk::Result::eSuboptimalKHR) {
+      std::lock_guard lock { present_mutex };
+      displayed_frames.emplace_back(id, Clock::now());
+    }
+  }
+}
+
+auto RenderEngine::get_memory_usage() const -> std::array<vk::DeviceSize, memory_category_count> {
+  return memory_tracker->get_category_sizes();
+}
+
+auto RenderEngine::get_frame_stats() const -> FrameStats {
+  auto stats = frame_balancer->get_stats();
+  stats.swap_chain_images = (headless ? 0 : static_cast<uint32_t>(swap_chain_images.size()));
+  return stats;
+}
+
+auto RenderEngine::get_render_graph_stats() const -> const RenderGraph::Stats& {
+  return render_graph->get_stats();
 }
 
 void RenderEngine::wait_to_finish() const {
   device->waitIdle();
+  if (frame_capture) {
+    frame_capture->flush();
+  }
 }
\ No newline at end of file
@@ -1,25 +1,76 @@
 #pragma once
 #include <memory>
+#include <functional>
 #include <utility>
 #include <optional>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 #define VULKAN_HPP_NO_CONSTRUCTORS
 #include <vulkan/vulkan.hpp>
 #include <vulkan/vulkan_raii.hpp>
 #include "render_config.h"
+#include "render_graph.h"
+#include "memory_tracker.h"
+#include "texture_streamer.h"
+#include "transform_system.h"
+#include "bvh.h"
+#include "frame_state.h"
+#include "latency_tracker.h"
+#include "frame_pacer.h"
+#include "frame_balancer.h"
+#include "frame_capture.h"
+#include "particle_system.h"
+#include "geometry_pool.h"
+#include "pipeline_cache.h"
+#include "frame_arena.h"
+#include "gpu_profiler.h"
+#include "occlusion_culler.h"
+#include "clustered_lighting.h"
+#include "debug_log.h"
 
 class Application;
+class JobSystem;
 
 class RenderEngine {
 public:
-  RenderEngine(const RenderConfig&, const Application&);
+  RenderEngine(const RenderConfig&, const Application&, JobSystem&);
+  // Renders into offscreen images at the configured resolution, frames are only seen through capture
+  RenderEngine(const RenderConfig&, JobSystem&);
 
-  void render();
+  void render(const FrameState&);
+  void record_input(std::chrono::steady_clock::time_point);
+  // Steps the particles on the GPU and the CPU reference from the same state, returns the share that disagree
+  auto validate_particles(uint32_t steps, float delta_time) -> double;
+  struct SortBenchmark {
+    double mismatch;
+    double milliseconds;
+  };
+  // Radix sorts random key-value pairs on the GPU and compares them with the CPU reference, the time is
+  // the average GPU time of iterations sorts of the same input
+  auto benchmark_radix_sort(uint32_t count, uint32_t iterations) -> SortBenchmark;
+  // Device memory allocated in each category, indexed by MemoryCategory
+  auto get_memory_usage() const -> std::array<vk::DeviceSize, memory_category_count>;
+  auto get_frame_stats() const -> FrameStats;
+  auto get_render_graph_stats() const -> const RenderGraph::Stats&;
   void wait_to_finish() const;
+  // Mutes or unmutes the validation layers, which have to be enabled in the config to be loaded at all
+  void set_validation_messages(bool enabled);
+  bool are_validation_messages_enabled() const;
 
 private:
+  RenderEngine(const RenderConfig&, const Application*, JobSystem&);
+
   const RenderConfig config;
+  const bool headless;
+  JobSystem& job_system;
   vk::raii::Context context;
 
+  // Debug Log, outlives the instance which still reports messages while it is destroyed
+  void create_debug_log();
+  std::unique_ptr<DebugLog> debug_log;
+
   // Instance
   void create_instance();
   void check_required_extensions_support();
@@ -44,13 +95,22 @@ private:
   // Physical Device
   void select_physical_device();
   bool is_device_suitable(const vk::raii::PhysicalDevice&);
+  void select_optional_device_extensions();
   std::vector<const char*> required_device_extensions;
+  std::vector<const char*> enabled_device_extensions;
+  bool present_wait_enabled;
+  bool memory_budget_enabled;
+  bool vertex_pulling_enabled;
+  bool occlusion_culling_enabled;
+  uint32_t max_draw_indirect_count;
+  bool radix_sort_supported;
   std::unique_ptr<vk::raii::PhysicalDevice> physical_device;
 
   // Queue Family
   struct QueueFamilyIndices {
     std::optional<uint32_t> graphics_family;
     std::optional<uint32_t> present_family;
+    std::optional<uint32_t> transfer_family;
 
     bool is_complete() {
       return graphics_family.has_value() && present_family.has_value();
@@ -63,10 +123,15 @@ private:
   void create_logical_device();
   std::unique_ptr<vk::raii::Device> device;
 
+  // Memory
+  void create_memory_tracker();
+  std::unique_ptr<MemoryTracker> memory_tracker;
+
   // Queues
   void query_queues();
   std::unique_ptr<vk::raii::Queue> graphics_queue;
   std::unique_ptr<vk::raii::Queue> present_queue;
+  std::unique_ptr<vk::raii::Queue> transfer_queue;
 
   // Swap Chain
   struct SwapChainInfo {
@@ -78,8 +143,13 @@ private:
   auto select_swap_chain_extent(const vk::SurfaceCapabilitiesKHR&) -> vk::Extent2D;
   auto select_surface_format(const std::vector<vk::SurfaceFormatKHR>&) -> vk::SurfaceFormatKHR;
   auto select_present_mode(const std::vector<vk::PresentModeKHR>&) -> vk::PresentModeKHR;
+  auto select_swap_chain_image_count(const vk::SurfaceCapabilitiesKHR&) -> uint32_t;
   void create_swap_chain();
+  void recreate_swap_chain();
+  void create_offscreen_images();
   std::unique_ptr<vk::raii::SwapchainKHR> swap_chain;
+  std::vector<vk::raii::Image> offscreen_images;
+  std::vector<DeviceAllocation> offscreen_image_memories;
   std::vector<vk::Image> swap_chain_images;
   vk::Format swap_chain_image_format;
   vk::Extent2D swap_chain_extent;
@@ -88,9 +158,9 @@ private:
   void create_swap_chain_image_views();
   std::vector<vk::raii::ImageView> swap_chain_image_views;
 
-  // Render Pass
-  void create_render_pass();
-  std::unique_ptr<vk::raii::RenderPass> render_pass;
+  // Depth
+  void select_depth_format();
+  vk::Format depth_format;
 
   // Descriptor set layout
   void create_descriptor_set_layout();
@@ -98,25 +168,33 @@ private:
 
   // Graphics Pipeline
   void create_graphics_pipeline();
-  std::vector<std::byte> read_file(const std::string&);
-  auto create_shader_module(const std::vector<std::byte>&) -> std::unique_ptr<vk::raii::ShaderModule>;
   std::unique_ptr<vk::raii::PipelineLayout> pipeline_layout;
-  std::unique_ptr<vk::raii::Pipeline> graphics_pipeline;
+  std::unique_ptr<PipelineCache> pipeline_cache;
+  PipelineState main_pipeline_state;
+  PipelineCache::PipelineHandle main_pipeline;
+  // Owned by the pipeline cache, only set when pipelines compile asynchronously
+  vk::Pipeline fallback_pipeline;
+
+  // Frame Capture
+  void create_frame_capture();
+  std::unique_ptr<FrameCapture> frame_capture;
 
-  // Framebuffers
-  void create_framebuffers();
-  std::vector<vk::raii::Framebuffer> swap_chain_framebuffers;
+  // Render Graph
+  void create_render_graph();
+  void draw_scene(vk::raii::CommandBuffer&);
+  std::unique_ptr<RenderGraph> render_graph;
+  RenderGraph::ResourceHandle backbuffer;
+  RenderGraph::ResourceHandle depth_buffer;
+  RenderGraph::ResourceHandle capture_buffer;
 
   // Command Pool
   void create_command_pool();
+  void submit_one_time(const std::function<void(vk::raii::CommandBuffer&)>&);
   std::unique_ptr<vk::raii::CommandPool> command_pool;
 
-  // Uniform Buffers
-  void create_uniform_buffers();
-  void update_uniform_buffer(uint32_t);
-  std::vector<vk::raii::Buffer> uniform_buffers;
-  std::vector<vk::raii::DeviceMemory> uniform_buffer_memories;
-  std::vector<void*> uniform_buffer_ptrs;
+  // GPU Profiler
+  void create_gpu_profiler();
+  std::unique_ptr<GpuProfiler> gpu_profiler;
 
   // Descriptors
   void create_descriptor_pool();
@@ -125,25 +203,128 @@ private:
   std::vector<vk::raii::DescriptorSet> descriptor_sets;
 
   // Buffers
-  uint32_t find_memory_type(uint32_t, vk::MemoryPropertyFlags);
-  auto create_buffer(vk::DeviceSize, vk::BufferUsageFlags, vk::MemoryPropertyFlags)
-    -> std::pair<vk::raii::Buffer, vk::raii::DeviceMemory>;
+  auto create_buffer(vk::DeviceSize, vk::BufferUsageFlags, vk::MemoryPropertyFlags, MemoryCategory)
+    -> std::pair<vk::raii::Buffer, DeviceAllocation>;
   void copy_buffer(vk::Buffer, vk::Buffer, vk::DeviceSize);
-  void create_vertex_buffer();
-  void create_index_buffer();
-  std::unique_ptr<vk::raii::Buffer> vertex_buffer;
-  std::unique_ptr<vk::raii::DeviceMemory> vertex_buffer_memory;
-  std::unique_ptr<vk::raii::Buffer> index_buffer;
-  std::unique_ptr<vk::raii::DeviceMemory> index_buffer_memory;
+
+  // Geometry
+  void create_geometry_pool();
+  std::unique_ptr<GeometryPool> geometry_pool;
+  // The quad comes first, a generated scene adds its meshes after it
+  std::vector<GeometryPool::MeshHandle> meshes;
+  std::vector<Aabb> mesh_bounds;
+
+  // Instance Buffers
+  void create_instance_buffers();
+  std::vector<vk::raii::Buffer> instance_buffers;
+  std::vector<DeviceAllocation> instance_buffer_memories;
+  std::vector<void*> instance_buffer_ptrs;
+  // Material of every instance, written with the scene and read by every frame
+  std::unique_ptr<vk::raii::Buffer> material_buffer;
+  std::unique_ptr<DeviceAllocation> material_buffer_memory;
+  std::span<uint32_t> material_buffer_data;
+
+  // Textures
+  void create_textures();
+  void update_textures(uint32_t);
+  void write_texture_descriptors(uint32_t);
+  std::unique_ptr<TextureStreamer> texture_streamer;
+  std::vector<uint64_t> texture_descriptor_versions;
+
+  // Particles
+  void create_particles();
+  void update_particles(const FrameState&);
+  std::unique_ptr<ParticleSystem> particle_system;
+  std::unique_ptr<vk::raii::Buffer> particle_buffer;
+  std::unique_ptr<DeviceAllocation> particle_buffer_memory;
+  RenderGraph::ResourceHandle particle_resource;
+  double particle_time;
+  float particle_delta_time;
+
+  // Occlusion Culling, candidates that passed the frustum are tested against the previous frame's depth
+  void create_occlusion_culler();
+  std::unique_ptr<OcclusionCuller> occlusion_culler;
+  RenderGraph::ResourceHandle hiz_pyramid;
+  RenderGraph::ResourceHandle indirect_draws;
+  uint32_t occlusion_candidate_count;
+  glm::mat4 previous_view_projection, culling_view_projection;
+
+  // Lighting, a compute pass bins the lights into clusters which the main pass shades with
+  void create_lights();
+  void update_lights(uint32_t, const FrameState&);
+  std::unique_ptr<ClusteredLighting> clustered_lighting;
+  std::vector<Light> scene_lights;
+  RenderGraph::ResourceHandle light_clusters;
+  RenderGraph::ResourceHandle light_indices;
+
+  // Scene
+  void create_scene();
+  void create_grid_scene();
+  void create_generated_scene();
+  void update_scene(uint32_t, const FrameState&);
+  std::unique_ptr<TransformSystem> transform_system;
+  TransformSystem::NodeHandle root_node;
+  glm::quat root_rotation;
+  // Mesh and material of every instance, instances are the transform nodes in order
+  std::vector<uint32_t> instance_meshes;
+  std::vector<uint32_t> instance_materials;
+  // Nodes that turn around their z axis at speed radians per second from rotation
+  struct SpinningNode {
+    TransformSystem::NodeHandle node;
+    glm::quat rotation;
+    float speed;
+  };
+  std::vector<SpinningNode> spinning_nodes;
+
+  // Visibility, the instances inside the frustum are drawn as ranges of consecutive instances of the
+  // same mesh unless the occlusion culler draws them
+  struct DrawRange {
+    uint32_t mesh, first_instance, instance_count;
+  };
+  void cull_scene(uint32_t);
+  Bvh scene_bvh;
+  std::vector<Aabb> scene_bounds;
+  std::vector<uint32_t> visible_instances;
+  std::vector<DrawRange> draw_list;
+
+  // Frame Arenas, transient CPU data of a frame is allocated here and freed once its fence signals
+  static constexpr size_t frame_arena_size = 64 * 1024;
+  void create_frame_arenas();
+  std::vector<std::unique_ptr<FrameArena>> frame_arenas;
 
   // Command Buffer
   void create_command_buffer();
   void record_command_buffer(vk::raii::CommandBuffer&, uint32_t);
   std::vector<vk::raii::CommandBuffer> command_buffers;
 
+  // Frame Balancing, frames are classified as CPU or GPU bound and the frames in flight follow
+  void create_frame_balancer();
+  void set_frames_in_flight(uint32_t);
+  std::unique_ptr<FrameBalancer> frame_balancer;
+  // CPU side of the frame last recorded in each slot, completed with its GPU time once its fence signals
+  std::vector<FrameBalancer::Sample> frame_samples;
+  uint32_t frames_in_flight;
+  std::chrono::steady_clock::time_point last_frame_end;
+
   // Rendering
   void create_sync_objects();
+  void present(uint32_t image_index);
   std::vector<vk::raii::Semaphore> image_available_semaphores, render_finished_semaphores;
   std::vector<vk::raii::Fence> in_flight_fences;
   uint32_t current_frame;
+
+  // Frame Timing
+  using Clock = std::chrono::steady_clock;
+  void create_frame_timing();
+  void collect_display_times();
+  void wait_for_presents(std::stop_token);
+  std::unique_ptr<LatencyTracker> latency_tracker;
+  std::unique_ptr<FramePacer> frame_pacer;
+  uint64_t frame_id;
+  std::vector<uint64_t> frame_ids;
+  std::mutex present_mutex;
+  std::condition_variable_any present_condition;
+  std::vector<uint64_t> pending_presents;
+  std::vector<std::pair<uint64_t, Clock::time_point>> displayed_frames;
+  std::jthread present_wait_thread;
 };
\ No newline at end of file
@@ -0,0 +1,622 @@
+#include "render_graph.h"
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+
+constexpr uint32_t unused_resource = std::numeric_limits<uint32_t>::max();
+
+RenderGraph::PassBuilder::PassBuilder(RenderGraph& _graph, uint32_t _pass_index)
+  : graph { _graph }, pass_index { _pass_index } {}
+
+auto RenderGraph::PassBuilder::read(ResourceHandle resource, Usage usage) -> PassBuilder& {
+  graph.passes[pass_index].uses.push_back({ resource, usage, true, false });
+  return *this;
+}
+
+auto RenderGraph::PassBuilder::write(ResourceHandle resource, Usage usage) -> PassBuilder& {
+  bool read = (usage == Usage::eStorageReadWrite);
+  graph.passes[pass_index].uses.push_back({ resource, usage, read, true });
+  return *this;
+}
+
+auto RenderGraph::PassBuilder::write_color(ResourceHandle resource, std::optional<vk::ClearColorValue> clear)
+    -> PassBuilder& {
+  auto& pass = graph.passes[pass_index];
+  pass.uses.push_back({ resource, Usage::eColorAttachment, !clear.has_value(), true });
+
+  std::optional<vk::ClearValue> clear_value;
+  if (clear.has_value()) {
+    clear_value = vk::ClearValue { .color = clear.value() };
+  }
+  pass.color_attachments.push_back({ resource, clear_value });
+  return *this;
+}
+
+auto RenderGraph::PassBuilder::write_depth(ResourceHandle resource, std::optional<vk::ClearDepthStencilValue> clear)
+    -> PassBuilder& {
+  auto& pass = graph.passes[pass_index];
+  pass.uses.push_back({ resource, Usage::eDepthAttachment, !clear.has_value(), true });
+
+  std::optional<vk::ClearValue> clear_value;
+  if (clear.has_value()) {
+    clear_value = vk::ClearValue { .depthStencil = clear.value() };
+  }
+  pass.depth_attachment = Attachment { resource, clear_value };
+  return *this;
+}
+
+auto RenderGraph::PassBuilder::side_effects() -> PassBuilder& {
+  graph.passes[pass_index].has_side_effects = true;
+  return *this;
+}
+
+RenderGraph::RenderGraph(const vk::raii::Device& _device, MemoryTracker& _memory_tracker)
+  : device { _device }, memory_tracker { _memory_tracker } {}
+
+auto RenderGraph::import_image(
+  const std::string& name, const ImageInfo& info, ResourceState initial, std::optional<ResourceState> final)
+    -> ResourceHandle {
+  Resource resource {
+    .name = name,
+    .type = ResourceType::eImage,
+    .transient = false,
+    .image_info = info,
+    .initial_state = initial,
+    .final_state = final,
+  };
+  resources.push_back(std::move(resource));
+  return static_cast<ResourceHandle>(resources.size() - 1);
+}
+
+auto RenderGraph::import_buffer(const std::string& name, vk::Buffer buffer, vk::DeviceSize size, ResourceState initial)
+    -> ResourceHandle {
+  Resource resource {
+    .name = name,
+    .type = ResourceType::eBuffer,
+    .transient = false,
+    .buffer = buffer,
+    .buffer_size = size,
+    .initial_state = initial,
+    .final_state = initial,
+  };
+  resources.push_back(std::move(resource));
+  return static_cast<ResourceHandle>(resources.size() - 1);
+}
+
+auto RenderGraph::create_image(const std::string& name, const ImageInfo& info) -> ResourceHandle {
+  Resource resource {
+    .name = name,
+    .type = ResourceType::eImage,
+    .transient = true,
+    .image_info = info,
+    .initial_state = { vk::PipelineStageFlagBits2::eNone, vk::AccessFlagBits2::eNone, vk::ImageLayout::eUndefined },
+  };
+  resources.push_back(std::move(resource));
+  return static_cast<ResourceHandle>(resources.size() - 1);
+}
+
+auto RenderGraph::add_pass(const std::string& name, RecordFunction record) -> PassBuilder {
+  passes.push_back(Pass {
+    .name = name,
+    .profile_name = Profiler::intern(name),
+    .record = std::move(record),
+    .has_side_effects = false
+  });
+  return PassBuilder { *this, static_cast<uint32_t>(passes.size() - 1) };
+}
+
+void RenderGraph::set_image(ResourceHandle handle, vk::Image image, vk::ImageView image_view) {
+  resources[handle].image = image;
+  resources[handle].image_view = image_view;
+}
+
+void RenderGraph::set_buffer(ResourceHandle handle, vk::Buffer buffer) {
+  resources[handle].buffer = buffer;
+}
+
+auto RenderGraph::get_image(ResourceHandle handle) const -> vk::Image {
+  return resources[handle].image;
+}
+
+auto RenderGraph::get_image_view(ResourceHandle handle) const -> vk::ImageView {
+  return resources[handle].image_view;
+}
+
+auto RenderGraph::get_usage_state(Usage usage) -> ResourceState {
+  using Stage = vk::PipelineStageFlagBits2;
+  using Access = vk::AccessFlagBits2;
+  using enum vk::ImageLayout;
+
+  switch (usage) {
+    case Usage::eColorAttachment:
+      return {
+        Stage::eColorAttachmentOutput,
+        Access::eColorAttachmentRead | Access::eColorAttachmentWrite,
+        eColorAttachmentOptimal
+      };
+    case Usage::eDepthAttachment:
+      return {
+        Stage::eEarlyFragmentTests | Stage::eLateFragmentTests,
+        Access::eDepthStencilAttachmentRead | Access::eDepthStencilAttachmentWrite,
+        eDepthStencilAttachmentOptimal
+      };
+    case Usage::eDepthRead:
+      return {
+        Stage::eEarlyFragmentTests | Stage::eLateFragmentTests,
+        Access::eDepthStencilAttachmentRead,
+        eDepthStencilReadOnlyOptimal
+      };
+    case Usage::eSampledFragment:
+      return { Stage::eFragmentShader, Access::eShaderSampledRead, eShaderReadOnlyOptimal };
+    case Usage::eSampledCompute:
+      return { Stage::eComputeShader, Access::eShaderSampledRead, eShaderReadOnlyOptimal };
+    case Usage::eStorageRead:
+      return { Stage::eComputeShader, Access::eShaderStorageRead, eGeneral };
+    case Usage::eStorageWrite:
+      return { Stage::eComputeShader, Access::eShaderStorageWrite, eGeneral };
+    case Usage::eStorageReadWrite:
+      return { Stage::eComputeShader, Access::eShaderStorageRead | Access::eShaderStorageWrite, eGeneral };
+    case Usage::eStorageReadVertex:
+      return { Stage::eVertexShader, Access::eShaderStorageRead, eGeneral };
+    case Usage::eStorageReadFragment:
+      return { Stage::eFragmentShader, Access::eShaderStorageRead, eGeneral };
+    case Usage::eTransferSrc:
+      return { Stage::eAllTransfer, Access::eTransferRead, eTransferSrcOptimal };
+    case Usage::eTransferDst:
+      return { Stage::eAllTransfer, Access::eTransferWrite, eTransferDstOptimal };
+    case Usage::eVertexBuffer:
+      return { Stage::eVertexAttributeInput, Access::eVertexAttributeRead, eUndefined };
+    case Usage::eIndexBuffer:
+      return { Stage::eIndexInput, Access::eIndexRead, eUndefined };
+    case Usage::eIndirectBuffer:
+      return { Stage::eDrawIndirect, Access::eIndirectCommandRead, eUndefined };
+  }
+  throw std::runtime_error("Unknown render graph resource usage");
+}
+
+bool RenderGraph::is_write_access(vk::AccessFlags2 access) {
+  using enum vk::AccessFlagBits2;
+  constexpr vk::AccessFlags2 write_mask = eShaderWrite | eShaderStorageWrite | eColorAttachmentWrite
+    | eDepthStencilAttachmentWrite | eTransferWrite | eHostWrite | eMemoryWrite;
+  return static_cast<bool>(access & write_mask);
+}
+
+void RenderGraph::compile() {
+  compiled_passes.clear();
+  final_barriers.clear();
+  memory_blocks.clear();
+  for (auto& resource : resources) {
+    if (resource.transient) {
+      resource.owned_image_view.reset();
+      resource.owned_image.reset();
+    }
+  }
+  memories.clear();
+
+  cull_passes();
+  compute_lifetimes();
+  allocate_transient_images();
+  compute_barriers();
+}
+
+void RenderGraph::cull_passes() {
+  std::vector<bool> needed(resources.size());
+  for (size_t i = 0; i < resources.size(); ++i) {
+    needed[i] = !resources[i].transient;
+  }
+
+  std::vector<bool> live(passes.size(), false);
+  for (size_t i = passes.size(); i-- > 0;) {
+    const auto& pass = passes[i];
+    live[i] = pass.has_side_effects || std::ranges::any_of(pass.uses, [&needed] (const ResourceUse& use) {
+      return use.write && needed[use.resource];
+    });
+    if (!live[i]) {
+      continue;
+    }
+
+    for (const auto& use : pass.uses) {
+      if (use.write && !use.read && resources[use.resource].transient) {
+        needed[use.resource] = false;
+      }
+    }
+    for (const auto& use : pass.uses) {
+      if (use.read) {
+        needed[use.resource] = true;
+      }
+    }
+  }
+
+  for (uint32_t i = 0; i < static_cast<uint32_t>(passes.size()); ++i) {
+    if (live[i]) {
+      compiled_passes.push_back({ .pass_index = i });
+    }
+  }
+}
+
+void RenderGraph::compute_lifetimes() {
+  for (auto& resource : resources) {
+    resource.first_use = unused_resource;
+    resource.last_use = 0;
+  }
+
+  for (uint32_t i = 0; i < static_cast<uint32_t>(compiled_passes.size()); ++i) {
+    for (const auto& use : passes[compiled_passes[i].pass_index].uses) {
+      auto& resource = resources[use.resource];
+      resource.first_use = std::min(resource.first_use, i);
+      resource.last_use = std::max(resource.last_use, i);
+    }
+  }
+}
+
+void RenderGraph::allocate_transient_images() {
+  std::vector<ResourceHandle> transients;
+  std::vector<vk::MemoryRequirements> requirements(resources.size());
+
+  for (ResourceHandle handle = 0; handle < static_cast<ResourceHandle>(resources.size()); ++handle) {
+    auto& resource = resources[handle];
+    if (!resource.transient || resource.first_use == unused_resource) {
+      continue;
+    }
+
+    const auto& info = resource.image_info;
+    vk::ImageCreateInfo create_info {
+      .imageType = vk::ImageType::e2D,
+      .format = info.format,
+      .extent = { info.extent.width, info.extent.height, 1 },
+      .mipLevels = info.mip_levels,
+      .arrayLayers = 1,
+      .samples = vk::SampleCountFlagBits::e1,
+      .tiling = vk::ImageTiling::eOptimal,
+      .usage = info.usage,
+      .sharingMode = vk::SharingMode::eExclusive,
+      .initialLayout = vk::ImageLayout::eUndefined
+    };
+    resource.owned_image = std::make_unique<vk::raii::Image>(device, create_info);
+    requirements[handle] = resource.owned_image->getMemoryRequirements();
+    transients.push_back(handle);
+  }
+
+  // Largest first, so that every block is sized by its first occupant
+  std::ranges::sort(transients, std::greater {}, [&requirements] (ResourceHandle handle) {
+    return requirements[handle].size;
+  });
+
+  for (auto handle : transients) {
+    auto& resource = resources[handle];
+    const auto& requirement = requirements[handle];
+
+    auto block = std::ranges::find_if(memory_blocks, [&] (const MemoryBlock& block) {
+      if ((block.memory_type_bits & requirement.memoryTypeBits) == 0 || requirement.size > block.size) {
+        return false;
+      }
+      return std::ranges::none_of(block.occupants, [&] (ResourceHandle occupant) {
+        const auto& other = resources[occupant];
+        return resource.first_use <= other.last_use && other.first_use <= resource.last_use;
+      });
+    });
+
+    if (block == memory_blocks.end()) {
+      memory_blocks.push_back({
+        .size = requirement.size,
+        .alignment = requirement.alignment,
+        .offset = 0,
+        .memory_type_bits = requirement.memoryTypeBits,
+      });
+      block = std::prev(memory_blocks.end());
+    }
+
+    block->alignment = std::max(block->alignment, requirement.alignment);
+    block->memory_type_bits &= requirement.memoryTypeBits;
+    block->occupants.push_back(handle);
+    resource.memory_block = static_cast<uint32_t>(std::distance(memory_blocks.begin(), block));
+  }
+
+  // One allocation per memory type, blocks are placed back to back
+  std::vector<uint32_t> memory_types;
+  std::vector<vk::DeviceSize> memory_sizes;
+  for (auto& block : memory_blocks) {
+    uint32_t memory_type = memory_tracker.find_memory_type(block.memory_type_bits, vk::MemoryPropertyFlagBits::eDeviceLocal);
+    auto it = std::ranges::find(memory_types, memory_type);
+    if (it == memory_types.end()) {
+      memory_types.push_back(memory_type);
+      memory_sizes.push_back(0);
+      it = std::prev(memory_types.end());
+    }
+
+    block.memory_index = static_cast<uint32_t>(std::distance(memory_types.begin(), it));
+    auto& size = memory_sizes[block.memory_index];
+    block.offset = (size + block.alignment - 1) / block.alignment * block.alignment;
+    size = block.offset + block.size;
+  }
+
+  memories.reserve(memory_types.size());
+  for (size_t i = 0; i < memory_types.size(); ++i) {
+    memories.push_back(memory_tracker.allocate(memory_sizes[i], memory_types[i], MemoryCategory::eRenderTarget));
+  }
+
+  vk::DeviceSize unaliased_size = 0;
+  for (auto handle : transients) {
+    auto& resource = resources[handle];
+    const auto& block = memory_blocks[resource.memory_block];
+    resource.owned_image->bindMemory(*memories[block.memory_index], block.offset);
+    unaliased_size += requirements[handle].size;
+
+    vk::ImageViewCreateInfo create_info {
+      .image = **resource.owned_image,
+      .viewType = vk::ImageViewType::e2D,
+      .format = resource.image_info.format,
+      .subresourceRange = {
+        .aspectMask = resource.image_info.aspect,
+        .baseMipLevel = 0,
+        .levelCount = resource.image_info.mip_levels,
+        .baseArrayLayer = 0,
+        .layerCount = 1
+      }
+    };
+    resource.owned_image_view = std::make_unique<vk::raii::ImageView>(device, create_info);
+    resource.image = **resource.owned_image;
+    resource.image_view = **resource.owned_image_view;
+  }
+
+  vk::DeviceSize aliased_size = 0;
+  for (auto size : memory_sizes) {
+    aliased_size += size;
+  }
+
+  stats = {
+    .compiled_pass_count = static_cast<uint32_t>(compiled_passes.size()),
+    .pass_count = static_cast<uint32_t>(passes.size()),
+    .transient_image_count = static_cast<uint32_t>(transients.size()),
+    .memory_block_count = static_cast<uint32_t>(memory_blocks.size()),
+    .transient_size = aliased_size,
+    .unaliased_size = unaliased_size
+  };
+}
+
+void RenderGraph::compute_barriers() {
+  constexpr auto no_stages = vk::PipelineStageFlagBits2::eNone;
+  constexpr auto no_access = vk::AccessFlagBits2::eNone;
+
+  struct Tracker {
+    vk::ImageLayout layout;
+    vk::PipelineStageFlags2 write_stages, read_stages, visible_stages;
+    vk::AccessFlags2 write_access, visible_access;
+    bool touched;
+  };
+
+  // Transient first uses must wait for whatever aliased the same memory before them, including
+  // the last occupant of the previous frame, so the simulation runs twice to close the loop.
+  std::vector<ResourceState> block_states(memory_blocks.size(), { no_stages, no_access, vk::ImageLayout::eUndefined });
+
+  for (int iteration = 0; iteration < 2; ++iteration) {
+    bool emit = (iteration == 1);
+
+    std::vector<Tracker> trackers(resources.size());
+    for (size_t i = 0; i < resources.size(); ++i) {
+      const auto& initial = resources[i].initial_state;
+      trackers[i] = {
+        .layout = initial.layout,
+        .write_stages = initial.stage,
+        .read_stages = initial.stage,
+        .visible_stages = no_stages,
+        .write_access = initial.access,
+        .visible_access = no_access,
+        .touched = false
+      };
+    }
+
+    for (auto& compiled_pass : compiled_passes) {
+      for (const auto& use : passes[compiled_pass.pass_index].uses) {
+        auto& resource = resources[use.resource];
+        auto& tracker = trackers[use.resource];
+        auto dst = get_usage_state(use.usage);
+        bool write = is_write_access(dst.access);
+
+        if (resource.transient && !tracker.touched) {
+          auto& block_state = block_states[resource.memory_block];
+          tracker.layout = vk::ImageLayout::eUndefined;
+          tracker.write_stages = block_state.stage;
+          tracker.write_access = block_state.access;
+          tracker.read_stages = no_stages;
+        }
+        tracker.touched = true;
+
+        if (write || dst.layout != tracker.layout) {
+          if (emit) {
+            ResourceState src { tracker.write_stages | tracker.read_stages, tracker.write_access, tracker.layout };
+            compiled_pass.barriers.push_back(make_barrier(use.resource, src, dst, dst.layout));
+          }
+          tracker.layout = dst.layout;
+          tracker.write_stages = dst.stage;
+          tracker.write_access = write ? dst.access : no_access;
+          tracker.read_stages = write ? no_stages : dst.stage;
+          tracker.visible_stages = dst.stage;
+          tracker.visible_access = dst.access;
+        } else {
+          bool visible = !(dst.stage & ~tracker.visible_stages) && !(dst.access & ~tracker.visible_access);
+          if (!visible && tracker.write_stages) {
+            if (emit) {
+              ResourceState src { tracker.write_stages, tracker.write_access, tracker.layout };
+              compiled_pass.barriers.push_back(make_barrier(use.resource, src, dst, dst.layout));
+            }
+            tracker.visible_stages |= dst.stage;
+            tracker.visible_access |= dst.access;
+          }
+          tracker.read_stages |= dst.stage;
+        }
+
+        if (resource.transient) {
+          block_states[resource.memory_block] = {
+            tracker.write_stages | tracker.read_stages, tracker.write_access, vk::ImageLayout::eUndefined
+          };
+        }
+      }
+    }
+
+    if (!emit) {
+      continue;
+    }
+
+    for (ResourceHandle handle = 0; handle < static_cast<ResourceHandle>(resources.size()); ++handle) {
+      const auto& resource = resources[handle];
+      const auto& tracker = trackers[handle];
+      if (resource.transient || !resource.final_state.has_value()) {
+        continue;
+      }
+
+      const auto& final = resource.final_state.value();
+      auto layout = (final.layout == vk::ImageLayout::eUndefined ? tracker.layout : final.layout);
+      bool visible = !(final.stage & ~tracker.visible_stages) && !(final.access & ~tracker.visible_access);
+      if (layout == tracker.layout && (!tracker.write_access || visible)) {
+        continue;
+      }
+
+      ResourceState src { tracker.write_stages | tracker.read_stages, tracker.write_access, tracker.layout };
+      final_barriers.push_back(make_barrier(handle, src, final, layout));
+    }
+  }
+}
+
+auto RenderGraph::make_barrier(
+  ResourceHandle handle, const ResourceState& src, const ResourceState& dst, vk::ImageLayout new_layout) const
+    -> Barrier {
+  const auto& resource = resources[handle];
+  Barrier barrier { .resource = handle };
+
+  if (resource.type == ResourceType::eImage) {
+    barrier.image_barrier = {
+      .srcStageMask = src.stage,
+      .srcAccessMask = src.access,
+      .dstStageMask = dst.stage,
+      .dstAccessMask = dst.access,
+      .oldLayout = src.layout,
+      .newLayout = new_layout,
+      .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+      .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+      .subresourceRange = {
+        .aspectMask = resource.image_info.aspect,
+        .baseMipLevel = 0,
+        .levelCount = vk::RemainingMipLevels,
+        .baseArrayLayer = 0,
+        .layerCount = 1
+      }
+    };
+  } else {
+    barrier.buffer_barrier = {
+      .srcStageMask = src.stage,
+      .srcAccessMask = src.access,
+      .dstStageMask = dst.stage,
+      .dstAccessMask = dst.access,
+      .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+      .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+      .offset = 0,
+      .size = vk::WholeSize
+    };
+  }
+
+  return barrier;
+}
+
+void RenderGraph::emit_barriers(
+  vk::raii::CommandBuffer& command_buffer, const std::vector<Barrier>& barriers, std::pmr::memory_resource& arena) {
+  if (barriers.empty()) {
+    return;
+  }
+
+  std::pmr::vector<vk::ImageMemoryBarrier2> image_barriers { &arena };
+  std::pmr::vector<vk::BufferMemoryBarrier2> buffer_barriers { &arena };
+  image_barriers.reserve(barriers.size());
+  buffer_barriers.reserve(barriers.size());
+  for (const auto& barrier : barriers) {
+    const auto& resource = resources[barrier.resource];
+    if (resource.type == ResourceType::eImage) {
+      auto& image_barrier = image_barriers.emplace_back(barrier.image_barrier);
+      image_barrier.image = resource.image;
+    } else {
+      auto& buffer_barrier = buffer_barriers.emplace_back(barrier.buffer_barrier);
+      buffer_barrier.buffer = resource.buffer;
+    }
+  }
+
+  vk::DependencyInfo dependency_info {
+    .bufferMemoryBarrierCount = static_cast<uint32_t>(buffer_barriers.size()),
+    .pBufferMemoryBarriers = buffer_barriers.data(),
+    .imageMemoryBarrierCount = static_cast<uint32_t>(image_barriers.size()),
+    .pImageMemoryBarriers = image_barriers.data()
+  };
+  command_buffer.pipelineBarrier2(dependency_info);
+}
+
+void RenderGraph::begin_rendering(
+  vk::raii::CommandBuffer& command_buffer, const Pass& pass, std::pmr::memory_resource& arena) {
+  auto make_attachment_info = [this] (const Attachment& attachment, vk::ImageLayout layout) {
+    vk::RenderingAttachmentInfo attachment_info {
+      .imageView = resources[attachment.resource].image_view,
+      .imageLayout = layout,
+      .loadOp = attachment.clear_value.has_value() ? vk::AttachmentLoadOp::eClear : vk::AttachmentLoadOp::eLoad,
+      .storeOp = vk::AttachmentStoreOp::eStore,
+    };
+    if (attachment.clear_value.has_value()) {
+      attachment_info.clearValue = attachment.clear_value.value();
+    }
+    return attachment_info;
+  };
+
+  std::pmr::vector<vk::RenderingAttachmentInfo> color_attachments { &arena };
+  color_attachments.reserve(pass.color_attachments.size());
+  for (const auto& attachment : pass.color_attachments) {
+    color_attachments.push_back(make_attachment_info(attachment, vk::ImageLayout::eColorAttachmentOptimal));
+  }
+
+  vk::RenderingAttachmentInfo depth_attachment_info;
+  if (pass.depth_attachment.has_value()) {
+    depth_attachment_info = make_attachment_info(
+      pass.depth_attachment.value(), vk::ImageLayout::eDepthStencilAttachmentOptimal
+    );
+  }
+
+  auto first_attachment = pass.color_attachments.empty()
+    ? pass.depth_attachment.value().resource
+    : pass.color_attachments.front().resource;
+
+  vk::RenderingInfo rendering_info {
+    .renderArea = {
+      .offset = { 0, 0 },
+      .extent = resources[first_attachment].image_info.extent
+    },
+    .layerCount = 1,
+    .colorAttachmentCount = static_cast<uint32_t>(color_attachments.size()),
+    .pColorAttachments = color_attachments.data(),
+    .pDepthAttachment = pass.depth_attachment.has_value() ? &depth_attachment_info : nullptr
+  };
+  command_buffer.beginRendering(rendering_info);
+}
+
+void RenderGraph::execute(
+  vk::raii::CommandBuffer& command_buffer, std::pmr::memory_resource& arena, GpuProfiler* gpu_profiler) {
+  for (const auto& compiled_pass : compiled_passes) {
+    const auto& pass = passes[compiled_pass.pass_index];
+    ProfileZone zone { pass.profile_name };
+    if (gpu_profiler) {
+      gpu_profiler->begin_zone(command_buffer, pass.profile_name);
+    }
+
+    emit_barriers(command_buffer, compiled_pass.barriers, arena);
+    bool is_rendering = !pass.color_attachments.empty() || pass.depth_attachment.has_value();
+    if (is_rendering) {
+      begin_rendering(command_buffer, pass, arena);
+    }
+    pass.record(command_buffer);
+    if (is_rendering) {
+      command_buffer.endRendering();
+    }
+
+    if (gpu_profiler) {
+      gpu_profiler->end_zone(command_buffer);
+    }
+  }
+
+  emit_barriers(command_buffer, final_barriers, arena);
+}
\ No newline at end of file
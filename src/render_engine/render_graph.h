@@ -0,0 +1,180 @@
+#pragma once
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <vector>
+#include <optional>
+#include <functional>
+#define VULKAN_HPP_NO_CONSTRUCTORS
+#include <vulkan/vulkan.hpp>
+#include <vulkan/vulkan_raii.hpp>
+#include "memory_tracker.h"
+#include "gpu_profiler.h"
+
+class RenderGraph {
+public:
+  using ResourceHandle = uint32_t;
+  using RecordFunction = std::function<void(vk::raii::CommandBuffer&)>;
+
+  enum class Usage {
+    eColorAttachment,
+    eDepthAttachment,
+    eDepthRead,
+    eSampledFragment,
+    eSampledCompute,
+    eStorageRead,
+    eStorageWrite,
+    eStorageReadWrite,
+    eStorageReadVertex,
+    eStorageReadFragment,
+    eTransferSrc,
+    eTransferDst,
+    eVertexBuffer,
+    eIndexBuffer,
+    eIndirectBuffer,
+  };
+
+  struct ResourceState {
+    vk::PipelineStageFlags2 stage;
+    vk::AccessFlags2 access;
+    vk::ImageLayout layout;
+  };
+
+  struct ImageInfo {
+    vk::Format format;
+    vk::Extent2D extent;
+    vk::ImageUsageFlags usage;
+    vk::ImageAspectFlags aspect;
+    uint32_t mip_levels = 1;
+  };
+
+  // Filled in by compile()
+  struct Stats {
+    uint32_t compiled_pass_count;
+    uint32_t pass_count;
+    uint32_t transient_image_count;
+    uint32_t memory_block_count;
+    vk::DeviceSize transient_size;
+    // What the transient images would take without sharing memory
+    vk::DeviceSize unaliased_size;
+  };
+
+  class PassBuilder {
+  public:
+    PassBuilder(RenderGraph&, uint32_t);
+
+    PassBuilder& read(ResourceHandle, Usage);
+    PassBuilder& write(ResourceHandle, Usage);
+    PassBuilder& write_color(ResourceHandle, std::optional<vk::ClearColorValue> = std::nullopt);
+    PassBuilder& write_depth(ResourceHandle, std::optional<vk::ClearDepthStencilValue> = std::nullopt);
+    PassBuilder& side_effects();
+
+  private:
+    RenderGraph& graph;
+    uint32_t pass_index;
+  };
+
+  RenderGraph(const vk::raii::Device&, MemoryTracker&);
+
+  auto import_image(const std::string&, const ImageInfo&, ResourceState initial, std::optional<ResourceState> final)
+    -> ResourceHandle;
+  auto import_buffer(const std::string&, vk::Buffer, vk::DeviceSize, ResourceState initial)
+    -> ResourceHandle;
+  auto create_image(const std::string&, const ImageInfo&) -> ResourceHandle;
+  auto add_pass(const std::string&, RecordFunction) -> PassBuilder;
+
+  void set_image(ResourceHandle, vk::Image, vk::ImageView);
+  void set_buffer(ResourceHandle, vk::Buffer);
+  auto get_image(ResourceHandle) const -> vk::Image;
+  auto get_image_view(ResourceHandle) const -> vk::ImageView;
+
+  void compile();
+  auto get_stats() const -> const Stats& { return stats; }
+  // Barrier and attachment lists are built in the arena, which only has to outlive the call. Every
+  // pass becomes a zone of the profiler, and of the GPU profiler when one is given.
+  void execute(vk::raii::CommandBuffer&, std::pmr::memory_resource& arena, GpuProfiler* = nullptr);
+
+private:
+  enum class ResourceType { eImage, eBuffer };
+
+  struct Resource {
+    std::string name;
+    ResourceType type;
+    bool transient;
+    ImageInfo image_info;
+    vk::Image image;
+    vk::ImageView image_view;
+    vk::Buffer buffer;
+    vk::DeviceSize buffer_size;
+    ResourceState initial_state;
+    std::optional<ResourceState> final_state;
+
+    std::unique_ptr<vk::raii::Image> owned_image;
+    std::unique_ptr<vk::raii::ImageView> owned_image_view;
+    uint32_t first_use, last_use;
+    uint32_t memory_block;
+  };
+
+  struct ResourceUse {
+    ResourceHandle resource;
+    Usage usage;
+    bool read, write;
+  };
+
+  struct Attachment {
+    ResourceHandle resource;
+    std::optional<vk::ClearValue> clear_value;
+  };
+
+  struct Pass {
+    std::string name;
+    const char* profile_name;
+    RecordFunction record;
+    std::vector<ResourceUse> uses;
+    std::vector<Attachment> color_attachments;
+    std::optional<Attachment> depth_attachment;
+    bool has_side_effects;
+  };
+
+  struct Barrier {
+    ResourceHandle resource;
+    vk::ImageMemoryBarrier2 image_barrier;
+    vk::BufferMemoryBarrier2 buffer_barrier;
+  };
+
+  struct CompiledPass {
+    uint32_t pass_index;
+    std::vector<Barrier> barriers;
+  };
+
+  struct MemoryBlock {
+    vk::DeviceSize size, alignment, offset;
+    uint32_t memory_type_bits;
+    uint32_t memory_index;
+    std::vector<ResourceHandle> occupants;
+  };
+
+  static auto get_usage_state(Usage) -> ResourceState;
+  static bool is_write_access(vk::AccessFlags2);
+
+  // Compilation
+  void cull_passes();
+  void compute_lifetimes();
+  void allocate_transient_images();
+  void compute_barriers();
+  auto make_barrier(ResourceHandle, const ResourceState& src, const ResourceState& dst, vk::ImageLayout) const
+    -> Barrier;
+  void emit_barriers(vk::raii::CommandBuffer&, const std::vector<Barrier>&, std::pmr::memory_resource&);
+  void begin_rendering(vk::raii::CommandBuffer&, const Pass&, std::pmr::memory_resource&);
+
+  const vk::raii::Device& device;
+  MemoryTracker& memory_tracker;
+
+  std::vector<Resource> resources;
+  std::vector<Pass> passes;
+  std::vector<CompiledPass> compiled_passes;
+  std::vector<Barrier> final_barriers;
+  std::vector<MemoryBlock> memory_blocks;
+  std::vector<DeviceAllocation> memories;
+  Stats stats {};
+};
\ No newline at end of file
@@ -1,8 +1,89 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(constant_id = 0) const uint texture_count = 1;
+
+// Match Light, ClusteredLighting::Parameters and ClusteredLighting::max_lights_per_cluster
+struct Light {
+  vec3 position;
+  float range;
+  vec3 color;
+  float cos_inner_angle;
+  vec3 direction;
+  float cos_outer_angle;
+};
+
+const uint max_lights_per_cluster = 128;
+const vec3 ambient = vec3(0.2);
+
+layout(binding = 1) uniform sampler2D textures[texture_count];
+
+layout(std430, binding = 2) readonly buffer Lights {
+  mat4 view;
+  mat4 inverse_projection;
+  uvec4 grid;
+  vec2 tile_size;
+  vec2 slice_scale_bias;
+  vec2 viewport_size;
+  vec2 padding;
+  Light lights[];
+};
+
+layout(std430, binding = 3) readonly buffer Clusters {
+  uint light_counts[];
+};
+
+layout(std430, binding = 4) readonly buffer LightIndices {
+  uint light_indices[];
+};
 
 layout(location = 0) in vec3 frag_color;
+layout(location = 1) in vec2 frag_uv;
+layout(location = 2) flat in uint texture_index;
+layout(location = 3) in vec3 frag_position;
+layout(location = 4) in vec3 frag_normal;
 layout(location = 0) out vec4 out_color;
 
+uint get_cluster(float view_depth) {
+  uvec2 tile = min(uvec2(gl_FragCoord.xy / tile_size), grid.xy - 1);
+  float slice = log(view_depth) * slice_scale_bias.x + slice_scale_bias.y;
+  uint z = uint(clamp(slice, 0.0, float(grid.z - 1)));
+  return (z * grid.y + tile.y) * grid.x + tile.x;
+}
+
+// Lambert with a falloff that reaches zero at the light's range
+vec3 evaluate_light(Light light, vec3 normal) {
+  vec3 to_light = light.position - frag_position;
+  float distance_squared = dot(to_light, to_light);
+  float range_squared = light.range * light.range;
+  float window = clamp(1.0 - (distance_squared * distance_squared) / (range_squared * range_squared), 0.0, 1.0);
+  float attenuation = window * window / (1.0 + distance_squared);
+
+  vec3 direction = to_light * inversesqrt(max(distance_squared, 1e-8));
+  float cone = 1.0;
+  if (light.cos_outer_angle > -1.0) {
+    cone = smoothstep(light.cos_outer_angle, light.cos_inner_angle, dot(-direction, light.direction));
+  }
+  return light.color * (max(dot(normal, direction), 0.0) * attenuation * cone);
+}
+
 void main() {
-  out_color = vec4(frag_color, 1.0);
+  vec3 view_position = (view * vec4(frag_position, 1.0)).xyz;
+
+  // Quads are seen from both sides, the lit side is the one facing the camera
+  vec3 normal = normalize(frag_normal);
+  if (dot(mat3(view) * normal, view_position) > 0.0) {
+    normal = -normal;
+  }
+
+  // Only the lights binned into this fragment's cluster can reach it
+  uint cluster = get_cluster(-view_position.z);
+  uint first = cluster * max_lights_per_cluster;
+  vec3 lighting = ambient;
+  for (uint i = 0; i < light_counts[cluster]; ++i) {
+    lighting += evaluate_light(lights[light_indices[first + i]], normal);
+  }
+
+  vec4 albedo = vec4(frag_color, 1.0) * texture(textures[nonuniformEXT(texture_index)], frag_uv);
+  out_color = vec4(albedo.rgb * lighting, albedo.a);
 }
\ No newline at end of file
@@ -1,17 +1,32 @@
 #version 450
 
-layout(binding = 0) uniform UniformBufferObject {
-  mat4 model;
-  mat4 view;
-  mat4 projection;
-} mvp;
+layout(constant_id = 0) const uint texture_count = 1;
+
+// Offsets match PushConstants in render_engine.cc
+layout(push_constant) uniform Constants {
+  mat4 view_projection;
+  layout(offset = 88) uint first_texture;
+} constants;
 
 layout (location = 0) in vec2 position;
 layout (location = 1) in vec3 color;
+layout (location = 2) in vec2 uv;
+layout (location = 3) in mat4 model;
+layout (location = 7) in uint material;
 
 layout(location = 0) out vec3 frag_color;
+layout(location = 1) out vec2 frag_uv;
+layout(location = 2) flat out uint texture_index;
+layout(location = 3) out vec3 frag_position;
+layout(location = 4) out vec3 frag_normal;
 
 void main() {
-  gl_Position = mvp.projection * mvp.view * mvp.model * vec4(position, 0.0, 1.0);
+  vec4 world_position = model * vec4(position, 0.0, 1.0);
+  gl_Position = constants.view_projection * world_position;
+  frag_position = world_position.xyz;
+  // Meshes lie in the model's xy plane, scales are uniform so the model matrix carries its normal
+  frag_normal = mat3(model) * vec3(0.0, 0.0, 1.0);
   frag_color = color;
+  frag_uv = uv;
+  texture_index = (constants.first_texture + material) % texture_count;
 }
\ No newline at end of file
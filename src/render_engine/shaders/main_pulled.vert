@@ -0,0 +1,59 @@
+#version 450
+#extension GL_EXT_buffer_reference : require
+
+layout(constant_id = 0) const uint texture_count = 1;
+
+layout(buffer_reference, std430, buffer_reference_align = 4) readonly buffer Vertices {
+  float values[];
+};
+
+// Offsets match PushConstants in render_engine.cc. Attribute offsets count floats from the start
+// of a vertex, negative ones mark a missing attribute.
+layout(push_constant) uniform Constants {
+  mat4 view_projection;
+  Vertices vertices;
+  uint stride;
+  int position_offset;
+  int color_offset;
+  int uv_offset;
+  uint first_texture;
+} constants;
+
+layout (location = 3) in mat4 model;
+layout (location = 7) in uint material;
+
+layout(location = 0) out vec3 frag_color;
+layout(location = 1) out vec2 frag_uv;
+layout(location = 2) flat out uint texture_index;
+layout(location = 3) out vec3 frag_position;
+layout(location = 4) out vec3 frag_normal;
+
+vec2 read_vec2(uint base, int offset, vec2 fallback) {
+  if (offset < 0) {
+    return fallback;
+  }
+  uint index = base + uint(offset);
+  return vec2(constants.vertices.values[index], constants.vertices.values[index + 1]);
+}
+
+vec3 read_vec3(uint base, int offset, vec3 fallback) {
+  if (offset < 0) {
+    return fallback;
+  }
+  uint index = base + uint(offset);
+  return vec3(constants.vertices.values[index], constants.vertices.values[index + 1], constants.vertices.values[index + 2]);
+}
+
+void main() {
+  uint base = uint(gl_VertexIndex) * constants.stride;
+  vec2 position = read_vec2(base, constants.position_offset, vec2(0.0));
+
+  vec4 world_position = model * vec4(position, 0.0, 1.0);
+  gl_Position = constants.view_projection * world_position;
+  frag_position = world_position.xyz;
+  // Meshes lie in the model's xy plane, scales are uniform so the model matrix carries its normal
+  frag_normal = mat3(model) * vec3(0.0, 0.0, 1.0);
+  frag_color = read_vec3(base, constants.color_offset, vec3(1.0));
+  frag_uv = read_vec2(base, constants.uv_offset, vec2(0.0));
+  texture_index = (constants.first_texture + material) % texture_count;
+}
\ No newline at end of file
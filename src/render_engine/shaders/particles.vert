@@ -0,0 +1,29 @@
+#version 450
+
+struct Particle {
+  vec3 position;
+  float life;
+  vec3 velocity;
+  uint spawn_count;
+};
+
+layout(std430, binding = 0) readonly buffer Particles {
+  Particle particles[];
+};
+
+layout(push_constant) uniform Constants {
+  mat4 view_projection;
+} constants;
+
+layout(location = 0) out vec3 frag_color;
+
+void main() {
+  Particle particle = particles[gl_VertexIndex];
+  gl_Position = constants.view_projection * vec4(particle.position, 1.0);
+  // Larger points would need the largePoints feature
+  gl_PointSize = 1.0;
+
+  // Hot and fast at launch, cooling as the particle slows and ages
+  float heat = clamp(length(particle.velocity) / 3.0, 0.0, 1.0) * clamp(particle.life, 0.0, 1.0);
+  frag_color = mix(vec3(0.2, 0.3, 1.0), vec3(1.0, 0.8, 0.3), heat);
+}
\ No newline at end of file
@@ -0,0 +1,381 @@
+#include "texture_decoder.h"
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <fmt/core.h>
+
+namespace {
+
+using Texel = std::array<uint8_t, 4>;
+using Block = std::array<Texel, 16>;
+
+enum class Codec {
+  eBc1, eBc1Alpha, eBc2, eBc3, eBc4, eBc5, eEtc2Rgb, eEtc2Rgba
+};
+
+auto get_codec(vk::Format format) -> std::optional<Codec> {
+  using enum vk::Format;
+  switch (format) {
+    case eBc1RgbUnormBlock: case eBc1RgbSrgbBlock: return Codec::eBc1;
+    case eBc1RgbaUnormBlock: case eBc1RgbaSrgbBlock: return Codec::eBc1Alpha;
+    case eBc2UnormBlock: case eBc2SrgbBlock: return Codec::eBc2;
+    case eBc3UnormBlock: case eBc3SrgbBlock: return Codec::eBc3;
+    case eBc4UnormBlock: return Codec::eBc4;
+    case eBc5UnormBlock: return Codec::eBc5;
+    case eEtc2R8G8B8UnormBlock: case eEtc2R8G8B8SrgbBlock: return Codec::eEtc2Rgb;
+    case eEtc2R8G8B8A8UnormBlock: case eEtc2R8G8B8A8SrgbBlock: return Codec::eEtc2Rgba;
+    default: return std::nullopt;
+  }
+}
+
+bool is_srgb(vk::Format format) {
+  using enum vk::Format;
+  switch (format) {
+    case eBc1RgbSrgbBlock: case eBc1RgbaSrgbBlock: case eBc2SrgbBlock: case eBc3SrgbBlock:
+    case eEtc2R8G8B8SrgbBlock: case eEtc2R8G8B8A8SrgbBlock:
+      return true;
+    default:
+      return false;
+  }
+}
+
+auto read_le16(const uint8_t* data) -> uint32_t {
+  return data[0] | (uint32_t { data[1] } << 8);
+}
+
+auto read_le64(const uint8_t* data) -> uint64_t {
+  uint64_t value = 0;
+  for (int i = 7; i >= 0; --i) {
+    value = (value << 8) | data[i];
+  }
+  return value;
+}
+
+auto read_be64(const uint8_t* data) -> uint64_t {
+  uint64_t value = 0;
+  for (int i = 0; i < 8; ++i) {
+    value = (value << 8) | data[i];
+  }
+  return value;
+}
+
+auto clamp_byte(int value) -> uint8_t {
+  return static_cast<uint8_t>(std::clamp(value, 0, 255));
+}
+
+auto expand_565(uint32_t color) -> Texel {
+  uint32_t r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+  return {
+    static_cast<uint8_t>((r * 255 + 15) / 31),
+    static_cast<uint8_t>((g * 255 + 31) / 63),
+    static_cast<uint8_t>((b * 255 + 15) / 31),
+    255
+  };
+}
+
+// BC1 color block, also the color half of BC2 and BC3 which always use four colors
+void decode_bc1_color(const uint8_t* data, bool three_color_mode, bool alpha, Block& block) {
+  uint32_t c0 = read_le16(data), c1 = read_le16(data + 2);
+  std::array<Texel, 4> palette { expand_565(c0), expand_565(c1), {}, {} };
+
+  for (size_t c = 0; c < 3; ++c) {
+    int a = palette[0][c], b = palette[1][c];
+    if (c0 > c1 || !three_color_mode) {
+      palette[2][c] = static_cast<uint8_t>((2 * a + b) / 3);
+      palette[3][c] = static_cast<uint8_t>((a + 2 * b) / 3);
+    } else {
+      palette[2][c] = static_cast<uint8_t>((a + b) / 2);
+      palette[3][c] = 0;
+    }
+  }
+  palette[2][3] = 255;
+  palette[3][3] = (c0 <= c1 && three_color_mode && alpha ? 0 : 255);
+
+  uint32_t indices = data[4] | (uint32_t { data[5] } << 8) | (uint32_t { data[6] } << 16) | (uint32_t { data[7] } << 24);
+  for (size_t i = 0; i < 16; ++i) {
+    block[i] = palette[(indices >> (2 * i)) & 3];
+  }
+}
+
+// BC3 alpha block, also the channels of BC4 and BC5
+void decode_bc3_channel(const uint8_t* data, size_t channel, Block& block) {
+  int a0 = data[0], a1 = data[1];
+  std::array<uint8_t, 8> palette { static_cast<uint8_t>(a0), static_cast<uint8_t>(a1) };
+  if (a0 > a1) {
+    for (int i = 1; i < 7; ++i) {
+      palette[i + 1] = static_cast<uint8_t>(((7 - i) * a0 + i * a1) / 7);
+    }
+  } else {
+    for (int i = 1; i < 5; ++i) {
+      palette[i + 1] = static_cast<uint8_t>(((5 - i) * a0 + i * a1) / 5);
+    }
+    palette[6] = 0;
+    palette[7] = 255;
+  }
+
+  uint64_t indices = read_le64(data) >> 16;
+  for (size_t i = 0; i < 16; ++i) {
+    block[i][channel] = palette[(indices >> (3 * i)) & 7];
+  }
+}
+
+constexpr std::array<std::array<int, 2>, 8> etc_modifiers {{
+  { 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 }, { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 }
+}};
+
+constexpr std::array<int, 8> etc_distances { 3, 6, 11, 16, 23, 32, 41, 64 };
+
+auto extend_4(uint32_t value) -> int { return static_cast<int>((value << 4) | value); }
+auto extend_5(uint32_t value) -> int { return static_cast<int>((value << 3) | (value >> 2)); }
+auto extend_6(uint32_t value) -> int { return static_cast<int>((value << 2) | (value >> 4)); }
+auto extend_7(uint32_t value) -> int { return static_cast<int>((value << 1) | (value >> 6)); }
+
+auto bits(uint64_t value, int high, int low) -> uint32_t {
+  return static_cast<uint32_t>((value >> low) & ((uint64_t { 1 } << (high - low + 1)) - 1));
+}
+
+// Pixels are indexed column by column, with the most significant index bits in the upper half
+auto etc_pixel_index(uint64_t word, size_t x, size_t y) -> uint32_t {
+  size_t p = x * 4 + y;
+  return static_cast<uint32_t>((((word >> (16 + p)) & 1) << 1) | ((word >> p) & 1));
+}
+
+void decode_etc2_color(const uint8_t* data, Block& block) {
+  uint64_t word = read_be64(data);
+  bool differential = bits(word, 33, 33);
+  bool flip = bits(word, 32, 32);
+
+  auto paint = [&block, word] (const std::array<std::array<int, 3>, 4>& colors) {
+    for (size_t y = 0; y < 4; ++y) {
+      for (size_t x = 0; x < 4; ++x) {
+        const auto& color = colors[etc_pixel_index(word, x, y)];
+        block[y * 4 + x] = { clamp_byte(color[0]), clamp_byte(color[1]), clamp_byte(color[2]), 255 };
+      }
+    }
+  };
+
+  std::array<int, 3> base1, base2;
+  if (!differential) {
+    base1 = { extend_4(bits(word, 63, 60)), extend_4(bits(word, 55, 52)), extend_4(bits(word, 47, 44)) };
+    base2 = { extend_4(bits(word, 59, 56)), extend_4(bits(word, 51, 48)), extend_4(bits(word, 43, 40)) };
+  } else {
+    auto signed_3 = [] (uint32_t value) { return static_cast<int>(value) - (value >= 4 ? 8 : 0); };
+    int r = static_cast<int>(bits(word, 63, 59)), g = static_cast<int>(bits(word, 55, 51));
+    int b = static_cast<int>(bits(word, 47, 43));
+    int r2 = r + signed_3(bits(word, 58, 56)), g2 = g + signed_3(bits(word, 50, 48));
+    int b2 = b + signed_3(bits(word, 42, 40));
+
+    if (r2 < 0 || r2 > 31) {
+      // T mode
+      int d = etc_distances[(bits(word, 35, 34) << 1) | bits(word, 32, 32)];
+      std::array c1 {
+        extend_4((bits(word, 60, 59) << 2) | bits(word, 57, 56)), extend_4(bits(word, 55, 52)), extend_4(bits(word, 51, 48))
+      };
+      std::array c2 { extend_4(bits(word, 47, 44)), extend_4(bits(word, 43, 40)), extend_4(bits(word, 39, 36)) };
+      paint({{
+        c1,
+        { c2[0] + d, c2[1] + d, c2[2] + d },
+        c2,
+        { c2[0] - d, c2[1] - d, c2[2] - d }
+      }});
+      return;
+    }
+
+    if (g2 < 0 || g2 > 31) {
+      // H mode
+      uint32_t r1 = bits(word, 62, 59), g1 = (bits(word, 58, 56) << 1) | bits(word, 52, 52);
+      uint32_t b1 = (bits(word, 51, 51) << 3) | bits(word, 49, 47);
+      uint32_t r2h = bits(word, 46, 43), g2h = bits(word, 42, 39), b2h = bits(word, 38, 35);
+      uint32_t index = (bits(word, 34, 34) << 2) | (bits(word, 32, 32) << 1);
+      if (((r1 << 8) | (g1 << 4) | b1) >= ((r2h << 8) | (g2h << 4) | b2h)) {
+        index |= 1;
+      }
+      int d = etc_distances[index];
+      std::array c1 { extend_4(r1), extend_4(g1), extend_4(b1) };
+      std::array c2 { extend_4(r2h), extend_4(g2h), extend_4(b2h) };
+      paint({{
+        { c1[0] + d, c1[1] + d, c1[2] + d },
+        { c1[0] - d, c1[1] - d, c1[2] - d },
+        { c2[0] + d, c2[1] + d, c2[2] + d },
+        { c2[0] - d, c2[1] - d, c2[2] - d }
+      }});
+      return;
+    }
+
+    if (b2 < 0 || b2 > 31) {
+      // Planar mode, a color gradient over the block
+      std::array origin {
+        extend_6(bits(word, 62, 57)),
+        extend_7((bits(word, 56, 56) << 6) | bits(word, 54, 49)),
+        extend_6((bits(word, 48, 48) << 5) | (bits(word, 44, 43) << 3) | bits(word, 41, 39))
+      };
+      std::array horizontal {
+        extend_6((bits(word, 38, 34) << 1) | bits(word, 32, 32)), extend_7(bits(word, 31, 25)), extend_6(bits(word, 24, 19))
+      };
+      std::array vertical { extend_6(bits(word, 18, 13)), extend_7(bits(word, 12, 6)), extend_6(bits(word, 5, 0)) };
+
+      for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 4; ++x) {
+          auto& texel = block[static_cast<size_t>(y * 4 + x)];
+          for (size_t c = 0; c < 3; ++c) {
+            int value = x * (horizontal[c] - origin[c]) + y * (vertical[c] - origin[c]) + 4 * origin[c] + 2;
+            texel[c] = clamp_byte(value >> 2);
+          }
+          texel[3] = 255;
+        }
+      }
+      return;
+    }
+
+    base1 = { extend_5(static_cast<uint32_t>(r)), extend_5(static_cast<uint32_t>(g)), extend_5(static_cast<uint32_t>(b)) };
+    base2 = { extend_5(static_cast<uint32_t>(r2)), extend_5(static_cast<uint32_t>(g2)), extend_5(static_cast<uint32_t>(b2)) };
+  }
+
+  // Individual and differential modes, two sub-blocks side by side or on top of each other
+  std::array tables { bits(word, 39, 37), bits(word, 36, 34) };
+  for (size_t y = 0; y < 4; ++y) {
+    for (size_t x = 0; x < 4; ++x) {
+      size_t sub_block = (flip ? y >= 2 : x >= 2);
+      const auto& base = (sub_block == 0 ? base1 : base2);
+      uint32_t index = etc_pixel_index(word, x, y);
+      int modifier = etc_modifiers[tables[sub_block]][index & 1];
+      if (index & 2) {
+        modifier = -modifier;
+      }
+      block[y * 4 + x] = {
+        clamp_byte(base[0] + modifier), clamp_byte(base[1] + modifier), clamp_byte(base[2] + modifier), 255
+      };
+    }
+  }
+}
+
+constexpr std::array<std::array<int, 8>, 16> eac_modifiers {{
+  { -3, -6, -9, -15, 2, 5, 8, 14 },
+  { -3, -7, -10, -13, 2, 6, 9, 12 },
+  { -2, -5, -8, -13, 1, 4, 7, 12 },
+  { -2, -4, -6, -13, 1, 3, 5, 12 },
+  { -3, -6, -8, -12, 2, 5, 7, 11 },
+  { -3, -7, -9, -11, 2, 6, 8, 10 },
+  { -4, -7, -8, -11, 3, 6, 7, 10 },
+  { -3, -5, -8, -11, 2, 4, 7, 10 },
+  { -2, -6, -8, -10, 1, 5, 7, 9 },
+  { -2, -5, -8, -10, 1, 4, 7, 9 },
+  { -2, -4, -8, -10, 1, 3, 7, 9 },
+  { -2, -5, -7, -10, 1, 4, 6, 9 },
+  { -3, -4, -7, -10, 2, 3, 6, 9 },
+  { -1, -2, -3, -10, 0, 1, 2, 9 },
+  { -4, -6, -8, -9, 3, 5, 7, 8 },
+  { -3, -5, -7, -9, 2, 4, 6, 8 }
+}};
+
+void decode_eac_alpha(const uint8_t* data, Block& block) {
+  uint64_t word = read_be64(data);
+  int base = static_cast<int>(bits(word, 63, 56));
+  int multiplier = static_cast<int>(bits(word, 55, 52));
+  const auto& modifiers = eac_modifiers[bits(word, 51, 48)];
+
+  for (size_t x = 0; x < 4; ++x) {
+    for (size_t y = 0; y < 4; ++y) {
+      int shift = 45 - static_cast<int>(x * 4 + y) * 3;
+      block[y * 4 + x][3] = clamp_byte(base + modifiers[bits(word, shift + 2, shift)] * multiplier);
+    }
+  }
+}
+
+void decode_block(Codec codec, const uint8_t* data, Block& block) {
+  switch (codec) {
+    case Codec::eBc1:
+      decode_bc1_color(data, true, false, block);
+      break;
+
+    case Codec::eBc1Alpha:
+      decode_bc1_color(data, true, true, block);
+      break;
+
+    case Codec::eBc2:
+      decode_bc1_color(data + 8, false, false, block);
+      for (size_t i = 0; i < 16; ++i) {
+        uint32_t alpha = (data[i / 2] >> (4 * (i % 2))) & 15;
+        block[i][3] = static_cast<uint8_t>(alpha * 17);
+      }
+      break;
+
+    case Codec::eBc3:
+      decode_bc1_color(data + 8, false, false, block);
+      decode_bc3_channel(data, 3, block);
+      break;
+
+    case Codec::eBc4:
+      block.fill({ 0, 0, 0, 255 });
+      decode_bc3_channel(data, 0, block);
+      break;
+
+    case Codec::eBc5:
+      block.fill({ 0, 0, 0, 255 });
+      decode_bc3_channel(data, 0, block);
+      decode_bc3_channel(data + 8, 1, block);
+      break;
+
+    case Codec::eEtc2Rgb:
+      decode_etc2_color(data, block);
+      break;
+
+    case Codec::eEtc2Rgba:
+      decode_etc2_color(data + 8, block);
+      decode_eac_alpha(data, block);
+      break;
+  }
+}
+
+}
+
+bool can_decode(vk::Format format) {
+  return get_codec(format).has_value();
+}
+
+auto decode_to_rgba8(const TextureSource& source) -> TextureSource {
+  auto codec = get_codec(source.format);
+  auto info = get_format_info(source.format);
+  if (!codec || !info) {
+    throw std::runtime_error(fmt::format("No CPU decoder for texture format {}", vk::to_string(source.format)));
+  }
+
+  TextureSource decoded {
+    .format = (is_srgb(source.format) ? vk::Format::eR8G8B8A8Srgb : vk::Format::eR8G8B8A8Unorm),
+    .levels = {},
+    .data = {}
+  };
+
+  size_t total_size = 0;
+  for (const auto& level : source.levels) {
+    size_t size = size_t { level.extent.width } * level.extent.height * 4;
+    decoded.levels.push_back({ .extent = level.extent, .offset = total_size, .size = size });
+    total_size += size;
+  }
+  decoded.data.resize(total_size);
+
+  Block block;
+  for (size_t i = 0; i < source.levels.size(); ++i) {
+    const auto& level = source.levels[i];
+    auto extent = level.extent;
+    const auto* blocks = reinterpret_cast<const uint8_t*>(source.data.data() + level.offset);
+    auto* texels = reinterpret_cast<uint8_t*>(decoded.data.data() + decoded.levels[i].offset);
+
+    uint32_t blocks_x = (extent.width + 3) / 4, blocks_y = (extent.height + 3) / 4;
+    for (uint32_t by = 0; by < blocks_y; ++by) {
+      for (uint32_t bx = 0; bx < blocks_x; ++bx) {
+        decode_block(*codec, blocks + (size_t { by } * blocks_x + bx) * info->block_size, block);
+
+        // Blocks on the right and bottom edges may hang over the level
+        for (uint32_t y = 0; y < 4 && by * 4 + y < extent.height; ++y) {
+          for (uint32_t x = 0; x < 4 && bx * 4 + x < extent.width; ++x) {
+            const auto& texel = block[y * 4 + x];
+            std::copy(texel.begin(), texel.end(), texels + ((size_t { by } * 4 + y) * extent.width + bx * 4 + x) * 4);
+          }
+        }
+      }
+    }
+  }
+
+  return decoded;
+}
\ No newline at end of file
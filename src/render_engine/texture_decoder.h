@@ -0,0 +1,7 @@
+#pragma once
+#include "texture_source.h"
+
+// Decodes block-compressed textures on the CPU for devices that cannot sample their format.
+// Covers BC1-5 and ETC2 RGB and RGBA, the result is RGBA8 with the same color space.
+bool can_decode(vk::Format);
+auto decode_to_rgba8(const TextureSource&) -> TextureSource;
\ No newline at end of file
@@ -0,0 +1,96 @@
+#include "texture_source.h"
+#include <algorithm>
+#include <bit>
+
+auto get_format_info(vk::Format format) -> std::optional<FormatInfo> {
+  using enum vk::Format;
+  auto uncompressed = [] (uint32_t size) { return FormatInfo { 1, 1, size, false }; };
+  auto compressed = [] (uint32_t width, uint32_t height, uint32_t size) { return FormatInfo { width, height, size, true }; };
+
+  switch (format) {
+    case eR8Unorm:
+      return uncompressed(1);
+    case eR8G8Unorm:
+      return uncompressed(2);
+    case eR8G8B8A8Unorm:
+    case eR8G8B8A8Srgb:
+    case eB8G8R8A8Unorm:
+    case eB8G8R8A8Srgb:
+      return uncompressed(4);
+    case eR16G16B16A16Sfloat:
+      return uncompressed(8);
+    case eR32G32B32A32Sfloat:
+      return uncompressed(16);
+
+    case eBc1RgbUnormBlock:
+    case eBc1RgbSrgbBlock:
+    case eBc1RgbaUnormBlock:
+    case eBc1RgbaSrgbBlock:
+    case eBc4UnormBlock:
+    case eEtc2R8G8B8UnormBlock:
+    case eEtc2R8G8B8SrgbBlock:
+    case eEtc2R8G8B8A1UnormBlock:
+    case eEtc2R8G8B8A1SrgbBlock:
+      return compressed(4, 4, 8);
+    case eBc2UnormBlock:
+    case eBc2SrgbBlock:
+    case eBc3UnormBlock:
+    case eBc3SrgbBlock:
+    case eBc5UnormBlock:
+    case eBc6HUfloatBlock:
+    case eBc6HSfloatBlock:
+    case eBc7UnormBlock:
+    case eBc7SrgbBlock:
+    case eEtc2R8G8B8A8UnormBlock:
+    case eEtc2R8G8B8A8SrgbBlock:
+      return compressed(4, 4, 16);
+
+    case eAstc4x4UnormBlock: case eAstc4x4SrgbBlock: return compressed(4, 4, 16);
+    case eAstc5x4UnormBlock: case eAstc5x4SrgbBlock: return compressed(5, 4, 16);
+    case eAstc5x5UnormBlock: case eAstc5x5SrgbBlock: return compressed(5, 5, 16);
+    case eAstc6x5UnormBlock: case eAstc6x5SrgbBlock: return compressed(6, 5, 16);
+    case eAstc6x6UnormBlock: case eAstc6x6SrgbBlock: return compressed(6, 6, 16);
+    case eAstc8x5UnormBlock: case eAstc8x5SrgbBlock: return compressed(8, 5, 16);
+    case eAstc8x6UnormBlock: case eAstc8x6SrgbBlock: return compressed(8, 6, 16);
+    case eAstc8x8UnormBlock: case eAstc8x8SrgbBlock: return compressed(8, 8, 16);
+    case eAstc10x5UnormBlock: case eAstc10x5SrgbBlock: return compressed(10, 5, 16);
+    case eAstc10x6UnormBlock: case eAstc10x6SrgbBlock: return compressed(10, 6, 16);
+    case eAstc10x8UnormBlock: case eAstc10x8SrgbBlock: return compressed(10, 8, 16);
+    case eAstc10x10UnormBlock: case eAstc10x10SrgbBlock: return compressed(10, 10, 16);
+    case eAstc12x10UnormBlock: case eAstc12x10SrgbBlock: return compressed(12, 10, 16);
+    case eAstc12x12UnormBlock: case eAstc12x12SrgbBlock: return compressed(12, 12, 16);
+
+    default:
+      return std::nullopt;
+  }
+}
+
+auto get_level_size(const FormatInfo& info, vk::Extent2D extent) -> size_t {
+  size_t blocks_x = (extent.width + info.block_width - 1) / info.block_width;
+  size_t blocks_y = (extent.height + info.block_height - 1) / info.block_height;
+  return blocks_x * blocks_y * info.block_size;
+}
+
+auto get_full_level_count(vk::Extent2D extent) -> uint32_t {
+  return static_cast<uint32_t>(std::bit_width(std::max(extent.width, extent.height)));
+}
+
+auto generate_checker_texture(uint32_t size, uint32_t cell_size, std::array<uint8_t, 4> color) -> TextureSource {
+  size_t level_size = size_t { size } * size * 4;
+  TextureSource source {
+    .format = vk::Format::eR8G8B8A8Srgb,
+    .levels = { { .extent = { size, size }, .offset = 0, .size = level_size } },
+    .data = std::vector<std::byte>(level_size)
+  };
+
+  constexpr std::array<uint8_t, 4> white { 255, 255, 255, 255 };
+  auto* texels = reinterpret_cast<uint8_t*>(source.data.data());
+  for (uint32_t y = 0; y < size; ++y) {
+    for (uint32_t x = 0; x < size; ++x) {
+      const auto& texel = ((x / cell_size + y / cell_size) % 2 == 0 ? color : white);
+      std::copy(texel.begin(), texel.end(), texels + (size_t { y } * size + x) * 4);
+    }
+  }
+
+  return source;
+}
\ No newline at end of file
@@ -0,0 +1,34 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+#define VULKAN_HPP_NO_CONSTRUCTORS
+#include <vulkan/vulkan.hpp>
+
+// Texel data of a texture on the CPU, every mip level at its own offset into data, finest first.
+// Uncompressed sources may stop short of the full mip chain, the rest is generated on the GPU.
+struct TextureSource {
+  struct Level {
+    vk::Extent2D extent;
+    size_t offset, size;
+  };
+
+  vk::Format format;
+  std::vector<Level> levels;
+  std::vector<std::byte> data;
+};
+
+// Size of a block of texels, a single texel for uncompressed formats
+struct FormatInfo {
+  uint32_t block_width, block_height, block_size;
+  bool compressed;
+};
+
+auto get_format_info(vk::Format) -> std::optional<FormatInfo>;
+auto get_level_size(const FormatInfo&, vk::Extent2D) -> size_t;
+auto get_full_level_count(vk::Extent2D) -> uint32_t;
+
+// Checkerboard without mip levels, for scenes without texture assets
+auto generate_checker_texture(uint32_t size, uint32_t cell_size, std::array<uint8_t, 4> color) -> TextureSource;
\ No newline at end of file
@@ -0,0 +1,603 @@
+#include "texture_streamer.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+
+namespace {
+
+// Satisfies the offset alignment of every texel block size
+constexpr vk::DeviceSize staging_alignment = 16;
+
+auto align(vk::DeviceSize value, vk::DeviceSize alignment) -> vk::DeviceSize {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+}
+
+TextureStreamer::TextureStreamer(
+  const vk::raii::PhysicalDevice& _physical_device, const vk::raii::Device& _device, MemoryTracker& _memory_tracker,
+  const vk::raii::Queue& _graphics_queue, uint32_t graphics_family,
+  const vk::raii::Queue& _transfer_queue, uint32_t transfer_family, const Config& _config)
+  : physical_device { _physical_device }, device { _device }, memory_tracker { _memory_tracker },
+    graphics_queue { _graphics_queue }, transfer_queue { _transfer_queue }, config { _config },
+    resident_bytes { 0 }, retiring_bytes { 0 }, frame { 0 }, version { 0 } {
+  queue_families.push_back(graphics_family);
+  if (transfer_family != graphics_family) {
+    queue_families.push_back(transfer_family);
+  }
+
+  vk::CommandPoolCreateInfo command_pool_create_info {
+    .flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+    .queueFamilyIndex = transfer_family
+  };
+  command_pool = vk::raii::CommandPool { device, command_pool_create_info };
+
+  vk::CommandPoolCreateInfo graphics_command_pool_create_info {
+    .flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+    .queueFamilyIndex = graphics_family
+  };
+  graphics_command_pool = vk::raii::CommandPool { device, graphics_command_pool_create_info };
+
+  vk::CommandBufferAllocateInfo graphics_allocate_info {
+    .commandPool = *graphics_command_pool,
+    .level = vk::CommandBufferLevel::ePrimary,
+    .commandBufferCount = 1
+  };
+  graphics_command_buffer = std::move(vk::raii::CommandBuffers { device, graphics_allocate_info }.front());
+  graphics_fence = vk::raii::Fence { device, vk::FenceCreateInfo {} };
+
+  vk::SamplerCreateInfo sampler_create_info {
+    .magFilter = vk::Filter::eLinear,
+    .minFilter = vk::Filter::eLinear,
+    .mipmapMode = vk::SamplerMipmapMode::eLinear,
+    .addressModeU = vk::SamplerAddressMode::eRepeat,
+    .addressModeV = vk::SamplerAddressMode::eRepeat,
+    .addressModeW = vk::SamplerAddressMode::eRepeat,
+    .mipLodBias = 0.0f,
+    .anisotropyEnable = false,
+    .maxAnisotropy = 1.0f,
+    .compareEnable = false,
+    .compareOp = vk::CompareOp::eAlways,
+    .minLod = 0.0f,
+    .maxLod = VK_LOD_CLAMP_NONE,
+    .borderColor = vk::BorderColor::eIntOpaqueBlack,
+    .unnormalizedCoordinates = false
+  };
+  sampler = vk::raii::Sampler { device, sampler_create_info };
+
+  vk::CommandBufferAllocateInfo allocate_info {
+    .commandPool = *command_pool,
+    .level = vk::CommandBufferLevel::ePrimary,
+    .commandBufferCount = config.max_uploads
+  };
+  vk::raii::CommandBuffers command_buffers { device, allocate_info };
+
+  upload_slots.reserve(config.max_uploads);
+  for (auto& command_buffer : command_buffers) {
+    upload_slots.push_back({
+      .command_buffer = std::move(command_buffer),
+      .fence = vk::raii::Fence { device, vk::FenceCreateInfo {} },
+      .busy = false,
+      .texture = 0,
+      .level = 0
+    });
+  }
+}
+
+auto TextureStreamer::add(TextureSource source) -> TextureHandle {
+  auto info = get_format_info(source.format);
+  if (info && !info->compressed && source.levels.size() < get_full_level_count(source.levels.front().extent)) {
+    generate_mip_levels(source);
+  }
+
+  // The tail starts at the first level that fits into tail_size
+  uint32_t tail_level = 0;
+  while (tail_level + 1 < source.levels.size()) {
+    auto extent = source.levels[tail_level].extent;
+    if (std::max(extent.width, extent.height) <= config.tail_size) {
+      break;
+    }
+    ++tail_level;
+  }
+
+  textures.push_back({
+    .source = std::move(source),
+    .tail_level = tail_level,
+    .resident_level = tail_level,
+    .requested_level = not_requested,
+    .last_requested = 0,
+    .uploading = false
+  });
+  auto handle = static_cast<TextureHandle>(textures.size() - 1);
+
+  auto slot = std::ranges::find_if(upload_slots, [] (const UploadSlot& slot) { return !slot.busy; });
+  if (slot == upload_slots.end()) {
+    for (const auto& busy_slot : upload_slots) {
+      (void)device.waitForFences(*busy_slot.fence, true, UINT64_MAX);
+    }
+    finish_uploads();
+    slot = upload_slots.begin();
+  }
+
+  start_upload(*slot, handle, tail_level);
+  (void)device.waitForFences(*slot->fence, true, UINT64_MAX);
+
+  textures[handle].tail = std::move(slot->image);
+  slot->staging_buffer.clear();
+  slot->staging_memory = {};
+  slot->busy = false;
+  ++version;
+  return handle;
+}
+
+void TextureStreamer::request(TextureHandle handle, uint32_t level) {
+  auto& texture = textures[handle];
+  texture.requested_level = std::min({ texture.requested_level, level, texture.tail_level });
+  texture.last_requested = frame;
+}
+
+auto TextureStreamer::get_image_view(TextureHandle handle) const -> vk::ImageView {
+  const auto& texture = textures[handle];
+  return (*texture.streamed.view ? *texture.streamed.view : *texture.tail.view);
+}
+
+auto TextureStreamer::get_level_count(TextureHandle handle) const -> uint32_t {
+  return static_cast<uint32_t>(textures[handle].source.levels.size());
+}
+
+auto TextureStreamer::get_width(TextureHandle handle) const -> uint32_t {
+  return textures[handle].source.levels.front().extent.width;
+}
+
+void TextureStreamer::update() {
+  ++frame;
+
+  // Every frame that could still sample a retired image has finished by now
+  std::erase_if(retired_images, [this] (const RetiredImage& retired) {
+    if (frame < retired.frame + config.frames_in_flight) {
+      return false;
+    }
+    retiring_bytes -= retired.image.memory.get_size();
+    return true;
+  });
+
+  finish_uploads();
+  start_uploads();
+
+  for (auto& texture : textures) {
+    texture.requested_level = not_requested;
+  }
+}
+
+void TextureStreamer::finish_uploads() {
+  for (auto& slot : upload_slots) {
+    if (!slot.busy || slot.fence.getStatus() != vk::Result::eSuccess) {
+      continue;
+    }
+
+    auto& texture = textures[slot.texture];
+    resident_bytes -= texture.streamed.memory.get_size();
+    retire(std::move(texture.streamed));
+    texture.streamed = std::move(slot.image);
+    texture.resident_level = slot.level;
+    texture.uploading = false;
+
+    slot.staging_buffer.clear();
+    slot.staging_memory = {};
+    slot.busy = false;
+    ++version;
+  }
+}
+
+void TextureStreamer::start_uploads() {
+  candidates.clear();
+  for (TextureHandle handle = 0; handle < size(); ++handle) {
+    const auto& texture = textures[handle];
+    if (!texture.uploading && texture.requested_level < texture.resident_level) {
+      candidates.push_back(handle);
+    }
+  }
+
+  // The textures furthest from the detail they need first
+  std::ranges::sort(candidates, std::greater {}, [this] (TextureHandle handle) {
+    return textures[handle].resident_level - textures[handle].requested_level;
+  });
+
+  vk::DeviceSize uploaded = 0;
+  for (auto handle : candidates) {
+    auto slot = std::ranges::find_if(upload_slots, [] (const UploadSlot& slot) { return !slot.busy; });
+    if (slot == upload_slots.end()) {
+      break;
+    }
+
+    auto& texture = textures[handle];
+    uint32_t level = texture.requested_level;
+    auto size = get_image_size(texture, level);
+    if (uploaded > 0 && uploaded + size > config.upload_limit) {
+      break;
+    }
+    if (!make_room(size, handle)) {
+      continue;
+    }
+
+    try {
+      start_upload(*slot, handle, level);
+    } catch (const std::runtime_error&) {
+      // The heap is over its budget, try again once evicted images have been freed
+      slot->image = {};
+      slot->staging_buffer.clear();
+      slot->staging_memory = {};
+      break;
+    }
+
+    resident_bytes += slot->image.memory.get_size();
+    texture.uploading = true;
+    uploaded += size;
+  }
+}
+
+bool TextureStreamer::make_room(vk::DeviceSize size, TextureHandle requester) {
+  while (resident_bytes + size > config.budget) {
+    // Only textures resident at more detail than they need this frame give up their memory,
+    // the ones requested longest ago first
+    auto victim = std::optional<TextureHandle> {};
+    for (TextureHandle handle = 0; handle < this->size(); ++handle) {
+      const auto& texture = textures[handle];
+      if (handle == requester || texture.uploading || !*texture.streamed.image
+          || texture.requested_level <= texture.resident_level) {
+        continue;
+      }
+      if (!victim || texture.last_requested < textures[*victim].last_requested) {
+        victim = handle;
+      }
+    }
+
+    if (!victim) {
+      return false;
+    }
+    evict(*victim);
+  }
+
+  return resident_bytes + retiring_bytes + size <= config.budget;
+}
+
+void TextureStreamer::evict(TextureHandle handle) {
+  auto& texture = textures[handle];
+  resident_bytes -= texture.streamed.memory.get_size();
+  retire(std::move(texture.streamed));
+  texture.resident_level = texture.tail_level;
+  ++version;
+}
+
+void TextureStreamer::retire(GpuImage&& image) {
+  if (!*image.image) {
+    return;
+  }
+  retiring_bytes += image.memory.get_size();
+  retired_images.push_back({ .image = std::move(image), .frame = frame });
+}
+
+auto TextureStreamer::get_image_size(const Texture& texture, uint32_t base_level) const -> vk::DeviceSize {
+  vk::DeviceSize size = 0;
+  for (size_t level = base_level; level < texture.source.levels.size(); ++level) {
+    size += texture.source.levels[level].size;
+  }
+  return size;
+}
+
+auto TextureStreamer::create_image(const Texture& texture, uint32_t base_level) -> GpuImage {
+  const auto& source = texture.source;
+  auto extent = source.levels[base_level].extent;
+  uint32_t level_count = static_cast<uint32_t>(source.levels.size()) - base_level;
+
+  vk::ImageCreateInfo create_info {
+    .imageType = vk::ImageType::e2D,
+    .format = source.format,
+    .extent = { extent.width, extent.height, 1 },
+    .mipLevels = level_count,
+    .arrayLayers = 1,
+    .samples = vk::SampleCountFlagBits::e1,
+    .tiling = vk::ImageTiling::eOptimal,
+    .usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+    .initialLayout = vk::ImageLayout::eUndefined
+  };
+
+  // Sharing concurrently avoids ownership transfers between the transfer and graphics queues
+  if (queue_families.size() > 1) {
+    create_info.sharingMode = vk::SharingMode::eConcurrent;
+    create_info.queueFamilyIndexCount = static_cast<uint32_t>(queue_families.size());
+    create_info.pQueueFamilyIndices = queue_families.data();
+  } else {
+    create_info.sharingMode = vk::SharingMode::eExclusive;
+  }
+
+  GpuImage image;
+  image.image = vk::raii::Image { device, create_info };
+  auto requirements = image.image.getMemoryRequirements();
+  uint32_t memory_type = memory_tracker.find_memory_type(
+    requirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal
+  );
+  image.memory = memory_tracker.allocate(requirements.size, memory_type, MemoryCategory::eTexture);
+  image.image.bindMemory(*image.memory, 0);
+
+  vk::ImageViewCreateInfo view_create_info {
+    .image = *image.image,
+    .viewType = vk::ImageViewType::e2D,
+    .format = source.format,
+    .subresourceRange = {
+      .aspectMask = vk::ImageAspectFlagBits::eColor,
+      .baseMipLevel = 0,
+      .levelCount = level_count,
+      .baseArrayLayer = 0,
+      .layerCount = 1
+    }
+  };
+  image.view = vk::raii::ImageView { device, view_create_info };
+  return image;
+}
+
+void TextureStreamer::start_upload(UploadSlot& slot, TextureHandle handle, uint32_t base_level) {
+  const auto& source = textures[handle].source;
+  slot.image = create_image(textures[handle], base_level);
+
+  copy_regions.clear();
+  vk::DeviceSize staging_size = 0;
+  for (uint32_t level = base_level; level < source.levels.size(); ++level) {
+    staging_size = align(staging_size, staging_alignment);
+    auto extent = source.levels[level].extent;
+    copy_regions.push_back({
+      .bufferOffset = staging_size,
+      .bufferRowLength = 0,
+      .bufferImageHeight = 0,
+      .imageSubresource = {
+        .aspectMask = vk::ImageAspectFlagBits::eColor,
+        .mipLevel = level - base_level,
+        .baseArrayLayer = 0,
+        .layerCount = 1
+      },
+      .imageOffset = { 0, 0, 0 },
+      .imageExtent = { extent.width, extent.height, 1 }
+    });
+    staging_size += source.levels[level].size;
+  }
+
+  std::tie(slot.staging_buffer, slot.staging_memory) =
+    create_staging_buffer(staging_size, vk::BufferUsageFlagBits::eTransferSrc);
+
+  auto* staging = static_cast<std::byte*>(slot.staging_memory.map(0, staging_size));
+  for (size_t i = 0; i < copy_regions.size(); ++i) {
+    const auto& level = source.levels[base_level + i];
+    std::memcpy(staging + copy_regions[i].bufferOffset, source.data.data() + level.offset, level.size);
+  }
+  slot.staging_memory.unmap();
+
+  auto& command_buffer = slot.command_buffer;
+  command_buffer.reset();
+  command_buffer.begin({ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+
+  vk::ImageSubresourceRange range {
+    .aspectMask = vk::ImageAspectFlagBits::eColor,
+    .baseMipLevel = 0,
+    .levelCount = static_cast<uint32_t>(copy_regions.size()),
+    .baseArrayLayer = 0,
+    .layerCount = 1
+  };
+
+  vk::ImageMemoryBarrier2 to_transfer {
+    .srcStageMask = vk::PipelineStageFlagBits2::eNone,
+    .srcAccessMask = vk::AccessFlagBits2::eNone,
+    .dstStageMask = vk::PipelineStageFlagBits2::eCopy,
+    .dstAccessMask = vk::AccessFlagBits2::eTransferWrite,
+    .oldLayout = vk::ImageLayout::eUndefined,
+    .newLayout = vk::ImageLayout::eTransferDstOptimal,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .image = *slot.image.image,
+    .subresourceRange = range
+  };
+  command_buffer.pipelineBarrier2({ .imageMemoryBarrierCount = 1, .pImageMemoryBarriers = &to_transfer });
+
+  command_buffer.copyBufferToImage(
+    *slot.staging_buffer, *slot.image.image, vk::ImageLayout::eTransferDstOptimal, copy_regions
+  );
+
+  // The transfer queue may not support shader stages, the graphics queue only samples the image
+  // after the fence has been observed
+  vk::ImageMemoryBarrier2 to_shader_read {
+    .srcStageMask = vk::PipelineStageFlagBits2::eCopy,
+    .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eNone,
+    .dstAccessMask = vk::AccessFlagBits2::eNone,
+    .oldLayout = vk::ImageLayout::eTransferDstOptimal,
+    .newLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .image = *slot.image.image,
+    .subresourceRange = range
+  };
+  command_buffer.pipelineBarrier2({ .imageMemoryBarrierCount = 1, .pImageMemoryBarriers = &to_shader_read });
+  command_buffer.end();
+
+  device.resetFences(*slot.fence);
+  vk::CommandBuffer command_buffers[] = { *command_buffer };
+  vk::SubmitInfo submit_info {
+    .commandBufferCount = 1,
+    .pCommandBuffers = command_buffers
+  };
+  transfer_queue.submit(submit_info, *slot.fence);
+
+  slot.busy = true;
+  slot.texture = handle;
+  slot.level = base_level;
+}
+
+auto TextureStreamer::create_staging_buffer(vk::DeviceSize size, vk::BufferUsageFlags usage)
+    -> std::pair<vk::raii::Buffer, DeviceAllocation> {
+  vk::BufferCreateInfo create_info {
+    .size = size,
+    .usage = usage,
+    .sharingMode = vk::SharingMode::eExclusive
+  };
+  vk::raii::Buffer buffer { device, create_info };
+
+  auto requirements = buffer.getMemoryRequirements();
+  uint32_t memory_type = memory_tracker.find_memory_type(
+    requirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
+  );
+  auto memory = memory_tracker.allocate(requirements.size, memory_type, MemoryCategory::eStaging);
+  buffer.bindMemory(*memory, 0);
+  return std::make_pair(std::move(buffer), std::move(memory));
+}
+
+void TextureStreamer::generate_mip_levels(TextureSource& source) {
+  using enum vk::FormatFeatureFlagBits;
+  auto features = physical_device.getFormatProperties(source.format).optimalTilingFeatures;
+  if (!(features & eBlitSrc) || !(features & eBlitDst) || !(features & eSampledImageFilterLinear)) {
+    return;
+  }
+
+  auto info = *get_format_info(source.format);
+  auto extent = source.levels.front().extent;
+  uint32_t level_count = get_full_level_count(extent);
+
+  std::vector<TextureSource::Level> levels;
+  size_t total_size = 0;
+  for (uint32_t level = 0; level < level_count; ++level) {
+    vk::Extent2D level_extent { std::max(extent.width >> level, 1u), std::max(extent.height >> level, 1u) };
+    total_size = align(total_size, staging_alignment);
+    levels.push_back({ .extent = level_extent, .offset = total_size, .size = get_level_size(info, level_extent) });
+    total_size += levels.back().size;
+  }
+
+  vk::ImageCreateInfo create_info {
+    .imageType = vk::ImageType::e2D,
+    .format = source.format,
+    .extent = { extent.width, extent.height, 1 },
+    .mipLevels = level_count,
+    .arrayLayers = 1,
+    .samples = vk::SampleCountFlagBits::e1,
+    .tiling = vk::ImageTiling::eOptimal,
+    .usage = vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst,
+    .sharingMode = vk::SharingMode::eExclusive,
+    .initialLayout = vk::ImageLayout::eUndefined
+  };
+  vk::raii::Image image { device, create_info };
+  auto requirements = image.getMemoryRequirements();
+  uint32_t memory_type = memory_tracker.find_memory_type(
+    requirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal
+  );
+  auto memory = memory_tracker.allocate(requirements.size, memory_type, MemoryCategory::eTexture);
+  image.bindMemory(*memory, 0);
+
+  const auto& base = source.levels.front();
+  auto [upload_buffer, upload_memory] = create_staging_buffer(base.size, vk::BufferUsageFlagBits::eTransferSrc);
+  std::memcpy(upload_memory.map(0, base.size), source.data.data() + base.offset, base.size);
+  upload_memory.unmap();
+
+  auto [readback_buffer, readback_memory] = create_staging_buffer(total_size, vk::BufferUsageFlagBits::eTransferDst);
+
+  auto& command_buffer = graphics_command_buffer;
+  command_buffer.reset();
+  command_buffer.begin({ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+
+  auto level_barrier = [&image] (uint32_t level, uint32_t count, vk::ImageLayout old_layout, vk::ImageLayout new_layout) {
+    bool from_write = (old_layout == vk::ImageLayout::eTransferDstOptimal);
+    return vk::ImageMemoryBarrier2 {
+      .srcStageMask = (from_write ? vk::PipelineStageFlagBits2::eCopy | vk::PipelineStageFlagBits2::eBlit
+                                  : vk::PipelineStageFlagBits2::eNone),
+      .srcAccessMask = (from_write ? vk::AccessFlagBits2::eTransferWrite : vk::AccessFlagBits2::eNone),
+      .dstStageMask = vk::PipelineStageFlagBits2::eCopy | vk::PipelineStageFlagBits2::eBlit,
+      .dstAccessMask = (from_write ? vk::AccessFlagBits2::eTransferRead : vk::AccessFlagBits2::eTransferWrite),
+      .oldLayout = old_layout,
+      .newLayout = new_layout,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .image = *image,
+      .subresourceRange = {
+        .aspectMask = vk::ImageAspectFlagBits::eColor,
+        .baseMipLevel = level,
+        .levelCount = count,
+        .baseArrayLayer = 0,
+        .layerCount = 1
+      }
+    };
+  };
+
+  auto barrier = level_barrier(0, level_count, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal);
+  command_buffer.pipelineBarrier2({ .imageMemoryBarrierCount = 1, .pImageMemoryBarriers = &barrier });
+
+  vk::BufferImageCopy base_region {
+    .bufferOffset = 0,
+    .bufferRowLength = 0,
+    .bufferImageHeight = 0,
+    .imageSubresource = { .aspectMask = vk::ImageAspectFlagBits::eColor, .mipLevel = 0, .baseArrayLayer = 0, .layerCount = 1 },
+    .imageOffset = { 0, 0, 0 },
+    .imageExtent = { extent.width, extent.height, 1 }
+  };
+  command_buffer.copyBufferToImage(*upload_buffer, *image, vk::ImageLayout::eTransferDstOptimal, base_region);
+
+  // Each level is filtered from the one above it, which has just become a blit source
+  for (uint32_t level = 1; level < level_count; ++level) {
+    barrier = level_barrier(level - 1, 1, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eTransferSrcOptimal);
+    command_buffer.pipelineBarrier2({ .imageMemoryBarrierCount = 1, .pImageMemoryBarriers = &barrier });
+
+    auto src = levels[level - 1].extent, dst = levels[level].extent;
+    vk::ImageBlit blit {
+      .srcSubresource = { .aspectMask = vk::ImageAspectFlagBits::eColor, .mipLevel = level - 1, .baseArrayLayer = 0, .layerCount = 1 },
+      .srcOffsets = std::array { vk::Offset3D { 0, 0, 0 }, vk::Offset3D { static_cast<int32_t>(src.width), static_cast<int32_t>(src.height), 1 } },
+      .dstSubresource = { .aspectMask = vk::ImageAspectFlagBits::eColor, .mipLevel = level, .baseArrayLayer = 0, .layerCount = 1 },
+      .dstOffsets = std::array { vk::Offset3D { 0, 0, 0 }, vk::Offset3D { static_cast<int32_t>(dst.width), static_cast<int32_t>(dst.height), 1 } }
+    };
+    command_buffer.blitImage(
+      *image, vk::ImageLayout::eTransferSrcOptimal, *image, vk::ImageLayout::eTransferDstOptimal, blit, vk::Filter::eLinear
+    );
+  }
+
+  barrier = level_barrier(level_count - 1, 1, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eTransferSrcOptimal);
+  command_buffer.pipelineBarrier2({ .imageMemoryBarrierCount = 1, .pImageMemoryBarriers = &barrier });
+
+  copy_regions.clear();
+  for (uint32_t level = 0; level < level_count; ++level) {
+    copy_regions.push_back({
+      .bufferOffset = levels[level].offset,
+      .bufferRowLength = 0,
+      .bufferImageHeight = 0,
+      .imageSubresource = { .aspectMask = vk::ImageAspectFlagBits::eColor, .mipLevel = level, .baseArrayLayer = 0, .layerCount = 1 },
+      .imageOffset = { 0, 0, 0 },
+      .imageExtent = { levels[level].extent.width, levels[level].extent.height, 1 }
+    });
+  }
+  command_buffer.copyImageToBuffer(*image, vk::ImageLayout::eTransferSrcOptimal, *readback_buffer, copy_regions);
+
+  vk::BufferMemoryBarrier2 readback_barrier {
+    .srcStageMask = vk::PipelineStageFlagBits2::eCopy,
+    .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+    .dstStageMask = vk::PipelineStageFlagBits2::eHost,
+    .dstAccessMask = vk::AccessFlagBits2::eHostRead,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .buffer = *readback_buffer,
+    .offset = 0,
+    .size = VK_WHOLE_SIZE
+  };
+  command_buffer.pipelineBarrier2({ .bufferMemoryBarrierCount = 1, .pBufferMemoryBarriers = &readback_barrier });
+  command_buffer.end();
+
+  vk::CommandBuffer command_buffers[] = { *command_buffer };
+  vk::SubmitInfo submit_info {
+    .commandBufferCount = 1,
+    .pCommandBuffers = command_buffers
+  };
+  graphics_queue.submit(submit_info, *graphics_fence);
+  (void)device.waitForFences(*graphics_fence, true, UINT64_MAX);
+  device.resetFences(*graphics_fence);
+
+  // The streamer uploads from the CPU copy, so it takes the generated levels back
+  source.data.resize(total_size);
+  std::memcpy(source.data.data(), readback_memory.map(0, total_size), total_size);
+  readback_memory.unmap();
+  source.levels = std::move(levels);
+}
\ No newline at end of file
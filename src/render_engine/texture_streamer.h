@@ -0,0 +1,123 @@
+#pragma once
+#include <cstdint>
+#include <utility>
+#include <vector>
+#define VULKAN_HPP_NO_CONSTRUCTORS
+#include <vulkan/vulkan.hpp>
+#include <vulkan/vulkan_raii.hpp>
+#include "memory_tracker.h"
+#include "texture_source.h"
+
+// Keeps the coarse mip tail of every texture resident and streams finer levels in on the transfer
+// queue as they are requested. A texture is bound either to its tail image or to a streamed image
+// holding every level from the finest resident one down, so streaming in and evicting only change
+// which image is bound and neither waits for the GPU. Uncompressed textures without a full mip
+// chain get the missing levels generated on the GPU when they are added.
+class TextureStreamer {
+public:
+  using TextureHandle = uint32_t;
+  static constexpr uint32_t not_requested = UINT32_MAX;
+
+  struct Config {
+    vk::DeviceSize budget;
+    vk::DeviceSize upload_limit;
+    uint32_t tail_size;
+    uint32_t max_uploads;
+    uint32_t frames_in_flight;
+  };
+
+  // Images are shared concurrently between both queue families, streaming uploads go to the transfer
+  // queue and mip generation to the graphics queue
+  TextureStreamer(
+    const vk::raii::PhysicalDevice&, const vk::raii::Device&, MemoryTracker&,
+    const vk::raii::Queue& graphics_queue, uint32_t graphics_family,
+    const vk::raii::Queue& transfer_queue, uint32_t transfer_family, const Config&);
+
+  // Generates missing mip levels, uploads the mip tail and waits for both, so the texture can be
+  // sampled right away
+  auto add(TextureSource) -> TextureHandle;
+
+  // Finest level the texture is needed at this frame
+  void request(TextureHandle, uint32_t level);
+
+  // Call once per frame after the oldest frame in flight has finished
+  void update();
+
+  auto get_image_view(TextureHandle) const -> vk::ImageView;
+  auto get_sampler() const -> vk::Sampler { return *sampler; }
+  auto get_level_count(TextureHandle handle) const -> uint32_t;
+  auto get_width(TextureHandle handle) const -> uint32_t;
+  auto get_resident_level(TextureHandle handle) const -> uint32_t { return textures[handle].resident_level; }
+  auto get_streamed_bytes() const -> vk::DeviceSize { return resident_bytes + retiring_bytes; }
+  auto size() const -> uint32_t { return static_cast<uint32_t>(textures.size()); }
+
+  // Changes whenever the image bound to any texture changes
+  auto get_version() const -> uint64_t { return version; }
+
+private:
+  struct GpuImage {
+    DeviceAllocation memory;
+    vk::raii::Image image { nullptr };
+    vk::raii::ImageView view { nullptr };
+  };
+
+  struct Texture {
+    TextureSource source;
+    uint32_t tail_level, resident_level, requested_level;
+    uint64_t last_requested;
+    bool uploading;
+    GpuImage tail, streamed;
+  };
+
+  struct UploadSlot {
+    vk::raii::CommandBuffer command_buffer;
+    vk::raii::Fence fence;
+    bool busy;
+    TextureHandle texture;
+    uint32_t level;
+    GpuImage image;
+    vk::raii::Buffer staging_buffer { nullptr };
+    DeviceAllocation staging_memory;
+  };
+
+  struct RetiredImage {
+    GpuImage image;
+    uint64_t frame;
+  };
+
+  auto create_image(const Texture&, uint32_t base_level) -> GpuImage;
+  auto create_staging_buffer(vk::DeviceSize, vk::BufferUsageFlags) -> std::pair<vk::raii::Buffer, DeviceAllocation>;
+  void generate_mip_levels(TextureSource&);
+  void start_upload(UploadSlot&, TextureHandle, uint32_t base_level);
+  void finish_uploads();
+  void start_uploads();
+  bool make_room(vk::DeviceSize, TextureHandle requester);
+  void evict(TextureHandle);
+  void retire(GpuImage&&);
+  auto get_image_size(const Texture&, uint32_t base_level) const -> vk::DeviceSize;
+
+  const vk::raii::PhysicalDevice& physical_device;
+  const vk::raii::Device& device;
+  MemoryTracker& memory_tracker;
+  const vk::raii::Queue& graphics_queue;
+  const vk::raii::Queue& transfer_queue;
+  std::vector<uint32_t> queue_families;
+  Config config;
+
+  vk::raii::CommandPool command_pool { nullptr };
+  vk::raii::CommandPool graphics_command_pool { nullptr };
+  vk::raii::CommandBuffer graphics_command_buffer { nullptr };
+  vk::raii::Fence graphics_fence { nullptr };
+  vk::raii::Sampler sampler { nullptr };
+
+  std::vector<Texture> textures;
+  std::vector<UploadSlot> upload_slots;
+  std::vector<RetiredImage> retired_images;
+  std::vector<TextureHandle> candidates;
+  std::vector<vk::BufferImageCopy> copy_regions;
+
+  // Retired images still count against the budget until they are destroyed
+  vk::DeviceSize resident_bytes, retiring_bytes;
+  uint64_t frame;
+  uint64_t version;
+};
\ No newline at end of file
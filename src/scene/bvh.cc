@@ -0,0 +1,411 @@
+#include "bvh.h"
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+  #include <emmintrin.h>
+  #define BVH_SSE
+#endif
+
+namespace {
+
+constexpr float empty_bound = 1e30f;
+
+const Aabb empty_bounds {
+  .min = glm::vec3(empty_bound),
+  .max = glm::vec3(-empty_bound)
+};
+
+auto merge(const Aabb& a, const Aabb& b) -> Aabb {
+  return { glm::min(a.min, b.min), glm::max(a.max, b.max) };
+}
+
+auto surface_area(const Aabb& bounds) -> float {
+  auto extent = glm::max(bounds.max - bounds.min, glm::vec3(0.0f));
+  return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+// Per box, whether it is outside any plane and which planes it still crosses
+struct LaneTest {
+  uint32_t outside;
+  std::array<uint8_t, 4> crossed;
+};
+
+}
+
+#if defined(BVH_SSE)
+
+// The corner furthest along a plane's normal decides whether a box is outside, the nearest corner
+// whether it is fully inside. Which corners those are only depends on the signs of the normal.
+static auto test_lanes(const std::array<float, 4>* bounds, const Frustum& frustum, uint8_t plane_mask) -> LaneTest {
+  __m128 lower[3] = { _mm_load_ps(bounds[0].data()), _mm_load_ps(bounds[1].data()), _mm_load_ps(bounds[2].data()) };
+  __m128 upper[3] = { _mm_load_ps(bounds[3].data()), _mm_load_ps(bounds[4].data()), _mm_load_ps(bounds[5].data()) };
+  __m128 zero = _mm_setzero_ps();
+
+  LaneTest result { 0, { 0, 0, 0, 0 } };
+  for (uint32_t p = 0; p < 6; ++p) {
+    if ((plane_mask & (1u << p)) == 0) {
+      continue;
+    }
+
+    const auto& plane = frustum.planes[p];
+    __m128 far = _mm_set1_ps(plane.w), near = far;
+    for (int axis = 0; axis < 3; ++axis) {
+      __m128 normal = _mm_set1_ps(plane[axis]);
+      bool positive = (plane[axis] >= 0.0f);
+      far = _mm_add_ps(far, _mm_mul_ps(normal, positive ? upper[axis] : lower[axis]));
+      near = _mm_add_ps(near, _mm_mul_ps(normal, positive ? lower[axis] : upper[axis]));
+    }
+
+    result.outside |= static_cast<uint32_t>(_mm_movemask_ps(_mm_cmplt_ps(far, zero)));
+    auto crossing = static_cast<uint32_t>(_mm_movemask_ps(_mm_cmplt_ps(near, zero)));
+    for (uint32_t lane = 0; lane < 4; ++lane) {
+      result.crossed[lane] |= static_cast<uint8_t>(((crossing >> lane) & 1u) << p);
+    }
+  }
+  return result;
+}
+
+#else
+
+static auto test_lanes(const std::array<float, 4>* bounds, const Frustum& frustum, uint8_t plane_mask) -> LaneTest {
+  LaneTest result { 0, { 0, 0, 0, 0 } };
+  for (uint32_t p = 0; p < 6; ++p) {
+    if ((plane_mask & (1u << p)) == 0) {
+      continue;
+    }
+
+    const auto& plane = frustum.planes[p];
+    glm::vec3 normal { plane };
+    auto positive = glm::greaterThanEqual(normal, glm::vec3(0.0f));
+    for (uint32_t lane = 0; lane < 4; ++lane) {
+      glm::vec3 lower { bounds[0][lane], bounds[1][lane], bounds[2][lane] };
+      glm::vec3 upper { bounds[3][lane], bounds[4][lane], bounds[5][lane] };
+      float far = glm::dot(normal, glm::mix(lower, upper, positive)) + plane.w;
+      float near = glm::dot(normal, glm::mix(upper, lower, positive)) + plane.w;
+      result.outside |= (far < 0.0f ? 1u : 0u) << lane;
+      result.crossed[lane] |= static_cast<uint8_t>((near < 0.0f ? 1u : 0u) << p);
+    }
+  }
+  return result;
+}
+
+#endif
+
+auto transform_bounds(const Aabb& bounds, const glm::mat4& matrix) -> Aabb {
+  glm::vec3 translation { matrix[3] };
+  Aabb result { translation, translation };
+  for (int column = 0; column < 3; ++column) {
+    glm::vec3 a = glm::vec3(matrix[column]) * bounds.min[column];
+    glm::vec3 b = glm::vec3(matrix[column]) * bounds.max[column];
+    result.min += glm::min(a, b);
+    result.max += glm::max(a, b);
+  }
+  return result;
+}
+
+auto Frustum::from_matrix(const glm::mat4& view_projection) -> Frustum {
+  auto row = [&view_projection] (int i) {
+    return glm::vec4(view_projection[0][i], view_projection[1][i], view_projection[2][i], view_projection[3][i]);
+  };
+
+  // The near plane is the one of a -w..w depth range, for a 0..w range it lies behind the real one,
+  // which only keeps a little more than needed
+  return {{
+    row(3) + row(0), row(3) - row(0),
+    row(3) + row(1), row(3) - row(1),
+    row(3) + row(2), row(3) - row(2)
+  }};
+}
+
+void Bvh::build(std::span<const Aabb> bounds) {
+  order.resize(bounds.size());
+  object_nodes.resize(bounds.size());
+  object_slots.resize(bounds.size());
+  packets.clear();
+  nodes.clear();
+  tasks.clear();
+  for (uint32_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  if (bounds.empty()) {
+    dirty.clear();
+    return;
+  }
+
+  std::vector<glm::vec3> centroids(bounds.size());
+  for (size_t i = 0; i < bounds.size(); ++i) {
+    centroids[i] = 0.5f * (bounds[i].min + bounds[i].max);
+  }
+
+  std::vector<BuildNode> build_nodes;
+  build_nodes.reserve(2 * bounds.size() / max_leaf_size + 1);
+  uint32_t root = build_range(build_nodes, bounds, centroids, 0, static_cast<uint32_t>(bounds.size()));
+
+  nodes.reserve(build_nodes.size() / 3 + 1);
+  packets.reserve(build_nodes.size() / 2 + 1);
+  collapse(build_nodes, bounds, root, no_child);
+  dirty.assign(nodes.size(), 0);
+  create_tasks();
+}
+
+auto Bvh::build_range(
+  std::vector<BuildNode>& build_nodes, std::span<const Aabb> object_bounds, std::span<const glm::vec3> centroids,
+  uint32_t first, uint32_t count) -> uint32_t {
+  Aabb bounds = empty_bounds, centroid_bounds = empty_bounds;
+  for (uint32_t i = first; i < first + count; ++i) {
+    bounds = merge(bounds, object_bounds[order[i]]);
+    centroid_bounds = merge(centroid_bounds, { centroids[order[i]], centroids[order[i]] });
+  }
+
+  auto index = static_cast<uint32_t>(build_nodes.size());
+  build_nodes.push_back({ bounds, no_child, no_child, first, count });
+  if (count <= max_leaf_size) {
+    return index;
+  }
+
+  // Bins along the axis the centroids spread furthest on, then the cheapest split between two bins
+  auto extent = centroid_bounds.max - centroid_bounds.min;
+  int axis = (extent.x > extent.y && extent.x > extent.z) ? 0 : (extent.y > extent.z ? 1 : 2);
+  uint32_t split = first + count / 2;
+  if (extent[axis] > 0.0f) {
+    struct Bin {
+      Aabb bounds = empty_bounds;
+      uint32_t count = 0;
+    };
+    std::array<Bin, bin_count> bins;
+    float scale = bin_count / extent[axis];
+    auto bin_of = [&] (uint32_t object) {
+      auto bin = static_cast<uint32_t>((centroids[object][axis] - centroid_bounds.min[axis]) * scale);
+      return std::min(bin, bin_count - 1);
+    };
+    for (uint32_t i = first; i < first + count; ++i) {
+      auto& bin = bins[bin_of(order[i])];
+      bin.bounds = merge(bin.bounds, object_bounds[order[i]]);
+      ++bin.count;
+    }
+
+    // Right to left sweep for the cost of every right side, then left to right for the left sides
+    std::array<float, bin_count> right_costs;
+    Aabb right_bounds = empty_bounds;
+    uint32_t right_count = 0;
+    for (uint32_t i = bin_count - 1; i > 0; --i) {
+      right_bounds = merge(right_bounds, bins[i].bounds);
+      right_count += bins[i].count;
+      right_costs[i] = surface_area(right_bounds) * static_cast<float>(right_count);
+    }
+
+    float best_cost = std::numeric_limits<float>::max();
+    uint32_t best_bin = 0;
+    Aabb left_bounds = empty_bounds;
+    uint32_t left_count = 0;
+    for (uint32_t i = 0; i + 1 < bin_count; ++i) {
+      left_bounds = merge(left_bounds, bins[i].bounds);
+      left_count += bins[i].count;
+      float cost = surface_area(left_bounds) * static_cast<float>(left_count) + right_costs[i + 1];
+      if (left_count > 0 && left_count < count && cost < best_cost) {
+        best_cost = cost;
+        best_bin = i;
+      }
+    }
+
+    if (best_cost < std::numeric_limits<float>::max()) {
+      auto middle = std::partition(order.begin() + first, order.begin() + first + count, [&] (uint32_t object) {
+        return bin_of(object) <= best_bin;
+      });
+      split = static_cast<uint32_t>(middle - order.begin());
+    }
+  }
+
+  // Coincident centroids cannot be binned apart, halving the range still bounds the depth
+  uint32_t left = build_range(build_nodes, object_bounds, centroids, first, split - first);
+  uint32_t right = build_range(build_nodes, object_bounds, centroids, split, first + count - split);
+  build_nodes[index].left = left;
+  build_nodes[index].right = right;
+  return index;
+}
+
+auto Bvh::collapse(
+  const std::vector<BuildNode>& build_nodes, std::span<const Aabb> object_bounds, uint32_t build_node, uint32_t parent)
+  -> uint32_t {
+  // Opens the largest internal lane until four lanes are filled, a leaf root fills a single lane
+  std::array<uint32_t, 4> lanes { build_node };
+  uint32_t lane_count = 1;
+  while (lane_count < 4) {
+    uint32_t largest = no_child;
+    float largest_area = -1.0f;
+    for (uint32_t i = 0; i < lane_count; ++i) {
+      const auto& candidate = build_nodes[lanes[i]];
+      float area = surface_area(candidate.bounds);
+      if (candidate.left != no_child && area > largest_area) {
+        largest = i;
+        largest_area = area;
+      }
+    }
+    if (largest == no_child) {
+      break;
+    }
+    const auto& opened = build_nodes[lanes[largest]];
+    lanes[largest] = opened.left;
+    lanes[lane_count++] = opened.right;
+  }
+
+  auto index = static_cast<uint32_t>(nodes.size());
+  nodes.emplace_back();
+  nodes[index].parent = parent;
+  for (uint32_t lane = 0; lane < 4; ++lane) {
+    if (lane >= lane_count) {
+      set_lane(nodes[index].bounds, lane, empty_bounds);
+      nodes[index].child[lane] = no_child;
+      nodes[index].first[lane] = 0;
+      nodes[index].count[lane] = 0;
+      continue;
+    }
+
+    const auto& source = build_nodes[lanes[lane]];
+    uint32_t child;
+    if (source.left == no_child) {
+      auto packet = static_cast<uint32_t>(packets.size());
+      auto& leaf = packets.emplace_back();
+      for (uint32_t slot = 0; slot < 4; ++slot) {
+        uint32_t object = (slot < source.count ? order[source.first + slot] : no_child);
+        set_lane(leaf, slot, (object == no_child ? empty_bounds : object_bounds[object]));
+        if (object != no_child) {
+          object_nodes[object] = index;
+          object_slots[object] = packet * 4 + slot;
+        }
+      }
+      child = leaf_flag | packet;
+    } else {
+      child = collapse(build_nodes, object_bounds, lanes[lane], index);
+    }
+
+    // Collapsing the children may have moved the node
+    auto& node = nodes[index];
+    set_lane(node.bounds, lane, source.bounds);
+    node.child[lane] = child;
+    node.first[lane] = source.first;
+    node.count[lane] = source.count;
+  }
+  return index;
+}
+
+void Bvh::create_tasks() {
+  // Breadth first until there are enough subtrees for every thread to get several
+  for (uint32_t lane = 0; lane < 4; ++lane) {
+    if (nodes[0].count[lane] > 0) {
+      tasks.push_back({ 0, lane });
+    }
+  }
+  for (size_t i = 0; i < tasks.size() && tasks.size() < min_task_count; ) {
+    uint32_t child = nodes[tasks[i].node].child[tasks[i].lane];
+    if (child & leaf_flag) {
+      ++i;
+      continue;
+    }
+
+    tasks.erase(tasks.begin() + static_cast<std::ptrdiff_t>(i));
+    for (uint32_t lane = 0; lane < 4; ++lane) {
+      if (nodes[child].count[lane] > 0) {
+        tasks.push_back({ child, lane });
+      }
+    }
+  }
+}
+
+auto Bvh::get_lane(const Bounds4& bounds, uint32_t lane) -> Aabb {
+  return {
+    { bounds.min_x[lane], bounds.min_y[lane], bounds.min_z[lane] },
+    { bounds.max_x[lane], bounds.max_y[lane], bounds.max_z[lane] }
+  };
+}
+
+void Bvh::set_lane(Bounds4& bounds, uint32_t lane, const Aabb& aabb) {
+  bounds.min_x[lane] = aabb.min.x;
+  bounds.min_y[lane] = aabb.min.y;
+  bounds.min_z[lane] = aabb.min.z;
+  bounds.max_x[lane] = aabb.max.x;
+  bounds.max_y[lane] = aabb.max.y;
+  bounds.max_z[lane] = aabb.max.z;
+}
+
+auto Bvh::merge_lanes(const Bounds4& bounds, uint32_t count) -> Aabb {
+  Aabb merged = empty_bounds;
+  for (uint32_t lane = 0; lane < count; ++lane) {
+    merged = merge(merged, get_lane(bounds, lane));
+  }
+  return merged;
+}
+
+void Bvh::set_bounds(uint32_t object, const Aabb& bounds) {
+  set_lane(packets[object_slots[object] / 4], object_slots[object] % 4, bounds);
+  for (uint32_t node = object_nodes[object]; node != no_child && !dirty[node]; node = nodes[node].parent) {
+    dirty[node] = 1;
+  }
+}
+
+void Bvh::refit() {
+  for (size_t i = nodes.size(); i-- > 0; ) {
+    if (!dirty[i]) {
+      continue;
+    }
+
+    // Unused lanes are inverted, merging all four of a child leaves them out
+    auto& node = nodes[i];
+    for (uint32_t lane = 0; lane < 4; ++lane) {
+      uint32_t child = node.child[lane];
+      if (node.count[lane] == 0) {
+        continue;
+      }
+      const auto& child_bounds = (child & leaf_flag) ? packets[child & ~leaf_flag] : nodes[child].bounds;
+      set_lane(node.bounds, lane, merge_lanes(child_bounds, 4));
+    }
+    dirty[i] = 0;
+  }
+}
+
+void Bvh::cull(const Frustum& frustum, std::vector<uint32_t>& visible) const {
+  if (!nodes.empty()) {
+    cull_node(frustum, 0, all_planes, visible);
+  }
+}
+
+void Bvh::cull_task(const Frustum& frustum, uint32_t task, std::vector<uint32_t>& visible) const {
+  const auto& [node, lane] = tasks[task];
+  auto test = test_lanes(&nodes[node].bounds.min_x, frustum, all_planes);
+  if ((test.outside & (1u << lane)) == 0) {
+    cull_lane(frustum, node, lane, test.crossed[lane], visible);
+  }
+}
+
+void Bvh::cull_node(const Frustum& frustum, uint32_t node_index, uint8_t plane_mask, std::vector<uint32_t>& visible) const {
+  const auto& node = nodes[node_index];
+  auto test = test_lanes(&node.bounds.min_x, frustum, plane_mask);
+  for (uint32_t lane = 0; lane < 4; ++lane) {
+    if (node.count[lane] > 0 && (test.outside & (1u << lane)) == 0) {
+      cull_lane(frustum, node_index, lane, test.crossed[lane], visible);
+    }
+  }
+}
+
+// Only the planes a lane crosses are tested further down, a lane inside all of them is taken whole
+void Bvh::cull_lane(
+  const Frustum& frustum, uint32_t node_index, uint32_t lane, uint8_t plane_mask, std::vector<uint32_t>& visible) const {
+  const auto& node = nodes[node_index];
+  uint32_t child = node.child[lane];
+  if (plane_mask == 0) {
+    append_range(node.first[lane], node.count[lane], visible);
+  } else if ((child & leaf_flag) == 0) {
+    cull_node(frustum, child, plane_mask, visible);
+  } else {
+    auto test = test_lanes(&packets[child & ~leaf_flag].min_x, frustum, plane_mask);
+    for (uint32_t slot = 0; slot < node.count[lane]; ++slot) {
+      if ((test.outside & (1u << slot)) == 0) {
+        visible.push_back(order[node.first[lane] + slot]);
+      }
+    }
+  }
+}
+
+void Bvh::append_range(uint32_t first, uint32_t count, std::vector<uint32_t>& visible) const {
+  visible.insert(visible.end(), order.begin() + first, order.begin() + first + count);
+}
\ No newline at end of file
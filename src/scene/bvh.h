@@ -0,0 +1,100 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+#include <glm/glm.hpp>
+
+struct Aabb {
+  glm::vec3 min, max;
+};
+
+// Bounds of the box after transforming it, found from the matrix without transforming eight corners
+auto transform_bounds(const Aabb&, const glm::mat4&) -> Aabb;
+
+// The planes face inwards, a point is inside when dot(plane.xyz, point) + plane.w >= 0 for all six
+struct Frustum {
+  std::array<glm::vec4, 6> planes;
+
+  static auto from_matrix(const glm::mat4& view_projection) -> Frustum;
+};
+
+// Bounding volume hierarchy over the bounds of objects, which keep the index they were built with.
+// A binary tree is built with binned SAH and collapsed into nodes of four children, whose bounds are
+// stored as structure of arrays so that a plane is tested against all four at once. Moving objects
+// are refit in place, which keeps the topology and loosens the tree until the next build.
+class Bvh {
+public:
+  static constexpr uint32_t max_leaf_size = 4;
+
+  void build(std::span<const Aabb> bounds);
+  // The tree only catches up with moved objects on refit
+  void set_bounds(uint32_t object, const Aabb&);
+  // Only visits the nodes above objects moved since the last refit
+  void refit();
+
+  auto size() const -> uint32_t { return static_cast<uint32_t>(order.size()); }
+
+  // Appends every object whose bounds intersect the frustum, in no particular order
+  void cull(const Frustum&, std::vector<uint32_t>& visible) const;
+  // Disjoint subtrees that together hold every object, culling each separately splits the work across threads
+  auto get_task_count() const -> uint32_t { return static_cast<uint32_t>(tasks.size()); }
+  void cull_task(const Frustum&, uint32_t task, std::vector<uint32_t>& visible) const;
+
+private:
+  static constexpr uint32_t no_child = std::numeric_limits<uint32_t>::max();
+  static constexpr uint32_t leaf_flag = 1u << 31;
+  static constexpr uint32_t min_task_count = 64;
+  static constexpr uint32_t bin_count = 16;
+  static constexpr uint8_t all_planes = 0x3f;
+
+  // Four boxes as structure of arrays, unused boxes are inverted
+  struct alignas(16) Bounds4 {
+    std::array<float, 4> min_x, min_y, min_z, max_x, max_y, max_z;
+  };
+
+  struct alignas(64) Node {
+    Bounds4 bounds;
+    // Internal lanes hold a node index, leaf lanes the leaf flag and the index of the packet with the
+    // bounds of their objects. Every lane covers a contiguous range of the object order.
+    std::array<uint32_t, 4> child, first, count;
+    uint32_t parent;
+  };
+
+  struct BuildNode {
+    Aabb bounds;
+    uint32_t left, right;
+    uint32_t first, count;
+  };
+
+  struct Task {
+    uint32_t node, lane;
+  };
+
+  auto build_range(
+    std::vector<BuildNode>&, std::span<const Aabb> bounds, std::span<const glm::vec3> centroids, uint32_t first,
+    uint32_t count) -> uint32_t;
+  auto collapse(const std::vector<BuildNode>&, std::span<const Aabb> bounds, uint32_t build_node, uint32_t parent)
+    -> uint32_t;
+  void create_tasks();
+  static auto get_lane(const Bounds4&, uint32_t lane) -> Aabb;
+  static void set_lane(Bounds4&, uint32_t lane, const Aabb&);
+  static auto merge_lanes(const Bounds4&, uint32_t count) -> Aabb;
+
+  void cull_node(const Frustum&, uint32_t node, uint8_t plane_mask, std::vector<uint32_t>& visible) const;
+  void cull_lane(const Frustum&, uint32_t node, uint32_t lane, uint8_t plane_mask, std::vector<uint32_t>& visible) const;
+  void append_range(uint32_t first, uint32_t count, std::vector<uint32_t>& visible) const;
+
+  // Object indices in leaf order
+  std::vector<uint32_t> order;
+  // The node whose leaf lane holds each object, and its packet and slot as packet * 4 + slot
+  std::vector<uint32_t> object_nodes;
+  std::vector<uint32_t> object_slots;
+  // Bounds of the objects of every leaf lane, tested together once the lane crosses a plane
+  std::vector<Bounds4> packets;
+  // Parents precede their children, refitting back to front visits children first
+  std::vector<Node> nodes;
+  std::vector<uint8_t> dirty;
+  std::vector<Task> tasks;
+};
\ No newline at end of file
@@ -0,0 +1,11 @@
+#pragma once
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// Everything the renderer needs from the simulation for one frame
+struct FrameState {
+  uint64_t tick;
+  double time;
+  glm::quat rotation;
+};
\ No newline at end of file
@@ -0,0 +1,66 @@
+#include "scene_generator.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace {
+
+auto generate_mesh(std::mt19937& rng) -> GeneratedMesh {
+  std::uniform_real_distribution<float> unit { 0.0f, 1.0f };
+  auto point_count = 3 + static_cast<uint32_t>(rng() % 30);
+  // Every other vertex is pulled in by the same amount, 1 gives a regular polygon
+  float inner_radius = 0.5f * (0.4f + 0.6f * unit(rng));
+  glm::vec3 base_color { unit(rng), unit(rng), unit(rng) };
+
+  GeneratedMesh mesh;
+  auto add_vertex = [&] (glm::vec2 position) {
+    glm::vec3 color = glm::clamp(base_color + 0.2f * glm::vec3(unit(rng), unit(rng), unit(rng)) - 0.1f, 0.0f, 1.0f);
+    mesh.vertices.push_back({ .position = position, .color = color, .uv = position + 0.5f });
+  };
+
+  // A fan around the center, counterclockwise like the quad
+  uint32_t rim_count = 2 * point_count;
+  add_vertex(glm::vec2(0.0f));
+  for (uint32_t i = 0; i < rim_count; ++i) {
+    float angle = 6.2831853f * static_cast<float>(i) / static_cast<float>(rim_count);
+    float radius = (i % 2 == 0 ? 0.5f : inner_radius);
+    add_vertex(radius * glm::vec2(std::cos(angle), std::sin(angle)));
+  }
+  for (uint32_t i = 0; i < rim_count; ++i) {
+    mesh.indices.insert(mesh.indices.end(), { 0, 1 + i, 1 + (i + 1) % rim_count });
+  }
+  return mesh;
+}
+
+}
+
+auto generate_scene(const StressSceneConfig& config) -> GeneratedScene {
+  std::mt19937 rng { config.seed };
+  std::uniform_real_distribution<float> unit { 0.0f, 1.0f };
+
+  GeneratedScene scene;
+  scene.meshes.reserve(config.mesh_count);
+  for (uint32_t i = 0; i < config.mesh_count; ++i) {
+    scene.meshes.push_back(generate_mesh(rng));
+  }
+
+  float base_scale = std::min(0.1f, 0.8f / std::sqrt(static_cast<float>(std::max(config.object_count, 1u))));
+  scene.objects.reserve(config.object_count);
+  for (uint32_t i = 0; i < config.object_count; ++i) {
+    // Tilted by at most 30 degrees, so every object still faces the camera above
+    float heading = 6.2831853f * unit(rng);
+    float tilt = 0.5235988f * unit(rng);
+    glm::vec3 tilt_axis { std::cos(heading), std::sin(heading), 0.0f };
+    bool dynamic = unit(rng) < config.dynamic_fraction;
+
+    scene.objects.push_back({
+      .mesh = static_cast<uint32_t>(rng() % std::max(config.mesh_count, 1u)),
+      .material = static_cast<uint32_t>(rng() % std::max(config.material_count, 1u)),
+      .position = { unit(rng) - 0.5f, unit(rng) - 0.5f, 0.02f + 0.3f * unit(rng) },
+      .rotation = glm::angleAxis(tilt, tilt_axis) * glm::angleAxis(heading, glm::vec3(0.0f, 0.0f, 1.0f)),
+      .scale = base_scale * (0.5f + unit(rng)),
+      .spin = (dynamic ? 0.5f + 2.0f * unit(rng) : 0.0f)
+    });
+  }
+  return scene;
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// A procedural workload for scaling benchmarks: object_count objects, each drawing one of mesh_count
+// meshes with one of material_count materials. The same config always generates the same scene.
+struct StressSceneConfig {
+  uint32_t object_count;
+  uint32_t mesh_count;
+  uint32_t material_count;
+  // Share of the objects that spin every frame, the others never change after creation
+  float dynamic_fraction;
+  uint32_t seed;
+};
+
+// Meshes are flat like the renderer's quad, they lie in the xy plane within -0.5 to 0.5
+struct GeneratedMesh {
+  struct Vertex {
+    glm::vec2 position;
+    glm::vec3 color;
+    glm::vec2 uv;
+  };
+
+  std::vector<Vertex> vertices;
+  std::vector<uint32_t> indices;
+};
+
+struct GeneratedObject {
+  uint32_t mesh;
+  uint32_t material;
+  glm::vec3 position;
+  glm::quat rotation;
+  float scale;
+  // Radians per second around the object's z axis, 0 for static objects
+  float spin;
+};
+
+struct GeneratedScene {
+  std::vector<GeneratedMesh> meshes;
+  std::vector<GeneratedObject> objects;
+};
+
+// Meshes are star shaped polygons of 3 to 32 points, objects are spread over the unit square above
+// the xy plane and get smaller as there are more of them, so the covered area stays about the same
+auto generate_scene(const StressSceneConfig&) -> GeneratedScene;
\ No newline at end of file
@@ -0,0 +1,343 @@
+#include "transform_system.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__AVX__)
+  #include <immintrin.h>
+  #define TRANSFORM_SYSTEM_AVX
+#elif defined(__SSE2__) || defined(_M_X64)
+  #include <emmintrin.h>
+  #define TRANSFORM_SYSTEM_SSE
+#endif
+
+namespace {
+
+struct BatchInput {
+  const float *position_x, *position_y, *position_z;
+  const float *rotation_x, *rotation_y, *rotation_z, *rotation_w;
+  const float *scale_x, *scale_y, *scale_z;
+};
+
+#if defined(TRANSFORM_SYSTEM_AVX) || defined(TRANSFORM_SYSTEM_SSE)
+
+// Scatters 16 lane vectors (one per matrix element) of four nodes into four column-major matrices
+inline void store_transposed(__m128 (&elements)[16], float* output) {
+  for (int column = 0; column < 4; ++column) {
+    __m128 r0 = elements[column * 4 + 0];
+    __m128 r1 = elements[column * 4 + 1];
+    __m128 r2 = elements[column * 4 + 2];
+    __m128 r3 = elements[column * 4 + 3];
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    _mm_storeu_ps(output + 0 * 16 + column * 4, r0);
+    _mm_storeu_ps(output + 1 * 16 + column * 4, r1);
+    _mm_storeu_ps(output + 2 * 16 + column * 4, r2);
+    _mm_storeu_ps(output + 3 * 16 + column * 4, r3);
+  }
+}
+
+#endif
+
+#if defined(TRANSFORM_SYSTEM_AVX)
+
+void compose_batch(const BatchInput& in, uint32_t offset, float* output) {
+  __m256 x = _mm256_loadu_ps(in.rotation_x + offset);
+  __m256 y = _mm256_loadu_ps(in.rotation_y + offset);
+  __m256 z = _mm256_loadu_ps(in.rotation_z + offset);
+  __m256 w = _mm256_loadu_ps(in.rotation_w + offset);
+  __m256 sx = _mm256_loadu_ps(in.scale_x + offset);
+  __m256 sy = _mm256_loadu_ps(in.scale_y + offset);
+  __m256 sz = _mm256_loadu_ps(in.scale_z + offset);
+
+  __m256 one = _mm256_set1_ps(1.0f), two = _mm256_set1_ps(2.0f);
+  __m256 xx = _mm256_mul_ps(x, x), yy = _mm256_mul_ps(y, y), zz = _mm256_mul_ps(z, z);
+  __m256 xy = _mm256_mul_ps(x, y), xz = _mm256_mul_ps(x, z), yz = _mm256_mul_ps(y, z);
+  __m256 wx = _mm256_mul_ps(w, x), wy = _mm256_mul_ps(w, y), wz = _mm256_mul_ps(w, z);
+
+  __m256 elements[16] = {
+    _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(yy, zz))), sx),
+    _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xy, wz)), sx),
+    _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xz, wy)), sx),
+    _mm256_setzero_ps(),
+
+    _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), sy),
+    _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, zz))), sy),
+    _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(yz, wx)), sy),
+    _mm256_setzero_ps(),
+
+    _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xz, wy)), sz),
+    _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), sz),
+    _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, yy))), sz),
+    _mm256_setzero_ps(),
+
+    _mm256_loadu_ps(in.position_x + offset),
+    _mm256_loadu_ps(in.position_y + offset),
+    _mm256_loadu_ps(in.position_z + offset),
+    one
+  };
+
+  __m128 low[16], high[16];
+  for (int i = 0; i < 16; ++i) {
+    low[i] = _mm256_castps256_ps128(elements[i]);
+    high[i] = _mm256_extractf128_ps(elements[i], 1);
+  }
+  store_transposed(low, output);
+  store_transposed(high, output + 4 * 16);
+}
+
+#elif defined(TRANSFORM_SYSTEM_SSE)
+
+void compose_half_batch(const BatchInput& in, uint32_t offset, float* output) {
+  __m128 x = _mm_loadu_ps(in.rotation_x + offset);
+  __m128 y = _mm_loadu_ps(in.rotation_y + offset);
+  __m128 z = _mm_loadu_ps(in.rotation_z + offset);
+  __m128 w = _mm_loadu_ps(in.rotation_w + offset);
+  __m128 sx = _mm_loadu_ps(in.scale_x + offset);
+  __m128 sy = _mm_loadu_ps(in.scale_y + offset);
+  __m128 sz = _mm_loadu_ps(in.scale_z + offset);
+
+  __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f);
+  __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+  __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+  __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+  __m128 elements[16] = {
+    _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx),
+    _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx),
+    _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx),
+    _mm_setzero_ps(),
+
+    _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy),
+    _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy),
+    _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy),
+    _mm_setzero_ps(),
+
+    _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz),
+    _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz),
+    _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz),
+    _mm_setzero_ps(),
+
+    _mm_loadu_ps(in.position_x + offset),
+    _mm_loadu_ps(in.position_y + offset),
+    _mm_loadu_ps(in.position_z + offset),
+    one
+  };
+
+  store_transposed(elements, output);
+}
+
+void compose_batch(const BatchInput& in, uint32_t offset, float* output) {
+  compose_half_batch(in, offset, output);
+  compose_half_batch(in, offset + 4, output + 4 * 16);
+}
+
+#else
+
+void compose_batch(const BatchInput& in, uint32_t offset, float* output) {
+  for (uint32_t lane = 0; lane < TransformSystem::batch_size; ++lane, output += 16) {
+    uint32_t i = offset + lane;
+    float x = in.rotation_x[i], y = in.rotation_y[i], z = in.rotation_z[i], w = in.rotation_w[i];
+    float sx = in.scale_x[i], sy = in.scale_y[i], sz = in.scale_z[i];
+
+    output[0] = (1.0f - 2.0f * (y * y + z * z)) * sx;
+    output[1] = 2.0f * (x * y + w * z) * sx;
+    output[2] = 2.0f * (x * z - w * y) * sx;
+    output[3] = 0.0f;
+
+    output[4] = 2.0f * (x * y - w * z) * sy;
+    output[5] = (1.0f - 2.0f * (x * x + z * z)) * sy;
+    output[6] = 2.0f * (y * z + w * x) * sy;
+    output[7] = 0.0f;
+
+    output[8] = 2.0f * (x * z + w * y) * sz;
+    output[9] = 2.0f * (y * z - w * x) * sz;
+    output[10] = (1.0f - 2.0f * (x * x + y * y)) * sz;
+    output[11] = 0.0f;
+
+    output[12] = in.position_x[i];
+    output[13] = in.position_y[i];
+    output[14] = in.position_z[i];
+    output[15] = 1.0f;
+  }
+}
+
+#endif
+
+void multiply(const float* a, const float* b, float* output) {
+#if defined(TRANSFORM_SYSTEM_AVX) || defined(TRANSFORM_SYSTEM_SSE)
+  __m128 a0 = _mm_loadu_ps(a + 0);
+  __m128 a1 = _mm_loadu_ps(a + 4);
+  __m128 a2 = _mm_loadu_ps(a + 8);
+  __m128 a3 = _mm_loadu_ps(a + 12);
+  for (int column = 0; column < 4; ++column) {
+    const float* b_column = b + column * 4;
+    __m128 result = _mm_mul_ps(a0, _mm_set1_ps(b_column[0]));
+    result = _mm_add_ps(result, _mm_mul_ps(a1, _mm_set1_ps(b_column[1])));
+    result = _mm_add_ps(result, _mm_mul_ps(a2, _mm_set1_ps(b_column[2])));
+    result = _mm_add_ps(result, _mm_mul_ps(a3, _mm_set1_ps(b_column[3])));
+    _mm_storeu_ps(output + column * 4, result);
+  }
+#else
+  for (int column = 0; column < 4; ++column) {
+    for (int row = 0; row < 4; ++row) {
+      float sum = 0.0f;
+      for (int k = 0; k < 4; ++k) {
+        sum += a[k * 4 + row] * b[column * 4 + k];
+      }
+      output[column * 4 + row] = sum;
+    }
+  }
+#endif
+}
+
+// Output buffers are mapped write-combined memory that is never read back
+void stream_store(const float* matrix, float* output) {
+#if defined(TRANSFORM_SYSTEM_AVX) || defined(TRANSFORM_SYSTEM_SSE)
+  for (int i = 0; i < 16; i += 4) {
+    _mm_stream_ps(output + i, _mm_loadu_ps(matrix + i));
+  }
+#else
+  std::memcpy(output, matrix, 16 * sizeof(float));
+#endif
+}
+
+}
+
+TransformSystem::TransformSystem(uint32_t _output_count)
+  : output_count { _output_count }, node_count { 0 }, first_dirty { 0 }, first_pending { 0 } {}
+
+void TransformSystem::reserve_batch() {
+  auto capacity = parents.size() + batch_size;
+  position_x.resize(capacity, 0.0f);
+  position_y.resize(capacity, 0.0f);
+  position_z.resize(capacity, 0.0f);
+  rotation_x.resize(capacity, 0.0f);
+  rotation_y.resize(capacity, 0.0f);
+  rotation_z.resize(capacity, 0.0f);
+  rotation_w.resize(capacity, 1.0f);
+  scale_x.resize(capacity, 1.0f);
+  scale_y.resize(capacity, 1.0f);
+  scale_z.resize(capacity, 1.0f);
+  parents.resize(capacity, no_parent);
+  local_dirty.resize(capacity, 0);
+  pending_outputs.resize(capacity, 0);
+  local_matrices.resize(capacity * 16, 0.0f);
+  world_matrices.resize(capacity * 16, 0.0f);
+}
+
+auto TransformSystem::create(NodeHandle parent) -> NodeHandle {
+  if (parent != no_parent && parent >= node_count) {
+    throw std::out_of_range("Parent transform node does not exist");
+  }
+
+  if (node_count == parents.size()) {
+    reserve_batch();
+  }
+
+  NodeHandle node = node_count++;
+  parents[node] = parent;
+  mark_dirty(node);
+  return node;
+}
+
+void TransformSystem::mark_dirty(NodeHandle node) {
+  local_dirty[node] = 1;
+  first_dirty = std::min(first_dirty, node);
+}
+
+void TransformSystem::set_position(NodeHandle node, const glm::vec3& position) {
+  position_x[node] = position.x;
+  position_y[node] = position.y;
+  position_z[node] = position.z;
+  mark_dirty(node);
+}
+
+void TransformSystem::set_rotation(NodeHandle node, const glm::quat& rotation) {
+  rotation_x[node] = rotation.x;
+  rotation_y[node] = rotation.y;
+  rotation_z[node] = rotation.z;
+  rotation_w[node] = rotation.w;
+  mark_dirty(node);
+}
+
+void TransformSystem::set_scale(NodeHandle node, const glm::vec3& scale) {
+  scale_x[node] = scale.x;
+  scale_y[node] = scale.y;
+  scale_z[node] = scale.z;
+  mark_dirty(node);
+}
+
+void TransformSystem::set_output_count(uint32_t count) {
+  output_count = count;
+  std::fill(pending_outputs.begin(), pending_outputs.begin() + node_count, static_cast<uint8_t>(count));
+  first_pending = 0;
+}
+
+auto TransformSystem::get_world_matrix(NodeHandle node) const -> const float* {
+  return world_matrices.data() + static_cast<size_t>(node) * 16;
+}
+
+void TransformSystem::update(float* output) {
+  update_local_matrices(first_dirty_batch(), batch_count());
+  update_world_matrices(output);
+}
+
+void TransformSystem::update_local_matrices(uint32_t first_batch, uint32_t last_batch) {
+  BatchInput input {
+    position_x.data(), position_y.data(), position_z.data(),
+    rotation_x.data(), rotation_y.data(), rotation_z.data(), rotation_w.data(),
+    scale_x.data(), scale_y.data(), scale_z.data()
+  };
+
+  for (uint32_t batch = first_batch; batch < last_batch; ++batch) {
+    uint32_t offset = batch * batch_size;
+
+    uint64_t flags;
+    static_assert(sizeof(flags) == batch_size);
+    std::memcpy(&flags, local_dirty.data() + offset, sizeof(flags));
+    if (flags == 0) {
+      continue;
+    }
+
+    compose_batch(input, offset, local_matrices.data() + static_cast<size_t>(offset) * 16);
+  }
+}
+
+void TransformSystem::update_world_matrices(float* output) {
+  uint32_t first = std::min(first_dirty, first_pending);
+  first_pending = node_count;
+  changed_nodes.clear();
+
+  for (uint32_t i = first; i < node_count; ++i) {
+    NodeHandle parent = parents[i];
+    bool changed = local_dirty[i] || (parent != no_parent && local_dirty[parent]);
+
+    if (changed) {
+      // Reuse the dirty flag to propagate the change to children further down
+      local_dirty[i] = 1;
+      const float* local = local_matrices.data() + static_cast<size_t>(i) * 16;
+      float* world = world_matrices.data() + static_cast<size_t>(i) * 16;
+      if (parent == no_parent) {
+        std::memcpy(world, local, 16 * sizeof(float));
+      } else {
+        multiply(world_matrices.data() + static_cast<size_t>(parent) * 16, local, world);
+      }
+      pending_outputs[i] = static_cast<uint8_t>(output_count);
+      changed_nodes.push_back(i);
+    }
+
+    if (output != nullptr && pending_outputs[i]) {
+      stream_store(world_matrices.data() + static_cast<size_t>(i) * 16, output + static_cast<size_t>(i) * 16);
+      if (--pending_outputs[i] > 0) {
+        first_pending = std::min(first_pending, i);
+      }
+    }
+  }
+
+#if defined(TRANSFORM_SYSTEM_AVX) || defined(TRANSFORM_SYSTEM_SSE)
+  _mm_sfence();
+#endif
+
+  std::fill(local_dirty.begin() + first, local_dirty.end(), 0);
+  first_dirty = node_count;
+}
\ No newline at end of file
@@ -0,0 +1,58 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// Local transforms are stored as structure of arrays and turned into world matrices in batches.
+// Nodes are kept in creation order, and since a parent has to exist before its children, every
+// parent precedes its children and the hierarchy can be propagated in a single forward sweep.
+class TransformSystem {
+public:
+  using NodeHandle = uint32_t;
+  static constexpr NodeHandle no_parent = std::numeric_limits<NodeHandle>::max();
+  static constexpr uint32_t batch_size = 8;
+
+  explicit TransformSystem(uint32_t output_count = 1);
+
+  auto create(NodeHandle parent = no_parent) -> NodeHandle;
+  void set_position(NodeHandle, const glm::vec3&);
+  void set_rotation(NodeHandle, const glm::quat&);
+  void set_scale(NodeHandle, const glm::vec3&);
+  // Outputs joining the rotation hold stale matrices, so every node is written to each output again
+  void set_output_count(uint32_t);
+
+  // Writes the world matrix of every node that changed into output, one column-major mat4 per node.
+  // Every change is written output_count times, once for each output buffer used round-robin.
+  void update(float* output);
+  void update_local_matrices(uint32_t first_batch, uint32_t last_batch);
+  void update_world_matrices(float* output);
+
+  auto size() const -> uint32_t { return node_count; }
+  auto batch_count() const -> uint32_t { return (node_count + batch_size - 1) / batch_size; }
+  auto first_dirty_batch() const -> uint32_t { return first_dirty / batch_size; }
+  auto get_world_matrix(NodeHandle) const -> const float*;
+  // Nodes whose world matrix changed in the last update, in ascending order
+  auto get_changed_nodes() const -> std::span<const NodeHandle> { return changed_nodes; }
+
+private:
+  void reserve_batch();
+  void mark_dirty(NodeHandle);
+
+  uint32_t output_count;
+  uint32_t node_count;
+  NodeHandle first_dirty, first_pending;
+
+  std::vector<float> position_x, position_y, position_z;
+  std::vector<float> rotation_x, rotation_y, rotation_z, rotation_w;
+  std::vector<float> scale_x, scale_y, scale_z;
+  std::vector<NodeHandle> parents;
+
+  std::vector<uint8_t> local_dirty;
+  std::vector<uint8_t> pending_outputs;
+  std::vector<float> local_matrices;
+  std::vector<float> world_matrices;
+  std::vector<NodeHandle> changed_nodes;
+};
\ No newline at end of file
@@ -0,0 +1,141 @@
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <string>
+#include <fmt/core.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include "render_engine.h"
+#include "job_system.h"
+
+// Renders generated scenes of growing size headless and reports how startup, frame time and device
+// memory grow with the object count. Runs from the directory holding the compiled shaders.
+
+constexpr std::array object_counts { 1'024u, 4'096u, 16'384u, 65'536u, 262'144u };
+constexpr uint32_t mesh_count = 64;
+constexpr uint32_t material_count = 16;
+constexpr uint32_t warmup_frame_count = 32;
+constexpr uint32_t timed_frame_count = 256;
+
+struct Measurement {
+  double startup_ms;
+  double frame_ms;
+  std::array<vk::DeviceSize, memory_category_count> memory;
+};
+
+double milliseconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+auto make_config(uint32_t object_count, float dynamic_fraction) -> RenderConfig {
+  return {
+    .resolution = { .width = 1280, .height = 720 },
+    .vulkan = { .required_extensions = {}, .requested_layers = {} },
+    .validation = { .enabled = false, .min_severity = LogSeverity::eWarning, .max_messages_per_second = 8 },
+    .max_frames_in_flight = 2,
+    .adaptive_frames_in_flight = false,
+    .max_instances = object_count + 1,
+    .max_vertices = 1 << 16,
+    .max_indices = 1 << 18,
+    .max_textures = material_count,
+    .texture_budget = 64 * 1024 * 1024,
+    .texture_paths = {},
+    .particle_count = 0,
+    .light_count = 1024,
+    .vertex_pulling = true,
+    .frame_pacing = false,
+    .async_pipelines = false,
+    .occlusion_culling = true,
+    .scene = {
+      .object_count = object_count,
+      .mesh_count = mesh_count,
+      .material_count = material_count,
+      .dynamic_fraction = dynamic_fraction,
+      .seed = 1
+    },
+    .capture = { .enabled = false, .directory = {}, .format = CaptureFormat::ePpm }
+  };
+}
+
+auto measure(JobSystem& job_system, uint32_t object_count, float dynamic_fraction) -> Measurement {
+  auto start = std::chrono::steady_clock::now();
+  RenderEngine render_engine { make_config(object_count, dynamic_fraction), job_system };
+  double startup_ms = milliseconds_since(start);
+
+  // Time moves at 60 frames per second so dynamic objects spin, the root stays put
+  FrameState frame_state { .tick = 0, .time = 0.0, .rotation = glm::angleAxis(0.5f, glm::vec3(0.0f, 0.0f, 1.0f)) };
+  auto render = [&] {
+    ++frame_state.tick;
+    frame_state.time = static_cast<double>(frame_state.tick) / 60.0;
+    render_engine.render(frame_state);
+  };
+
+  for (uint32_t i = 0; i < warmup_frame_count; ++i) {
+    render();
+  }
+  render_engine.wait_to_finish();
+
+  start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < timed_frame_count; ++i) {
+    render();
+  }
+  render_engine.wait_to_finish();
+  return {
+    .startup_ms = startup_ms,
+    .frame_ms = milliseconds_since(start) / timed_frame_count,
+    .memory = render_engine.get_memory_usage()
+  };
+}
+
+double to_mib(vk::DeviceSize bytes) {
+  return static_cast<double>(bytes) / (1024.0 * 1024.0);
+}
+
+void run_series(JobSystem& job_system, float dynamic_fraction) {
+  fmt::println("{:.0f}% dynamic, {} meshes, {} materials", 100.0f * dynamic_fraction, mesh_count, material_count);
+  fmt::println(
+    "  {:>8} {:>10} {:>9} {:>8} {:>10} {:>9} {:>9} {:>9} {:>9}",
+    "objects", "startup ms", "frame ms", "scaling", "memory MiB", "instance", "vertex", "index", "storage"
+  );
+
+  double previous_frame_ms = 0.0;
+  uint32_t previous_count = 0;
+  for (auto object_count : object_counts) {
+    auto result = measure(job_system, object_count, dynamic_fraction);
+    vk::DeviceSize total = 0;
+    for (auto size : result.memory) {
+      total += size;
+    }
+    auto mib = [&result] (MemoryCategory category) {
+      return to_mib(result.memory[static_cast<size_t>(category)]);
+    };
+
+    // Frame time growth relative to object count growth since the previous row, 1.0 is linear
+    std::string scaling = "-";
+    if (previous_count > 0) {
+      double exponent = std::log(result.frame_ms / previous_frame_ms)
+        / std::log(static_cast<double>(object_count) / previous_count);
+      scaling = fmt::format("n^{:.2f}", exponent);
+    }
+    fmt::println(
+      "  {:>8} {:>10.1f} {:>9.3f} {:>8} {:>10.1f} {:>9.1f} {:>9.1f} {:>9.1f} {:>9.1f}",
+      object_count, result.startup_ms, result.frame_ms, scaling, to_mib(total), mib(MemoryCategory::eInstance),
+      mib(MemoryCategory::eVertex), mib(MemoryCategory::eIndex), mib(MemoryCategory::eStorage)
+    );
+    previous_frame_ms = result.frame_ms;
+    previous_count = object_count;
+  }
+}
+
+int main() {
+  try {
+    JobSystem job_system;
+    run_series(job_system, 0.0f);
+    run_series(job_system, 1.0f);
+  } catch (const std::exception& e) {
+    fmt::println("std::exception-> {}", e.what());
+    return -1;
+  }
+  return 0;
+}
\ No newline at end of file
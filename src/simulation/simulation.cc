@@ -0,0 +1,76 @@
+#include "simulation.h"
+#include <algorithm>
+
+const FrameState initial_state {
+  .tick = 0,
+  .time = 0.0,
+  .rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f)
+};
+
+Simulation::Simulation(uint32_t tick_rate)
+  : tick_duration { std::chrono::nanoseconds { std::chrono::seconds { 1 } } / tick_rate } {
+  snapshots.get_write_buffer() = { initial_state, initial_state, Clock::now() };
+  snapshots.publish();
+}
+
+Simulation::~Simulation() {
+  stop();
+}
+
+void Simulation::start() {
+  thread = std::jthread([this] (std::stop_token stop_token) { run(stop_token); });
+}
+
+void Simulation::stop() {
+  if (thread.joinable()) {
+    thread.request_stop();
+    thread.join();
+  }
+}
+
+void Simulation::step(FrameState& state) const {
+  float delta_time = std::chrono::duration<float>(tick_duration).count();
+  auto delta_rotation = glm::angleAxis(delta_time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+
+  state.tick += 1;
+  state.time += delta_time;
+  state.rotation = glm::normalize(delta_rotation * state.rotation);
+}
+
+void Simulation::run(std::stop_token stop_token) {
+  constexpr int max_catch_up_ticks = 8;
+
+  FrameState state = initial_state;
+  auto next_tick = Clock::now();
+
+  while (!stop_token.stop_requested()) {
+    FrameState previous = state;
+    step(state);
+
+    snapshots.get_write_buffer() = { previous, state, Clock::now() };
+    snapshots.publish();
+
+    // After a long stall, drop the missed ticks instead of running them back to back
+    next_tick += tick_duration;
+    auto now = Clock::now();
+    if (now - next_tick > tick_duration * max_catch_up_ticks) {
+      next_tick = now;
+    }
+    std::this_thread::sleep_until(next_tick);
+  }
+}
+
+auto Simulation::get_frame_state() -> FrameState {
+  snapshots.acquire();
+  const auto& snapshot = snapshots.get_read_buffer();
+
+  using Seconds = std::chrono::duration<float>;
+  float alpha = Seconds(Clock::now() - snapshot.published_at) / Seconds(tick_duration);
+  alpha = std::clamp(alpha, 0.0f, 1.0f);
+
+  return {
+    .tick = snapshot.current.tick,
+    .time = glm::mix(snapshot.previous.time, snapshot.current.time, static_cast<double>(alpha)),
+    .rotation = glm::slerp(snapshot.previous.rotation, snapshot.current.rotation, alpha)
+  };
+}
\ No newline at end of file
@@ -0,0 +1,35 @@
+#pragma once
+#include <chrono>
+#include <thread>
+#include "frame_state.h"
+#include "triple_buffer.h"
+
+class Simulation {
+public:
+  explicit Simulation(uint32_t tick_rate);
+  ~Simulation();
+
+  Simulation(const Simulation&) = delete;
+  Simulation& operator=(const Simulation&) = delete;
+
+  void start();
+  void stop();
+
+  // Interpolates between the two latest ticks, so rendering trails the simulation by one tick
+  auto get_frame_state() -> FrameState;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Snapshot {
+    FrameState previous, current;
+    Clock::time_point published_at;
+  };
+
+  void run(std::stop_token);
+  void step(FrameState&) const;
+
+  const std::chrono::nanoseconds tick_duration;
+  TripleBuffer<Snapshot> snapshots;
+  std::jthread thread;
+};
\ No newline at end of file
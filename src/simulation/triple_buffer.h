@@ -0,0 +1,44 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Single producer, single consumer. The producer always has a buffer to write into and the
+// consumer always has the latest complete one to read, so neither side ever waits for the other.
+template<typename T>
+class TripleBuffer {
+public:
+  auto get_write_buffer() -> T& {
+    return buffers[back].value;
+  }
+
+  void publish() {
+    back = state.exchange(static_cast<uint8_t>(back | dirty_bit), std::memory_order_acq_rel) & index_mask;
+  }
+
+  // Returns true when a newer buffer than the previous read one was published
+  bool acquire() {
+    if (!(state.load(std::memory_order_relaxed) & dirty_bit)) {
+      return false;
+    }
+    front = state.exchange(front, std::memory_order_acq_rel) & index_mask;
+    return true;
+  }
+
+  auto get_read_buffer() const -> const T& {
+    return buffers[front].value;
+  }
+
+private:
+  static constexpr uint8_t index_mask = 0b011;
+  static constexpr uint8_t dirty_bit = 0b100;
+
+  struct alignas(64) Slot {
+    T value {};
+  };
+
+  std::array<Slot, 3> buffers;
+  alignas(64) std::atomic<uint8_t> state { 1 };
+  alignas(64) uint8_t back = 0;
+  alignas(64) uint8_t front = 2;
+};
\ No newline at end of file
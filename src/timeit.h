@@ -1,8 +1,10 @@
 #pragma once
 #include <chrono>
 #include <fmt/chrono.h>
+#include "profiler.h"
 
 inline void timeit(const std::string& info, auto&& f) {
+	ProfileZone zone { Profiler::intern(info) };
 	auto t1 = std::chrono::steady_clock::now();
 	std::forward<decltype(f)>(f)();
 	auto t2 = std::chrono::steady_clock::now();
@@ -0,0 +1,431 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <new>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fmt/core.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include "render_engine.h"
+#include "radix_sort.h"
+#include "job_system.h"
+
+namespace fs = std::filesystem;
+
+constexpr uint32_t golden_frame_count = 64;
+// Matches SKIP_RETURN_CODE in CMakeLists.txt
+constexpr int skipped_return_code = 77;
+constexpr uint32_t warmup_frame_count = 32;
+constexpr uint32_t timed_frame_count = 256;
+constexpr uint32_t performance_runs = 3;
+
+// Lavapipe rasterizes deterministically, the tolerance only absorbs rounding differences between its versions
+constexpr int channel_tolerance = 2;
+constexpr double max_differing_fraction = 0.001;
+
+constexpr uint32_t particle_steps = 240;
+constexpr double max_particle_mismatch = 0.001;
+
+constexpr uint32_t radix_sort_count = 1 << 20;
+constexpr uint32_t radix_sort_iterations = 16;
+
+constexpr uint32_t balance_frame_count = 256;
+
+constexpr uint32_t allocation_warmup_frames = 64;
+constexpr uint32_t allocation_frame_count = 256;
+
+// Only allocations on the thread that renders count, worker and driver threads allocate on their own schedule
+std::atomic<uint64_t> render_thread_allocations { 0 };
+thread_local bool count_allocations = false;
+
+auto counted_allocate(size_t size, size_t alignment) -> void* {
+  if (count_allocations) {
+    render_thread_allocations.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  size = std::max<size_t>(size, 1);
+  void* pointer = (alignment > alignof(std::max_align_t))
+    ? std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)
+    : std::malloc(size);
+  if (pointer == nullptr) {
+    throw std::bad_alloc {};
+  }
+  return pointer;
+}
+
+void* operator new(size_t size) { return counted_allocate(size, alignof(std::max_align_t)); }
+void* operator new[](size_t size) { return counted_allocate(size, alignof(std::max_align_t)); }
+void* operator new(size_t size, std::align_val_t alignment) { return counted_allocate(size, static_cast<size_t>(alignment)); }
+void* operator new[](size_t size, std::align_val_t alignment) { return counted_allocate(size, static_cast<size_t>(alignment)); }
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+void operator delete[](void* pointer) noexcept { std::free(pointer); }
+void operator delete(void* pointer, size_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept { std::free(pointer); }
+
+struct Image {
+  uint32_t width, height;
+  std::vector<uint8_t> pixels;
+};
+
+auto make_config(const RenderConfig::CaptureInfo& capture) -> RenderConfig {
+  return {
+    .resolution = { .width = 256, .height = 256 },
+    .vulkan = { .required_extensions = {}, .requested_layers = {} },
+    .validation = { .enabled = false, .min_severity = LogSeverity::eWarning, .max_messages_per_second = 8 },
+    .max_frames_in_flight = 2,
+    .adaptive_frames_in_flight = false,
+    .max_instances = 1024,
+    .max_vertices = 1 << 16,
+    .max_indices = 1 << 18,
+    .max_textures = 16,
+    .texture_budget = 64 * 1024 * 1024,
+    .texture_paths = {},
+    .particle_count = 65536,
+    .light_count = 1024,
+    .vertex_pulling = true,
+    .frame_pacing = false,
+    .async_pipelines = false,
+    .occlusion_culling = true,
+    .scene = {},
+    .capture = capture
+  };
+}
+
+// Time stands still, every frame shows the scene in the same pose
+auto frozen_frame_state() -> FrameState {
+  return { .tick = 0, .time = 0.0, .rotation = glm::angleAxis(0.5f, glm::vec3(0.0f, 0.0f, 1.0f)) };
+}
+
+double milliseconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+auto read_ppm(const fs::path& path) -> std::optional<Image> {
+  std::ifstream file { path, std::ios::binary };
+  std::string magic;
+  uint32_t max_value;
+  Image image {};
+  if (!(file >> magic >> image.width >> image.height >> max_value) || magic != "P6" || max_value != 255) {
+    return std::nullopt;
+  }
+  file.get();
+
+  image.pixels.resize(static_cast<size_t>(image.width) * image.height * 3);
+  if (!file.read(reinterpret_cast<char*>(image.pixels.data()), static_cast<std::streamsize>(image.pixels.size()))) {
+    return std::nullopt;
+  }
+  return image;
+}
+
+void write_ppm(const fs::path& path, const Image& image) {
+  std::ofstream file { path, std::ios::binary };
+  file << fmt::format("P6\n{} {}\n255\n", image.width, image.height);
+  file.write(reinterpret_cast<const char*>(image.pixels.data()), static_cast<std::streamsize>(image.pixels.size()));
+}
+
+int run_golden(const fs::path& golden_directory, const fs::path& output_directory, bool record) {
+  auto golden_path = golden_directory / "default.ppm";
+  if (!record && !fs::exists(golden_path)) {
+    fmt::println("Skipped, golden image {} is missing, record it on lavapipe with the record_golden target", golden_path.string());
+    return skipped_return_code;
+  }
+
+  fs::remove_all(output_directory);
+  {
+    JobSystem job_system;
+    RenderConfig::CaptureInfo capture { .enabled = true, .directory = output_directory.string(), .format = CaptureFormat::ePpm };
+    RenderEngine render_engine { make_config(capture), job_system };
+
+    // Idling between frames lets every texture upload finish before the next frame, which makes
+    // the streamed mip levels the same on every run
+    auto frame_state = frozen_frame_state();
+    for (uint32_t i = 0; i < golden_frame_count; ++i) {
+      render_engine.render(frame_state);
+      render_engine.wait_to_finish();
+    }
+  }
+
+  auto rendered_path = output_directory / fmt::format("frame_{:06}.ppm", golden_frame_count);
+  auto rendered = read_ppm(rendered_path);
+  if (!rendered) {
+    fmt::println("Failed to read rendered frame {}", rendered_path.string());
+    return 1;
+  }
+
+  if (record) {
+    fs::create_directories(golden_directory);
+    fs::copy_file(rendered_path, golden_path, fs::copy_options::overwrite_existing);
+    fmt::println("Recorded golden image {}", golden_path.string());
+    return 0;
+  }
+
+  auto golden = read_ppm(golden_path);
+  if (!golden || golden->width != rendered->width || golden->height != rendered->height) {
+    fmt::println("Golden image {} does not match the rendered size", golden_path.string());
+    return 1;
+  }
+
+  Image difference { rendered->width, rendered->height, std::vector<uint8_t>(rendered->pixels.size()) };
+  size_t differing_pixels = 0;
+  for (size_t i = 0; i < rendered->pixels.size(); i += 3) {
+    bool differs = false;
+    for (size_t channel = i; channel < i + 3; ++channel) {
+      int delta = std::abs(int { rendered->pixels[channel] } - int { golden->pixels[channel] });
+      difference.pixels[channel] = static_cast<uint8_t>(std::min(255, delta * 16));
+      differs = differs || delta > channel_tolerance;
+    }
+    differing_pixels += (differs ? 1 : 0);
+  }
+
+  auto pixel_count = static_cast<double>(rendered->pixels.size() / 3);
+  fmt::println("{} of {} pixels differ from the golden image", differing_pixels, pixel_count);
+  if (static_cast<double>(differing_pixels) > max_differing_fraction * pixel_count) {
+    auto difference_path = output_directory / "default_difference.ppm";
+    write_ppm(difference_path, difference);
+    fmt::println("Golden image mismatch, differences written to {}", difference_path.string());
+    return 1;
+  }
+  return 0;
+}
+
+auto read_baselines(const fs::path& path) -> std::map<std::string, double> {
+  std::map<std::string, double> baselines;
+  std::ifstream file { path };
+  std::string name;
+  double value;
+  while (file >> name >> value) {
+    baselines[name] = value;
+  }
+  return baselines;
+}
+
+void write_baselines(const fs::path& path, const std::map<std::string, double>& baselines) {
+  std::ofstream file { path };
+  for (const auto& [name, value] : baselines) {
+    file << fmt::format("{} {}\n", name, value);
+  }
+}
+
+int run_performance(const fs::path& baseline_path, double tolerance) {
+  JobSystem job_system;
+  auto config = make_config({ .enabled = false, .directory = {}, .format = CaptureFormat::ePpm });
+  auto frame_state = frozen_frame_state();
+
+  // The best of several runs is the least disturbed by whatever else the machine is doing
+  std::map<std::string, double> metrics {
+    { "startup_ms", std::numeric_limits<double>::max() },
+    { "frame_ms", std::numeric_limits<double>::max() }
+  };
+  for (uint32_t run = 0; run < performance_runs; ++run) {
+    auto start = std::chrono::steady_clock::now();
+    RenderEngine render_engine { config, job_system };
+    metrics["startup_ms"] = std::min(metrics["startup_ms"], milliseconds_since(start));
+
+    for (uint32_t i = 0; i < warmup_frame_count; ++i) {
+      render_engine.render(frame_state);
+    }
+    render_engine.wait_to_finish();
+
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < timed_frame_count; ++i) {
+      render_engine.render(frame_state);
+    }
+    render_engine.wait_to_finish();
+    metrics["frame_ms"] = std::min(metrics["frame_ms"], milliseconds_since(start) / timed_frame_count);
+  }
+
+  auto baselines = read_baselines(baseline_path);
+  bool failed = false, recorded = false;
+  for (const auto& [name, value] : metrics) {
+    auto baseline = baselines.find(name);
+    if (baseline == baselines.end()) {
+      baselines[name] = value;
+      recorded = true;
+      fmt::println("{:<12} {:.3f} ms, recorded as baseline", name, value);
+      continue;
+    }
+
+    double change = 100.0 * (value / baseline->second - 1.0);
+    bool regressed = change > tolerance;
+    failed = failed || regressed;
+    fmt::println(
+      "{:<12} {:.3f} ms, baseline {:.3f} ms ({:+.1f}%){}",
+      name, value, baseline->second, change, (regressed ? " REGRESSED" : "")
+    );
+  }
+
+  if (recorded) {
+    write_baselines(baseline_path, baselines);
+  }
+  if (failed) {
+    fmt::println("More than {}% slower than the baseline, delete {} to record a new one", tolerance, baseline_path.string());
+  }
+  return (failed ? 1 : 0);
+}
+
+int run_particles() {
+  JobSystem job_system;
+  RenderEngine render_engine {
+    make_config({ .enabled = false, .directory = {}, .format = CaptureFormat::ePpm }), job_system
+  };
+
+  double mismatch = render_engine.validate_particles(particle_steps, 1.0f / 60.0f);
+  fmt::println("{:.4f}% of particles differ from the CPU reference after {} steps", 100.0 * mismatch, particle_steps);
+  return (mismatch > max_particle_mismatch ? 1 : 0);
+}
+
+int run_radix_sort() {
+  JobSystem job_system;
+  RenderEngine render_engine {
+    make_config({ .enabled = false, .directory = {}, .format = CaptureFormat::ePpm }), job_system
+  };
+  auto result = render_engine.benchmark_radix_sort(radix_sort_count, radix_sort_iterations);
+
+  // The CPU sorts the same amount of random pairs, once with the reference and once with the standard library
+  std::mt19937 rng { 1 };
+  std::vector<uint32_t> keys(radix_sort_count), values(radix_sort_count);
+  std::vector<std::pair<uint32_t, uint32_t>> pairs(radix_sort_count);
+  for (uint32_t i = 0; i < radix_sort_count; ++i) {
+    keys[i] = static_cast<uint32_t>(rng());
+    values[i] = i;
+    pairs[i] = { keys[i], i };
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  RadixSort::sort_reference(keys, values);
+  double reference_ms = milliseconds_since(start);
+
+  start = std::chrono::steady_clock::now();
+  std::stable_sort(pairs.begin(), pairs.end(), [] (const auto& a, const auto& b) { return a.first < b.first; });
+  double standard_ms = milliseconds_since(start);
+
+  fmt::println("Sorting {} key-value pairs", radix_sort_count);
+  fmt::println("  GPU radix sort    {:8.3f} ms", result.milliseconds);
+  fmt::println("  CPU radix sort    {:8.3f} ms", reference_ms);
+  fmt::println("  std::stable_sort  {:8.3f} ms", standard_ms);
+  fmt::println("{:.4f}% of pairs differ from the CPU reference", 100.0 * result.mismatch);
+  return (result.mismatch > 0.0 ? 1 : 0);
+}
+
+// Feeds the balancer windows of synthetic frames and checks where each one leaves the frames in flight,
+// then renders with adaptive frames in flight to check the engine's classification
+int run_frames_in_flight() {
+  struct Phase {
+    const char* name;
+    FrameBalancer::Sample even, odd;
+    uint32_t windows;
+    uint32_t expected;
+  };
+  const Phase phases[] = {
+    { "GPU bound, light CPU", { 1.0, 10.0, 9.0 }, { 1.0, 10.0, 9.0 }, 4, 1 },
+    { "CPU bound", { 10.0, 5.0, 0.0 }, { 10.0, 5.0, 0.0 }, 4, 2 },
+    { "mixed", { 5.0, 8.0, 3.0 }, { 8.0, 5.0, 0.0 }, 4, 4 },
+    { "GPU bound, heavy CPU", { 4.0, 10.0, 6.0 }, { 4.0, 10.0, 6.0 }, 4, 2 }
+  };
+
+  bool failed = false;
+  FrameBalancer balancer { 4, true };
+  for (const auto& phase : phases) {
+    for (uint32_t frame = 0; frame < phase.windows * 32; ++frame) {
+      balancer.record(frame % 2 == 0 ? phase.even : phase.odd);
+    }
+    auto frames_in_flight = balancer.get_frames_in_flight();
+    failed = failed || frames_in_flight != phase.expected;
+    fmt::println("{:<22} {} frames in flight, expected {}", phase.name, frames_in_flight, phase.expected);
+  }
+
+  JobSystem job_system;
+  auto config = make_config({ .enabled = false, .directory = {}, .format = CaptureFormat::ePpm });
+  config.max_frames_in_flight = 4;
+  config.adaptive_frames_in_flight = true;
+  RenderEngine render_engine { config, job_system };
+  auto frame_state = frozen_frame_state();
+  for (uint32_t i = 0; i < balance_frame_count; ++i) {
+    render_engine.render(frame_state);
+  }
+  render_engine.wait_to_finish();
+
+  auto stats = render_engine.get_frame_stats();
+  fmt::println(
+    "rendered {} frames, {} classified: {} frames in flight, {:.0f}% GPU bound, CPU {:.3f} ms, GPU {:.3f} ms",
+    balance_frame_count, stats.classified_frames, stats.frames_in_flight, 100.0f * stats.gpu_bound_share,
+    stats.cpu_milliseconds, stats.gpu_milliseconds
+  );
+  failed = failed || stats.frames_in_flight < 1 || stats.frames_in_flight > config.max_frames_in_flight;
+  return (failed ? 1 : 0);
+}
+
+int run_allocations() {
+  JobSystem job_system;
+  RenderEngine render_engine {
+    make_config({ .enabled = false, .directory = {}, .format = CaptureFormat::ePpm }), job_system
+  };
+
+  // Warm-up settles texture streaming and lets every reused container reach its steady size
+  auto frame_state = frozen_frame_state();
+  for (uint32_t i = 0; i < allocation_warmup_frames; ++i) {
+    render_engine.render(frame_state);
+    render_engine.wait_to_finish();
+  }
+
+  count_allocations = true;
+  for (uint32_t i = 0; i < allocation_frame_count; ++i) {
+    render_engine.render(frame_state);
+  }
+  count_allocations = false;
+  render_engine.wait_to_finish();
+
+  auto allocations = render_thread_allocations.load();
+  fmt::println("{} heap allocations in {} steady state frames", allocations, allocation_frame_count);
+  return (allocations > 0 ? 1 : 0);
+}
+
+int main(int argc, char** argv) {
+  std::string_view mode { argc > 1 ? argv[1] : "" };
+  try {
+    if ((mode == "golden" || mode == "record_golden") && argc == 4) {
+      return run_golden(argv[2], argv[3], mode == "record_golden");
+    }
+    if (mode == "performance" && argc == 4) {
+      return run_performance(argv[2], std::stod(argv[3]));
+    }
+    if (mode == "particles" && argc == 2) {
+      return run_particles();
+    }
+    if (mode == "allocations" && argc == 2) {
+      return run_allocations();
+    }
+    if (mode == "radix_sort" && argc == 2) {
+      return run_radix_sort();
+    }
+    if (mode == "frames_in_flight" && argc == 2) {
+      return run_frames_in_flight();
+    }
+  } catch (const std::exception& e) {
+    fmt::println("std::exception-> {}", e.what());
+    return 1;
+  }
+
+  fmt::println("usage: regression golden <golden directory> <output directory>");
+  fmt::println("       regression record_golden <golden directory> <output directory>");
+  fmt::println("       regression performance <baseline file> <tolerance percent>");
+  fmt::println("       regression particles");
+  fmt::println("       regression allocations");
+  fmt::println("       regression radix_sort");
+  fmt::println("       regression frames_in_flight");
+  return 1;
+}
\ No newline at end of file